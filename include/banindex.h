@@ -0,0 +1,91 @@
+#ifndef INCLUDED_banindex_h
+#define INCLUDED_banindex_h
+/*
+ * IRC - Internet Relay Chat, include/banindex.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+/** @file
+ * @brief Lookup index for server bans, Kill blocks and channel bans.
+ * @version $Id$
+ */
+#ifndef INCLUDED_sys_types_h
+#include <sys/types.h>
+#define INCLUDED_sys_types_h
+#endif
+
+#include <netinet/in.h>
+
+struct BanIndexNode;
+
+/** Where a BanIndexEntry is filed. */
+enum BanIndexWhere {
+  BI_NONE,     /**< Not in the index. */
+  BI_IP,       /**< In the CIDR radix tree. */
+  BI_HOST,     /**< In the host suffix trie. */
+  BI_RESIDUAL  /**< On the residual list, checked for every lookup. */
+};
+
+/** Index linkage embedded in each indexed ban. */
+struct BanIndexEntry {
+  struct BanIndexEntry  *bie_next;   /**< Next entry in the same node. */
+  struct BanIndexEntry **bie_prev_p; /**< What points to this entry. */
+  struct BanIndexEntry  *bie_before; /**< Previous entry in list order. */
+  struct BanIndexEntry  *bie_after;  /**< Next entry in list order. */
+  struct BanIndexNode   *bie_node;   /**< Radix or trie node holding us. */
+  unsigned long          bie_order;  /**< Rank in list order. */
+  enum BanIndexWhere     bie_where;  /**< Which structure we are in. */
+  void                  *bie_ban;    /**< The G-line, Z-line or shun. */
+};
+
+/** Index over one ban list.
+ * IP masks live in a path-compressed radix tree keyed on the network
+ * and prefix length; host masks whose tail is literal are filed in a
+ * trie of their trailing labels, read right to left; anything else
+ * goes on a residual list.  Entries also carry their rank in the
+ * owning list, so a lookup can return the same ban a walk of that list
+ * would have found first.
+ */
+struct BanIndex {
+  struct BanIndexNode   *bi_root;    /**< Root (0.0.0.0/0) of the radix tree. */
+  struct BanIndexNode  **bi_hosts;   /**< Trie nodes, hashed by suffix. */
+  unsigned int           bi_hmask;   /**< Size of bi_hosts minus one. */
+  unsigned int           bi_hcount;  /**< Number of trie nodes. */
+  struct BanIndexEntry  *bi_residual; /**< Entries checked linearly. */
+  struct BanIndexEntry  *bi_first;   /**< First entry in list order. */
+  struct BanIndexEntry  *bi_last;    /**< Last entry in list order. */
+  unsigned int           bi_count;   /**< Number of indexed entries. */
+  unsigned long          bi_step;    /**< Gap between neighbouring ranks. */
+};
+
+/** Callback deciding whether a candidate ban applies.
+ * It may free the ban it was given (for instance because it has
+ * expired), but must not otherwise change the index.
+ */
+typedef int (*BanIndexCheck)(void *ban, void *arg);
+
+extern void banindex_add(struct BanIndex *idx, struct BanIndexEntry *entry,
+                         void *ban, struct BanIndexEntry *after,
+                         struct in_addr *ipnum, int bits, const char *host);
+extern void banindex_del(struct BanIndex *idx, struct BanIndexEntry *entry);
+extern void banindex_clear(struct BanIndex *idx);
+extern void *banindex_find(struct BanIndex *idx, struct in_addr ip,
+                           const char *host, BanIndexCheck check, void *arg);
+extern void *banindex_find_names(struct BanIndex *idx, struct in_addr ip,
+                                 const char *const *names, int count,
+                                 BanIndexCheck check, void *arg);
+extern size_t banindex_memory_count(struct BanIndex *idx);
+
+#endif /* INCLUDED_banindex_h */
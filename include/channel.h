@@ -33,6 +33,7 @@
 
 struct SLink;
 struct Client;
+struct BanCache;
 
 /*
  * General defines
@@ -228,6 +229,8 @@ struct Membership {
   struct Membership* prev_member;	/**< The previous user on this channel*/
   struct Membership* next_channel;	/**< Next channel this user is on */
   struct Membership* prev_channel;	/**< Previous channel this user is on*/
+  struct Membership* next_local;	/**< Next local user on this channel */
+  struct Membership* prev_local;	/**< Previous local user on this channel */
   unsigned int       status;		/**< Flags for op'd, voice'd, etc */
 };
 
@@ -283,9 +286,14 @@ struct Channel {
   time_t             last_sent;     /**< Last time a message was sent */
   unsigned int       users;         /**< Number of clients on this channel */
   struct Membership* members;       /**< Pointer to the clients on this channel*/
+  struct Membership* locals;        /**< Local clients on this channel */
+  struct SLink*      downlinks;     /**< Server links with clients on this
+                                     * channel; flags holds the count */
   struct SLink*      invites;       /**< List of invites on this channel */
   struct SLink*      banlist;       /**< List of bans on this channel */
   struct SLink*      exceptlist;    /**< List of excepts on this channel */
+  struct BanCache*   bancache;      /**< Compiled banlist, built on demand */
+  struct BanCache*   exceptcache;   /**< Compiled exceptlist, built on demand */
   struct Mode        mode;	    /**< This channels mode */
   unsigned int       marker;        /**< Channel marker */
   char               topic[TOPICLEN + 1]; /**< Channels topic */
@@ -465,6 +473,7 @@ extern int is_ext_excepted(struct Client *cptr, struct Channel *chptr, struct Me
 extern int is_excepted(struct Client *cptr, struct Channel *chptr, struct Membership* member, int shared);
 extern int ext_text_ban(struct Client* sptr, struct Channel* chptr, const char* text);
 extern int common_chan_count(struct Client *a, struct Client *b, int max);
+extern size_t ban_cache_memory(struct BanCache *bc);
 
 extern unsigned int get_channel_marker(void);
 
@@ -146,6 +146,7 @@ enum Flag {
     FLAG_GOTID,                     /**< successful ident lookup achieved */
     FLAG_DOID,                      /**< I-lines say must use ident return */
     FLAG_NONL,                      /**< No \n in buffer */
+    FLAG_PARSING,                   /**< Parsing a line in its recvQ */
     FLAG_TS8,                       /**< Why do you want to know? */
     FLAG_MAP,                       /**< Show server on the map */
     FLAG_JUNCTION,                  /**< Junction causing the net.burst. */
@@ -222,7 +223,7 @@ struct Connection {
   int                 con_fd;         /**< >= 0, for local clients */
   int                 con_freeflag;   /**< indicates if connection can be freed */
   int                 con_error;      /**< last socket level error for client */
-  int                 con_sentalong;  /**< sentalong marker for connection */
+  struct Connection*  con_sentalong;  /**< next connection marked by current send */
   unsigned int        con_snomask;    /**< mask for server messages */
   time_t              con_nextnick;   /**< Next time a nick change is allowed */
   time_t              con_nexttarget; /**< Next time a target change is allowed */
@@ -242,8 +243,6 @@ struct Connection {
 				      for parsing */
   struct DNSReply*    con_dns_reply;  /**< DNS reply used during client
 					registration */
-  struct DNSReply*    con_dnsbl_reply; /**< DNSBL reply used during client
-					registration */
   struct ListingArgs* con_listing;
   unsigned int        con_max_sendq;  /**< cached max send queue for client */
   unsigned int        con_ping_freq;  /**< cached ping freq from client conf
@@ -262,6 +261,9 @@ struct Connection {
   struct Timer        con_proc;       /**< process latent messages from client */
   struct AuthRequest* con_auth;       /**< auth request for client */
   struct LOCInfo*     con_loc;        /**< Login-on-connect information */
+  unsigned int        con_eflags;     /**< Cached E:Line exemptions (EFLAG_*) */
+  unsigned int        con_elinegen;   /**< eline_generation con_eflags is
+                                         valid for, 0 if not computed */
 };
 
 /** Magic constant to identify valid Connection structures. */
@@ -293,7 +295,6 @@ struct Client {
   struct Privs   cli_privs;     /**< client privs */
   unsigned int   cli_oflags;    /**< oper flags */
   unsigned int   cli_hopcount;  /**< number of servers to this 0 = local */
-  unsigned int   cli_dnsblcount; /**< number of dnsbls left to check */
   struct in_addr cli_ip;        /**< Real ip# NOT defined for remote servers! */
   short          cli_status;    /**< Client type */
   char cli_name[HOSTLEN + 1];   /**< Unique name of the client, nick or host */
@@ -384,8 +385,6 @@ struct Client {
 #define cli_sdnsbls(cli)	((cli)->cli_sdnsbls)
 /** Get dnsbl rejection message for client. */
 #define cli_dnsblformat(cli)	((cli)->cli_dnsblformat)
-/** Get dnsbl count for client. */
-#define cli_dnsblcount(cli)	((cli)->cli_dnsblcount)
 /** Get the last dnsnbl rank that the client went through. */
 #define cli_dnsbllastrank(cli)  ((cli)->cli_dnsbllastrank)
 
@@ -429,8 +428,6 @@ struct Client {
 #define cli_handler(cli)	((cli)->cli_connect->con_handler)
 /** Get DNS reply for client. */
 #define cli_dns_reply(cli)	((cli)->cli_connect->con_dns_reply)
-/** Get DNSBL reply for client. */
-#define cli_dnsbl_reply(cli)	((cli)->cli_connect->con_dnsbl_reply)
 /** Get LIST status for client. */
 #define cli_listing(cli)	((cli)->cli_connect->con_listing)
 /** Get cached max SendQ for client. */
@@ -449,7 +446,7 @@ struct Client {
 #define cli_sockhost(cli)	((cli)->cli_connect->con_sockhost)
 /** Get the client's password. */
 #define cli_passwd(cli)		((cli)->cli_connect->con_passwd)
-/** Get sentalong marker for client. */
+/** Get sentalong mark (next marked connection) for client. */
 #define cli_sentalong(cli)      ((cli)->cli_connect->con_sentalong)
 /** Get the unprocessed input buffer for a client's connection.  */
 #define cli_buffer(cli)		((cli)->cli_connect->con_buffer)
@@ -463,6 +460,10 @@ struct Client {
 #define cli_auth(cli)		((cli)->cli_connect->con_auth)
 /** Get login on connect request for client. */
 #define cli_loc(cli)		((cli)->cli_connect->con_loc)
+/** Get cached E:Line exemptions for client. */
+#define cli_eflags(cli)		((cli)->cli_connect->con_eflags)
+/** Get E:Line generation the client's cached exemptions are valid for. */
+#define cli_elinegen(cli)	((cli)->cli_connect->con_elinegen)
 /** Get SSL client certificate fingerprint */
 #define cli_sslclifp(cli)       ((cli)->cli_sslclifp)
 /** Get WebIRC password used for successful WEBIRC */
@@ -490,7 +491,7 @@ struct Client {
 #define con_freeflag(con)	((con)->con_freeflag)
 /** Get last error code on connection. */
 #define con_error(con)		((con)->con_error)
-/** Get sentalong marker for connection. */
+/** Get sentalong mark (next marked connection) for connection. */
 #define con_sentalong(con)      ((con)->con_sentalong)
 /** Get server notice mask for connection. */
 #define con_snomask(con)	((con)->con_snomask)
@@ -524,8 +525,6 @@ struct Client {
 #define con_handler(con)	((con)->con_handler)
 /** Get DNS reply for the connection. */
 #define con_dns_reply(con)	((con)->con_dns_reply)
-/** Get DNSBL reply for the connection. */
-#define con_dnsbl_reply(con)	((con)->con_dnsbl_reply)
 /** Get the LIST status for the connection. */
 #define con_listing(con)	((con)->con_listing)
 /** Get the maximum permitted SendQ size for the connection. */
@@ -554,6 +553,10 @@ struct Client {
 #define con_auth(con)		((con)->con_auth)
 /** Get the login on connect request for the connection. */
 #define con_loc(con)		((con)->con_loc)
+/** Get cached E:Line exemptions for the connection. */
+#define con_eflags(con)		((con)->con_eflags)
+/** Get E:Line generation the cached exemptions are valid for. */
+#define con_elinegen(con)	((con)->con_elinegen)
 
 #define STAT_CONNECTING         0x001 /**< connecting to another server */
 #define STAT_HANDSHAKE          0x002 /**< pass - server sent */
@@ -1155,6 +1158,8 @@ extern char *client_check_privs(struct Client *client, struct Client *replyto);
 extern int client_modify_priv_by_name(struct Client *who, char *priv, int what);
 
 extern void DoMD5(unsigned char *mdout, unsigned char *src, unsigned long n);
+extern void DoMD5x4(unsigned char *mdout[4], unsigned char *src[4],
+                    unsigned long n[4]);
 
 extern unsigned int get_client_marker(void);
 extern int clear_privs(struct Client *who);
@@ -23,7 +23,11 @@
  * @version $Id$
  */
 
+struct Client;
+
 extern char *hidehost_normalhost(char *host);
 extern char *hidehost_ipv4(char *host);
+extern void cloak_flush_cache(void);
+extern void cloak_count_memory(struct Client *cptr);
 
 #endif /* INCLUDED_cloak_h */
@@ -35,6 +35,7 @@ extern int DBufAllocCount;      /* GLOBAL - count of dbufs allocated */
 extern int DBufUsedCount;       /* GLOBAL - count of dbufs in use */
 
 struct DBufBuffer;
+struct iovec;
 
 /** Queue of data chunks. */
 struct DBuf {
@@ -54,9 +55,14 @@ struct DBuf {
  */
 extern void dbuf_delete(struct DBuf *dyn, unsigned int length);
 extern int dbuf_put(struct DBuf *dyn, const char *buf, unsigned int length);
+extern int dbuf_reserve(struct DBuf *dyn, struct iovec *iov,
+                        unsigned int length);
+extern void dbuf_commit(struct DBuf *dyn, unsigned int length);
 extern const char *dbuf_map(const struct DBuf *dyn, unsigned int *length);
 extern unsigned int dbuf_get(struct DBuf *dyn, char *buf, unsigned int length);
 extern unsigned int dbuf_getmsg(struct DBuf *dyn, char *buf, unsigned int length);
+extern char *dbuf_getline(struct DBuf *dyn, unsigned int length,
+                          unsigned int *count);
 extern void dbuf_count_memory(size_t *allocated, size_t *used);
 
 
@@ -0,0 +1,108 @@
+#ifndef INCLUDED_filter_h
+#define INCLUDED_filter_h
+/*
+ * IRC - Internet Relay Chat, include/filter.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+/** @file
+ * @brief Compiled F:Line and spam filter rules.
+ * @version $Id$
+ */
+#ifndef INCLUDED_config_h
+#include "config.h"
+#endif
+#ifdef PCRE_SYSTEM
+#include <pcre.h>
+#else
+#include "pcre.h"
+#endif
+
+/** Number of WFFLAG_* watch flags. */
+#define FILTER_WATCH_BITS 11
+
+struct FilterAcState;
+
+/** A filter rule, ready to run. */
+struct FilterRule {
+  void         *fr_owner;   /**< F:Line or SpamFilter holding this rule. */
+  pcre         *fr_filter;  /**< Compiled regex (freed by the owner). */
+  pcre_extra   *fr_extra;   /**< pcre_study() data, or NULL. */
+  unsigned int  fr_rflags;  /**< Reaction flags (RFFLAG_*). */
+  unsigned int  fr_wflags;  /**< Watch flags (WFFLAG_*). */
+  char         *fr_literal; /**< Lower-cased text every match contains. */
+  unsigned int  fr_index;   /**< Position in its FilterSet. */
+  unsigned long fr_calls;   /**< Times PCRE was run for this rule. */
+  unsigned long fr_hits;    /**< Times it matched. */
+  unsigned long fr_samples; /**< Runs that were timed. */
+  unsigned long long fr_time; /**< CPU time of the timed runs, in ns. */
+  unsigned long long fr_max; /**< Slowest timed run, in ns. */
+  int           fr_timed;   /**< Whether the last run was timed. */
+  int           fr_warned;  /**< Whether opers were told it is slow. */
+};
+
+/** What filter_rule_cost() thinks of a rule's running time. */
+enum FilterCost {
+  FILTER_COST_OK,    /**< Fast enough, or not yet known. */
+  FILTER_COST_WARN,  /**< Slower than FEAT_FILTER_WARN_TIME on average. */
+  FILTER_COST_FATAL  /**< Slower than FEAT_FILTER_FATAL_TIME on average. */
+};
+
+/** Rules of one filter list, grouped by watch flag.
+ * A set also holds an Aho-Corasick automaton over the rules' required
+ * literals; each text is scanned once, and rules whose literal did
+ * not turn up are known not to match without running PCRE.
+ */
+struct FilterSet {
+  struct FilterRule   **fs_rules;   /**< All rules, in list order. */
+  unsigned int          fs_count;   /**< Number of rules. */
+  unsigned int          fs_size;    /**< Allocated size of fs_rules. */
+  struct FilterRule   **fs_watch[FILTER_WATCH_BITS]; /**< Rules by flag. */
+  unsigned int          fs_nwatch[FILTER_WATCH_BITS]; /**< Sizes of those. */
+  struct FilterAcState *fs_states;  /**< Automaton states; 0 is the root. */
+  unsigned int          fs_nstates; /**< Number of automaton states. */
+  unsigned int         *fs_root;    /**< Root transitions, by byte. */
+  unsigned int         *fs_next;    /**< Next rule sharing a final state. */
+  unsigned int         *fs_seen;    /**< Scan in which each rule's literal
+                                         was last seen. */
+  unsigned int          fs_scan;    /**< Number of the current scan. */
+  const char           *fs_text;    /**< Text being filtered. */
+  int                   fs_scanned; /**< Whether fs_text has been scanned. */
+  int                   fs_dirty;   /**< Rules changed; rebuild first. */
+};
+
+extern void filter_rule_init(struct FilterRule *rule, void *owner,
+                             pcre *filter, const char *pattern, int options,
+                             const char *rflags, const char *wflags);
+extern void filter_rule_clear(struct FilterRule *rule);
+extern void filter_rule_reset_cost(struct FilterRule *rule);
+extern enum FilterCost filter_rule_cost(struct FilterRule *rule);
+extern unsigned long long filter_rule_total(const struct FilterRule *rule);
+
+extern void filterset_reset(struct FilterSet *set);
+extern void filterset_add(struct FilterSet *set, struct FilterRule *rule);
+extern void filterset_build(struct FilterSet *set);
+extern struct FilterRule **filterset_begin(struct FilterSet *set,
+                                           const char *text,
+                                           unsigned int flags,
+                                           unsigned int *count);
+extern int filterset_candidate(struct FilterSet *set, struct FilterRule *rule);
+extern int filterset_exec(struct FilterSet *set, struct FilterRule *rule,
+                          int *ovector, int ovecsize);
+
+/** Mark a FilterSet as needing to be rebuilt from its list. */
+#define filterset_changed(set)	((set)->fs_dirty = 1)
+
+#endif /* INCLUDED_filter_h */
@@ -34,6 +34,10 @@
 
 #include <netinet/in.h>
 
+#ifndef INCLUDED_banindex_h
+#include "banindex.h"
+#endif
+
 struct Client;
 struct StatDesc;
 
@@ -51,6 +55,7 @@ struct Gline {
   struct in_addr ipnum;         /**< IP in binary for ip glines */
   char bits;                    /**< Usable bits in gl_addr. */
   unsigned int	gl_flags;       /**< G-line status flags. */
+  struct BanIndexEntry gl_index; /**< Linkage in the G-line index. */
 };
 
 #define GLINE_ACTIVE	0x0001  /**< G-line is active. */
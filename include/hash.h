@@ -23,6 +23,10 @@
 
 #ifndef INCLUDED_hash_h
 #define INCLUDED_hash_h
+#ifndef INCLUDED_sys_types_h
+#include <sys/types.h>          /* size_t */
+#define INCLUDED_sys_types_h
+#endif
 
 struct Client;
 struct Channel;
@@ -33,11 +37,6 @@ struct Watch;
  * general defines
  */
 
-/** Size of client and channel hash tables.
- * Both must be of the same size.
- */
-#define HASHSIZE                32000
-
 /*
  * Structures
  */
@@ -92,6 +91,7 @@ extern struct Channel *hSeekChannel(const char *name);
 extern struct Watch *hSeekWatch(const char *name);
 
 extern int m_hash(struct Client *cptr, struct Client *sptr, int parc, char *parv[]);
+extern unsigned int hash_memory_count(size_t *mem);
 
 extern int isNickJuped(const char *nick);
 extern int addNickJupes(const char *nicks);
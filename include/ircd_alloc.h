@@ -31,6 +31,7 @@
 /** Type of handler for out-of-memory conditions. */
 typedef void (*OutOfMemoryHandler)(void);
 extern void set_nomem_handler(OutOfMemoryHandler handler);
+extern void alloc_nomem(void);
 
 /* The mappings for the My* functions... */
 /** Helper macro for standard allocations. */
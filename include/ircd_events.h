@@ -109,6 +109,9 @@ struct Socket {
   enum SocketState s_state;	/**< state socket's in */
   unsigned int	   s_events;	/**< events socket is interested in */
   int		   s_fd;	/**< file descriptor for socket */
+  unsigned int	   s_eng_events; /**< interest mask last given to the engine */
+  struct Socket*   s_dirty_next; /**< next socket with deferred changes */
+  struct Socket**  s_dirty_prev_p; /**< what points to us on the dirty list */
 #ifdef USE_SSL
   SSL*             ssl;         /**< if not NULL, use SSL routines on socket */
 #endif /* USE_SSL */
@@ -212,7 +215,7 @@ struct Event {
 struct Generators {
   struct GenHeader* g_socket;	/**< list of socket generators */
   struct GenHeader* g_signal;	/**< list of signal generators */
-  struct GenHeader* g_timer;	/**< list of timer generators */
+  struct GenHeader* g_timer;	/**< list of timer generators already due */
 };
 
 /** Returns 1 if successfully initialized, 0 if not.
@@ -262,8 +265,14 @@ struct Engine {
   EngineEvents	eng_events;	/**< express interest in socket events */
   EngineDelete	eng_closing;	/**< socket is being closed */
   EngineLoop	eng_loop;	/**< actual event loop */
+  unsigned int	eng_flags;	/**< ENGINE_* flags */
 };
 
+/** Engine wants interest mask changes batched; socket_events() only
+ * records them and the engine calls socket_flush() before waiting.
+ */
+#define ENGINE_DEFER_EVENTS	0x0001
+
 /** Increment the reference count of \a gen. */
 #define gen_ref_inc(gen)	(((struct GenHeader*) (gen))->gh_ref++)
 /** Decrement the reference count of \a gen. */
@@ -291,8 +300,7 @@ void timer_add(struct Timer* timer, EventCallBack call, void* data,
 void timer_del(struct Timer* timer);
 void timer_chg(struct Timer* timer, enum TimerType type, time_t value);
 void timer_run(void);
-/** Retrieve the next timer's expiration time from Generators \a gen. */
-#define timer_next(gen)	((gen)->g_timer ? ((struct Timer*)(gen)->g_timer)->t_expire : 0)
+time_t timer_next(struct Generators* gen);
 
 void signal_add(struct Signal* signal, EventCallBack call, void* data,
 		int sig);
@@ -302,8 +310,10 @@ int socket_add(struct Socket* sock, EventCallBack call, void* data,
 void socket_del(struct Socket* sock);
 void socket_state(struct Socket* sock, enum SocketState state);
 void socket_events(struct Socket* sock, unsigned int events);
+void socket_flush(void);
 
 const char* engine_name(void);
+void engine_event_stats(unsigned long* changed, unsigned long* applied);
 
 #ifdef DEBUGMODE
 /* These routines pretty-print names for states and types for debug printing */
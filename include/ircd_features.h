@@ -34,6 +34,8 @@ extern struct Client his;
 enum Feature {
   /* Misc. features */
   FEAT_LOG,
+  FEAT_LOG_ASYNC,
+  FEAT_LOG_ASYNC_BUFFER,
   FEAT_DOMAINNAME,
   FEAT_RELIABLE_CLOCK,
   FEAT_BUFFERPOOL,
@@ -92,6 +94,10 @@ enum Feature {
   FEAT_POLLS_PER_LOOP,
   FEAT_IRCD_RES_RETRIES,
   FEAT_IRCD_RES_TIMEOUT,
+  FEAT_IRCD_RES_CACHE_SIZE,
+  FEAT_IRCD_RES_MIN_TTL,
+  FEAT_IRCD_RES_MAX_TTL,
+  FEAT_IRCD_RES_NEGATIVE_TTL,
   FEAT_AUTH_TIMEOUT,
 
   /* features that affect all operators */
@@ -206,6 +212,7 @@ enum Feature {
   FEAT_HOST_HIDING_KEY1,
   FEAT_HOST_HIDING_KEY2,
   FEAT_HOST_HIDING_KEY3,
+  FEAT_HOST_HIDING_CACHE,
   FEAT_OPERHOST_HIDING,
   FEAT_HIDDEN_OPERHOST,
   FEAT_TOPIC_BURST,
@@ -273,6 +280,7 @@ enum Feature {
   FEAT_DIEPASS,
   FEAT_DNSBL_CHECKS,
   FEAT_DNSBL_EXEMPT_CLASS,
+  FEAT_DNSBL_CACHE_TIME,
   FEAT_ANNOUNCE_INVITES,
   FEAT_OPERFLAGS,
   FEAT_WHOIS_OPER,
@@ -74,6 +74,7 @@ extern void log_debug_init(int usetty);
 extern void log_init(const char *process_name);
 extern void log_reopen(void);
 extern void log_close(void);
+extern void log_flush(void);
 
 extern void log_write(enum LogSys subsys, enum LogLevel severity,
 		      unsigned int flags, const char *fmt, ...);
@@ -112,6 +113,8 @@ extern char *log_get_default(void);
 extern void log_feature_unmark(void);
 extern int log_feature_mark(int flag);
 extern void log_feature_report(struct Client *to, int flag);
+extern void log_feature_async(void);
+extern void log_count_memory(struct Client *cptr);
 
 extern int log_inassert;
 
@@ -8,6 +8,7 @@
 struct Client;
 struct sockaddr_in;
 struct MsgQ;
+struct iovec;
 
 /** Result of an input/output operation. */
 typedef enum IOResult {
@@ -34,6 +35,8 @@ extern int os_get_sockname(int fd, struct sockaddr_in* sin_out);
 extern int os_get_peername(int fd, struct sockaddr_in* sin_out);
 extern IOResult os_recv_nonb(int fd, char* buf, unsigned int length,
                         unsigned int* length_out);
+extern IOResult os_recvv_nonb(int fd, struct iovec* iov, int count,
+                              unsigned int* length_out);
 extern IOResult os_send_nonb(int fd, const char* buf, unsigned int length,
                         unsigned int* length_out);
 extern IOResult os_sendv_nonb(int fd, struct MsgQ* buf,
@@ -0,0 +1,63 @@
+#ifndef INCLUDED_ircd_slab_h
+#define INCLUDED_ircd_slab_h
+/*
+ * IRC - Internet Relay Chat, include/ircd_slab.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+/** @file
+ * @brief Slab allocator for small fixed-size structures.
+ * @version $Id$
+ */
+#ifndef INCLUDED_sys_types_h
+#include <sys/types.h>
+#define INCLUDED_sys_types_h
+#endif
+
+struct Client;
+struct Slab;
+
+/** Pool of objects of one type.
+ * Objects are carved out of aligned slabs mapped straight from the
+ * system, so an object finds its slab by masking its address.  Slabs
+ * with free objects are kept on one list and full slabs on another; a
+ * slab whose last object is freed is unmapped, except that one empty
+ * slab is held back to absorb churn around a slab boundary.
+ */
+struct SlabType {
+  const char      *st_name;     /**< Name shown in /STATS z. */
+  size_t           st_size;     /**< Size of each object, rounded up. */
+  unsigned int     st_perslab;  /**< Objects held by each slab. */
+  unsigned int     st_slabs;    /**< Slabs currently mapped. */
+  struct Slab     *st_partial;  /**< Slabs with some objects free. */
+  struct Slab     *st_full;     /**< Slabs with no objects free. */
+  struct Slab     *st_spare;    /**< Empty slab kept for reuse. */
+  size_t           st_inuse;    /**< Objects currently allocated. */
+  size_t           st_allocs;   /**< Objects ever allocated. */
+  size_t           st_released; /**< Slabs ever returned to the system. */
+  struct SlabType *st_next;     /**< Next type in #SlabTypeList. */
+};
+
+/** Initializer for a SlabType holding objects of type \a type. */
+#define SLAB_TYPE_INIT(name, type) { (name), sizeof(type) }
+
+/** Every SlabType that has allocated anything. */
+extern struct SlabType *SlabTypeList;
+
+extern void *slab_alloc(struct SlabType *type);
+extern void slab_free(struct SlabType *type, void *obj);
+extern void slab_count_memory(struct Client *cptr);
+
+#endif /* INCLUDED_ircd_slab_h */
@@ -70,6 +70,20 @@ struct Server {
 
 #define SFLAG_UWORLD         0x0001  /**< Server has UWorld privileges */
 
+/** Masks a user's channel bans and excepts are matched against.
+ * Built on first use by user_ban_identity() and kept until the user's
+ * nick, host, account or modes change.  Masks that do not apply to the
+ * user are empty.
+ */
+struct BanIdentity {
+  unsigned int bid_serial;  /**< Serial it was built at; 0 when stale. */
+  char bid_host[NICKLEN + USERLEN + HOSTLEN + 3];     /**< Shown host. */
+  char bid_sethost[NICKLEN + USERLEN + HOSTLEN + 3];  /**< Real host if +h. */
+  char bid_fakehost[NICKLEN + USERLEN + HOSTLEN + 3]; /**< Fake host. */
+  char bid_accthost[NICKLEN + USERLEN + HOSTLEN + 3]; /**< Account host. */
+  char bid_ip[NICKLEN + USERLEN + 16 + 3];            /**< nick!user@IP. */
+};
+
 /** Describes a user on the network. */
 struct User {
   struct User*       nextu;
@@ -98,6 +112,7 @@ struct User {
   char*              swhois;         /**< pointer to swhois message */
   char               response[BUFSIZE + 1];
   char               auth_oper[NICKLEN + 1 ];
+  struct BanIdentity banid;          /**< cached masks for ban matching */
 };
 
 /** Describes a Login on connect session on the network. */
@@ -35,6 +35,11 @@ struct SLink {
       char *who;
       time_t when;
     } ban;
+    struct {
+      char *mask;           /**< Silence mask as given. */
+      char *cmask;          /**< Compiled form of the mask. */
+      int minlen;           /**< Minimum length of matching strings. */
+    } silence;
     struct {
       char *exceptstr;
       char *extstr;
@@ -83,6 +83,8 @@ struct MotdCache {
   int			maxcount; /**< Number of lines allocated for message. */
   struct tm		modtime;  /**< Last modification time from file. */
   int			count;    /**< Actual number of lines used in message. */
+  char*			text;     /**< Replies to a local user, pre-rendered. */
+  unsigned int		textlen;  /**< Length of MotdCache::text. */
   char			motd[1][MOTD_LINESIZE]; /**< Message body. */
 };
 
@@ -56,6 +56,9 @@ struct MsgQ {
   struct MsgQList prio;		/**< Priority Msg queue */
 };
 
+/** Most text msgq_bulk() can put in one buffer. */
+#define MSGQ_BULKSIZE	4096
+
 /** Returns the current number of bytes stored in \a mq. */
 #define MsgQLength(mq) ((mq)->length)
 
@@ -77,6 +80,7 @@ extern int msgq_mapiov(const struct MsgQ *mq, struct iovec *iov, int count,
 extern struct MsgBuf *msgq_make(struct Client *dest, const char *format, ...);
 extern struct MsgBuf *msgq_vmake(struct Client *dest, const char *format,
 				 va_list args);
+extern struct MsgBuf *msgq_bulk(const char *text, unsigned int length);
 extern void msgq_append(struct Client *dest, struct MsgBuf *mb,
 			const char *format, ...);
 extern void msgq_clean(struct MsgBuf *mb);
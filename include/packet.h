@@ -15,8 +15,9 @@ struct Client;
  * Prototypes
  */
 
-extern int server_dopacket(struct Client* cptr, const char* buffer, int length);
-extern int connect_dopacket(struct Client* cptr, const char* buffer, int length);
-extern int client_dopacket(struct Client* cptr, unsigned int length);
+extern int server_dopacket(struct Client* cptr, char* buffer, int length);
+extern int connect_dopacket(struct Client* cptr, char* buffer, int length);
+extern int client_dopacket(struct Client* cptr, char* buffer,
+                           unsigned int length);
 
 #endif /* INCLUDED_packet_h */
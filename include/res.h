@@ -46,6 +46,7 @@ extern int      m_dns(struct Client* cptr, struct Client* sptr,
 extern int      resolver_read(void);
 extern void     resolver_read_multiple(int count);
 extern void     flush_resolver_cache(void);
+extern void     trim_resolver_cache(void);
 
 #endif /* INCLUDED_res_h */
 
@@ -31,6 +31,7 @@
 
 struct Client;
 struct DNSReply;
+struct DNSBLVerdict;
 
 struct AuthRequest {
   struct AuthRequest* next;      /* linked list node ptr */
@@ -40,6 +41,8 @@ struct AuthRequest {
   int                 fd;        /* file descriptor for auth queries */
   struct Socket       socket;    /* socket descriptor for auth queries */
   struct Timer        timeout;   /* timeout timer for auth queries */
+  struct DNSBLVerdict* dnsbl;    /* DNSBL verdict being waited for */
+  struct AuthRequest* dnsbl_next; /* next request waiting for it */
 };
 
 /*
@@ -83,6 +86,8 @@ extern void read_auth_reply(struct AuthRequest* req);
 extern void send_auth_query(struct AuthRequest* req);
 extern void destroy_auth_request(struct AuthRequest *req, int send_reports);
 extern void auth_dnsbl_callback(void* vptr, struct DNSReply* reply);
+extern void dnsbl_flush_verdicts(void);
+extern void dnsbl_count_memory(struct Client* sptr);
 
 #endif /* INCLUDED_s_auth_h */
 
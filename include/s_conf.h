@@ -21,6 +21,7 @@
 #define INCLUDED_netinet_in_h
 #endif
 
+#include "banindex.h"
 #include "client.h"
 
 #ifdef PCRE_SYSTEM
@@ -30,6 +31,9 @@
 #include "pcre.h"
 #include "pcreposix.h"
 #endif
+#ifndef INCLUDED_filter_h
+#include "filter.h"
+#endif
 
 struct StatDesc;
 struct Client;
@@ -84,6 +88,7 @@ struct ConfItem {
   int                      flags;
   struct Privs privs; /* Priviledges for opers. */
   struct Privs privs_dirty;
+  struct BanIndexEntry     index;       /* Linkage in the Client block index */
 };
 
 struct ServerConf {
@@ -108,6 +113,7 @@ struct DenyConf {
   unsigned int        address;
   unsigned int        flags;
   char                bits;        /* Number of bits for ipkills */
+  struct BanIndexEntry index;      /* Linkage in the Kill block index */
 };
 
 #define DENY_FLAGS_FILE     0x0001 /* Comment is a filename */
@@ -254,6 +260,7 @@ struct fline {
   char *nchan;
   int length;
   int active;
+  struct FilterRule rule;
 };
 
 /*
@@ -272,7 +279,9 @@ extern struct svcline*	GlobalServicesList;
 extern struct blline*	GlobalBLList;
 extern struct wline*    GlobalWList;
 extern struct eline*    GlobalEList;
+extern unsigned int     eline_generation;
 extern struct fline*    GlobalFList;
+extern struct FilterSet FlineRules;
 extern unsigned int	GlobalBLCount;
 extern char*		GlobalForwards[256];
 
@@ -314,6 +323,9 @@ extern void read_tlines(void);
 extern int find_fline(struct Client *cptr, struct Client *sptr, char *string, unsigned int flags, char *target);
 extern int find_eline(struct Client *cptr, unsigned int flags);
 extern int find_eline_from_ip(struct in_addr addr, unsigned int flags);
+/** Forget the E:Line exemptions cached for \a cptr, after its user name,
+ * IP or host changes. */
+#define forget_eline(cptr)	(cli_elinegen(cptr) = 0)
 extern int find_kill(struct Client *cptr);
 extern struct DenyConf *find_prompt(struct Client *cptr);
 
@@ -4,6 +4,9 @@
  */
 #ifndef INCLUDED_s_user_h
 #define INCLUDED_s_user_h
+#ifndef INCLUDED_ircd_defs_h
+#include "ircd_defs.h"        /* HOSTLEN, NICKLEN, USERLEN */
+#endif
 #ifndef INCLUDED_sys_types_h
 #include <sys/types.h>
 #define INCLUDED_sys_types_h
@@ -14,6 +17,7 @@ struct User;
 struct Channel;
 struct MsgBuf;
 struct Flags;
+struct BanIdentity;
 
 #define MAGIC_SVSMODE_OVERRIDE 0x12345678
 
@@ -57,6 +61,17 @@ struct Flags;
 
 #define COOKIE_VERIFIED 0xffffffff
 
+/** Identity strings of a message sender, matched against the silence
+ * lists of its recipients.  See silence_sender_init().
+ */
+struct SilenceSender {
+  struct Client *sptr;    /**< Client sending the message. */
+  int ready;              /**< Non-zero once the strings are built. */
+  char sender[HOSTLEN + NICKLEN + USERLEN + 5];     /**< nick!user\@host */
+  char senderip[SOCKIPLEN + NICKLEN + USERLEN + 5]; /**< nick!user\@ip */
+  char senderh[HOSTLEN + NICKLEN + USERLEN + 5];    /**< nick!user\@realhost */
+};
+
 extern struct SLink *opsarray[];
 
 /** Formatter function for send_user_info().
@@ -87,6 +102,9 @@ extern void send_user_info(struct Client* to, char* names, int rpl,
 extern int add_silence(struct Client* sptr, const char* mask, int exempt);
 
 extern void make_hidden_hostmask(char *buffer, struct Client *cptr);
+extern struct BanIdentity *user_ban_identity(struct Client *cptr);
+extern void ban_identity_clear(struct Client *cptr);
+extern void ban_identity_flush(void);
 extern int hide_hostmask(struct Client *cptr);
 extern int unhide_hostmask(struct Client *cptr);
 extern int set_hostmask(struct Client *sptr, struct Client *cptr,
@@ -95,6 +113,8 @@ extern int set_user_mode(struct Client *cptr, struct Client *sptr,
                          int parc, char *parv[]);
 extern int is_silenced(struct Client *sptr, struct Client *acptr);
 extern int is_silence_exempted(struct Client *sptr, struct Client *acptr);
+extern void silence_sender_init(struct SilenceSender *ss, struct Client *sptr);
+extern int silence_blocks(struct SilenceSender *ss, struct Client *acptr);
 extern int hunt_server(int, struct Client *cptr, struct Client *sptr,
     char *command, int server, int parc, char *parv[]);
 extern int hunt_server_cmd(struct Client *from, const char *cmd,
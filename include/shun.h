@@ -32,6 +32,10 @@
 
 #include <netinet/in.h>
 
+#ifndef INCLUDED_banindex_h
+#include "banindex.h"
+#endif
+
 struct Client;
 struct StatDesc;
 
@@ -48,6 +52,7 @@ struct Shun {
   struct in_addr ipnum;  /* We store the IP in binary for ip shuns */
   char 		bits;
   unsigned int	sh_flags;
+  struct BanIndexEntry sh_index; /* linkage in the shun index */
 };
 
 #define SHUN_ACTIVE	0x0001
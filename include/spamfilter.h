@@ -38,6 +38,9 @@
 #include "pcre.h"
 #include "pcreposix.h"
 #endif
+#ifndef INCLUDED_filter_h
+#include "filter.h"
+#endif
 
 struct SpamFilter {
   struct SpamFilter *sf_next;        /**< Next SpamFilter in linked list. */
@@ -51,6 +54,7 @@ struct SpamFilter {
   unsigned int sf_flags;             /**< active/deactivated */
   int sf_length;                     /**< Gline/Shun/Zline length */
   time_t sf_expire;                  /**< Expiration time */
+  struct FilterRule sf_rule;         /**< Compiled form of the filter */
 };
 
 #define SPAMFILTER_MAX_EXPIRE 604800 /**< max expire: 7 days */
@@ -60,6 +64,9 @@ struct SpamFilter {
 /** Test whether \a spamfilter is active. */
 #define SpamFilterIsActive(s)     ((s)->sf_flags & SPAMFILTER_ACTIVE)
 
+extern struct SpamFilter* GlobalSpamFilterList;
+extern struct FilterSet SpamFilterRules;
+
 extern void spamfilter_check_expires();
 extern void spamfilter_stats(struct Client* to, const struct StatDesc *sd, char* param);
 extern void spamfilter_burst(struct Client *cptr);
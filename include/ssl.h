@@ -54,6 +54,7 @@ extern char  *ssl_get_cipher(SSL *ssl);
 extern int ssl_send(struct Client *cptr, const char *buf, unsigned int len);
 extern int ssl_murder(void *ssl, int fd, const char *buf);
 extern int ssl_count(void);
+extern void ssl_record_stats(unsigned long *records, unsigned long *bytes);
 
 extern void ssl_add_connection(struct Listener *listener, int fd);
 extern void ssl_free(struct Socket *socket);
@@ -32,6 +32,10 @@
 
 #include <netinet/in.h>
 
+#ifndef INCLUDED_banindex_h
+#include "banindex.h"
+#endif
+
 struct Client;
 struct StatDesc;
 
@@ -47,6 +51,7 @@ struct Zline {
   struct in_addr ipnum;  /* We store the IP in binary for ip zlines */
   char 		bits;
   unsigned int	zl_flags;
+  struct BanIndexEntry zl_index; /* linkage in the Z-line index */
 };
 
 #define ZLINE_ACTIVE	0x0001
@@ -45,18 +45,41 @@ struct IPTargetEntry {
   unsigned char targets[MAXTARGETS]; /**< Array of recent targets. */
 };
 
-/** Stores recent information about a particular IP address. */
+/** Stores recent information about a particular IP address.
+ * Entries live directly in the slots of an IPRegistryTable.
+ */
 struct IPRegistryEntry {
-  struct IPRegistryEntry*  next;   /**< Next entry in the hash chain. */
   struct IPTargetEntry*    target; /**< Recent targets, if any. */
   unsigned int             addr;   /**< IP address for this user. */
   int		           last_connect; /**< Last connection attempt timestamp. */
   unsigned short           connected; /**< Number of currently connected clients. */
   unsigned char            attempts; /**< Number of recent connection attempts. */
+  unsigned int             dist;   /**< Distance from home slot plus one,
+                                        or zero if the slot is free. */
+};
+
+/** Open-addressing hash table of IPRegistryEntry records.
+ * Collisions are resolved by linear probing with Robin Hood
+ * displacement, so an entry is never far from its home slot and a
+ * failed lookup stops as soon as it reaches an entry closer to home
+ * than the address would be.
+ */
+struct IPRegistryTable {
+  struct IPRegistryEntry* slots; /**< Table of 2^n slots, or NULL. */
+  unsigned int            mask;  /**< Number of slots minus one. */
+  unsigned int            count; /**< Number of entries in use. */
 };
 
-/** Size of hash table (must be a power of two). */
+/** Initial and minimum size of hash table (must be a power of two). */
 #define IP_REGISTRY_TABLE_SIZE 0x10000
+/** Number of timer ticks (seconds) over which the whole table is
+ * checked for expired entries. */
+#define IP_REGISTRY_EXPIRE_SLICES 60
+/** Number of slots of the old table moved for each new entry while
+ * the table is being resized. */
+#define IP_REGISTRY_MIGRATE_STEP 4
+/** Whether \a n entries overload table \a t (more than 3/4 full). */
+#define IP_REGISTRY_FULL(t, n) ((n) > (t)->mask - ((t)->mask >> 2))
 /** Report current time for tracking in IPRegistryEntry::last_connect. */
 #define NOW ((unsigned short)(CurrentTime & 0xffff))
 /** Time from \a x until now, in seconds. */
@@ -70,98 +93,197 @@ struct IPRegistryEntry {
 #define IPCHECK_CLONE_DELAY feature_int(FEAT_IPCHECK_CLONE_DELAY)
 
 /** Hash table for storing IPRegistryEntry entries. */
-static struct IPRegistryEntry* hashTable[IP_REGISTRY_TABLE_SIZE];
-/** List of allocated but unused IPRegistryEntry structs. */
-static struct IPRegistryEntry* freeList;
+static struct IPRegistryTable registry;
+/** Previous table, whose entries are being moved into #registry after
+ * a resize; its slots are NULL when no resize is in progress. */
+static struct IPRegistryTable oldRegistry;
+/** Next slot of #oldRegistry to move. */
+static unsigned int migrateNext;
+/** Next slot of #registry to check for expiry. */
+static unsigned int expireNext;
 /** Periodic timer to look for too-old registry entries. */
 static struct Timer expireTimer;
 
 /** Calculate hash value for an IP address.
  * @param[in] ip Address to hash; must be in canonical form.
- * @return Hash value for address.
+ * @param[in] mask Size of the table minus one.
+ * @return Home slot for address.
  */
 
-static unsigned int ip_registry_hash(unsigned int ip)
+static unsigned int ip_registry_hash(unsigned int ip, unsigned int mask)
 {
-  return ((ip >> 16) ^ ip) & (IP_REGISTRY_TABLE_SIZE - 1);
+  /* spread addresses from a single network over the whole table */
+  ip ^= ip >> 16;
+  ip *= 0x45d9f3b;
+  ip ^= ip >> 16;
+  return ip & mask;
 }
 
-/** Find an IP registry entry if one exists for the IP address.
- * If \a ip looks like an IPv6 address, only consider the first 64 bits
- * of the address. Otherwise, only consider the final 32 bits.
+/** Look up an address in one table.
+ * @param[in] table Table to search.
  * @param[in] ip IP address to search for.
  * @return Matching registry entry, or NULL if none exists.
  */
-static struct IPRegistryEntry* ip_registry_find(unsigned int ip)
+static struct IPRegistryEntry* ip_registry_table_find(struct IPRegistryTable* table,
+                                                      unsigned int ip)
 {
   struct IPRegistryEntry* entry;
-  entry = hashTable[ip_registry_hash(ip)];
-  for ( ; entry; entry = entry->next) {
+  unsigned int slot;
+  unsigned int dist;
+
+  if (!table->slots)
+    return 0;
+  slot = ip_registry_hash(ip, table->mask);
+  for (dist = 1; ; dist++) {
+    entry = &table->slots[slot];
+    if (entry->dist < dist) /* free, or closer to home than ip would be */
+      return 0;
     if (entry->addr == ip)
-      break;
+      return entry;
+    slot = (slot + 1) & table->mask;
   }
-  return entry;
 }
 
-/** Add an IP registry entry to the hash table.
- * @param[in] entry Registry entry to add.
+/** Put a copy of an entry in a table.
+ * Entries further along their probe sequence take over the slots of
+ * those nearer to home, which move on.
+ * @param[in] table Table to add to; must have a free slot.
+ * @param[in] src Entry to copy.
+ * @return The slot holding the copy of \a src.
  */
-static void ip_registry_add(struct IPRegistryEntry* entry)
+static struct IPRegistryEntry* ip_registry_table_insert(struct IPRegistryTable* table,
+                                                        const struct IPRegistryEntry* src)
 {
-  unsigned int bucket = ip_registry_hash(entry->addr);
-  entry->next = hashTable[bucket];
-  hashTable[bucket] = entry;
+  struct IPRegistryEntry carry = *src;
+  struct IPRegistryEntry tmp;
+  struct IPRegistryEntry* entry;
+  struct IPRegistryEntry* result = 0;
+  unsigned int slot = ip_registry_hash(src->addr, table->mask);
+
+  for (carry.dist = 1; ; carry.dist++) {
+    entry = &table->slots[slot];
+    if (0 == entry->dist) {
+      *entry = carry;
+      table->count++;
+      return result ? result : entry;
+    }
+    if (entry->dist < carry.dist) {
+      tmp = *entry;
+      *entry = carry;
+      carry = tmp;
+      if (!result)
+        result = entry;
+    }
+    slot = (slot + 1) & table->mask;
+  }
 }
 
-/** Remove an IP registry entry from the hash table.
- * @param[in] entry Registry entry to add.
+/** Take an entry out of its table.
+ * The entries that follow it are shifted back a slot, so \a entry
+ * may afterwards hold the next entry of the probe sequence.
+ * @param[in] table Table holding \a entry.
+ * @param[in] entry Registry entry to remove.
  */
-static void ip_registry_remove(struct IPRegistryEntry* entry)
+static void ip_registry_table_remove(struct IPRegistryTable* table,
+                                     struct IPRegistryEntry* entry)
 {
-  unsigned int bucket = ip_registry_hash(entry->addr);
-  if (hashTable[bucket] == entry)
-    hashTable[bucket] = entry->next;
-  else {
-    struct IPRegistryEntry* prev = hashTable[bucket];
-    for ( ; prev; prev = prev->next) {
-      if (prev->next == entry) {
-        prev->next = entry->next;
-        break;
-      }
+  unsigned int slot = entry - table->slots;
+  struct IPRegistryEntry* next;
+
+  for (;;) {
+    next = &table->slots[(slot + 1) & table->mask];
+    if (next->dist <= 1) /* free, or already at home */
+      break;
+    table->slots[slot] = *next;
+    table->slots[slot].dist--;
+    slot = (slot + 1) & table->mask;
+  }
+  table->slots[slot].dist = 0;
+  table->count--;
+}
+
+/** Move entries from #oldRegistry into #registry.
+ * @param[in] steps Number of old slots to move or skip; zero for all.
+ */
+static void ip_registry_migrate(unsigned int steps)
+{
+  struct IPRegistryEntry* entry;
+
+  while (oldRegistry.slots) {
+    if (0 == oldRegistry.count) {
+      MyFree(oldRegistry.slots);
+      oldRegistry.slots = 0;
+      break;
+    }
+    assert(migrateNext <= oldRegistry.mask);
+    entry = &oldRegistry.slots[migrateNext];
+    if (entry->dist) {
+      ip_registry_table_insert(&registry, entry);
+      ip_registry_table_remove(&oldRegistry, entry); /* may refill slot */
     }
+    else
+      migrateNext++;
+    if (steps && 0 == --steps)
+      break;
   }
 }
 
-/** Allocate a new IP registry entry.
- * For members that have a sensible default value, that is used.
- * @return Newly allocated registry entry.
+/** Start moving the registry into a table of \a size slots.
+ * The move itself happens a few slots at a time, as entries are added
+ * and on each expiry tick; meanwhile lookups check both tables.
+ * @param[in] size New number of slots (must be a power of two).
  */
-static struct IPRegistryEntry* ip_registry_new_entry(void)
+static void ip_registry_resize(unsigned int size)
 {
-  struct IPRegistryEntry* entry = freeList;
-  if (entry)
-    freeList = entry->next;
-  else
-    entry = (struct IPRegistryEntry*) MyMalloc(sizeof(struct IPRegistryEntry));
-
-  assert(0 != entry);
-  memset(entry, 0, sizeof(struct IPRegistryEntry));
-  entry->last_connect = NOW;     /* Seconds since last connect attempt */
-  entry->connected    = 1;       /* connected clients for this IP */
-  entry->attempts     = 1;       /* Number attempts for this IP */
+  ip_registry_migrate(0); /* finish any earlier resize first */
+  Debug((DEBUG_DEBUG, "IPcheck resizing registry from %u to %u slots (%u entries)",
+         registry.slots ? registry.mask + 1 : 0, size, registry.count));
+  oldRegistry = registry;
+  migrateNext = 0;
+  expireNext = 0;
+  registry.slots = (struct IPRegistryEntry*) MyCalloc(size, sizeof(struct IPRegistryEntry));
+  registry.mask = size - 1;
+  registry.count = 0;
+}
+
+/** Find an IP registry entry if one exists for the IP address.
+ * If \a ip looks like an IPv6 address, only consider the first 64 bits
+ * of the address. Otherwise, only consider the final 32 bits.
+ * @param[in] ip IP address to search for.
+ * @return Matching registry entry, or NULL if none exists.
+ */
+static struct IPRegistryEntry* ip_registry_find(unsigned int ip)
+{
+  struct IPRegistryEntry* entry = ip_registry_table_find(&registry, ip);
+  if (!entry)
+    entry = ip_registry_table_find(&oldRegistry, ip);
   return entry;
 }
 
-/** Deallocate memory for \a entry.
- * The entry itself is prepended to #freeList.
- * @param[in] entry IP registry entry to release.
+/** Add a new IP registry entry for an address.
+ * For members that have a sensible default value, that is used.
+ * The entry returned may move once another entry is added.
+ * @param[in] addr Address the entry is for; must not be in the registry.
+ * @return Newly added registry entry.
  */
-static void ip_registry_delete_entry(struct IPRegistryEntry* entry)
+static struct IPRegistryEntry* ip_registry_add(unsigned int addr)
 {
-  if (entry->target)
-    MyFree(entry->target);
-  entry->next = freeList;
-  freeList = entry;
+  struct IPRegistryEntry entry;
+
+  if (!registry.slots)
+    ip_registry_resize(IP_REGISTRY_TABLE_SIZE);
+  else {
+    ip_registry_migrate(IP_REGISTRY_MIGRATE_STEP);
+    if (IP_REGISTRY_FULL(&registry, registry.count + oldRegistry.count + 1))
+      ip_registry_resize((registry.mask + 1) * 2);
+  }
+
+  memset(&entry, 0, sizeof(entry));
+  entry.addr         = addr;
+  entry.last_connect = NOW;     /* Seconds since last connect attempt */
+  entry.connected    = 1;       /* connected clients for this IP */
+  entry.attempts     = 1;       /* Number attempts for this IP */
+  return ip_registry_table_insert(&registry, &entry);
 }
 
 /** Update free target count for \a entry.
@@ -184,8 +306,9 @@ static unsigned int ip_registry_update_free_targets(struct IPRegistryEntry* entr
  * If the entry is at least 600 seconds stale, free the entire thing.
  * If it is at least 120 seconds stale, expire its free targets list.
  * @param[in] entry Registry entry to check for expiration.
+ * @return Non-zero if the entry was removed from #registry.
  */
-static void ip_registry_expire_entry(struct IPRegistryEntry* entry)
+static int ip_registry_expire_entry(struct IPRegistryEntry* entry)
 {
   /*
    * Don't touch this number, it has statistical significance
@@ -197,8 +320,10 @@ static void ip_registry_expire_entry(struct IPRegistryEntry* entry)
      * expired
      */
     Debug((DEBUG_DEBUG, "IPcheck expiring registry for %s (no clients connected).", ircd_ntoa((char*) &entry->addr)));
-    ip_registry_remove(entry);
-    ip_registry_delete_entry(entry);
+    if (entry->target)
+      MyFree(entry->target);
+    ip_registry_table_remove(&registry, entry);
+    return 1;
   }
   else if (CONNECTED_SINCE(entry->last_connect) > 120 && 0 != entry->target) {
     /*
@@ -207,38 +332,50 @@ static void ip_registry_expire_entry(struct IPRegistryEntry* entry)
     MyFree(entry->target);
     entry->target = 0;
   }
+  return 0;
 }
 
 /** Periodic timer callback to check for expired registry entries.
+ * Each tick looks at the next 1/#IP_REGISTRY_EXPIRE_SLICES of the
+ * table, so every entry is still checked about once a minute but the
+ * work is spread out; it also moves on any resize in progress.
  * @param[in] ev Timer event (ignored).
  */
 static void ip_registry_expire(struct Event* ev)
 {
-  int i;
+  unsigned int slice;
   struct IPRegistryEntry* entry;
-  struct IPRegistryEntry* entry_next;
 
   assert(ET_EXPIRE == ev_type(ev));
   assert(0 != ev_timer(ev));
 
-  for (i = 0; i < IP_REGISTRY_TABLE_SIZE; ++i) {
-    for (entry = hashTable[i]; entry; entry = entry_next) {
-      entry_next = entry->next;
-      if (0 == entry->connected)
-        ip_registry_expire_entry(entry);
+  if (registry.slots) {
+    slice = (registry.mask + 1) / IP_REGISTRY_EXPIRE_SLICES + 1;
+    ip_registry_migrate(slice);
+
+    for (; slice > 0; slice--) {
+      if (expireNext > registry.mask)
+        expireNext = 0;
+      entry = &registry.slots[expireNext];
+      if (entry->dist && 0 == entry->connected && ip_registry_expire_entry(entry))
+        continue; /* the slot may now hold the next entry */
+      expireNext++;
     }
+
+    /* Give back memory once a flood of addresses has expired */
+    if (!oldRegistry.slots && registry.mask + 1 > IP_REGISTRY_TABLE_SIZE
+        && registry.count < (registry.mask + 1) / 16)
+      ip_registry_resize((registry.mask + 1) / 2);
   }
-  Debug((DEBUG_DEBUG, "[%i] ip_registry_expire() again in 60s",
-       CurrentTime));
 
-  timer_add(&expireTimer, ip_registry_expire, 0, TT_ABSOLUTE, CurrentTime+60);
+  timer_add(&expireTimer, ip_registry_expire, 0, TT_ABSOLUTE, CurrentTime+1);
 }
 
 /** Initialize the IPcheck subsystem. */
 void IPcheck_init(void)
 {
   Debug((DEBUG_DEBUG, "IPcheck: Initializing timer"));
-  timer_add(timer_init(&expireTimer), ip_registry_expire, 0, TT_RELATIVE, 60);
+  timer_add(timer_init(&expireTimer), ip_registry_expire, 0, TT_RELATIVE, 1);
 }
 
 /** Check whether a new connection from a local client should be allowed.
@@ -256,9 +393,7 @@ int ip_registry_check_local(unsigned int addr, time_t* next_target_out)
   unsigned int free_targets = STARTTARGETS;
 
   if (0 == entry) {
-    entry       = ip_registry_new_entry();
-    entry->addr = addr;    /* The IP number of registry entry */
-    ip_registry_add(entry);
+    entry = ip_registry_add(addr);
     Debug((DEBUG_DEBUG, "IPcheck added new registry for local connection from %s.", ircd_ntoa((char*) &entry->addr)));
     return 1;
   }
@@ -322,11 +457,9 @@ int ip_registry_check_remote(struct Client* cptr, int is_burst)
   SetIPChecked(cptr);
   entry = ip_registry_find((cli_ip(cptr)).s_addr);
   if (0 == entry) {
-    entry = ip_registry_new_entry();
-    entry->addr = cli_ip(cptr).s_addr;    /* The IP number of registry entry */
+    entry = ip_registry_add(cli_ip(cptr).s_addr);
     if (is_burst)
       entry->attempts = 0;
-    ip_registry_add(entry);
     Debug((DEBUG_DEBUG, "IPcheck added new registry for remote connection from %s.",  ircd_ntoa((char*) &entry->addr)));
     return 1;
   }
@@ -0,0 +1,621 @@
+/*
+ * IRC - Internet Relay Chat, ircd/banindex.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+/** @file
+ * @brief Lookup index for server bans, Kill blocks and channel bans.
+ * @version $Id$
+ *
+ * The G-line, Z-line, shun and Kill block lists used to be walked in
+ * full, with a match() or netmask compare per entry, whenever a client
+ * registered (and, for shuns, on every message).  This index narrows each lookup
+ * to the entries that can possibly apply:
+ *
+ * - IP masks sit in a path-compressed binary radix tree, so a lookup
+ *   only visits the (at most 33) prefixes of the client's address.
+ * - Host masks ending in literal labels ("*.example.com", or a plain
+ *   hostname) are filed under that suffix in a trie of labels read
+ *   right to left.  Trie nodes are kept in a hash table keyed on the
+ *   whole suffix, and a lookup follows the client's hostname one label
+ *   at a time until it reaches a suffix with no node.
+ * - Everything else (realname bans, "foo*", masks with escapes) stays
+ *   on a residual list that is always checked.
+ *
+ * Candidates still go through the caller's full check, and the index
+ * keeps every entry's rank in the owning list so that, of the bans
+ * that apply, the one returned is the one the old list walk would have
+ * stopped at.
+ */
+#include "config.h"
+
+#include "banindex.h"
+#include "ircd_alloc.h"
+#include "ircd_chattr.h"
+#include "ircd_log.h"
+#include "ircd_string.h"
+
+/* #include <assert.h> -- Now using assert in ircd_log.h */
+#include <limits.h>
+#include <string.h>
+
+/** Node of the radix tree or of the host suffix trie. */
+struct BanIndexNode {
+  struct BanIndexNode  *bin_parent;   /**< Parent node, 0 for the root. */
+  struct BanIndexNode  *bin_child[2]; /**< Radix children, by next bit. */
+  struct BanIndexNode  *bin_hnext;    /**< Next trie node in hash bucket. */
+  struct BanIndexEntry *bin_entries;  /**< Bans filed at this node. */
+  unsigned int          bin_prefix;   /**< Radix network, host order. */
+  unsigned int          bin_bits;     /**< Radix prefix length. */
+  unsigned int          bin_hash;     /**< Hash of the trie suffix. */
+  unsigned int          bin_refs;     /**< Trie entries plus children. */
+  char                  bin_suffix[1]; /**< Trie suffix (variable length). */
+};
+
+/** Smallest number of buckets in the trie hash table. */
+#define BI_HOSTS_MIN 64
+
+/** Netmask for a prefix length, in host order. */
+#define BI_MASK(bits) ((bits) ? ~0U << (32 - (bits)) : 0U)
+/** Bit of \a addr just below a prefix of length \a bits. */
+#define BI_BIT(addr, bits) (((addr) >> (31 - (bits))) & 1)
+
+/** Add a character to a suffix hash.  Suffixes are hashed from their
+ * last character backwards, so the hash of each suffix of a hostname
+ * falls out of a single right-to-left pass.
+ * @param[in] hash Hash of the characters after \a ch.
+ * @param[in] ch Character to prepend.
+ * @return Hash including \a ch.
+ */
+static unsigned int
+suffix_hash_step(unsigned int hash, char ch)
+{
+  return hash * 31 + (unsigned char) ToLower(ch);
+}
+
+/** Hash a whole suffix.
+ * @param[in] suffix Suffix to hash.
+ * @return Hash of \a suffix.
+ */
+static unsigned int
+suffix_hash(const char *suffix)
+{
+  const char *ch = suffix + strlen(suffix);
+  unsigned int hash = 0;
+
+  while (ch > suffix)
+    hash = suffix_hash_step(hash, *--ch);
+  return hash;
+}
+
+/** Allocate an empty index node.
+ * @param[in] extra Bytes of suffix storage needed beyond the first.
+ * @return Newly allocated node.
+ */
+static struct BanIndexNode *
+node_alloc(size_t extra)
+{
+  struct BanIndexNode *node;
+
+  node = (struct BanIndexNode *) MyMalloc(sizeof(*node) + extra);
+  memset(node, 0, sizeof(*node));
+  return node;
+}
+
+/** Add an entry to the list kept at a node.
+ * @param[in] node Node to file the entry under.
+ * @param[in] entry Entry to file.
+ */
+static void
+node_link(struct BanIndexNode *node, struct BanIndexEntry *entry)
+{
+  entry->bie_node = node;
+  entry->bie_next = node->bin_entries;
+  entry->bie_prev_p = &node->bin_entries;
+  if (node->bin_entries)
+    node->bin_entries->bie_prev_p = &entry->bie_next;
+  node->bin_entries = entry;
+}
+
+/** Find or create the radix tree node for a network.
+ * @param[in] idx Index to search.
+ * @param[in] prefix Network address, host order, with no host bits set.
+ * @param[in] bits Prefix length.
+ * @return Node for \a prefix / \a bits.
+ */
+static struct BanIndexNode *
+radix_get(struct BanIndex *idx, unsigned int prefix, unsigned int bits)
+{
+  struct BanIndexNode *cur, *next, *node, *glue;
+  unsigned int common, limit, diff;
+  int side;
+
+  if (!idx->bi_root)
+    idx->bi_root = node_alloc(0);
+
+  for (cur = idx->bi_root; cur->bin_bits < bits; cur = next) {
+    side = BI_BIT(prefix, cur->bin_bits);
+    if (!(next = cur->bin_child[side])) {
+      node = node_alloc(0);
+      node->bin_prefix = prefix;
+      node->bin_bits = bits;
+      node->bin_parent = cur;
+      cur->bin_child[side] = node;
+      return node;
+    }
+
+    /* How far do we agree with the child? */
+    limit = bits < next->bin_bits ? bits : next->bin_bits;
+    diff = prefix ^ next->bin_prefix;
+    for (common = cur->bin_bits + 1;
+         common < limit && !(diff & (0x80000000U >> common)); common++)
+      ;
+
+    if (common == next->bin_bits)
+      continue; /* child covers us; keep descending */
+
+    if (common == bits) {
+      /* we cover the child: slot in between */
+      node = node_alloc(0);
+      node->bin_prefix = prefix;
+      node->bin_bits = bits;
+      node->bin_parent = cur;
+      node->bin_child[BI_BIT(next->bin_prefix, bits)] = next;
+      next->bin_parent = node;
+      cur->bin_child[side] = node;
+      return node;
+    }
+
+    /* we part ways below common: add a branch node for both */
+    glue = node_alloc(0);
+    glue->bin_prefix = prefix & BI_MASK(common);
+    glue->bin_bits = common;
+    glue->bin_parent = cur;
+    node = node_alloc(0);
+    node->bin_prefix = prefix;
+    node->bin_bits = bits;
+    node->bin_parent = glue;
+    glue->bin_child[BI_BIT(prefix, common)] = node;
+    glue->bin_child[BI_BIT(next->bin_prefix, common)] = next;
+    next->bin_parent = glue;
+    cur->bin_child[side] = glue;
+    return node;
+  }
+
+  return cur;
+}
+
+/** Remove radix tree nodes that no longer do anything.
+ * @param[in] idx Index the node belongs to.
+ * @param[in] node Node that just lost an entry.
+ */
+static void
+radix_prune(struct BanIndex *idx, struct BanIndexNode *node)
+{
+  struct BanIndexNode *parent, *child;
+
+  while (node != idx->bi_root && !node->bin_entries) {
+    parent = node->bin_parent;
+    if (node->bin_child[0] && node->bin_child[1])
+      return; /* still a branch point */
+
+    child = node->bin_child[0] ? node->bin_child[0] : node->bin_child[1];
+    parent->bin_child[parent->bin_child[0] == node ? 0 : 1] = child;
+    if (child)
+      child->bin_parent = parent;
+    MyFree(node);
+    if (child)
+      return; /* parent keeps as many children as before */
+    node = parent;
+  }
+}
+
+/** Look up a trie node by suffix.
+ * @param[in] idx Index to search.
+ * @param[in] suffix Suffix to find.
+ * @param[in] hash suffix_hash() of \a suffix.
+ * @return Matching node, or NULL if there is none.
+ */
+static struct BanIndexNode *
+trie_find(struct BanIndex *idx, const char *suffix, unsigned int hash)
+{
+  struct BanIndexNode *node;
+
+  if (!idx->bi_hosts)
+    return 0;
+  for (node = idx->bi_hosts[hash & idx->bi_hmask]; node;
+       node = node->bin_hnext)
+    if (node->bin_hash == hash && !ircd_strcmp(node->bin_suffix, suffix))
+      return node;
+  return 0;
+}
+
+/** Double the trie hash table (or create it).
+ * @param[in] idx Index to grow.
+ */
+static void
+trie_grow(struct BanIndex *idx)
+{
+  struct BanIndexNode **table, *node, *next;
+  unsigned int size, ii;
+
+  size = idx->bi_hosts ? (idx->bi_hmask + 1) * 2 : BI_HOSTS_MIN;
+  table = (struct BanIndexNode **) MyCalloc(size, sizeof(*table));
+  if (idx->bi_hosts) {
+    for (ii = 0; ii <= idx->bi_hmask; ii++)
+      for (node = idx->bi_hosts[ii]; node; node = next) {
+        next = node->bin_hnext;
+        node->bin_hnext = table[node->bin_hash & (size - 1)];
+        table[node->bin_hash & (size - 1)] = node;
+      }
+    MyFree(idx->bi_hosts);
+  }
+  idx->bi_hosts = table;
+  idx->bi_hmask = size - 1;
+}
+
+/** Find or create the trie node for a suffix, along with its parents.
+ * @param[in] idx Index to search.
+ * @param[in] suffix Label-aligned suffix of a host mask.
+ * @return Trie node for \a suffix.
+ */
+static struct BanIndexNode *
+trie_get(struct BanIndex *idx, const char *suffix)
+{
+  struct BanIndexNode *node;
+  const char *dot;
+  unsigned int hash = suffix_hash(suffix);
+  size_t len;
+
+  if ((node = trie_find(idx, suffix, hash)))
+    return node;
+
+  len = strlen(suffix);
+  node = node_alloc(len);
+  memcpy(node->bin_suffix, suffix, len + 1);
+  node->bin_hash = hash;
+  if ((dot = strchr(suffix, '.'))) {
+    node->bin_parent = trie_get(idx, dot + 1);
+    node->bin_parent->bin_refs++;
+  }
+
+  if (idx->bi_hcount >= (idx->bi_hosts ? idx->bi_hmask + 1 : 0))
+    trie_grow(idx);
+  node->bin_hnext = idx->bi_hosts[hash & idx->bi_hmask];
+  idx->bi_hosts[hash & idx->bi_hmask] = node;
+  idx->bi_hcount++;
+  return node;
+}
+
+/** Drop a reference to a trie node, freeing it and unused parents.
+ * @param[in] idx Index the node belongs to.
+ * @param[in] node Node to release.
+ */
+static void
+trie_release(struct BanIndex *idx, struct BanIndexNode *node)
+{
+  struct BanIndexNode **pp, *parent;
+
+  for (; node && !--node->bin_refs; node = parent) {
+    parent = node->bin_parent;
+    for (pp = &idx->bi_hosts[node->bin_hash & idx->bi_hmask]; *pp != node;
+         pp = &(*pp)->bin_hnext)
+      ;
+    *pp = node->bin_hnext;
+    idx->bi_hcount--;
+    MyFree(node);
+  }
+}
+
+/** Work out which trie suffix a host mask can be filed under.
+ * A mask can only match hostnames that end in the literal text after
+ * its last wildcard; the whole labels of that text make the key.
+ * @param[in] host Host mask.
+ * @return Suffix of \a host to file it under, or NULL if it has none.
+ */
+static const char *
+host_key(const char *host)
+{
+  const char *ch, *tail = host;
+
+  for (ch = host; *ch; ch++) {
+    if (*ch == '\\')
+      return 0; /* escapes are rare; leave them to match() */
+    if (*ch == '*' || *ch == '?')
+      tail = ch + 1;
+  }
+  if (tail == host)
+    return host; /* no wildcards: an exact hostname */
+  if (!(ch = strchr(tail, '.')))
+    return 0;
+  return ch + 1;
+}
+
+/** Give an entry its rank in list order, renumbering if need be.
+ * @param[in] idx Index the entry is being added to.
+ * @param[in] entry Entry, already linked into the order list.
+ */
+static void
+order_assign(struct BanIndex *idx, struct BanIndexEntry *entry)
+{
+  struct BanIndexEntry *prev = entry->bie_before, *next = entry->bie_after;
+  unsigned long rank;
+
+  if (prev && next) {
+    if (next->bie_order - prev->bie_order >= 2) {
+      entry->bie_order = prev->bie_order +
+        (next->bie_order - prev->bie_order) / 2;
+      return;
+    }
+  } else if (next) {
+    if (next->bie_order > idx->bi_step) {
+      entry->bie_order = next->bie_order - idx->bi_step;
+      return;
+    }
+  } else if (prev) {
+    if (ULONG_MAX - prev->bie_order > idx->bi_step) {
+      entry->bie_order = prev->bie_order + idx->bi_step;
+      return;
+    }
+  }
+
+  /* No room left: spread the whole list over the middle of the range,
+   * leaving as much space again at either end.
+   */
+  idx->bi_step = (ULONG_MAX / 2) / (idx->bi_count + 1);
+  rank = ULONG_MAX / 4;
+  for (entry = idx->bi_first; entry; entry = entry->bie_after) {
+    entry->bie_order = rank;
+    rank += idx->bi_step;
+  }
+}
+
+/** Add a ban to an index.
+ * @param[in] idx Index to add to.
+ * @param[in] entry Index linkage embedded in the ban.
+ * @param[in] ban The ban itself, handed back by banindex_find().
+ * @param[in] after Entry of the ban this one follows in list order,
+ * or NULL if it was put at the head of the list.
+ * @param[in] ipnum Network of an IP mask, or NULL for a host mask.
+ * @param[in] bits Prefix length of an IP mask.
+ * @param[in] host Host mask, or NULL if the ban has none.
+ */
+void
+banindex_add(struct BanIndex *idx, struct BanIndexEntry *entry, void *ban,
+             struct BanIndexEntry *after, struct in_addr *ipnum, int bits,
+             const char *host)
+{
+  struct BanIndexNode *node;
+  const char *key;
+  unsigned int prefix;
+
+  entry->bie_ban = ban;
+
+  entry->bie_before = after;
+  entry->bie_after = after ? after->bie_after : idx->bi_first;
+  if (entry->bie_after)
+    entry->bie_after->bie_before = entry;
+  else
+    idx->bi_last = entry;
+  if (after)
+    after->bie_after = entry;
+  else
+    idx->bi_first = entry;
+  idx->bi_count++;
+  order_assign(idx, entry);
+
+  if (ipnum) {
+    prefix = ntohl(ipnum->s_addr);
+    /* Host bits set or a silly length can never match; let the caller's
+     * check say so.
+     */
+    if (bits >= 0 && bits <= 32 && !(prefix & ~BI_MASK(bits))) {
+      node_link(radix_get(idx, prefix, bits), entry);
+      entry->bie_where = BI_IP;
+      return;
+    }
+  } else if (host && (key = host_key(host))) {
+    node = trie_get(idx, key);
+    node->bin_refs++;
+    node_link(node, entry);
+    entry->bie_where = BI_HOST;
+    return;
+  }
+
+  entry->bie_node = 0;
+  entry->bie_next = idx->bi_residual;
+  entry->bie_prev_p = &idx->bi_residual;
+  if (idx->bi_residual)
+    idx->bi_residual->bie_prev_p = &entry->bie_next;
+  idx->bi_residual = entry;
+  entry->bie_where = BI_RESIDUAL;
+}
+
+/** Remove a ban from an index.
+ * @param[in] idx Index to remove from.
+ * @param[in] entry Index linkage embedded in the ban.
+ */
+void
+banindex_del(struct BanIndex *idx, struct BanIndexEntry *entry)
+{
+  if (entry->bie_where == BI_NONE)
+    return;
+
+  *entry->bie_prev_p = entry->bie_next;
+  if (entry->bie_next)
+    entry->bie_next->bie_prev_p = entry->bie_prev_p;
+
+  if (entry->bie_before)
+    entry->bie_before->bie_after = entry->bie_after;
+  else
+    idx->bi_first = entry->bie_after;
+  if (entry->bie_after)
+    entry->bie_after->bie_before = entry->bie_before;
+  else
+    idx->bi_last = entry->bie_before;
+  idx->bi_count--;
+
+  if (entry->bie_where == BI_IP)
+    radix_prune(idx, entry->bie_node);
+  else if (entry->bie_where == BI_HOST)
+    trie_release(idx, entry->bie_node);
+  entry->bie_where = BI_NONE;
+}
+
+/** Remove every ban from an index and free its nodes.
+ * The index is left empty and ready for reuse.
+ * @param[in] idx Index to clear.
+ */
+void
+banindex_clear(struct BanIndex *idx)
+{
+  while (idx->bi_first)
+    banindex_del(idx, idx->bi_first);
+  if (idx->bi_root)
+    MyFree(idx->bi_root);
+  if (idx->bi_hosts)
+    MyFree(idx->bi_hosts);
+  memset(idx, 0, sizeof(*idx));
+}
+
+/** Check the entries filed at one node against the best match so far.
+ * @param[in] entry First entry to check.
+ * @param[in,out] best Earliest matching entry found so far.
+ * @param[in] check Caller's check function.
+ * @param[in] arg Argument for \a check.
+ */
+static void
+check_entries(struct BanIndexEntry *entry, struct BanIndexEntry **best,
+              BanIndexCheck check, void *arg)
+{
+  struct BanIndexEntry *next;
+
+  for (; entry; entry = next) {
+    next = entry->bie_next; /* check() may free entry */
+    if (*best && entry->bie_order > (*best)->bie_order)
+      continue; /* would not have been reached in the list */
+    if (check(entry->bie_ban, arg))
+      *best = entry;
+  }
+}
+
+/** Find the first ban in list order that applies to a client.
+ * @param[in] idx Index to search.
+ * @param[in] ip Client's IP address.
+ * @param[in] host Client's hostname, or NULL to skip host masks.
+ * @param[in] check Function deciding whether a candidate applies.
+ * @param[in] arg Argument for \a check.
+ * @return The matching ban, or NULL if none applies.
+ */
+void *
+banindex_find(struct BanIndex *idx, struct in_addr ip, const char *host,
+              BanIndexCheck check, void *arg)
+{
+  return banindex_find_names(idx, ip, &host, 1, check, arg);
+}
+
+/** Find the first ban in list order that applies to a client, looking
+ * up several names in the suffix trie.
+ * This is for indexes whose masks are matched against more than one
+ * string (hostname, real name, ...), each filed by host_key().  A ban
+ * turns up as a candidate when its key is a suffix of any of the
+ * names; \a check must still decide which name it is matched against.
+ * As two names may share a suffix, a candidate can be checked more than
+ * once, so \a check must not free bans here.
+ * @param[in] idx Index to search.
+ * @param[in] ip Client's IP address.
+ * @param[in] names Strings to look up; NULL elements are skipped.
+ * @param[in] count Number of elements in \a names.
+ * @param[in] check Function deciding whether a candidate applies.
+ * @param[in] arg Argument for \a check.
+ * @return The matching ban, or NULL if none applies.
+ */
+void *
+banindex_find_names(struct BanIndex *idx, struct in_addr ip,
+                    const char *const *names, int count,
+                    BanIndexCheck check, void *arg)
+{
+  struct BanIndexEntry *best = 0;
+  struct BanIndexNode *node, *next;
+  const char *ch, *host;
+  unsigned int addr = ntohl(ip.s_addr), hash;
+  int ii;
+
+  /* Every prefix of the address, shortest first */
+  for (node = idx->bi_root; node; node = next) {
+    if ((addr & BI_MASK(node->bin_bits)) != node->bin_prefix)
+      break;
+    /* pick the way down before check() can prune this node */
+    next = node->bin_bits < 32 ? node->bin_child[BI_BIT(addr, node->bin_bits)]
+                               : 0;
+    check_entries(node->bin_entries, &best, check, arg);
+  }
+
+  /* Every label-aligned suffix of each name, shortest first */
+  for (ii = 0; ii < count && idx->bi_hcount; ii++) {
+    if (!(host = names[ii]))
+      continue;
+    hash = 0;
+    for (ch = host + strlen(host); ; ) {
+      if (ch == host || ch[-1] == '.') {
+        if (!(node = trie_find(idx, ch, hash)))
+          break;
+        check_entries(node->bin_entries, &best, check, arg);
+      }
+      if (ch == host)
+        break;
+      hash = suffix_hash_step(hash, *--ch);
+    }
+  }
+
+  check_entries(idx->bi_residual, &best, check, arg);
+
+  return best ? best->bie_ban : 0;
+}
+
+/** Count the memory used by an index's own structures.
+ * @param[in] idx Index to count.
+ * @return Number of bytes used by nodes and hash table.
+ */
+size_t
+banindex_memory_count(struct BanIndex *idx)
+{
+  struct BanIndexNode *node, *next;
+  size_t size = 0;
+  unsigned int ii;
+
+  /* walk the radix tree without recursion, via the parent links */
+  for (node = idx->bi_root; node; node = next) {
+    size += sizeof(*node);
+    if (node->bin_child[0])
+      next = node->bin_child[0];
+    else if (node->bin_child[1])
+      next = node->bin_child[1];
+    else {
+      for (next = 0; node->bin_parent; node = node->bin_parent)
+        if (node->bin_parent->bin_child[0] == node
+            && (next = node->bin_parent->bin_child[1]))
+          break;
+    }
+  }
+
+  if (idx->bi_hosts) {
+    size += (idx->bi_hmask + 1) * sizeof(*idx->bi_hosts);
+    for (ii = 0; ii <= idx->bi_hmask; ii++)
+      for (node = idx->bi_hosts[ii]; node; node = node->bin_hnext)
+        size += sizeof(*node) + strlen(node->bin_suffix);
+  }
+  return size;
+}
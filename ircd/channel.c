@@ -22,6 +22,7 @@
 #include "config.h"
 
 #include "channel.h"
+#include "banindex.h"
 #include "client.h"
 #include "hash.h"
 #include "ircd.h"
@@ -31,6 +32,7 @@
 #include "ircd_features.h"
 #include "ircd_log.h"
 #include "ircd_reply.h"
+#include "ircd_slab.h"
 #include "ircd_snprintf.h"
 #include "ircd_string.h"
 #include "list.h"
@@ -59,10 +61,12 @@
 
 struct Channel* GlobalChannelList = 0;
 
-static unsigned int membershipAllocCount;
-static struct Membership* membershipFreeList;
+/** Slab pool for Membership structures. */
+static struct SlabType membershipSlab =
+  SLAB_TYPE_INIT("Membership", struct Membership);
 
 void del_invite(struct Client *, struct Channel *);
+static void ban_cache_free(struct BanCache** bcp);
 
 const char* const PartFmt1     = ":%s " MSG_PART " %s";
 const char* const PartFmt2     = ":%s " MSG_PART " %s :%s";
@@ -174,19 +178,6 @@ static char *make_nick_user_host(char *namebuf, const char *nick,
   return namebuf;
 }
 
-/*
- * Create a string of form "foo!bar@123.456.789.123" given foo, bar and the
- * IP-number as the parameters.  If NULL, they become "*".
- */
-#define NUI_BUFSIZE	(NICKLEN + USERLEN + 16 + 3)
-static char *make_nick_user_ip(char *ipbuf, char *nick, char *name,
-			       struct in_addr ip)
-{
-  ircd_snprintf(0, ipbuf, NUI_BUFSIZE, "%s!%s@%s", nick, name,
-		ircd_ntoa((const char*) &ip));
-  return ipbuf;
-}
-
 /*
  * Destroy the channel if it has no users and is not registered
  */
@@ -233,6 +224,8 @@ int destroy_unregistered_channel(struct Channel* chptr)
     MyFree(obtmp->value.except.who);
     free_link(obtmp);
   }
+  ban_cache_free(&chptr->bancache);
+  ban_cache_free(&chptr->exceptcache);
   if (chptr->prev)
     chptr->prev->next = chptr->next;
   else
@@ -302,6 +295,8 @@ int sub1_from_channel(struct Channel* chptr)
     MyFree(obtmp->value.except.who);
     free_link(obtmp);
   }
+  ban_cache_free(&chptr->bancache);
+  ban_cache_free(&chptr->exceptcache);
   if (chptr->prev)
     chptr->prev->next = chptr->next;
   else
@@ -415,6 +410,7 @@ int add_exceptid(struct Client *cptr, struct Channel *chptr, char *exceptid,
     /*
      * Erase except-valid-bit
      */
+    ban_cache_free(&chptr->exceptcache);
     for (member = chptr->members; member; member = member->next_member)
       ClearExceptValid(member);     /* `except' == channel member ! */
   }
@@ -540,6 +536,7 @@ int add_banid(struct Client *cptr, struct Channel *chptr, char *banid,
     /*
      * Erase ban-valid-bit
      */
+    ban_cache_free(&chptr->bancache);
     for (member = chptr->members; member; member = member->next_member)
       ClearBanValid(member);     /* `ban' == channel member ! */
   }
@@ -592,223 +589,367 @@ struct Membership* find_channel_member(struct Client* cptr, struct Channel* chpt
   return (member && !IsZombie(member)) ? member : 0;
 }
 
-/*
- * is_excepted - a non-zero value if except else 0.
+/** Fewest entries for which a ban or except list gets an index; shorter
+ * lists are simply walked.
  */
-int is_excepted(struct Client *cptr, struct Channel *chptr,
-                struct Membership* member, int shared)
+#define BAN_CACHE_MIN 8
+
+/** One entry of a compiled ban or except list. */
+struct BanCacheEntry {
+  struct BanIndexEntry bce_index;  /**< Linkage in the list's index. */
+  struct SLink*        bce_link;   /**< The ban or except itself. */
+  char*                bce_mask;   /**< Its mask. */
+  char*                bce_cmask;  /**< matchcomp() form of the mask, or
+                                    * NULL if the mask has escapes. */
+  int                  bce_minlen; /**< Shortest string bce_cmask matches. */
+};
+
+/** Compiled form of a channel's ban or except list.
+ * It is built the first time the list is checked after a change and
+ * thrown away by the next change.  Every mask is compiled for
+ * matchexec(); lists of #BAN_CACHE_MIN entries or more also get a
+ * BanIndex with CIDR masks filed by network, other masks by the
+ * literal labels that end their host part and extended bans on the
+ * residual list, so that a check only tries the entries that could
+ * apply.
+ */
+struct BanCache {
+  struct BanIndex      bc_index;    /**< Index over the entries. */
+  size_t               bc_size;     /**< Bytes allocated for this block. */
+  unsigned int         bc_count;    /**< Number of entries. */
+  struct BanCacheEntry bc_entry[1]; /**< Entries in list order, followed
+                                     * by the compiled masks. */
+};
+
+/** What ban_applies() and except_applies() check an entry against. */
+struct BanCheck {
+  struct Client*      bk_cptr;   /**< Client being checked. */
+  struct BanIdentity* bk_bid;    /**< Its masks, from user_ban_identity(). */
+  in_addr_t           bk_addr;   /**< Its IP address. */
+  int                 bk_shared; /**< Non-zero inside a shared ban check. */
+};
+
+/** Compile a ban or except list.
+ * @param[in] list Bans or excepts to compile.
+ * @param[in] except Non-zero if \a list holds excepts.
+ * @return Newly allocated compiled list.
+ */
+static struct BanCache* ban_cache_build(struct SLink* list, int except)
 {
-  struct SLink* tmpe;
-  struct Channel *tchptr;
-  char          tmphoste[HOSTLEN + 1];
-  char          nu_hoste[NUH_BUFSIZE];
-  char          nu_accthoste[NUH_BUFSIZE];
-  char          nu_dnsblhoste[NUH_BUFSIZE];
-  char          nu_realhoste[NUH_BUFSIZE];
-  char          nu_fakehoste[NUH_BUFSIZE];
-  char          nu_ipe[NUI_BUFSIZE];
-  char*         se;
-  char*         seb;
-  char*         sae = NULL;
-  char*         she = NULL;
-  char*         sfe = NULL;
-  char*         sde = NULL;
-  char*         ip_se = NULL;
-  in_addr_t     cli_addr = 0;
+  struct BanCache*      bc;
+  struct BanCacheEntry* bce;
+  struct BanIndexEntry* prev = 0;
+  struct SLink*         lp;
+  struct in_addr        addr;
+  unsigned int          count = 0;
+  size_t                len = 0;
+  char*                 cmask;
+  char*                 host;
+  char*                 cidr;
+  int                   charset;
+
+  for (lp = list; lp; lp = lp->next) {
+    count++;
+    len += strlen(except ? lp->value.except.exceptstr :
+                  lp->value.ban.banstr) + 1;
+  }
 
-  if (!IsUser(cptr))
-    return 0;
+  len += sizeof(struct BanCache) + count * sizeof(struct BanCacheEntry);
+  bc = (struct BanCache*) MyMalloc(len);
+  memset(&bc->bc_index, 0, sizeof(bc->bc_index));
+  bc->bc_size = len;
+  bc->bc_count = count;
+  cmask = (char*) (bc->bc_entry + count);
+
+  for (bce = bc->bc_entry, lp = list; lp; lp = lp->next, bce++) {
+    bce->bce_link = lp;
+    bce->bce_mask = except ? lp->value.except.exceptstr : lp->value.ban.banstr;
+    if (strchr(bce->bce_mask, '\\'))
+      bce->bce_cmask = 0; /* matchcomp() reads escapes differently */
+    else {
+      bce->bce_cmask = cmask;
+      cmask += matchcomp(cmask, &bce->bce_minlen, &charset, bce->bce_mask) + 1;
+    }
 
-  if (member && IsExceptValid(member))
-    return IsExcepted(member);
+    if (count < BAN_CACHE_MIN)
+      continue;
+    host = strrchr(bce->bce_mask, '@');
+    if ((except ? lp->value.except.extflag : lp->value.ban.extflag) || !host)
+      banindex_add(&bc->bc_index, &bce->bce_index, bce, prev, 0, 0, 0);
+    else if ((lp->flags & (except ? CHFL_EXCEPT_IPMASK : CHFL_BAN_IPMASK)) &&
+             (cidr = strchr(host + 1, '/'))) {
+      *cidr = '\0';
+      addr.s_addr = inet_addr(host + 1);
+      *cidr = '/';
+      banindex_add(&bc->bc_index, &bce->bce_index, bce, prev, &addr,
+                   atoi(cidr + 1), 0);
+    } else
+      banindex_add(&bc->bc_index, &bce->bce_index, bce, prev, 0, 0, host + 1);
+    prev = &bce->bce_index;
+  }
 
-  /* This is horrible code.  s is always set to the apparent host */
-  /* If the user is sethosted, sr is set to the real host */
-  /* If the user is fakehosted, sf is set to the real host */
-  /* If the user is authed and +x (and not +h), then sa is set to the real host */
-  /* If the user is authed and -x (or +h), then sa is set to the "account" host */
+  return bc;
+}
 
-  se = make_nick_user_host(nu_hoste, cli_name(cptr), (cli_user(cptr))->realusername,
-                          (cli_user(cptr))->realhost);
+/** Throw away a compiled ban or except list.
+ * @param[in,out] bcp Compiled list to free; cleared on return.
+ */
+static void ban_cache_free(struct BanCache** bcp)
+{
+  if (!*bcp)
+    return;
+  banindex_clear(&(*bcp)->bc_index);
+  MyFree(*bcp);
+  *bcp = 0;
+}
 
-  seb = make_nick_user_host(nu_hoste, cli_name(cptr), (cli_user(cptr))->realusername,
-                          (cli_user(cptr))->host);
+/** Count the memory used by a compiled ban or except list.
+ * @param[in] bc Compiled list, or NULL.
+ * @return Bytes used by \a bc and its index.
+ */
+size_t ban_cache_memory(struct BanCache* bc)
+{
+  return bc ? bc->bc_size + banindex_memory_count(&bc->bc_index) : 0;
+}
 
-  if (HasSetHost(cptr))
-    she = make_nick_user_host(nu_realhoste, cli_name(cptr),
-                             cli_user(cptr)->realusername,
-                             cli_user(cptr)->realhost);
+/** Match a string against an entry's mask.
+ * @param[in] bce Entry to match.
+ * @param[in] str String to test.
+ * @return Zero if \a str matches, as for match().
+ */
+static int ban_cache_match(const struct BanCacheEntry* bce, const char* str)
+{
+  if (bce->bce_cmask)
+    return matchexec(str, bce->bce_cmask, bce->bce_minlen);
+  return match(bce->bce_mask, str);
+}
 
-  if (HasFakeHost(cptr))
-    sfe = make_nick_user_host(nu_fakehoste, cli_name(cptr),
-                             cli_user(cptr)->realusername,
-                             cli_user(cptr)->fakehost);
-
-  if (feature_int(FEAT_HOST_HIDING_STYLE) == 1) {
-    if (IsAccount(cptr)) {
-       if (HasHiddenHost(cptr) && !HasSetHost(cptr))
-          sae = make_nick_user_host(nu_accthoste, cli_name(cptr),
-                                  cli_user(cptr)->realusername,
-                                  cli_user(cptr)->realhost);
-       else {
-          make_hidden_hostmask(tmphoste, cptr);
-          sae = make_nick_user_host(nu_accthoste, cli_name(cptr),
-                                   cli_user(cptr)->realusername,
-                                   tmphoste);
-       }
-    }
-  } else {
-     if (IsHiddenHost(cptr) && !HasSetHost(cptr))
-       sae = make_nick_user_host(nu_accthoste, cli_name(cptr),
-                               cli_user(cptr)->realusername,
-                               cli_user(cptr)->realhost);
-     else {
-       ircd_snprintf(0, tmphoste, HOSTLEN, "%s", cli_user(cptr)->virthost);
-       sae = make_nick_user_host(nu_accthoste, cli_name(cptr),
-                                cli_user(cptr)->realusername,
-                                tmphoste);
-     }
-  }
+static int ban_applies(void* ban, void* arg);
+static int except_applies(void* ban, void* arg);
+static int is_banned(struct Client *cptr, struct Channel *chptr,
+                     struct Membership* member, int shared);
+
+/** Check whether any entry of a ban or except list applies to a client.
+ * @param[in] cptr Client to check.
+ * @param[in,out] bcp Compiled form of \a list, built if need be.
+ * @param[in] list Ban or except list.
+ * @param[in] except Non-zero if \a list holds excepts.
+ * @param[in] shared Non-zero inside a shared ban or except check.
+ * @return Non-zero if an entry applies.
+ */
+static int ban_cache_check(struct Client* cptr, struct BanCache** bcp,
+                           struct SLink* list, int except, int shared)
+{
+  BanIndexCheck    check = except ? except_applies : ban_applies;
+  struct BanCache* bc;
+  struct BanCheck  bk;
+  struct in_addr   ip;
+  const char*      masks[5];
+  const char*      names[5];
+  const char*      host;
+  unsigned int     ii;
+  int              count = 0;
+  int              walk;
+
+  if (!list)
+    return 0;
+  if (!(bc = *bcp))
+    bc = *bcp = ban_cache_build(list, except);
 
-  for (tmpe = chptr->exceptlist; tmpe; tmpe = tmpe->next) {
-    if ((tmpe->flags & CHFL_EXCEPT_IPMASK)) {
-      char* ipe_start;
-      char* cidre_start;
-      
-      if (!ip_se) {
-        ip_se = make_nick_user_ip(nu_ipe, cli_name(cptr),
-                                 (cli_user(cptr))->realusername, cli_ip(cptr));
-        if ((ipe_start = strrchr(ip_se, '@')))
-          cli_addr = inet_addr(ipe_start + 1);
-      }
-      if (match(tmpe->value.except.exceptstr, ip_se) == 0)
-        break;
-      if ((ipe_start = strrchr(tmpe->value.except.exceptstr, '@')) && (cidre_start = strchr(ipe_start + 1, '/'))) {
-        int bitse = atoi(cidre_start + 1);
-        char* pe = strchr(ip_se, '@');
-        
-        if (pe) {
-          *pe = *ipe_start = 0;
-          if (match(tmpe->value.except.exceptstr, ip_se) == 0) {
-            if ((bitse > 0) && (bitse < 33)) {
-              in_addr_t except_addr;
-              *cidre_start = 0;
-              except_addr = inet_addr(ipe_start + 1);
-              *cidre_start = '/';
-              if ((NETMASK(bitse) & cli_addr) == except_addr) {
-                *pe = *ipe_start = '@';
-                break;
-              }
-            }
-          }
-          *pe = *ipe_start = '@';
-        }
-      }
-    }
+  bk.bk_cptr = cptr;
+  bk.bk_bid = user_ban_identity(cptr);
+  bk.bk_addr = cli_ip(cptr).s_addr;
+  bk.bk_shared = shared;
 
-    if (IsDNSBLMarked(cptr)) {
-      struct SLink* lp;
-      char tmpdhoste[BUFSIZE + 1];
-      int dnsble = 0;
+  /* DNSBL and kill marks make up extra hosts to match against; they
+   * are rare enough to just walk the list for.
+   */
+  walk = bc->bc_count < BAN_CACHE_MIN || IsDNSBLMarked(cptr) ||
+    !EmptyString(cli_killmark(cptr));
+
+  masks[0] = bk.bk_bid->bid_host;
+  masks[1] = bk.bk_bid->bid_sethost;
+  masks[2] = bk.bk_bid->bid_fakehost;
+  masks[3] = bk.bk_bid->bid_accthost;
+  masks[4] = bk.bk_bid->bid_ip;
+  for (ii = 0; !walk && ii < 5; ii++) {
+    if (!*masks[ii])
+      continue;
+    host = strrchr(masks[ii], '@');
+    host = host ? host + 1 : masks[ii];
+    if (strchr(host, '/'))
+      walk = 1; /* a CIDR mask could match it as text */
+    names[count++] = host;
+  }
 
-      for (lp = cli_sdnsbls(cptr); lp; lp = lp->next) {
-        ircd_snprintf(0, tmpdhoste, BUFSIZE, "%s.%s", lp->value.cp, cli_user(cptr)->realhost);
-        sde = make_nick_user_host(nu_dnsblhoste, cli_name(cptr),
-                                  cli_user(cptr)->realusername,
-                                  tmpdhoste);
+  if (walk) {
+    for (ii = 0; ii < bc->bc_count; ii++)
+      if (check(&bc->bc_entry[ii], &bk))
+        return 1;
+    return 0;
+  }
 
-        if (sde && match(tmpe->value.except.exceptstr, sde) == 0) {
-          dnsble = 1;
-          break;
+  ip.s_addr = bk.bk_addr;
+  return 0 != banindex_find_names(&bc->bc_index, ip, names, count, check, &bk);
+}
+
+/** Decide whether one except applies to a client.
+ * This is a BanIndexCheck; it temporarily cuts the masks it looks at
+ * but leaves everything as it found it.
+ * @param[in] ban Entry of the compiled except list.
+ * @param[in] arg The BanCheck describing the client.
+ * @return Non-zero if the except applies.
+ */
+static int except_applies(void* ban, void* arg)
+{
+  struct BanCacheEntry* bce = ban;
+  struct BanCheck*      bk = arg;
+  struct SLink*         tmpe = bce->bce_link;
+  struct Client*        cptr = bk->bk_cptr;
+  struct BanIdentity*   bid = bk->bk_bid;
+  struct Channel*       tchptr;
+  char                  nu_dnsblhoste[NUH_BUFSIZE];
+  char*                 sde = NULL;
+
+  /* This is horrible code.  bid_host is always the apparent host */
+  /* If the user is sethosted, bid_sethost is the real host */
+  /* If the user is fakehosted, bid_fakehost is the real host */
+  /* If the user is authed and +x (and not +h), then bid_accthost is the real host */
+  /* If the user is authed and -x (or +h), then bid_accthost is the "account" host */
+
+  if ((tmpe->flags & CHFL_EXCEPT_IPMASK)) {
+    char* ipe_start;
+    char* cidre_start;
+
+    if (ban_cache_match(bce, bid->bid_ip) == 0)
+      return 1;
+    if ((ipe_start = strrchr(tmpe->value.except.exceptstr, '@')) && (cidre_start = strchr(ipe_start + 1, '/'))) {
+      int bitse = atoi(cidre_start + 1);
+      char* pe = strchr(bid->bid_ip, '@');
+
+      if (pe) {
+        *pe = *ipe_start = 0;
+        if (match(tmpe->value.except.exceptstr, bid->bid_ip) == 0) {
+          if ((bitse > 0) && (bitse < 33)) {
+            in_addr_t except_addr;
+            *cidre_start = 0;
+            except_addr = inet_addr(ipe_start + 1);
+            *cidre_start = '/';
+            if ((NETMASK(bitse) & bk->bk_addr) == except_addr) {
+              *pe = *ipe_start = '@';
+              return 1;
+            }
+          }
         }
+        *pe = *ipe_start = '@';
       }
-
-      if (dnsble == 1)
-        break;
     }
+  }
 
-    if (!EmptyString(cli_killmark(cptr))) {
-      char tmpdhoste[BUFSIZE + 1];
+  if (IsDNSBLMarked(cptr)) {
+    struct SLink* lp;
+    char tmpdhoste[BUFSIZE + 1];
 
-      ircd_snprintf(0, tmpdhoste, BUFSIZE, "%s.%s", cli_killmark(cptr), cli_user(cptr)->realhost);
+    for (lp = cli_sdnsbls(cptr); lp; lp = lp->next) {
+      ircd_snprintf(0, tmpdhoste, BUFSIZE, "%s.%s", lp->value.cp, cli_user(cptr)->realhost);
       sde = make_nick_user_host(nu_dnsblhoste, cli_name(cptr),
                                 cli_user(cptr)->realusername,
                                 tmpdhoste);
 
-      if (sde && match(tmpe->value.except.exceptstr, sde) == 0)
-        break;
+      if (sde && ban_cache_match(bce, sde) == 0)
+        return 1;
     }
+  }
 
-    if (tmpe->value.except.extflag & EXTEXCEPT_CHAN) {
-      struct Membership *lp;
-      struct Channel *chptr2;
-      int cmatch = 0;
+  if (!EmptyString(cli_killmark(cptr))) {
+    char tmpdhoste[BUFSIZE + 1];
 
-      for (lp = cptr->cli_user->channel; lp; lp = lp->next_channel) {
-        chptr2 = lp->channel;
-        cmatch = 0;
+    ircd_snprintf(0, tmpdhoste, BUFSIZE, "%s.%s", cli_killmark(cptr), cli_user(cptr)->realhost);
+    sde = make_nick_user_host(nu_dnsblhoste, cli_name(cptr),
+                              cli_user(cptr)->realusername,
+                              tmpdhoste);
 
-        Debug((DEBUG_DEBUG, "ch: %s", chptr2->chname));
+    if (sde && ban_cache_match(bce, sde) == 0)
+      return 1;
+  }
 
-        if (*tmpe->value.except.extstr == '#') {
-          if (!mmatch(tmpe->value.except.extstr, chptr2->chname)) {
-            cmatch = 1;
-            break;
-          }
-        } else {
-          if (!mmatch(tmpe->value.except.extstr+1, chptr2->chname)) {
-            if ((*tmpe->value.except.extstr == '@') && IsChanOp(lp)) {
-              cmatch = 1;
-              break;
-            } else if ((*tmpe->value.except.extstr == '%') && IsHalfOp(lp)) {
-              cmatch = 1;
-              break;
-            } else if ((*tmpe->value.except.extstr == '+') && HasVoice(lp)) {
-              cmatch = 1;
-              break;
-            }
-          }
+  if (tmpe->value.except.extflag & EXTEXCEPT_CHAN) {
+    struct Membership *lp;
+    struct Channel *chptr2;
+
+    for (lp = cptr->cli_user->channel; lp; lp = lp->next_channel) {
+      chptr2 = lp->channel;
+
+      Debug((DEBUG_DEBUG, "ch: %s", chptr2->chname));
+
+      if (*tmpe->value.except.extstr == '#') {
+        if (!mmatch(tmpe->value.except.extstr, chptr2->chname))
+          return 1;
+      } else {
+        if (!mmatch(tmpe->value.except.extstr+1, chptr2->chname)) {
+          if ((*tmpe->value.except.extstr == '@') && IsChanOp(lp))
+            return 1;
+          else if ((*tmpe->value.except.extstr == '%') && IsHalfOp(lp))
+            return 1;
+          else if ((*tmpe->value.except.extstr == '+') && HasVoice(lp))
+            return 1;
         }
       }
-      if (cmatch)
-        break;
     }
+  }
 
 
-    if ((tmpe->value.ban.extflag & EXTEXCEPT_ACCOUNT) && cli_user(cptr)->account) {
-      if (!match(tmpe->value.ban.extstr, cli_user(cptr)->account))
-        break;
-    }
+  if ((tmpe->value.ban.extflag & EXTEXCEPT_ACCOUNT) && cli_user(cptr)->account) {
+    if (!match(tmpe->value.ban.extstr, cli_user(cptr)->account))
+      return 1;
+  }
 
-    if (tmpe->value.except.extflag & EXTEXCEPT_REAL) {
-      if (!mmatch(decodespace(tmpe->value.except.extstr), cli_info(cptr)))
-        break;
-    }
+  if (tmpe->value.except.extflag & EXTEXCEPT_REAL) {
+    if (!mmatch(decodespace(tmpe->value.except.extstr), cli_info(cptr)))
+      return 1;
+  }
 
-    if ((tmpe->value.except.extflag & EXTEXCEPT_SHARE)) {
-      if (shared == 0) {
-        if ((tchptr = FindChannel(tmpe->value.except.extstr))) {
-          if (is_excepted(cptr, tchptr, NULL, 1))
-            break;
-        }
+  if ((tmpe->value.except.extflag & EXTEXCEPT_SHARE)) {
+    if (bk->bk_shared == 0) {
+      if ((tchptr = FindChannel(tmpe->value.except.extstr))) {
+        if (is_excepted(cptr, tchptr, NULL, 1))
+          return 1;
       }
     }
-
-    if (match(tmpe->value.except.exceptstr, se) == 0)
-      break;
-    else if (seb && match(tmpe->value.except.exceptstr, seb) == 0)
-      break;
-    else if (she && match(tmpe->value.except.exceptstr, she) == 0)
-      break;
-    else if (sfe && match(tmpe->value.except.exceptstr, sfe) == 0)
-      break;
-    else if (sae && match(tmpe->value.except.exceptstr, sae) == 0)
-      break;
   }
 
+  if (ban_cache_match(bce, bid->bid_host) == 0)
+    return 1;
+  else if (*bid->bid_sethost && ban_cache_match(bce, bid->bid_sethost) == 0)
+    return 1;
+  else if (*bid->bid_fakehost && ban_cache_match(bce, bid->bid_fakehost) == 0)
+    return 1;
+  else if (*bid->bid_accthost && ban_cache_match(bce, bid->bid_accthost) == 0)
+    return 1;
+
+  return 0;
+}
+
+/*
+ * is_excepted - a non-zero value if except else 0.
+ */
+int is_excepted(struct Client *cptr, struct Channel *chptr,
+                struct Membership* member, int shared)
+{
+  int excepted;
+
+  if (!IsUser(cptr))
+    return 0;
+
+  if (member && IsExceptValid(member))
+    return IsExcepted(member);
+
+  excepted = ban_cache_check(cptr, &chptr->exceptcache, chptr->exceptlist,
+                             1, shared);
+
   if (member) {
     SetExceptValid(member);
-    if (tmpe) {
+    if (excepted) {
       SetExcepted(member);
       return 1;
     }
@@ -818,7 +959,7 @@ int is_excepted(struct Client *cptr, struct Channel *chptr,
     }
   }
 
-  return (tmpe != NULL);
+  return excepted;
 }
 
 int ext_text_ban(struct Client* sptr, struct Channel* chptr, const char* text) {
@@ -871,15 +1012,9 @@ int ext_text_ban(struct Client* sptr, struct Channel* chptr, const char* text) {
 int is_ext_banned(struct Client *cptr, struct Channel *chptr,
                   struct Membership* member, int flags) {
   struct SLink* tmp;
-  char          tmphost[HOSTLEN + 1];
-  char          nu_host[NUH_BUFSIZE];
-  char          nu_accthost[NUH_BUFSIZE];
+  struct BanIdentity* bid;
   char          nu_dnsblhost[NUH_BUFSIZE];
-  char          nu_realhost[NUH_BUFSIZE];
-  char          nu_fakehost[NUH_BUFSIZE];
-  char          nu_ip[NUI_BUFSIZE];
   char*         s;
-  char*         sb;
   char*         sa = NULL;
   char*         sh = NULL;
   char*         sf = NULL;
@@ -890,48 +1025,14 @@ int is_ext_banned(struct Client *cptr, struct Channel *chptr,
   if (!IsUser(cptr))
     return 0;
 
-  /* eeeek */
-  s = make_nick_user_host(nu_host, cli_name(cptr), (cli_user(cptr))->realusername,
-			  (cli_user(cptr))->realhost);
-
-  sb = make_nick_user_host(nu_host, cli_name(cptr), (cli_user(cptr))->realusername,
-			  (cli_user(cptr))->host);
-
-  if (HasSetHost(cptr))
-    sh = make_nick_user_host(nu_realhost, cli_name(cptr),
-			     cli_user(cptr)->realusername,
-			     cli_user(cptr)->realhost);
-
-  if (HasFakeHost(cptr))
-    sf = make_nick_user_host(nu_fakehost, cli_name(cptr),
-			     cli_user(cptr)->realusername,
-			     cli_user(cptr)->fakehost);
-
-  if (feature_int(FEAT_HOST_HIDING_STYLE) == 1) {
-    if (IsAccount(cptr)) {
-       if (HasHiddenHost(cptr) && !HasSetHost(cptr))
-          sa = make_nick_user_host(nu_accthost, cli_name(cptr),
-                                  cli_user(cptr)->realusername,
-                                  cli_user(cptr)->realhost);
-       else {
-	  make_hidden_hostmask(tmphost, cptr);
-          sa = make_nick_user_host(nu_accthost, cli_name(cptr),
-                                   cli_user(cptr)->realusername,
-                                   tmphost);
-       }
-    }
-  } else {
-     if (IsHiddenHost(cptr) && !HasSetHost(cptr))
-       sa = make_nick_user_host(nu_accthost, cli_name(cptr),
-                               cli_user(cptr)->realusername,
-                               cli_user(cptr)->realhost);
-     else {
-       ircd_snprintf(0, tmphost, HOSTLEN, "%s", cli_user(cptr)->virthost);
-       sa = make_nick_user_host(nu_accthost, cli_name(cptr),
-                                cli_user(cptr)->realusername,
-                                tmphost);
-     }
-  }
+  bid = user_ban_identity(cptr);
+  s = bid->bid_host;
+  if (*bid->bid_sethost)
+    sh = bid->bid_sethost;
+  if (*bid->bid_fakehost)
+    sf = bid->bid_fakehost;
+  if (*bid->bid_accthost)
+    sa = bid->bid_accthost;
 
   for (tmp = chptr->banlist; tmp; tmp = tmp->next) {
     if (tmp->value.ban.extflag) {
@@ -941,8 +1042,7 @@ int is_ext_banned(struct Client *cptr, struct Channel *chptr,
           char* cidr_start;
 
           if (!ip_s) {
-            ip_s = make_nick_user_ip(nu_ip, cli_name(cptr),
-                                     (cli_user(cptr))->realusername, cli_ip(cptr));
+            ip_s = bid->bid_ip;
             if ((ip_start = strrchr(ip_s, '@')))
               cli_addr = inet_addr(ip_start + 1);
           }
@@ -1006,8 +1106,6 @@ int is_ext_banned(struct Client *cptr, struct Channel *chptr,
   
         if (match(tmp->value.ban.extstr, s) == 0)
           break;
-        else if (sb && match(tmp->value.ban.extstr, sb) == 0)
-          break;
         else if (sh && match(tmp->value.ban.extstr, sh) == 0)
           break;
         else if (sf && match(tmp->value.ban.extstr, sf) == 0)
@@ -1027,15 +1125,9 @@ int is_ext_banned(struct Client *cptr, struct Channel *chptr,
 int is_ext_excepted(struct Client *cptr, struct Channel *chptr,
                     struct Membership* member, int flags) {
   struct SLink* tmp;
-  char          tmphost[HOSTLEN + 1];
-  char          nu_host[NUH_BUFSIZE];
-  char          nu_accthost[NUH_BUFSIZE];
+  struct BanIdentity* bid;
   char          nu_dnsblhost[NUH_BUFSIZE];
-  char          nu_realhost[NUH_BUFSIZE];
-  char          nu_fakehost[NUH_BUFSIZE];
-  char          nu_ip[NUI_BUFSIZE];
   char*         s;
-  char*         sb;
   char*         sa = NULL;
   char*         sh = NULL;
   char*         sf = NULL;
@@ -1046,48 +1138,14 @@ int is_ext_excepted(struct Client *cptr, struct Channel *chptr,
   if (!IsUser(cptr))
     return 0;
 
-  /* eeeek */
-  s = make_nick_user_host(nu_host, cli_name(cptr), (cli_user(cptr))->realusername,
-			  (cli_user(cptr))->realhost);
-
-  sb = make_nick_user_host(nu_host, cli_name(cptr), (cli_user(cptr))->realusername,
-			  (cli_user(cptr))->host);
-
-  if (HasSetHost(cptr))
-    sh = make_nick_user_host(nu_realhost, cli_name(cptr),
-			     cli_user(cptr)->realusername,
-			     cli_user(cptr)->realhost);
-
-  if (HasFakeHost(cptr))
-    sf = make_nick_user_host(nu_fakehost, cli_name(cptr),
-			     cli_user(cptr)->realusername,
-			     cli_user(cptr)->fakehost);
-
-  if (feature_int(FEAT_HOST_HIDING_STYLE) == 1) {
-    if (IsAccount(cptr)) {
-       if (HasHiddenHost(cptr) && !HasSetHost(cptr))
-          sa = make_nick_user_host(nu_accthost, cli_name(cptr),
-                                  cli_user(cptr)->realusername,
-                                  cli_user(cptr)->realhost);
-       else {
-	  make_hidden_hostmask(tmphost, cptr);
-          sa = make_nick_user_host(nu_accthost, cli_name(cptr),
-                                   cli_user(cptr)->realusername,
-                                   tmphost);
-       }
-    }
-  } else {
-     if (IsHiddenHost(cptr) && !HasSetHost(cptr))
-       sa = make_nick_user_host(nu_accthost, cli_name(cptr),
-                               cli_user(cptr)->realusername,
-                               cli_user(cptr)->realhost);
-     else {
-       ircd_snprintf(0, tmphost, HOSTLEN, "%s", cli_user(cptr)->virthost);
-       sa = make_nick_user_host(nu_accthost, cli_name(cptr),
-                                cli_user(cptr)->realusername,
-                                tmphost);
-     }
-  }
+  bid = user_ban_identity(cptr);
+  s = bid->bid_host;
+  if (*bid->bid_sethost)
+    sh = bid->bid_sethost;
+  if (*bid->bid_fakehost)
+    sf = bid->bid_fakehost;
+  if (*bid->bid_accthost)
+    sa = bid->bid_accthost;
 
   for (tmp = chptr->exceptlist; tmp; tmp = tmp->next) {
     if (tmp->value.except.extflag) {
@@ -1097,8 +1155,7 @@ int is_ext_excepted(struct Client *cptr, struct Channel *chptr,
           char* cidr_start;
 
           if (!ip_s) {
-            ip_s = make_nick_user_ip(nu_ip, cli_name(cptr),
-                                     (cli_user(cptr))->realusername, cli_ip(cptr));
+            ip_s = bid->bid_ip;
             if ((ip_start = strrchr(ip_s, '@')))
               cli_addr = inet_addr(ip_start + 1);
           }
@@ -1162,8 +1219,6 @@ int is_ext_excepted(struct Client *cptr, struct Channel *chptr,
   
         if (match(tmp->value.except.extstr, s) == 0)
           break;
-        else if (sb && match(tmp->value.except.extstr, sb) == 0)
-          break;
         else if (sh && match(tmp->value.except.extstr, sh) == 0)
           break;
         else if (sf && match(tmp->value.except.extstr, sf) == 0)
@@ -1180,297 +1235,191 @@ int is_ext_excepted(struct Client *cptr, struct Channel *chptr,
     return 0;
 }
 
-/*
- * is_banned - a non-zero value if banned else 0.
+/** Decide whether one ban applies to a client.
+ * This is a BanIndexCheck; it temporarily cuts the masks it looks at
+ * but leaves everything as it found it.
+ * @param[in] ban Entry of the compiled ban list.
+ * @param[in] arg The BanCheck describing the client.
+ * @return Non-zero if the ban applies.
  */
-static int is_banned(struct Client *cptr, struct Channel *chptr,
-                     struct Membership* member, int shared)
+static int ban_applies(void* ban, void* arg)
 {
-  struct SLink* tmp;
-  struct Channel *tchptr;
-  char          tmphost[HOSTLEN + 1];
-  char          nu_host[NUH_BUFSIZE];
-  char          nu_accthost[NUH_BUFSIZE];
-  char          nu_dnsblhost[NUH_BUFSIZE];
-  char          nu_realhost[NUH_BUFSIZE];
-  char          nu_fakehost[NUH_BUFSIZE];
-  char          nu_ip[NUI_BUFSIZE];
-  char*         s;
-  char*         sb;
-  char*         sa = NULL;
-  char*         sh = NULL;
-  char*         sf = NULL;
-  char*         sd = NULL;
-  char*         ip_s = NULL;
-  in_addr_t     cli_addr = 0;
-  int           banned = 0;
-
-  if (!IsUser(cptr))
-    return 0;
-
-  if (member && IsBanValid(member))
-    return IsBanned(member);
-
-  /* This is horrible code.  s is always set to the apparent host */
-  /* If the user is sethosted, sh is set to the real host */
-  /* If the user is fakehosted, sf is set to the real host */
-  /* If the user is authed and +x (and not +h), then sa is set to the real host */
-  /* If the user is authed and -x (or +h), then sa is set to the "account" host */
-
-  s = make_nick_user_host(nu_host, cli_name(cptr), (cli_user(cptr))->realusername,
-			  (cli_user(cptr))->realhost);
-
-  sb = make_nick_user_host(nu_host, cli_name(cptr), (cli_user(cptr))->realusername,
-			  (cli_user(cptr))->host);
-
-  if (HasSetHost(cptr))
-    sh = make_nick_user_host(nu_realhost, cli_name(cptr),
-			     cli_user(cptr)->realusername,
-			     cli_user(cptr)->realhost);
-
-  if (HasFakeHost(cptr))
-    sf = make_nick_user_host(nu_fakehost, cli_name(cptr),
-			     cli_user(cptr)->realusername,
-			     cli_user(cptr)->fakehost);
-
-  if (feature_int(FEAT_HOST_HIDING_STYLE) == 1) {
-    if (IsAccount(cptr)) {
-       if (HasHiddenHost(cptr) && !HasSetHost(cptr))
-          sa = make_nick_user_host(nu_accthost, cli_name(cptr),
-                                  cli_user(cptr)->realusername,
-                                  cli_user(cptr)->realhost);
-       else {
-	  make_hidden_hostmask(tmphost, cptr);
-          sa = make_nick_user_host(nu_accthost, cli_name(cptr),
-                                   cli_user(cptr)->realusername,
-                                   tmphost);
-       }
-    }
-  } else {
-     if (IsHiddenHost(cptr) && !HasSetHost(cptr))
-       sa = make_nick_user_host(nu_accthost, cli_name(cptr),
-                               cli_user(cptr)->realusername,
-                               cli_user(cptr)->realhost);
-     else {
-       ircd_snprintf(0, tmphost, HOSTLEN, "%s", cli_user(cptr)->virthost);
-       sa = make_nick_user_host(nu_accthost, cli_name(cptr),
-                                cli_user(cptr)->realusername,
-                                tmphost);
-     }
-  }
-
-  for (tmp = chptr->banlist; tmp; tmp = tmp->next) {
-    if ((tmp->flags & CHFL_BAN_IPMASK)) {
-      char* ip_start;
-      char* cidr_start;
-      
-      if (!ip_s) {
-        ip_s = make_nick_user_ip(nu_ip, cli_name(cptr),
-				 (cli_user(cptr))->realusername, cli_ip(cptr));
-        if ((ip_start = strrchr(ip_s, '@')))
-          cli_addr = inet_addr(ip_start + 1);
-      }
-      if (match(tmp->value.ban.banstr, ip_s) == 0) {
-        banned = 1;
-        break;
-      }
-      if ((ip_start = strrchr(tmp->value.ban.banstr, '@')) && (cidr_start = strchr(ip_start + 1, '/'))) {
-        int bits = atoi(cidr_start + 1);
-        char* p = strchr(ip_s, '@');
-        
-        if (p) {
-          *p = *ip_start = 0;
-          if (match(tmp->value.ban.banstr, ip_s) == 0) {
-            if ((bits > 0) && (bits < 33)) {
-              in_addr_t ban_addr;
-              *cidr_start = 0;
-              ban_addr = inet_addr(ip_start + 1);
-              *cidr_start = '/';
-              if ((NETMASK(bits) & cli_addr) == ban_addr) {
-                *p = *ip_start = '@';
-                banned = 1;
-                break;
-              }
+  struct BanCacheEntry* bce = ban;
+  struct BanCheck*      bk = arg;
+  struct SLink*         tmp = bce->bce_link;
+  struct Client*        cptr = bk->bk_cptr;
+  struct BanIdentity*   bid = bk->bk_bid;
+  struct Channel*       tchptr;
+  char                  nu_dnsblhost[NUH_BUFSIZE];
+  char*                 sd = NULL;
+
+  /* This is horrible code.  bid_host is always the apparent host */
+  /* If the user is sethosted, bid_sethost is the real host */
+  /* If the user is fakehosted, bid_fakehost is the real host */
+  /* If the user is authed and +x (and not +h), then bid_accthost is the real host */
+  /* If the user is authed and -x (or +h), then bid_accthost is the "account" host */
+
+  if ((tmp->flags & CHFL_BAN_IPMASK)) {
+    char* ip_start;
+    char* cidr_start;
+
+    if (ban_cache_match(bce, bid->bid_ip) == 0)
+      return 1;
+    if ((ip_start = strrchr(tmp->value.ban.banstr, '@')) && (cidr_start = strchr(ip_start + 1, '/'))) {
+      int bits = atoi(cidr_start + 1);
+      char* p = strchr(bid->bid_ip, '@');
+
+      if (p) {
+        *p = *ip_start = 0;
+        if (match(tmp->value.ban.banstr, bid->bid_ip) == 0) {
+          if ((bits > 0) && (bits < 33)) {
+            in_addr_t ban_addr;
+            *cidr_start = 0;
+            ban_addr = inet_addr(ip_start + 1);
+            *cidr_start = '/';
+            if ((NETMASK(bits) & bk->bk_addr) == ban_addr) {
+              *p = *ip_start = '@';
+              return 1;
             }
           }
-          *p = *ip_start = '@';
         }
+        *p = *ip_start = '@';
       }
     }
+  }
 
-    if (IsDNSBLMarked(cptr)) {
-      struct SLink* lp;
-      char tmpdhostb[BUFSIZE + 1];
-      int dnsblb = 0;
-
-      for (lp = cli_sdnsbls(cptr); lp; lp = lp->next) {
-        ircd_snprintf(0, tmpdhostb, BUFSIZE, "%s.%s", lp->value.cp, cli_user(cptr)->realhost);
-        sd = make_nick_user_host(nu_dnsblhost, cli_name(cptr),
-                                  cli_user(cptr)->realusername,
-                                  tmpdhostb);
-
-        if (sd && match(tmp->value.ban.banstr, sd) == 0) {
-          dnsblb = 1;
-          break;
-        }
-      }
-
-      if (dnsblb == 1) {
-        banned = 1;
-        break;
-      }
-    }
-
-    if (!EmptyString(cli_killmark(cptr))) {
-      char tmpdhostb[BUFSIZE + 1];
+  if (IsDNSBLMarked(cptr)) {
+    struct SLink* lp;
+    char tmpdhostb[BUFSIZE + 1];
 
-      ircd_snprintf(0, tmpdhostb, BUFSIZE, "%s.%s", cli_killmark(cptr), cli_user(cptr)->realhost);
+    for (lp = cli_sdnsbls(cptr); lp; lp = lp->next) {
+      ircd_snprintf(0, tmpdhostb, BUFSIZE, "%s.%s", lp->value.cp, cli_user(cptr)->realhost);
       sd = make_nick_user_host(nu_dnsblhost, cli_name(cptr),
-                               cli_user(cptr)->realusername,
-                               tmpdhostb);
+                                cli_user(cptr)->realusername,
+                                tmpdhostb);
 
-      if (sd && match(tmp->value.ban.banstr, sd) == 0) {
-        banned = 1;
-        break;
-      }
+      if (sd && ban_cache_match(bce, sd) == 0)
+        return 1;
     }
+  }
 
-    if (tmp->value.ban.extflag & EXTBAN_CHAN) {
-      struct Membership *lp;
-      struct Channel *chptr2;
-      int cmatch = 0;
+  if (!EmptyString(cli_killmark(cptr))) {
+    char tmpdhostb[BUFSIZE + 1];
 
+    ircd_snprintf(0, tmpdhostb, BUFSIZE, "%s.%s", cli_killmark(cptr), cli_user(cptr)->realhost);
+    sd = make_nick_user_host(nu_dnsblhost, cli_name(cptr),
+                             cli_user(cptr)->realusername,
+                             tmpdhostb);
 
-      if (!(tmp->value.ban.extflag & EXTBAN_REVERSE)) {
-        for (lp = cptr->cli_user->channel; lp; lp = lp->next_channel) {
-          chptr2 = lp->channel;
-          cmatch = 0;
+    if (sd && ban_cache_match(bce, sd) == 0)
+      return 1;
+  }
 
-          if (*tmp->value.ban.extstr == '#') {
-            if (!mmatch(tmp->value.ban.extstr, chptr2->chname)) {
-              cmatch = 1;
-              break;
-            }
-          } else {
-            if (!mmatch(tmp->value.ban.extstr+1, chptr2->chname)) {
-              if ((*tmp->value.ban.extstr == '@') && IsChanOp(lp)) {
-                cmatch = 1;
-                break;
-              } else if ((*tmp->value.ban.extstr == '%') && IsHalfOp(lp)) {
-                cmatch = 1;
-                break;
-              } else if ((*tmp->value.ban.extstr == '+') && HasVoice(lp)) {
-                cmatch = 1;
-                break;
-              }
-            }
-          }
-        }
-        if (cmatch == 1)
-          banned = 1;
-      }
+  if (tmp->value.ban.extflag & EXTBAN_CHAN) {
+    struct Membership *lp;
+    struct Channel *chptr2;
+    int cmatch = 0;
 
-      if ((cmatch == 0) && (tmp->value.ban.extflag & EXTBAN_REVERSE)) {
-        for (lp = cptr->cli_user->channel; lp; lp = lp->next_channel) {
-          chptr2 = lp->channel;
-          cmatch = 0;
+    for (lp = cptr->cli_user->channel; lp; lp = lp->next_channel) {
+      chptr2 = lp->channel;
 
-          if (*tmp->value.ban.extstr == '#') {
-            if (!mmatch(tmp->value.ban.extstr, chptr2->chname)) {
-              cmatch = 1;
-              break;
-            }
-          } else {
-            if (!mmatch(tmp->value.ban.extstr+1, chptr2->chname)) {
-              if ((*tmp->value.ban.extstr == '@') && IsChanOp(lp)) {
-                cmatch = 1;
-                break;
-              } else if ((*tmp->value.ban.extstr == '%') && IsHalfOp(lp)) {
-                cmatch = 1;
-                break;
-              } else if ((*tmp->value.ban.extstr == '+') && HasVoice(lp)) {
-                cmatch = 1;
-                break;
-              }
-            }
+      if (*tmp->value.ban.extstr == '#') {
+        if (!mmatch(tmp->value.ban.extstr, chptr2->chname)) {
+          cmatch = 1;
+          break;
+        }
+      } else {
+        if (!mmatch(tmp->value.ban.extstr+1, chptr2->chname)) {
+          if ((*tmp->value.ban.extstr == '@') && IsChanOp(lp)) {
+            cmatch = 1;
+            break;
+          } else if ((*tmp->value.ban.extstr == '%') && IsHalfOp(lp)) {
+            cmatch = 1;
+            break;
+          } else if ((*tmp->value.ban.extstr == '+') && HasVoice(lp)) {
+            cmatch = 1;
+            break;
           }
         }
-
-        if (cmatch == 0)
-          banned = 1;
       }
+    }
 
-      if (banned == 1)
-        break;
+    if (tmp->value.ban.extflag & EXTBAN_REVERSE) {
+      if (!cmatch)
+        return 1;
+    } else {
+      if (cmatch)
+        return 1;
     }
+  }
 
-    if (tmp->value.ban.extflag & EXTBAN_REAL) {
-      int rmatch = 0;
+  if (tmp->value.ban.extflag & EXTBAN_REAL) {
+    int rmatch = 0;
 
-      if (!mmatch(decodespace(tmp->value.ban.extstr), cli_info(cptr)))
-        rmatch = 1;
+    if (!mmatch(decodespace(tmp->value.ban.extstr), cli_info(cptr)))
+      rmatch = 1;
 
-      if (tmp->value.ban.extflag & EXTBAN_REVERSE) {
-        if (!rmatch) {
-          banned = 1;
-          break;
-        }
-      } else {
-        if (rmatch) {
-          banned = 1;
-          break;
-        }
-      }
+    if (tmp->value.ban.extflag & EXTBAN_REVERSE) {
+      if (!rmatch)
+        return 1;
+    } else {
+      if (rmatch)
+        return 1;
     }
+  }
 
-    if ((tmp->value.ban.extflag & EXTBAN_ACCOUNT) && cli_user(cptr)->account) {
-      int amatch = 0;
+  if ((tmp->value.ban.extflag & EXTBAN_ACCOUNT) && cli_user(cptr)->account) {
+    int amatch = 0;
 
-      if (!match(tmp->value.ban.extstr, cli_user(cptr)->account))
-        amatch = 1;
+    if (!match(tmp->value.ban.extstr, cli_user(cptr)->account))
+      amatch = 1;
 
-      if (tmp->value.ban.extflag & EXTBAN_REVERSE) {
-        if (!amatch) {
-          banned = 1;
-          break;
-        }
-      } else {
-        if (amatch) {
-          banned = 1;
-          break;
-        }
-      }
+    if (tmp->value.ban.extflag & EXTBAN_REVERSE) {
+      if (!amatch)
+        return 1;
+    } else {
+      if (amatch)
+        return 1;
     }
+  }
 
-    if ((tmp->value.ban.extflag & EXTBAN_SHARE)) {
-      if (shared == 0) {
-        if ((tchptr = FindChannel(tmp->value.ban.extstr))) {
-          if (is_banned(cptr, tchptr, NULL, 1)) {
-            banned = 1;
-            break;
-          }
-        }
+  if ((tmp->value.ban.extflag & EXTBAN_SHARE)) {
+    if (bk->bk_shared == 0) {
+      if ((tchptr = FindChannel(tmp->value.ban.extstr))) {
+        if (is_banned(cptr, tchptr, NULL, 1))
+          return 1;
       }
     }
-
-    if (match(tmp->value.ban.banstr, s) == 0) {
-      banned = 1;
-      break;
-    } else if (sb && match(tmp->value.ban.banstr, sb) == 0) {
-      banned = 1;
-      break;
-    } else if (sh && match(tmp->value.ban.banstr, sh) == 0) {
-      banned = 1;
-      break;
-    } else if (sf && match(tmp->value.ban.banstr, sf) == 0) {
-      banned = 1;
-      break;
-    } else if (sa && match(tmp->value.ban.banstr, sa) == 0) {
-      banned = 1;
-      break;
-    }
   }
 
+  if (ban_cache_match(bce, bid->bid_host) == 0)
+    return 1;
+  else if (*bid->bid_sethost && ban_cache_match(bce, bid->bid_sethost) == 0)
+    return 1;
+  else if (*bid->bid_fakehost && ban_cache_match(bce, bid->bid_fakehost) == 0)
+    return 1;
+  else if (*bid->bid_accthost && ban_cache_match(bce, bid->bid_accthost) == 0)
+    return 1;
+
+  return 0;
+}
+
+/*
+ * is_banned - a non-zero value if banned else 0.
+ */
+static int is_banned(struct Client *cptr, struct Channel *chptr,
+                     struct Membership* member, int shared)
+{
+  int banned;
+
+  if (!IsUser(cptr))
+    return 0;
+
+  if (member && IsBanValid(member))
+    return IsBanned(member);
+
+  banned = ban_cache_check(cptr, &chptr->bancache, chptr->banlist, 0, shared);
+
   if (member) {
     SetBanValid(member);
     if (banned) {
@@ -1486,6 +1435,72 @@ static int is_banned(struct Client *cptr, struct Channel *chptr,
   return banned;
 }
 
+/** Add a member to its channel's fan-out lists: local users go on the
+ * channel's list of local members, remote users add a reference to
+ * the server link they are behind.  Zombies are not on these lists.
+ * @param[in] member Membership to add.
+ */
+static void add_member_fanout(struct Membership* member)
+{
+  struct Channel* chptr = member->channel;
+  struct Client* link;
+  struct SLink* lp;
+
+  if (MyConnect(member->user)) {
+    member->prev_local = 0;
+    if ((member->next_local = chptr->locals))
+      member->next_local->prev_local = member;
+    chptr->locals = member;
+    return;
+  }
+
+  link = cli_from(member->user);
+  for (lp = chptr->downlinks; lp; lp = lp->next) {
+    if (lp->value.cptr == link) {
+      ++lp->flags;
+      return;
+    }
+  }
+  lp = make_link();
+  lp->value.cptr = link;
+  lp->flags = 1;
+  lp->next = chptr->downlinks;
+  chptr->downlinks = lp;
+}
+
+/** Remove a member from its channel's fan-out lists.
+ * @param[in] member Membership to remove.
+ */
+static void remove_member_fanout(struct Membership* member)
+{
+  struct Channel* chptr = member->channel;
+  struct Client* link;
+  struct SLink** lpp;
+  struct SLink* lp;
+
+  if (MyConnect(member->user)) {
+    if (member->next_local)
+      member->next_local->prev_local = member->prev_local;
+    if (member->prev_local)
+      member->prev_local->next_local = member->next_local;
+    else
+      chptr->locals = member->next_local;
+    return;
+  }
+
+  link = cli_from(member->user);
+  for (lpp = &chptr->downlinks; (lp = *lpp); lpp = &lp->next) {
+    if (lp->value.cptr == link) {
+      if (!--lp->flags) {
+        *lpp = lp->next;
+        free_link(lp);
+      }
+      return;
+    }
+  }
+  assert(0);
+}
+
 /*
  * adds a user to a channel by adding another link to the channels member
  * chain.
@@ -1498,14 +1513,9 @@ void add_user_to_channel(struct Channel* chptr, struct Client* who,
 
   if (cli_user(who)) {
    
-    struct Membership* member = membershipFreeList;
-    if (member)
-      membershipFreeList = member->next_member;
-    else {
-      member = (struct Membership*) MyMalloc(sizeof(struct Membership));
-      ++membershipAllocCount;
-    }
+    struct Membership* member;
 
+    member = (struct Membership*) slab_alloc(&membershipSlab);
     assert(0 != member);
     member->user         = who;
     member->channel      = chptr;
@@ -1517,6 +1527,9 @@ void add_user_to_channel(struct Channel* chptr, struct Client* who,
     member->prev_member  = 0; 
     chptr->members       = member;
 
+    if (!IsZombie(member))
+      add_member_fanout(member);
+
     member->next_channel = (cli_user(who))->channel;
     if (member->next_channel)
       member->next_channel->prev_channel = member;
@@ -1542,6 +1555,9 @@ static int remove_member_from_channel(struct Membership* member)
     member->prev_member->next_member = member->next_member;
   else
     member->channel->members = member->next_member; 
+
+  if (!IsZombie(member))
+    remove_member_fanout(member);
       
   /*
    * unlink client channel list
@@ -1555,8 +1571,7 @@ static int remove_member_from_channel(struct Membership* member)
 
   --(cli_user(member->user))->joined;
 
-  member->next_member = membershipFreeList;
-  membershipFreeList = member;
+  slab_free(&membershipSlab, member);
 
   return sub1_from_channel(chptr);
 }
@@ -2461,6 +2476,8 @@ void make_zombie(struct Membership* member, struct Client* who, struct Client* c
   assert(0 != chptr);
 
   /* Default for case a): */
+  if (!IsZombie(member))
+    remove_member_fanout(member);
   SetZombie(member);
 
   /* Case b) or c) ?: */
@@ -3135,6 +3152,7 @@ mode_except_invalidate(struct Channel *chan)
 {
   struct Membership *member;
 
+  ban_cache_free(&chan->exceptcache);
   for (member = chan->members; member; member = member->next_member)
     ClearExceptValid(member);
 }
@@ -3148,6 +3166,7 @@ mode_ban_invalidate(struct Channel *chan)
 {
   struct Membership *member;
 
+  ban_cache_free(&chan->bancache);
   for (member = chan->members; member; member = member->next_member)
     ClearBanValid(member);
 }
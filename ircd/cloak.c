@@ -24,16 +24,19 @@
  * @brief Implementation of style 2 host hiding
  * @version $Id$
  */
+#include "cloak.h"
 #include "client.h"
 #include "ircd.h"
 #include "ircd_alloc.h"
 #include "ircd_chattr.h"
 #include "ircd_defs.h"
 #include "ircd_features.h"
+#include "ircd_reply.h"
 #include "ircd_string.h"
 #include "ircd_snprintf.h"
 #include "match.h"
 #include "md5.h"
+#include "numeric.h"
 #include "s_bsd.h"
 #include "s_debug.h"
 #include "ircd_struct.h"
@@ -48,6 +51,176 @@
 #define KEY2 feature_str(FEAT_HOST_HIDING_KEY2) /**< Cloak key 2 */
 #define KEY3 feature_str(FEAT_HOST_HIDING_KEY3) /**< Cloak key 3 */
 
+/** Number of slots in each of the BETA and GAMMA caches. */
+#define CLOAK_PREFIXES	4096
+/** Slot for the /24 or /16 prefix \a p in a prefix cache. */
+#define CLOAK_SLOT(p)	(((p) * 2654435761U) >> 20)
+
+/** One cached BETA or GAMMA part. */
+struct CloakPrefix {
+  unsigned int cp_key;  /**< Prefix plus one, or 0 if the slot is empty. */
+  unsigned int cp_part; /**< Downsampled digest for the prefix. */
+};
+
+/** One cached cloak, of an IPv4 address or of a hostname. */
+struct CloakEntry {
+  struct CloakEntry *ce_hnext; /**< Next entry in the same hash bucket. */
+  struct CloakEntry *ce_prev;  /**< More recently used entry. */
+  struct CloakEntry *ce_next;  /**< Less recently used entry. */
+  unsigned int ce_key;         /**< Address in host byte order, or hash
+                                    of ce_host. */
+  char ce_host[HOSTLEN + 1];   /**< Hostname, or empty for an address. */
+  char ce_cloak[HOSTLEN + 1];  /**< Cloak for the address or hostname. */
+};
+
+/** Cached cloaks and cloak parts.
+ * The BETA and GAMMA parts of an IPv4 cloak depend only on the /24 and
+ * /16 the address is in, and are kept in direct-mapped tables.  Whole
+ * cloaks are kept for the last FEAT_HOST_HIDING_CACHE addresses and
+ * hostnames.  Everything is dropped when the keys or the prefix change.
+ */
+static struct {
+  struct CloakPrefix beta[CLOAK_PREFIXES];  /**< BETA parts by /24. */
+  struct CloakPrefix gamma[CLOAK_PREFIXES]; /**< GAMMA parts by /16. */
+  struct CloakEntry *entries;  /**< Cloak entries, allocated together. */
+  struct CloakEntry **hash;    /**< Hash buckets for cloak entries. */
+  struct CloakEntry *top;      /**< Most recently used entry. */
+  struct CloakEntry *bottom;   /**< Least recently used entry. */
+  unsigned int size;           /**< Number of entries allocated. */
+  unsigned int used;           /**< Number of entries holding a cloak. */
+  unsigned int shift;          /**< Shift giving a hash bucket number. */
+  unsigned long hits;          /**< Cloaks found in the cache. */
+  unsigned long misses;        /**< Cloaks computed. */
+  unsigned long part_hits;     /**< BETA and GAMMA parts found. */
+  unsigned long part_misses;   /**< BETA and GAMMA parts computed. */
+} CloakCache;
+
+/** Forget every cached cloak and cloak part.
+ * The cloak cache is sized again from FEAT_HOST_HIDING_CACHE when it
+ * is next used.
+ */
+void cloak_flush_cache(void)
+{
+  memset(CloakCache.beta, 0, sizeof(CloakCache.beta));
+  memset(CloakCache.gamma, 0, sizeof(CloakCache.gamma));
+  MyFree(CloakCache.entries);
+  MyFree(CloakCache.hash);
+  CloakCache.entries = 0;
+  CloakCache.hash = 0;
+  CloakCache.top = CloakCache.bottom = 0;
+  CloakCache.size = CloakCache.used = 0;
+}
+
+/** Hash bucket for cache key \a key. */
+#define CLOAK_BUCKET(key) \
+  (&CloakCache.hash[((key) * 2654435761U) >> CloakCache.shift])
+
+/** Calculate the cache key of a hostname (32-bit FNV-1a).
+ * Cloaks depend on the case of the hostname, so the key does too.
+ * @param[in] host Hostname.
+ * @return Key for \a host.
+ */
+static unsigned int cloak_host_key(const char *host)
+{
+  unsigned int key = 2166136261U;
+
+  while (*host)
+    key = (key ^ (unsigned char) *host++) * 16777619U;
+  return key;
+}
+
+/** Find a cached cloak, marking it as just used.
+ * @param[in] key Address in host byte order, or hash of \a host.
+ * @param[in] host Hostname, or empty for an address.
+ * @return Cache entry, or NULL if there is none.
+ */
+static struct CloakEntry *cloak_find(unsigned int key, const char *host)
+{
+  struct CloakEntry *ce;
+
+  if (!CloakCache.size)
+    return 0;
+  for (ce = *CLOAK_BUCKET(key); ce; ce = ce->ce_hnext)
+    if (ce->ce_key == key && !strcmp(ce->ce_host, host))
+      break;
+  if (ce && ce != CloakCache.top) {
+    /* move it to the top of the LRU list */
+    ce->ce_prev->ce_next = ce->ce_next;
+    if (ce->ce_next)
+      ce->ce_next->ce_prev = ce->ce_prev;
+    else
+      CloakCache.bottom = ce->ce_prev;
+    ce->ce_prev = 0;
+    ce->ce_next = CloakCache.top;
+    CloakCache.top->ce_prev = ce;
+    CloakCache.top = ce;
+  }
+  return ce;
+}
+
+/** Cache a cloak, replacing the least recently used one if the cache
+ * is full.
+ * @param[in] key Address in host byte order, or hash of \a host.
+ * @param[in] host Hostname of at most HOSTLEN characters, or empty for
+ * an address.
+ * @param[in] cloak Cloak for the address or hostname.
+ */
+static void cloak_add(unsigned int key, const char *host, const char *cloak)
+{
+  struct CloakEntry *ce, **pp;
+  unsigned int buckets;
+
+  if (!CloakCache.size) {
+    if (!(CloakCache.size = feature_int(FEAT_HOST_HIDING_CACHE)))
+      return;
+    for (buckets = 2, CloakCache.shift = 31; buckets < CloakCache.size;
+         buckets <<= 1)
+      CloakCache.shift--;
+    CloakCache.entries = (struct CloakEntry *)
+      MyCalloc(CloakCache.size, sizeof(struct CloakEntry));
+    CloakCache.hash = (struct CloakEntry **)
+      MyCalloc(buckets, sizeof(struct CloakEntry *));
+  }
+
+  if (CloakCache.used < CloakCache.size)
+    ce = &CloakCache.entries[CloakCache.used++];
+  else {
+    ce = CloakCache.bottom;
+    for (pp = CLOAK_BUCKET(ce->ce_key); *pp != ce; pp = &(*pp)->ce_hnext)
+      ;
+    *pp = ce->ce_hnext;
+    if ((CloakCache.bottom = ce->ce_prev))
+      CloakCache.bottom->ce_next = 0;
+    else
+      CloakCache.top = 0;
+  }
+
+  ce->ce_key = key;
+  strcpy(ce->ce_host, host);
+  ircd_strncpy(ce->ce_cloak, cloak, HOSTLEN);
+  pp = CLOAK_BUCKET(key);
+  ce->ce_hnext = *pp;
+  *pp = ce;
+  ce->ce_prev = 0;
+  if ((ce->ce_next = CloakCache.top))
+    CloakCache.top->ce_prev = ce;
+  else
+    CloakCache.bottom = ce;
+  CloakCache.top = ce;
+}
+
+/** Report cloak cache statistics to \a cptr.
+ * @param[in] cptr Client requesting information.
+ */
+void cloak_count_memory(struct Client *cptr)
+{
+  send_reply(cptr, SND_EXPLICIT | RPL_STATSDEBUG,
+             ":Cloaks cached %u(%zu) of %u hits %lu misses %lu parts hits "
+             "%lu misses %lu", CloakCache.used,
+             (size_t) CloakCache.size * sizeof(struct CloakEntry),
+             CloakCache.size, CloakCache.hits, CloakCache.misses,
+             CloakCache.part_hits, CloakCache.part_misses);
+}
 
 /** Downsamples a 128bit result to 32bits (md5 -> unsigned int).
  * @param[in] i 128bit result to downsample.
@@ -68,17 +241,151 @@ unsigned char r[4];
 	         (unsigned int)r[3]);
 }
 
+/** Parse an IPv4 address in the form ircd_ntoa() writes it.
+ * @param[in] host Text to parse.
+ * @param[out] addr Address in host byte order.
+ * @param[out] len16 Length of the /16 prefix ("a.b") of \a host.
+ * @param[out] len24 Length of the /24 prefix ("a.b.c") of \a host.
+ * @return Non-zero if \a host is four decimal octets without leading
+ * zeros, so that no other text gives the same address.
+ */
+static int cloak_parse(const char *host, unsigned int *addr,
+                       size_t *len16, size_t *len24)
+{
+  const char *p = host;
+  unsigned int octet;
+  int i;
+
+  for (*addr = 0, i = 0; i < 4; i++) {
+    if (!IsDigit(*p) || (*p == '0' && IsDigit(p[1])))
+      return 0;
+    for (octet = 0; IsDigit(*p) && octet < 256; p++)
+      octet = octet * 10 + (*p - '0');
+    if (octet > 255 || *p != (i < 3 ? '.' : '\0'))
+      return 0;
+    *addr = (*addr << 8) | octet;
+    if (i == 1)
+      *len16 = p - host;
+    else if (i == 2)
+      *len24 = p - host;
+    p++;
+  }
+  return 1;
+}
+
+/** Build the text hashed for a cloak part, "key1:middle:key2".
+ * Like ircd_snprintf() into a HOSTLEN buffer, it is cut short at
+ * HOSTLEN - 1 characters.
+ * @param[out] buf Buffer of HOSTLEN characters.
+ * @param[in] key1 Text before the middle.
+ * @param[in] middle Middle part of the text.
+ * @param[in] len Length of \a middle.
+ * @param[in] key2 Text after the middle.
+ */
+static void cloak_text(char *buf, const char *key1, const char *middle,
+                       size_t len, const char *key2)
+{
+  const char *piece[5];
+  size_t plen[5], used = 0, n;
+  int i;
+
+  piece[0] = key1;   plen[0] = strlen(key1);
+  piece[1] = ":";    plen[1] = 1;
+  piece[2] = middle; plen[2] = len;
+  piece[3] = ":";    plen[3] = 1;
+  piece[4] = key2;   plen[4] = strlen(key2);
+
+  for (i = 0; i < 5 && used < HOSTLEN - 1; i++) {
+    n = plen[i] < HOSTLEN - 1 - used ? plen[i] : HOSTLEN - 1 - used;
+    memcpy(buf + used, piece[i], n);
+    used += n;
+  }
+  buf[used] = '\0';
+}
+
+/** Append \a value in upper case hexadecimal, as "%X" would.
+ * @param[out] p Where to write.
+ * @param[in] value Value to write.
+ * @return Position just past the digits.
+ */
+static char *cloak_hex(char *p, unsigned int value)
+{
+  static const char digits[] = "0123456789ABCDEF";
+  char tmp[8];
+  int n = 0;
+
+  do {
+    tmp[n++] = digits[value & 15];
+    value >>= 4;
+  } while (value);
+  while (n)
+    *p++ = tmp[--n];
+  return p;
+}
+
+/** Compute parts of a cloak.
+ * Each part is downsample(md5(md5(text) + suffix)).  The parts are
+ * independent of each other, so when all three of an IPv4 cloak are
+ * needed they are hashed side by side with DoMD5x4(); for fewer, the
+ * unused lanes would cost more than they save.
+ * @param[in] count Number of parts, at most 3.
+ * @param[in] text Text to hash for each part.
+ * @param[in] suffix Key appended to the first digest for each part.
+ * @param[out] part Computed parts.
+ */
+static void cloak_parts(int count, char text[][HOSTLEN],
+                        const char **suffix, unsigned int *part)
+{
+  unsigned char res[4][512], res2[4][16], *src[4], *dst[4];
+  unsigned long n[4];
+  int i;
+
+  if (count < 3) {
+    for (i = 0; i < count; i++) {
+      DoMD5(res[i], (unsigned char *) text[i], strlen(text[i]));
+      strcpy((char *) res[i] + 16, suffix[i]);
+      DoMD5(res2[i], res[i], strlen((char *) res[i] + 16) + 16);
+      part[i] = downsample(res2[i]);
+    }
+    return;
+  }
+
+  for (i = 0; i < 4; i++) {
+    src[i] = (unsigned char *) text[i < count ? i : 0];
+    n[i] = i < count ? strlen(text[i]) : 0;
+    dst[i] = res[i];
+  }
+  DoMD5x4(dst, src, n);
+
+  for (i = 0; i < 4; i++) {
+    if (i < count)
+      strcpy((char *) res[i] + 16, suffix[i]);
+    src[i] = res[i];
+    n[i] = i < count ? strlen((char *) res[i] + 16) + 16 : 0;
+    dst[i] = res2[i];
+  }
+  DoMD5x4(dst, src, n);
+
+  for (i = 0; i < count; i++)
+    part[i] = downsample(res2[i]);
+}
+
 /** Cloak an IPv4 IP
  * @param[in] host IP to cloak.
  * @return result Cloaked IP.
  */
 char *hidehost_ipv4(char *host)
 {
-unsigned int a, b, c, d;
-static char buf[512], result[128];
-unsigned char res[512], res2[512];
-unsigned long n;
-unsigned int alpha, beta, gamma;
+unsigned int a = 0, b = 0, c = 0, d = 0;
+static char result[128];
+char text[3][HOSTLEN], *p;
+const char *suffix[3];
+unsigned int part[3], addr;
+unsigned int alpha, beta = 0, gamma = 0;
+struct CloakPrefix *bp = 0, *gp = 0;
+struct CloakEntry *ce;
+size_t len16 = 0, len24 = 0;
+int count = 1, bi = 0, gi = 0;
 
 	/* 
 	 * Output: ALPHA.BETA.GAMMA.IP
@@ -90,34 +397,83 @@ unsigned int alpha, beta, gamma;
 	 * BETA  = downsample(md5(md5("KEY3:A.B.C:KEY1")+"KEY2"));
 	 * GAMMA = downsample(md5(md5("KEY1:A.B:KEY2")+"KEY3"));
 	 */
-	sscanf(host, "%u.%u.%u.%u", &a, &b, &c, &d);
+	suffix[0] = KEY1;
+	if (cloak_parse(host, &addr, &len16, &len24)) {
+		if ((ce = cloak_find(addr, ""))) {
+			CloakCache.hits++;
+			strcpy(result, ce->ce_cloak);
+			return result;
+		}
+		CloakCache.misses++;
 
-	/* ALPHA... */
-	ircd_snprintf(0, buf, HOSTLEN, "%s:%s:%s", KEY2, host, KEY3);
-	DoMD5(res, (unsigned char*) buf, strlen(buf));
-	strcpy((char *)res+16, KEY1); 
-	n = strlen((char *)res+16) + 16;
-	DoMD5(res2, res, n);
-	alpha = downsample(res2);
+		/* ALPHA... */
+		cloak_text(text[0], KEY2, host, strlen(host), KEY3);
 
-	/* BETA... */
-	ircd_snprintf(0, buf, HOSTLEN, "%s:%d.%d.%d:%s", KEY3, a, b, c, KEY1); 
-	DoMD5(res, (unsigned char*) buf, strlen(buf));
-	strcpy((char *) res+16, KEY2);
-	n = strlen((char *)res+16) + 16;
-	DoMD5(res2, res, n);
-	beta = downsample(res2);
+		/* BETA... */
+		bp = &CloakCache.beta[CLOAK_SLOT(addr >> 8)];
+		if (bp->cp_key == (addr >> 8) + 1) {
+			beta = bp->cp_part;
+			CloakCache.part_hits++;
+		} else {
+			cloak_text(text[count], KEY3, host, len24, KEY1);
+			bi = count;
+			suffix[count++] = KEY2;
+		}
 
-	/* GAMMA... */
-	ircd_snprintf(0, buf, HOSTLEN, "%s:%d.%d:%s", KEY1, a, b, KEY2); 
-	DoMD5(res, (unsigned char*) buf, strlen(buf));
- 	strcpy((char *) res+16, KEY3);
-	n = strlen((char *)res+16) + 16;
-	DoMD5(res2, res, n);
-	gamma = downsample(res2);
+		/* GAMMA... */
+		gp = &CloakCache.gamma[CLOAK_SLOT(addr >> 16)];
+		if (gp->cp_key == (addr >> 16) + 1) {
+			gamma = gp->cp_part;
+			CloakCache.part_hits++;
+		} else {
+			cloak_text(text[count], KEY1, host, len16, KEY2);
+			gi = count;
+			suffix[count++] = KEY3;
+		}
+	} else {
+		/* not as ircd_ntoa() writes it; leave it out of the caches */
+		sscanf(host, "%u.%u.%u.%u", &a, &b, &c, &d);
+		ircd_snprintf(0, text[0], HOSTLEN, "%s:%s:%s", KEY2, host, KEY3);
+		ircd_snprintf(0, text[1], HOSTLEN, "%s:%d.%d.%d:%s", KEY3, a, b,
+		              c, KEY1);
+		ircd_snprintf(0, text[2], HOSTLEN, "%s:%d.%d:%s", KEY1, a, b,
+		              KEY2);
+		suffix[1] = KEY2;
+		suffix[2] = KEY3;
+		bi = 1;
+		gi = 2;
+		count = 3;
+	}
+
+	cloak_parts(count, text, suffix, part);
+	alpha = part[0];
+	if (bi) {
+		beta = part[bi];
+		if (bp) {
+			bp->cp_key = (addr >> 8) + 1;
+			bp->cp_part = beta;
+			CloakCache.part_misses++;
+		}
+	}
+	if (gi) {
+		gamma = part[gi];
+		if (gp) {
+			gp->cp_key = (addr >> 16) + 1;
+			gp->cp_part = gamma;
+			CloakCache.part_misses++;
+		}
+	}
 
 	/* lower case X? */
- 	ircd_snprintf(0, result, HOSTLEN, "%X.%X.%X.IP", alpha, beta, gamma);
+	p = cloak_hex(result, alpha);
+	*p++ = '.';
+	p = cloak_hex(p, beta);
+	*p++ = '.';
+	p = cloak_hex(p, gamma);
+	strcpy(p, ".IP");
+
+	if (bp)
+		cloak_add(addr, "", result);
 	return result;
 }
 
@@ -130,7 +486,19 @@ char *hidehost_normalhost(char *host)
 {
 char *p;
 static char buf[512], res[512], res2[512], result[HOSTLEN+1];
-unsigned int alpha, n;
+unsigned int alpha, n, key = 0;
+struct CloakEntry *ce;
+int cache = *host && strlen(host) <= HOSTLEN;
+
+	if (cache) {
+		key = cloak_host_key(host);
+		if ((ce = cloak_find(key, host))) {
+			CloakCache.hits++;
+			strcpy(result, ce->ce_cloak);
+			return result;
+		}
+		CloakCache.misses++;
+	}
 
 	ircd_snprintf(0, buf, 512, "%s:%s:%s", KEY1, host, KEY2);
 	DoMD5(res, buf, strlen(buf));
@@ -158,6 +526,8 @@ unsigned int alpha, n;
 	} else
 		ircd_snprintf(0, result, HOSTLEN, "%s-%X",  feature_str(FEAT_HOST_HIDING_PREFIX), alpha);
 
+	if (cache)
+		cloak_add(key, host, result);
 	return result;
 }
 
@@ -33,6 +33,7 @@
 
 /* #include <assert.h> -- Now using assert in ircd_log.h */
 #include <string.h>
+#include <sys/uio.h>
 
 /*
  * dbuf is a collection of functions which can be used to
@@ -208,6 +209,89 @@ int dbuf_put(struct DBuf *dyn, const char *buf, unsigned int length)
   return 1;
 }
 
+/** Map free space at the end of a DBuf so data can be read into it.
+ * The space is the unused part of the last buffer, followed by a new
+ * buffer if that leaves less than \a length bytes.  Every call must be
+ * followed by dbuf_commit(), which releases whatever was not used.
+ * @param[in,out] dyn Buffer to append to.
+ * @param[out] iov Receives up to two segments of free space.
+ * @param[in] length Number of bytes the caller would like room for.
+ * @return Number of segments in \a iov (zero if out of buffers).
+ */
+int dbuf_reserve(struct DBuf *dyn, struct iovec *iov, unsigned int length)
+{
+  struct DBufBuffer *db = dyn->length ? dyn->tail : 0;
+  struct DBufBuffer *spare;
+  unsigned int room = 0;
+  int count = 0;
+
+  assert(0 != dyn);
+  assert(0 != iov);
+
+  if (db && (room = (db->data + DBUF_SIZE) - db->end)) {
+    iov[count].iov_base = db->end;
+    iov[count++].iov_len = room;
+  }
+  if (room >= length)
+    return count;
+
+  if (0 == (spare = dbuf_alloc()) && feature_bool(FEAT_HAS_FERGUSON_FLUSHER)) {
+    flush_connections(0);
+    spare = dbuf_alloc();
+  }
+  if (0 == spare)
+    return count;
+
+  spare->next = 0;
+  spare->start = spare->end = spare->data;
+  /* dyn->tail only moves on to the new buffer once data lands in it */
+  if (db)
+    db->next = spare;
+  else
+    dyn->head = dyn->tail = spare;
+
+  iov[count].iov_base = spare->data;
+  iov[count++].iov_len = DBUF_SIZE;
+  return count;
+}
+
+/** Account for data read into space mapped by dbuf_reserve().
+ * @param[in,out] dyn Buffer that was appended to.
+ * @param[in] length Number of bytes stored in the mapped space.
+ */
+void dbuf_commit(struct DBuf *dyn, unsigned int length)
+{
+  struct DBufBuffer *db = dyn->tail;
+  unsigned int chunk;
+
+  assert(0 != dyn);
+
+  if (0 == db)
+    return;
+
+  dyn->length += length;
+  for (;;) {
+    chunk = (db->data + DBUF_SIZE) - db->end;
+    if (chunk > length)
+      chunk = length;
+    db->end += chunk;
+    if (0 == (length -= chunk))
+      break;
+    assert(0 != db->next);
+    db = db->next;
+  }
+
+  if (db->next) {
+    dbuf_free(db->next);
+    db->next = 0;
+  }
+  dyn->tail = db;
+  if (0 == dyn->length) {
+    dbuf_free(db);
+    dyn->head = dyn->tail = 0;
+  }
+}
+
 /** Get the first contiguous block of data from a DBuf.
  * Generally a call to dbuf_map(dyn, &count) will be followed with a
  * call to dbuf_delete(dyn, count).
@@ -389,3 +473,39 @@ unsigned int dbuf_getmsg(struct DBuf *dyn, char *buf, unsigned int length)
   }
   return 0;
 }
+
+/** Find the first line in a data buffer without copying it.
+ * If the first data buffer holds a complete line shorter than \a
+ * length, its terminator is overwritten with a NUL so that the line
+ * can be parsed in place.  The caller must dbuf_delete() \a *count
+ * plus one bytes once it is done with the line.
+ * @param[in,out] dyn Data buffer to search.
+ * @param[in] length Maximum line length, including the terminator.
+ * @param[out] count Receives the length of the line.
+ * @return Start of the line, or NULL if there is no complete line in
+ * the first data buffer (use dbuf_getmsg() for lines that straddle
+ * buffers).
+ */
+char *dbuf_getline(struct DBuf *dyn, unsigned int length, unsigned int *count)
+{
+  struct DBufBuffer *db;
+  char *end;
+  char *eol;
+
+  assert(0 != dyn);
+  assert(0 != count);
+
+  if (0 == dbuf_flush(dyn))
+    return 0;
+
+  db = dyn->head;
+  end = IRCD_MIN(db->end, (db->start + length));
+  for (eol = db->start; eol < end && !IsEol(*eol); ++eol)
+    ;
+  if (eol == end)
+    return 0;
+
+  *eol = '\0';
+  *count = eol - db->start;
+  return db->start;
+}
@@ -275,6 +275,8 @@ engine_loop(struct Generators *gen)
       events_count = tmp;
     }
 
+    socket_flush(); /* apply interest changes from the last iteration */
+
     wait = timer_next(gen) ? (timer_next(gen) - CurrentTime) * 1000 : -1;
     Debug((DEBUG_ENGINE, "epoll: delay: %d (%d) %d", timer_next(gen),
            CurrentTime, wait));
@@ -353,6 +355,7 @@ struct Engine engine_epoll = {
   engine_set_state,
   engine_set_events,
   engine_delete,
-  engine_loop
+  engine_loop,
+  ENGINE_DEFER_EVENTS
 };
 
@@ -0,0 +1,581 @@
+/*
+ * IRC - Internet Relay Chat, ircd/engine_iouring.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+/** @file
+ * @brief Linux io_uring event engine.
+ * @version $Id$
+ *
+ * Every socket with a non-empty interest set has one poll request
+ * outstanding on the ring.  Interest changes, re-arms and the wait for
+ * completions all go to the kernel in a single io_uring_enter() per
+ * loop iteration, where the epoll engine needs one epoll_ctl() per
+ * change plus the epoll_wait().
+ *
+ * Poll requests are one-shot and re-armed after they complete.
+ * Multishot poll requests only report new wakeups, and the rest of the
+ * server expects level-triggered readiness: a client whose input is
+ * throttled leaves data in the socket and must be told about it again.
+ * A re-armed one-shot poll completes at once if the socket is still
+ * ready, which gives exactly that.
+ *
+ * Each poll request is tagged with the socket's descriptor and a
+ * generation number kept in the socket's engine data, so completions
+ * for requests that were cancelled or replaced are recognized and
+ * dropped even if the descriptor has been reused.
+ *
+ * If the kernel does not support io_uring (or the features used here),
+ * engine_init() fails and the next engine, normally epoll, is used.
+ */
+#include "config.h"
+
+#include "ircd.h"
+#include "ircd_events.h"
+#include "ircd_alloc.h"
+#include "ircd_log.h"
+#include "s_debug.h"
+
+/* #include <assert.h> -- Now using assert in ircd_log.h */
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#define IOURING_ERROR_THRESHOLD 20   /**< after 20 io_uring errors, restart */
+#define ERROR_EXPIRE_TIME       3600 /**< expire errors after an hour */
+#define IOURING_MAX_SQ          4096 /**< largest submission queue to ask for */
+#define IOURING_MAX_CQ          65536 /**< largest completion queue to ask for */
+
+/** Build the user_data tag for a poll request. */
+#define IOURING_TAG(fd, gen)	(((__u64) (gen) << 32) | (__u32) (fd))
+/** Extract the descriptor from a poll request tag. */
+#define IOURING_TAG_FD(tag)	((int) ((tag) & 0xffffffff))
+/** Extract the generation from a poll request tag. */
+#define IOURING_TAG_GEN(tag)	((unsigned int) ((tag) >> 32))
+/** Generation of the poll request outstanding for \a sock (0 if none). */
+#define s_poll_gen(sock)	(*(unsigned int*) &s_ed_int(sock))
+
+/** Mapped submission queue ring. */
+static struct {
+  unsigned int* head;		/**< kernel's consumer index */
+  unsigned int* tail;		/**< our producer index */
+  unsigned int  mask;		/**< index mask */
+  unsigned int  entries;	/**< number of entries */
+  unsigned int  local_tail;	/**< tail including unpublished entries */
+  struct io_uring_sqe* sqes;	/**< submission queue entries */
+} sq;
+
+/** Mapped completion queue ring. */
+static struct {
+  unsigned int* head;		/**< our consumer index */
+  unsigned int* tail;		/**< kernel's producer index */
+  unsigned int  mask;		/**< index mask */
+  struct io_uring_cqe* cqes;	/**< completion queue entries */
+} cq;
+
+/** File descriptor for the ring. */
+static int ring_fd = -1;
+/** Mapping holding the submission ring (and the completion ring if
+ * the kernel maps both at once). */
+static void* sq_map;
+/** Size of ::sq_map. */
+static size_t sq_map_len;
+/** Mapping holding the completion ring, if separate. */
+static void* cq_map;
+/** Size of ::cq_map. */
+static size_t cq_map_len;
+/** Size of the submission queue entry array mapping. */
+static size_t sqes_len;
+/** Number of file descriptors we can handle. */
+static int sock_count;
+/** Socket registered for each file descriptor. */
+static struct Socket** sockList;
+/** Last poll request generation handed out. */
+static unsigned int poll_gen;
+/** Number of recent io_uring errors. */
+static int errors;
+/** Periodic timer to forget errors. */
+static struct Timer clear_error;
+
+/** Set up an io_uring instance.
+ * @param[in] entries Requested submission queue size.
+ * @param[in,out] p Setup parameters.
+ * @return Ring file descriptor, or -1 on error.
+ */
+static int
+io_uring_setup(unsigned int entries, struct io_uring_params* p)
+{
+  return syscall(__NR_io_uring_setup, entries, p);
+}
+
+/** Submit queued requests and optionally wait for completions.
+ * @param[in] to_submit Number of queued submission entries.
+ * @param[in] min_complete Number of completions to wait for.
+ * @param[in] flags IORING_ENTER_* flags.
+ * @param[in] arg Extended argument (or NULL).
+ * @param[in] argsz Size of \a arg.
+ * @return Number of entries submitted, or -1 on error.
+ */
+static int
+io_uring_enter(unsigned int to_submit, unsigned int min_complete,
+               unsigned int flags, void* arg, size_t argsz)
+{
+  return syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete,
+                 flags, arg, argsz);
+}
+
+/** Decrement the error count (once per hour).
+ * @param[in] ev Expired timer event (ignored).
+ */
+static void
+error_clear(struct Event *ev)
+{
+  if (!--errors)
+    timer_del(ev_timer(ev));
+}
+
+/** Count an io_uring error, restarting the server if there are too many.
+ * @param[in] what Operation that failed.
+ */
+static void
+ring_error(const char* what)
+{
+  log_write(LS_SOCKET, L_ERROR, 0, "io_uring %s error: %m", what);
+  if (!errors++)
+    timer_add(timer_init(&clear_error), error_clear, 0, TT_PERIODIC,
+              ERROR_EXPIRE_TIME);
+  else if (errors > IOURING_ERROR_THRESHOLD)
+    exit_schedule(1, 0, 0, "too many io_uring errors");
+}
+
+/** Number of submission queue entries not yet consumed by the kernel.
+ * @return Count of pending entries.
+ */
+static unsigned int
+sq_pending(void)
+{
+  return sq.local_tail - __atomic_load_n(sq.head, __ATOMIC_ACQUIRE);
+}
+
+/** Hand queued submission entries to the kernel without waiting. */
+static void
+sq_submit(void)
+{
+  __atomic_store_n(sq.tail, sq.local_tail, __ATOMIC_RELEASE);
+  while (sq_pending()) {
+    if (io_uring_enter(sq_pending(), 0, 0, 0, 0) < 0 && errno != EINTR) {
+      if (errno != EAGAIN && errno != EBUSY)
+        ring_error("submit");
+      break;
+    }
+  }
+}
+
+/** Get a cleared submission queue entry, submitting if the queue is full.
+ * @return Submission queue entry to fill in, or NULL if none is free.
+ */
+static struct io_uring_sqe*
+sq_get(void)
+{
+  struct io_uring_sqe* sqe;
+
+  if (sq_pending() >= sq.entries) {
+    sq_submit();
+    if (sq_pending() >= sq.entries)
+      return 0;
+  }
+  sqe = &sq.sqes[sq.local_tail++ & sq.mask];
+  memset(sqe, 0, sizeof(*sqe));
+  return sqe;
+}
+
+/** Calculate the poll mask for a socket.
+ * @param[in] state Socket state.
+ * @param[in] events User-specified event interest list.
+ * @return Poll events to wait for.
+ */
+static unsigned int
+poll_mask(enum SocketState state, unsigned int events)
+{
+  switch (state) {
+  case SS_CONNECTING:
+    return POLLOUT;
+
+  case SS_LISTENING:
+  case SS_NOTSOCK:
+    return POLLIN;
+
+  case SS_CONNECTED:
+  case SS_DATAGRAM:
+  case SS_CONNECTDG:
+    return ((events & SOCK_EVENT_READABLE) ? POLLIN : 0) |
+      ((events & SOCK_EVENT_WRITABLE) ? POLLOUT : 0);
+  }
+  return 0;
+}
+
+/** Queue a poll request for a socket.
+ * @param[in] sock Socket to poll.
+ * @param[in] state State to calculate the poll mask for.
+ * @param[in] events Interest list to calculate the poll mask for.
+ */
+static void
+poll_arm(struct Socket* sock, enum SocketState state, unsigned int events)
+{
+  struct io_uring_sqe* sqe;
+  unsigned int mask;
+
+  assert(0 == s_poll_gen(sock));
+  if (!(mask = poll_mask(state, events)))
+    return;
+  if (!(sqe = sq_get())) {
+    event_generate(ET_ERROR, sock, ENOBUFS);
+    return;
+  }
+  if (!++poll_gen) /* generation 0 means "no request" */
+    ++poll_gen;
+  s_poll_gen(sock) = poll_gen;
+
+#ifdef WORDS_BIGENDIAN
+  mask = (mask << 16) | (mask >> 16); /* kernel reads it as two halfwords */
+#endif
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = s_fd(sock);
+  sqe->poll32_events = mask;
+  sqe->user_data = IOURING_TAG(s_fd(sock), poll_gen);
+}
+
+/** Queue cancellation of a socket's outstanding poll request.
+ * @param[in] sock Socket whose poll request should go away.
+ */
+static void
+poll_disarm(struct Socket* sock)
+{
+  struct io_uring_sqe* sqe;
+
+  if (!s_poll_gen(sock))
+    return;
+  if ((sqe = sq_get())) {
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = IOURING_TAG(s_fd(sock), s_poll_gen(sock));
+    sqe->user_data = 0; /* nobody cares about the result */
+  }
+  s_poll_gen(sock) = 0;
+}
+
+/** Release the ring's mappings and descriptor. */
+static void
+ring_close(void)
+{
+  if (sq.sqes)
+    munmap(sq.sqes, sqes_len);
+  if (cq_map && cq_map != sq_map)
+    munmap(cq_map, cq_map_len);
+  if (sq_map)
+    munmap(sq_map, sq_map_len);
+  if (ring_fd >= 0)
+    close(ring_fd);
+  sq.sqes = 0;
+  sq_map = cq_map = 0;
+  ring_fd = -1;
+}
+
+/** Initialize the io_uring engine.
+ * @param[in] max_sockets Maximum number of file descriptors to support.
+ * @return Non-zero on success, or zero on failure.
+ */
+static int
+engine_init(int max_sockets)
+{
+  struct io_uring_params p;
+  unsigned int entries, ii;
+  char* base;
+
+  memset(&p, 0, sizeof(p));
+  entries = max_sockets < IOURING_MAX_SQ ? max_sockets : IOURING_MAX_SQ;
+  p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+  p.cq_entries = 2 * max_sockets < IOURING_MAX_CQ ? 2 * max_sockets :
+    IOURING_MAX_CQ;
+  if ((ring_fd = io_uring_setup(entries, &p)) < 0) {
+    log_write(LS_SYSTEM, L_WARNING, 0,
+              "io_uring engine cannot initialize: %m");
+    return 0;
+  }
+  if (!(p.features & IORING_FEAT_EXT_ARG) || !(p.features & IORING_FEAT_NODROP)) {
+    log_write(LS_SYSTEM, L_WARNING, 0,
+              "io_uring engine needs a newer kernel; not using it");
+    ring_close();
+    return 0;
+  }
+
+  sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+  cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if ((p.features & IORING_FEAT_SINGLE_MMAP) && cq_map_len > sq_map_len)
+    sq_map_len = cq_map_len;
+  sq_map = mmap(0, sq_map_len, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+  if (sq_map == MAP_FAILED) {
+    sq_map = 0;
+    goto fail;
+  }
+  if (p.features & IORING_FEAT_SINGLE_MMAP)
+    cq_map = sq_map;
+  else if ((cq_map = mmap(0, cq_map_len, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, ring_fd,
+                          IORING_OFF_CQ_RING)) == MAP_FAILED) {
+    cq_map = 0;
+    goto fail;
+  }
+  sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+  sq.sqes = mmap(0, sqes_len, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+  if (sq.sqes == MAP_FAILED) {
+    sq.sqes = 0;
+    goto fail;
+  }
+
+  base = sq_map;
+  sq.head = (unsigned int*) (base + p.sq_off.head);
+  sq.tail = (unsigned int*) (base + p.sq_off.tail);
+  sq.mask = *(unsigned int*) (base + p.sq_off.ring_mask);
+  sq.entries = p.sq_entries;
+  sq.local_tail = *sq.tail;
+  for (ii = 0; ii < p.sq_entries; ii++) /* ring slot i always uses sqe i */
+    ((unsigned int*) (base + p.sq_off.array))[ii] = ii;
+
+  base = cq_map;
+  cq.head = (unsigned int*) (base + p.cq_off.head);
+  cq.tail = (unsigned int*) (base + p.cq_off.tail);
+  cq.mask = *(unsigned int*) (base + p.cq_off.ring_mask);
+  cq.cqes = (struct io_uring_cqe*) (base + p.cq_off.cqes);
+
+  sock_count = max_sockets;
+  sockList = (struct Socket**) MyMalloc(sizeof(struct Socket*) * max_sockets);
+  memset(sockList, 0, sizeof(struct Socket*) * max_sockets);
+  return 1;
+
+fail:
+  log_write(LS_SYSTEM, L_WARNING, 0,
+            "io_uring engine cannot map its rings: %m");
+  ring_close();
+  return 0;
+}
+
+/** Add a socket to the event engine.
+ * @param[in] sock Socket to add to engine.
+ * @return Non-zero on success, or zero on error.
+ */
+static int
+engine_add(struct Socket *sock)
+{
+  assert(0 != sock);
+  assert(0 <= s_fd(sock));
+
+  if (s_fd(sock) >= sock_count) {
+    log_write(LS_SOCKET, L_ERROR, 0,
+              "Unable to add file descriptor %d to io_uring engine: too "
+              "many open files", s_fd(sock));
+    return 0;
+  }
+
+  Debug((DEBUG_ENGINE, "io_uring: Adding socket %d [%p], state %s, to engine",
+         s_fd(sock), sock, state_to_name(s_state(sock))));
+  sockList[s_fd(sock)] = sock;
+  s_poll_gen(sock) = 0;
+  poll_arm(sock, s_state(sock), s_events(sock));
+  return 1;
+}
+
+/** Handle state transition for a socket.
+ * @param[in] sock Socket changing state.
+ * @param[in] new_state New state for socket.
+ */
+static void
+engine_set_state(struct Socket *sock, enum SocketState new_state)
+{
+  assert(0 != sock);
+  Debug((DEBUG_ENGINE, "io_uring: Changing state for socket %p to %s",
+         sock, state_to_name(new_state)));
+  poll_disarm(sock);
+  poll_arm(sock, new_state, s_events(sock));
+}
+
+/** Handle change to preferred socket events.
+ * @param[in] sock Socket getting new interest list.
+ * @param[in] new_events New set of interesting events for socket.
+ */
+static void
+engine_set_events(struct Socket *sock, unsigned new_events)
+{
+  assert(0 != sock);
+  Debug((DEBUG_ENGINE, "io_uring: Changing event mask for socket %p to [%s]",
+         sock, sock_flags(new_events)));
+  poll_disarm(sock);
+  poll_arm(sock, s_state(sock), new_events);
+}
+
+/** Remove a socket from the event engine.
+ * @param[in] sock Socket being destroyed.
+ */
+static void
+engine_delete(struct Socket *sock)
+{
+  assert(0 != sock);
+  Debug((DEBUG_ENGINE, "io_uring: Deleting socket %d [%p], state %s",
+	 s_fd(sock), sock, state_to_name(s_state(sock))));
+  /* The pending request holds a reference to the file, so it must be
+   * cancelled for the descriptor to really close. */
+  poll_disarm(sock);
+  if (sockList[s_fd(sock)] == sock)
+    sockList[s_fd(sock)] = 0;
+}
+
+/** Dispatch one completed poll request.
+ * @param[in] tag User data of the request.
+ * @param[in] res Result of the request (poll events or -errno).
+ */
+static void
+engine_complete(__u64 tag, int res)
+{
+  struct Socket *sock;
+  socklen_t codesize;
+  int fd, errcode;
+
+  fd = IOURING_TAG_FD(tag);
+  if (!tag || fd >= sock_count || !(sock = sockList[fd]) ||
+      s_poll_gen(sock) != IOURING_TAG_GEN(tag))
+    return; /* cancellation result, or request was replaced */
+
+  s_poll_gen(sock) = 0; /* the request is finished */
+  gen_ref_inc(sock);
+  Debug((DEBUG_ENGINE,
+         "io_uring: Checking socket %p (fd %d) state %s, events %s",
+         sock, s_fd(sock), state_to_name(s_state(sock)),
+         sock_flags(s_events(sock))));
+
+  if (res < 0) {
+    event_generate(ET_ERROR, sock, -res);
+    gen_ref_dec(sock);
+    return;
+  } else if (res & POLLERR) {
+    errcode = 0;
+    codesize = sizeof(errcode);
+    if (getsockopt(s_fd(sock), SOL_SOCKET, SO_ERROR, &errcode,
+                   &codesize) < 0)
+      errcode = errno;
+    if (errcode) {
+      event_generate(ET_ERROR, sock, errcode);
+      gen_ref_dec(sock);
+      return;
+    }
+  } else if (res & POLLHUP) {
+    event_generate(ET_EOF, sock, 0);
+  } else switch (s_state(sock)) {
+  case SS_CONNECTING:
+    if (res & POLLOUT) /* connection completed */
+      event_generate(ET_CONNECT, sock, 0);
+    break;
+
+  case SS_LISTENING:
+    if (res & POLLIN) /* incoming connection */
+      event_generate(ET_ACCEPT, sock, 0);
+    break;
+
+  case SS_NOTSOCK:
+  case SS_CONNECTED:
+  case SS_DATAGRAM:
+  case SS_CONNECTDG:
+    if (res & POLLIN)
+      event_generate(ET_READ, sock, 0);
+    if (res & POLLOUT)
+      event_generate(ET_WRITE, sock, 0);
+    break;
+  }
+
+  /* keep watching the socket unless it went away or was re-armed */
+  if (!(sock->s_header.gh_flags & (GEN_DESTROY | GEN_ERROR)) &&
+      sockList[fd] == sock && !s_poll_gen(sock))
+    poll_arm(sock, s_state(sock), s_events(sock));
+  gen_ref_dec(sock);
+}
+
+/** Run engine event loop.
+ * @param[in] gen Lists of generators of various types.
+ */
+static void
+engine_loop(struct Generators *gen)
+{
+  struct io_uring_getevents_arg arg;
+  struct __kernel_timespec ts;
+  struct io_uring_cqe *cqe;
+  unsigned int head, tail;
+  __u64 tag;
+  int res;
+  time_t next;
+
+  while (running) {
+    socket_flush(); /* turn interest changes into ring requests */
+
+    memset(&arg, 0, sizeof(arg));
+    if ((next = timer_next(gen))) {
+      ts.tv_sec = next > CurrentTime ? next - CurrentTime : 0;
+      ts.tv_nsec = 0;
+      arg.ts = (__u64) (unsigned long) &ts;
+    }
+    Debug((DEBUG_ENGINE, "io_uring: delay: %d (%d) %d", next, CurrentTime,
+           next ? (int) ts.tv_sec : -1));
+
+    /* submit everything queued and wait, all in one system call */
+    __atomic_store_n(sq.tail, sq.local_tail, __ATOMIC_RELEASE);
+    if (io_uring_enter(sq_pending(), 1,
+                       IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                       &arg, sizeof(arg)) < 0 &&
+        errno != EINTR && errno != ETIME && errno != EBUSY && errno != EAGAIN)
+      ring_error("wait");
+    CurrentTime = time(0);
+
+    head = *cq.head;
+    tail = __atomic_load_n(cq.tail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+      cqe = &cq.cqes[head & cq.mask];
+      tag = cqe->user_data;
+      res = cqe->res;
+      __atomic_store_n(cq.head, ++head, __ATOMIC_RELEASE);
+      engine_complete(tag, res);
+    }
+    timer_run();
+  }
+}
+
+/** Descriptor for io_uring event engine. */
+struct Engine engine_iouring = {
+  "io_uring",
+  engine_init,
+  0,
+  engine_add,
+  engine_set_state,
+  engine_set_events,
+  engine_delete,
+  engine_loop,
+  ENGINE_DEFER_EVENTS
+};
@@ -447,6 +447,7 @@ struct Engine engine_kqueue = {
   engine_state,		/* Engine socket state change function */
   engine_events,	/* Engine socket events mask function */
   engine_delete,	/* Engine socket deletion function */
-  engine_loop		/* Core engine event loop */
+  engine_loop,		/* Core engine event loop */
+  0			/* Engine flags */
 };
 
@@ -0,0 +1,687 @@
+/*
+ * IRC - Internet Relay Chat, ircd/filter.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+/** @file
+ * @brief Compiled F:Line and spam filter rules.
+ * @version $Id$
+ *
+ * find_fline() used to re-parse every rule's flag strings and run
+ * pcre_exec() without study data for each rule on each message.  Rules
+ * are now compiled once into a struct FilterRule: flags parsed, the
+ * regex studied (and JIT compiled where the PCRE library supports it),
+ * and a literal that any match must contain pulled out of the pattern.
+ *
+ * The rules of each list are kept in a struct FilterSet, grouped by
+ * watch flag, together with an Aho-Corasick automaton over all their
+ * literals.  The automaton runs over a message at most once, the first
+ * time a rule with a literal is reached; rules whose literal it did not
+ * find are skipped without calling PCRE.
+ *
+ * Each rule also keeps count of its runs and matches and of the CPU
+ * time they take.  Only a sample of runs is timed, so that the clock
+ * is not read twice per rule per message; find_fline() disables rules
+ * whose average cost is too high.
+ */
+#include "config.h"
+
+#include "filter.h"
+#include "client.h"
+#include "ircd_alloc.h"
+#include "ircd_features.h"
+#include "ircd_log.h"
+#include "s_conf.h"
+
+/* #include <assert.h> -- Now using assert in ircd_log.h */
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+/** Shortest literal worth prefiltering on. */
+#define FILTER_LITERAL_MIN 3
+
+/** Longest literal kept. */
+#define FILTER_LITERAL_MAX 64
+
+/** Every run of a rule is timed until it has run this often... */
+#define FILTER_SAMPLE_FIRST 8
+
+/** ...and after that, one run in this many. */
+#define FILTER_SAMPLE_EVERY 16
+
+/** Timed runs needed before a rule's average is trusted. */
+#define FILTER_MIN_SAMPLES 4
+
+/** A single run taking this many times FEAT_FILTER_FATAL_TIME disables
+ * a rule without waiting for FILTER_MIN_SAMPLES. */
+#define FILTER_RUNAWAY 4
+
+/** State of the Aho-Corasick automaton. */
+struct FilterAcState {
+  unsigned int child;   /**< First child state, 0 if none. */
+  unsigned int sibling; /**< Next child of our parent, 0 if none. */
+  unsigned int fail;    /**< Longest proper suffix that is also a state. */
+  unsigned int output;  /**< Nearest state down the fail chain ending a
+                             literal, 0 if none. */
+  unsigned int match;   /**< First rule (index + 1) whose literal ends here. */
+  unsigned char ch;     /**< Byte leading here from the parent. */
+};
+
+/** Fold ASCII letters to lower case, as PCRE_CASELESS does by default. */
+#define FOLD(c) ((c) >= 'A' && (c) <= 'Z' ? (c) - 'A' + 'a' : (c))
+
+/** Skip white space and comments in an extended-mode pattern.
+ * @param[in] pat Position in the pattern.
+ * @param[in] extended Whether PCRE_EXTENDED is in effect.
+ * @return First position that is neither.
+ */
+static const char *
+pattern_space(const char *pat, int extended)
+{
+  while (extended) {
+    if (*pat == ' ' || *pat == '\t' || *pat == '\n' || *pat == '\r' ||
+        *pat == '\f' || *pat == '\v')
+      pat++;
+    else if (*pat == '#') {
+      while (*pat && *pat != '\n')
+        pat++;
+    } else
+      break;
+  }
+  return pat;
+}
+
+/** Parse a quantifier, if there is one.
+ * @param[in] pat Position just after an atom.
+ * @param[out] optional Set to 1 if the atom may be matched zero times,
+ * 0 if it must be matched, -1 if there is no quantifier.
+ * @return Position after the quantifier.
+ */
+static const char *
+pattern_quantifier(const char *pat, int *optional)
+{
+  const char *ch;
+  int min = 0, digits = 0;
+
+  *optional = -1;
+  if (*pat == '*' || *pat == '?') {
+    *optional = 1;
+    pat++;
+  } else if (*pat == '+') {
+    *optional = 0;
+    pat++;
+  } else if (*pat == '{') {
+    for (ch = pat + 1; *ch >= '0' && *ch <= '9'; ch++, digits++)
+      min = min * 10 + (*ch - '0');
+    if (*ch == ',')
+      for (ch++; *ch >= '0' && *ch <= '9'; ch++)
+        ;
+    if (!digits || *ch != '}')
+      return pat; /* PCRE takes this as a literal brace */
+    *optional = (min == 0);
+    pat = ch + 1;
+  } else
+    return pat;
+
+  if (*pat == '?' || *pat == '+') /* lazy or possessive */
+    pat++;
+  return pat;
+}
+
+/** Skip a character class.
+ * @param[in] pat Position of the opening bracket.
+ * @return Position after the closing bracket, or NULL if it is missing.
+ */
+static const char *
+pattern_class(const char *pat)
+{
+  pat++;
+  if (*pat == '^')
+    pat++;
+  if (*pat == ']')
+    pat++;
+  while (*pat != ']') {
+    if (!*pat)
+      return 0;
+    if (*pat == '\\') {
+      if (!pat[1])
+        return 0;
+      pat += 2;
+    } else if (pat[0] == '[' && pat[1] == ':') {
+      if (!(pat = strstr(pat + 2, ":]")))
+        return 0;
+      pat += 2;
+    } else
+      pat++;
+  }
+  return pat + 1;
+}
+
+/** Skip a parenthesized group.
+ * @param[in] pat Position of the opening parenthesis.
+ * @param[in] extended Whether PCRE_EXTENDED is in effect.
+ * @return Position after the closing parenthesis, or NULL if the group
+ * cannot safely be skipped.
+ */
+static const char *
+pattern_group(const char *pat, int extended)
+{
+  int depth = 0;
+
+  while (*pat) {
+    if (*pat == '\\') {
+      if (!pat[1] || pat[1] == 'Q')
+        return 0;
+      pat += 2;
+    } else if (*pat == '[') {
+      if (!(pat = pattern_class(pat)))
+        return 0;
+    } else if (*pat == '#' && extended)
+      return 0; /* a comment may hide parentheses */
+    else {
+      if (*pat == '(')
+        depth++;
+      else if (*pat == ')' && !--depth)
+        return pat + 1;
+      pat++;
+    }
+  }
+  return 0;
+}
+
+/** Find text that every match of a pattern must contain.
+ * Only the top level of the pattern is looked at: the longest run of
+ * literal characters that are neither optional nor inside a group.
+ * @param[in] pattern Regular expression.
+ * @param[in] options Options it was compiled with.
+ * @return Newly allocated lower-cased literal, or NULL if none was found.
+ */
+static char *
+pattern_literal(const char *pattern, int options)
+{
+  char run[FILTER_LITERAL_MAX + 1], best[FILTER_LITERAL_MAX + 1];
+  const char *pat = pattern, *next;
+  int extended = options & PCRE_EXTENDED;
+  int len = 0, best_len = 0, optional;
+  unsigned char ch;
+  char *literal;
+
+#define END_RUN() do { \
+    if (len > best_len) { \
+      memcpy(best, run, len); \
+      best_len = len; \
+    } \
+    len = 0; \
+  } while (0)
+
+  for (;;) {
+    pat = pattern_space(pat, extended);
+    if (!*pat)
+      break;
+
+    switch (*pat) {
+    case '|':
+      return 0; /* alternatives at top level: nothing is required */
+
+    case '(':
+      /* option settings and verbs change how the rest is read */
+      if ((pat[1] == '?' && (strchr("imsxXUJ-#", pat[2]) && pat[2])) ||
+          pat[1] == '*')
+        return 0;
+      if (!(pat = pattern_group(pat, extended)))
+        return 0;
+      END_RUN();
+      pat = pattern_quantifier(pattern_space(pat, extended), &optional);
+      continue;
+
+    case '[':
+      if (!(pat = pattern_class(pat)))
+        return 0;
+      END_RUN();
+      pat = pattern_quantifier(pattern_space(pat, extended), &optional);
+      continue;
+
+    case '.': case '^': case '$':
+      END_RUN();
+      pat = pattern_quantifier(pattern_space(pat + 1, extended), &optional);
+      continue;
+
+    case ')': case '*': case '+': case '?': case '{':
+      return 0;
+
+    case '\\':
+      ch = pat[1];
+      if (!ch)
+        return 0;
+      if ((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') ||
+          (ch >= '0' && ch <= '9')) {
+        /* single-letter classes and assertions; anything longer or
+         * rarer (\x.., \c., \p{..}, back references) ends the search */
+        if (!strchr("dDwWsSbBAzZGhHvVRXntrfea", ch))
+          return 0;
+        END_RUN();
+        pat = pattern_quantifier(pattern_space(pat + 2, extended), &optional);
+        continue;
+      }
+      pat += 2;
+      break;
+
+    default:
+      ch = *pat++;
+      break;
+    }
+
+    /* ch is a literal character; is it quantified? */
+    next = pattern_quantifier(pattern_space(pat, extended), &optional);
+    if (optional == 1 || ch >= 0x80) {
+      /* optional, or not folded the way we fold */
+      END_RUN();
+      pat = next;
+      continue;
+    }
+    if (len < FILTER_LITERAL_MAX)
+      run[len++] = FOLD(ch);
+    if (optional == 0) {
+      END_RUN();
+      pat = next;
+    }
+  }
+  END_RUN();
+#undef END_RUN
+
+  if (best_len < FILTER_LITERAL_MIN)
+    return 0;
+  literal = (char *) MyMalloc(best_len + 1);
+  memcpy(literal, best, best_len);
+  literal[best_len] = '\0';
+  return literal;
+}
+
+/** Compile a filter rule.
+ * @param[in] rule Rule to fill in.
+ * @param[in] owner F:Line or SpamFilter the rule belongs to.
+ * @param[in] filter Compiled regex, owned by \a owner.
+ * @param[in] pattern Source of \a filter.
+ * @param[in] options Options \a filter was compiled with.
+ * @param[in] rflags Reaction flag string.
+ * @param[in] wflags Watch flag string.
+ */
+void
+filter_rule_init(struct FilterRule *rule, void *owner, pcre *filter,
+                 const char *pattern, int options, const char *rflags,
+                 const char *wflags)
+{
+  const char *error = 0;
+
+  memset(rule, 0, sizeof(*rule));
+  rule->fr_owner = owner;
+  rule->fr_filter = filter;
+  rule->fr_rflags = reactfflagstr(rflags);
+  rule->fr_wflags = watchfflagstr(wflags);
+  if (!filter)
+    return;
+
+#ifdef PCRE_STUDY_JIT_COMPILE
+  rule->fr_extra = pcre_study(filter, PCRE_STUDY_JIT_COMPILE, &error);
+#else
+  rule->fr_extra = pcre_study(filter, 0, &error);
+#endif
+  rule->fr_literal = pattern_literal(pattern, options);
+}
+
+/** Release what filter_rule_init() allocated.
+ * @param[in] rule Rule to clear.
+ */
+void
+filter_rule_clear(struct FilterRule *rule)
+{
+  if (rule->fr_extra) {
+#ifdef PCRE_STUDY_JIT_COMPILE
+    pcre_free_study(rule->fr_extra);
+#else
+    pcre_free(rule->fr_extra);
+#endif
+    rule->fr_extra = 0;
+  }
+  MyFree(rule->fr_literal);
+}
+
+/** Forget the running costs of a rule, for instance when an oper
+ * turns it back on.
+ * @param[in] rule Rule to reset.
+ */
+void
+filter_rule_reset_cost(struct FilterRule *rule)
+{
+  rule->fr_calls = 0;
+  rule->fr_hits = 0;
+  rule->fr_samples = 0;
+  rule->fr_time = 0;
+  rule->fr_max = 0;
+  rule->fr_timed = 0;
+  rule->fr_warned = 0;
+}
+
+/** Judge a rule's running time after filterset_exec().
+ * Only runs that were timed are judged, and a rule is judged on its
+ * average rather than on any single run, so one run that was
+ * unlucky with the scheduler does not disable it.  Warnings are given
+ * once per rule.
+ * @param[in] rule Rule that was just run.
+ * @return What to do about the rule.
+ */
+enum FilterCost
+filter_rule_cost(struct FilterRule *rule)
+{
+  unsigned long long mean;
+  int fatal = feature_int(FEAT_FILTER_FATAL_TIME);
+  int warn = feature_int(FEAT_FILTER_WARN_TIME);
+
+  if (!rule->fr_timed)
+    return FILTER_COST_OK;
+  rule->fr_timed = 0;
+
+  /* one run so slow that waiting for more would stall the server */
+  if (fatal > 0 && rule->fr_max > fatal * 1000000ULL * FILTER_RUNAWAY)
+    return FILTER_COST_FATAL;
+  if (rule->fr_samples < FILTER_MIN_SAMPLES)
+    return FILTER_COST_OK;
+
+  mean = rule->fr_time / rule->fr_samples;
+  if (fatal > 0 && mean > fatal * 1000000ULL)
+    return FILTER_COST_FATAL;
+  if (warn > 0 && mean > warn * 1000000ULL && !rule->fr_warned) {
+    rule->fr_warned = 1;
+    return FILTER_COST_WARN;
+  }
+  return FILTER_COST_OK;
+}
+
+/** Estimate the CPU time a rule has used in all.
+ * @param[in] rule Rule to look at.
+ * @return Average time of its timed runs times its runs, in ns.
+ */
+unsigned long long
+filter_rule_total(const struct FilterRule *rule)
+{
+  if (!rule->fr_samples)
+    return 0;
+  return rule->fr_time / rule->fr_samples * rule->fr_calls;
+}
+
+/** Empty a filter set before adding its rules again.
+ * @param[in] set Set to empty.
+ */
+void
+filterset_reset(struct FilterSet *set)
+{
+  int ii;
+
+  set->fs_count = 0;
+  for (ii = 0; ii < FILTER_WATCH_BITS; ii++) {
+    MyFree(set->fs_watch[ii]);
+    set->fs_nwatch[ii] = 0;
+  }
+  MyFree(set->fs_states);
+  MyFree(set->fs_root);
+  MyFree(set->fs_next);
+  MyFree(set->fs_seen);
+  set->fs_nstates = 0;
+  set->fs_scan = 0;
+  set->fs_text = 0;
+}
+
+/** Add a rule to the end of a filter set.
+ * @param[in] set Set to add to.
+ * @param[in] rule Rule to add.
+ */
+void
+filterset_add(struct FilterSet *set, struct FilterRule *rule)
+{
+  if (set->fs_count == set->fs_size) {
+    set->fs_size = set->fs_size ? set->fs_size * 2 : 16;
+    set->fs_rules = (struct FilterRule **)
+      MyRealloc(set->fs_rules, set->fs_size * sizeof(*set->fs_rules));
+  }
+  rule->fr_index = set->fs_count;
+  set->fs_rules[set->fs_count++] = rule;
+}
+
+/** Find the child of an automaton state reached by a byte.
+ * @param[in] set Set holding the automaton.
+ * @param[in] state State to move from.
+ * @param[in] ch Folded byte.
+ * @return Child state, or 0 if there is none.
+ */
+static unsigned int
+ac_child(struct FilterSet *set, unsigned int state, unsigned char ch)
+{
+  unsigned int child;
+
+  if (!state)
+    return set->fs_root[ch];
+  for (child = set->fs_states[state].child; child;
+       child = set->fs_states[child].sibling)
+    if (set->fs_states[child].ch == ch)
+      break;
+  return child;
+}
+
+/** Build the per-flag lists and the literal automaton of a set.
+ * @param[in] set Set whose rules have all been added.
+ */
+void
+filterset_build(struct FilterSet *set)
+{
+  struct FilterAcState *st;
+  unsigned int *queue, ii, jj, state, child, fail, size, head, tail;
+  const unsigned char *ch;
+
+  /* group rules by watch flag, keeping list order */
+  for (jj = 0; jj < FILTER_WATCH_BITS; jj++) {
+    for (ii = 0; ii < set->fs_count; ii++)
+      if (set->fs_rules[ii]->fr_wflags & (1 << jj))
+        set->fs_nwatch[jj]++;
+    if (!set->fs_nwatch[jj])
+      continue;
+    set->fs_watch[jj] = (struct FilterRule **)
+      MyMalloc(set->fs_nwatch[jj] * sizeof(*set->fs_watch[jj]));
+    set->fs_nwatch[jj] = 0;
+    for (ii = 0; ii < set->fs_count; ii++)
+      if (set->fs_rules[ii]->fr_wflags & (1 << jj))
+        set->fs_watch[jj][set->fs_nwatch[jj]++] = set->fs_rules[ii];
+  }
+
+  set->fs_seen = (unsigned int *) MyCalloc(set->fs_count + 1,
+                                           sizeof(*set->fs_seen));
+  set->fs_next = (unsigned int *) MyCalloc(set->fs_count + 1,
+                                           sizeof(*set->fs_next));
+  set->fs_root = (unsigned int *) MyCalloc(256, sizeof(*set->fs_root));
+
+  /* the trie of literals */
+  size = 1;
+  for (ii = 0; ii < set->fs_count; ii++)
+    if (set->fs_rules[ii]->fr_literal)
+      size += strlen(set->fs_rules[ii]->fr_literal);
+  set->fs_states = st = (struct FilterAcState *)
+    MyCalloc(size, sizeof(*set->fs_states));
+  set->fs_nstates = 1;
+
+  for (ii = 0; ii < set->fs_count; ii++) {
+    if (!(ch = (const unsigned char *) set->fs_rules[ii]->fr_literal))
+      continue;
+    for (state = 0; *ch; ch++, state = child) {
+      if ((child = ac_child(set, state, *ch)))
+        continue;
+      child = set->fs_nstates++;
+      st[child].ch = *ch;
+      if (state) {
+        st[child].sibling = st[state].child;
+        st[state].child = child;
+      } else
+        set->fs_root[*ch] = child;
+    }
+    set->fs_next[ii] = st[state].match;
+    st[state].match = ii + 1;
+  }
+
+  /* failure and output links, breadth first */
+  queue = (unsigned int *) MyMalloc(set->fs_nstates * sizeof(*queue));
+  head = tail = 0;
+  for (ii = 0; ii < 256; ii++)
+    if ((child = set->fs_root[ii]))
+      queue[tail++] = child; /* fail and output are already 0 */
+  while (head < tail) {
+    state = queue[head++];
+    for (child = st[state].child; child; child = st[child].sibling) {
+      for (fail = st[state].fail; fail && !ac_child(set, fail, st[child].ch);
+           fail = st[fail].fail)
+        ;
+      st[child].fail = ac_child(set, fail, st[child].ch);
+      st[child].output = st[st[child].fail].match ? st[child].fail :
+        st[st[child].fail].output;
+      queue[tail++] = child;
+    }
+  }
+  MyFree(queue);
+
+  set->fs_dirty = 0;
+}
+
+/** Start filtering a text.
+ * @param[in] set Set to filter with.
+ * @param[in] text Text to filter.
+ * @param[in] flags Watch flag the text is being checked for.
+ * @param[out] count Number of rules returned.
+ * @return Rules to try, in list order.  If \a flags is not a single
+ * watch flag all rules are returned and callers must check fr_wflags.
+ */
+struct FilterRule **
+filterset_begin(struct FilterSet *set, const char *text, unsigned int flags,
+                unsigned int *count)
+{
+  int bit;
+
+  assert(!set->fs_dirty);
+
+  set->fs_text = text;
+  set->fs_scanned = 0;
+
+  for (bit = 0; bit < FILTER_WATCH_BITS; bit++)
+    if (flags == (1U << bit)) {
+      *count = set->fs_nwatch[bit];
+      return set->fs_watch[bit];
+    }
+  *count = set->fs_count;
+  return set->fs_rules;
+}
+
+/** Run the automaton over the current text, noting which literals occur.
+ * @param[in] set Set being filtered with.
+ */
+static void
+filterset_scan(struct FilterSet *set)
+{
+  struct FilterAcState *st = set->fs_states;
+  const unsigned char *ch;
+  unsigned int state = 0, next, out, rule;
+
+  if (++set->fs_scan == 0) {
+    memset(set->fs_seen, 0, set->fs_count * sizeof(*set->fs_seen));
+    set->fs_scan = 1;
+  }
+
+  for (ch = (const unsigned char *) set->fs_text; *ch; ch++) {
+    while (!(next = ac_child(set, state, FOLD(*ch))) && state)
+      state = st[state].fail;
+    state = next;
+    for (out = st[state].match ? state : st[state].output; out;
+         out = st[out].output)
+      for (rule = st[out].match; rule; rule = set->fs_next[rule - 1])
+        set->fs_seen[rule - 1] = set->fs_scan;
+  }
+  set->fs_scanned = 1;
+}
+
+/** Check whether a rule can match the text given to filterset_begin().
+ * @param[in] set Set the rule belongs to.
+ * @param[in] rule Rule to check.
+ * @return Zero if the rule's literal is missing from the text, so the
+ * rule cannot match; non-zero if filterset_exec() must decide.
+ */
+int
+filterset_candidate(struct FilterSet *set, struct FilterRule *rule)
+{
+  if (!rule->fr_literal)
+    return 1;
+  if (!set->fs_scanned)
+    filterset_scan(set);
+  return set->fs_seen[rule->fr_index] == set->fs_scan;
+}
+
+/** Read the CPU time used by this thread.
+ * @return CPU time in ns.
+ */
+static unsigned long long
+filter_clock(void)
+{
+  struct rusage ru;
+#ifdef CLOCK_THREAD_CPUTIME_ID
+  struct timespec ts;
+
+  if (!clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts))
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+  getrusage(RUSAGE_SELF, &ru);
+  return (ru.ru_utime.tv_sec * 1000000ULL + ru.ru_utime.tv_usec) * 1000;
+}
+
+/** Match a rule against the text given to filterset_begin().
+ * @param[in] set Set the rule belongs to.
+ * @param[in] rule Rule to run.
+ * @param[out] ovector Output vector for pcre_exec().
+ * @param[in] ovecsize Size of \a ovector.
+ * @return As for pcre_exec().
+ */
+int
+filterset_exec(struct FilterSet *set, struct FilterRule *rule, int *ovector,
+               int ovecsize)
+{
+  unsigned long long start, elapsed;
+  int res;
+
+  rule->fr_calls++;
+  rule->fr_timed = (rule->fr_calls <= FILTER_SAMPLE_FIRST ||
+                    rule->fr_calls % FILTER_SAMPLE_EVERY == 0);
+
+  if (rule->fr_timed) {
+    start = filter_clock();
+    res = pcre_exec(rule->fr_filter, rule->fr_extra, set->fs_text,
+                    strlen(set->fs_text), 0, 0, ovector, ovecsize);
+    elapsed = filter_clock() - start;
+
+    rule->fr_samples++;
+    rule->fr_time += elapsed;
+    if (elapsed > rule->fr_max)
+      rule->fr_max = elapsed;
+  } else
+    res = pcre_exec(rule->fr_filter, rule->fr_extra, set->fs_text,
+                    strlen(set->fs_text), 0, 0, ovector, ovecsize);
+
+  if (res > 0)
+    rule->fr_hits++;
+  return res;
+}
@@ -70,6 +70,9 @@
 struct Gline* GlobalGlineList  = 0;
 struct Gline* BadChanGlineList = 0;
 
+/** Index over #GlobalGlineList for gline_lookup(). */
+static struct BanIndex GlineIndex;
+
 static void
 canon_userhost(char *userhost, char **user_p, char **host_p, char *def_user)
 {
@@ -131,6 +134,7 @@ make_gline(char *user, char *host, char *reason, time_t expire, time_t lastmod,
   if (flags & GLINE_BADCHAN) { /* set a BADCHAN gline */
     DupString(gline->gl_user, user); /* first, remember channel */
     gline->gl_host = 0;
+    gline->gl_index.bie_where = BI_NONE; /* badchans are not indexed */
 
     gline->gl_next = BadChanGlineList; /* then link it into list */
     gline->gl_prev_p = &BadChanGlineList;
@@ -200,6 +204,15 @@ make_gline(char *user, char *host, char *reason, time_t expire, time_t lastmod,
 	GlobalGlineList->gl_prev_p = &gline->gl_next;
       GlobalGlineList = gline;
     }
+
+    if (GlineIsRealName(gline))
+      banindex_add(&GlineIndex, &gline->gl_index, gline,
+                   after ? &after->gl_index : 0, 0, 0, 0);
+    else
+      banindex_add(&GlineIndex, &gline->gl_index, gline,
+                   after ? &after->gl_index : 0,
+                   GlineIsIpMask(gline) ? &gline->ipnum : 0, gline->bits,
+                   gline->gl_host);
   }
 
   return gline;
@@ -721,59 +734,69 @@ gline_find(char *userhost, unsigned int flags)
   return gline;
 }
 
-struct Gline *
-gline_lookup(struct Client *cptr, unsigned int flags)
+/** Arguments for gline_check(). */
+struct GlineCheck {
+  struct Client *cptr;  /**< Client being looked up. */
+  unsigned int   flags; /**< Search flags passed to gline_lookup(). */
+};
+
+/** Check whether a G-line found through #GlineIndex applies.
+ * @param[in] ban G-line to check; it is freed if it has expired.
+ * @param[in] arg The client and search flags, as a struct GlineCheck.
+ * @return Non-zero if gline_lookup() should return \a ban.
+ */
+static int
+gline_check(void *ban, void *arg)
 {
-  struct Gline *gline;
-  struct Gline *sgline;
+  struct Gline *gline = ban;
+  struct Client *cptr = ((struct GlineCheck *) arg)->cptr;
+  unsigned int flags = ((struct GlineCheck *) arg)->flags;
 
-  for (gline = GlobalGlineList; gline; gline = sgline) {
-    sgline = gline->gl_next;
+  if (gline->gl_expire <= CurrentTime) {
+    gline_free(gline);
+    return 0;
+  }
 
-    if (gline->gl_expire <= CurrentTime) {
-      gline_free(gline);
-      continue;
-    }
-    
-    if ((flags & GLINE_GLOBAL && gline->gl_flags & GLINE_LOCAL) ||
-	     (flags & GLINE_LASTMOD && !gline->gl_lastmod))
-      continue;
+  if ((flags & GLINE_GLOBAL && gline->gl_flags & GLINE_LOCAL) ||
+      (flags & GLINE_LASTMOD && !gline->gl_lastmod))
+    return 0;
 
-    if (GlineIsRealName(gline)) {
-       Debug((DEBUG_DEBUG,"realname gline: '%s' '%s'",gline->gl_user,cli_info(cptr)));
-      if (match(gline->gl_user+2, cli_info(cptr)) != 0)
-	continue;
-      if (!GlineIsActive(gline))
-        continue;
-      return gline;
-    }
-    else {
-      if (match(gline->gl_user, (cli_user(cptr))->realusername) != 0)
-        continue;
-    	 
-      if (GlineIsIpMask(gline)) {
-        Debug((DEBUG_DEBUG,"IP gline: %08x %08x/%i",(cli_ip(cptr)).s_addr,gline->ipnum.s_addr,gline->bits));
-        if (((cli_ip(cptr)).s_addr & NETMASK(gline->bits)) != gline->ipnum.s_addr)
-          continue;
-      }    
-      else {
-        if (match(gline->gl_host, (cli_user(cptr))->realhost) != 0) 
-          continue;
-      }
-    }
+  if (GlineIsRealName(gline)) {
+    Debug((DEBUG_DEBUG,"realname gline: '%s' '%s'",gline->gl_user,cli_info(cptr)));
+    if (match(gline->gl_user+2, cli_info(cptr)) != 0)
+      return 0;
+    return GlineIsActive(gline);
+  }
 
-    /* Check if G:Lined user matches an E:Line */
-    if (find_eline(cptr, EFLAG_GLINE)) {
-      continue;;
-    }
+  if (match(gline->gl_user, (cli_user(cptr))->realusername) != 0)
+    return 0;
 
-    if (GlineIsActive(gline))
-      return gline;
+  if (GlineIsIpMask(gline)) {
+    Debug((DEBUG_DEBUG,"IP gline: %08x %08x/%i",(cli_ip(cptr)).s_addr,gline->ipnum.s_addr,gline->bits));
+    if (((cli_ip(cptr)).s_addr & NETMASK(gline->bits)) != gline->ipnum.s_addr)
+      return 0;
   }
-  /*
-   * No Glines matched
-   */
-  return 0;
+  else {
+    if (match(gline->gl_host, (cli_user(cptr))->realhost) != 0)
+      return 0;
+  }
+
+  /* Check if G:Lined user matches an E:Line */
+  if (find_eline(cptr, EFLAG_GLINE))
+    return 0;
+
+  return GlineIsActive(gline);
+}
+
+struct Gline *
+gline_lookup(struct Client *cptr, unsigned int flags)
+{
+  struct GlineCheck args;
+
+  args.cptr = cptr;
+  args.flags = flags;
+  return banindex_find(&GlineIndex, cli_ip(cptr), cli_user(cptr)->realhost,
+                       gline_check, &args);
 }
 
 void
@@ -781,6 +804,8 @@ gline_free(struct Gline *gline)
 {
   assert(0 != gline);
 
+  banindex_del(&GlineIndex, &gline->gl_index);
+
   *gline->gl_prev_p = gline->gl_next; /* squeeze this gline out */
   if (gline->gl_next)
     gline->gl_next->gl_prev_p = gline->gl_prev_p;
@@ -932,6 +957,7 @@ gline_memory_count(size_t *gl_size)
     *gl_size += gline->gl_host ? (strlen(gline->gl_host) + 1) : 0;
     *gl_size += gline->gl_reason ? (strlen(gline->gl_reason) + 1) : 0;
   }
+  *gl_size += banindex_memory_count(&GlineIndex);
   return gl;
 }
 
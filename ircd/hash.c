@@ -44,6 +44,13 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__x86_64__) && (defined(__clang__) || __GNUC__ > 4 || \
+                            (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+/** Use the SSE4.2 CRC32 instruction when the processor has it. */
+#define HASH_CRC32C
+#include <nmmintrin.h>
+#endif
+
 
 /** @file
  * @brief Hash table management.
@@ -51,17 +58,59 @@
  *
  * This file used to use some very complicated hash function.  Now it
  * uses CRC-32, but effectively remaps each input byte according to a
- * table initialized at startup.
+ * table initialized at startup.  On processors with SSE4.2, the CRC32C
+ * instruction is used instead, eight bytes at a time, on input bytes
+ * that are case-folded and remapped by a random permutation.
+ */
+
+/** Smallest number of buckets in a hash table. */
+#define HASH_MINSIZE            1024
+/** Number of old buckets moved to the new table on each add or remove. */
+#define HASH_REHASH_STEP        8
+
+/** Size bookkeeping for a hash table that resizes itself.
+ * A table doubles when it holds more entries than buckets and halves
+ * when it drops below an eighth of that.  Entries are not rehashed all
+ * at once: the old bucket array is kept and #HASH_REHASH_STEP of its
+ * buckets are moved over on each later add or remove.  An entry whose
+ * bucket in the old array has not been moved yet is still found there.
  */
+struct HashSize {
+  unsigned int mask;            /**< Number of buckets, minus one */
+  unsigned int oldmask;         /**< Same for the old array */
+  unsigned int moved;           /**< Old buckets already moved */
+  unsigned int count;           /**< Number of entries */
+  unsigned int resizes;         /**< Number of resizes started */
+};
 
 /** Hash table for clients. */
-static struct Client *clientTable[HASHSIZE];
+static struct Client **clientTable;
+/** Client hash table being emptied into #clientTable. */
+static struct Client **clientOld;
+/** Size of client hash table. */
+static struct HashSize clientSize;
 /** Hash table for channels. */
-static struct Channel *channelTable[HASHSIZE];
+static struct Channel **channelTable;
+/** Channel hash table being emptied into #channelTable. */
+static struct Channel **channelOld;
+/** Size of channel hash table. */
+static struct HashSize channelSize;
 /** Hash table for watches. */
-static struct Watch *watchTable[HASHSIZE];
+static struct Watch **watchTable;
+/** Watch hash table being emptied into #watchTable. */
+static struct Watch **watchOld;
+/** Size of watch hash table. */
+static struct HashSize watchSize;
 /** CRC-32 update table. */
 static uint32_t crc32hash[256];
+#ifdef HASH_CRC32C
+/** Non-zero if strhash() uses the CRC32C instruction. */
+static int crc32c_enabled;
+/** Random starting value for the CRC32C hash. */
+static uint32_t crc32c_seed;
+/** Case-folding and random remapping of each byte for the CRC32C hash. */
+static unsigned char crc32c_fold[256];
+#endif
 
 /** Initialize the map used by the hash function. */
 void init_hash(void)
@@ -88,21 +137,267 @@ void init_hash(void)
     crc32hash[poly] = jj;
     rnd >>= 8;
   }
+
+#ifdef HASH_CRC32C
+  if (__builtin_cpu_supports("sse4.2"))
+  {
+    unsigned char perm[256];
+
+    /* Shuffle the byte values, then fold case through the shuffle. */
+    for (ii = 0; ii < 256; ii++)
+      perm[ii] = ii;
+    for (ii = 0, rnd = 0; ii < 256; ii++)
+    {
+      if (!rnd)
+        rnd = ircrandom();
+      poly = ii + rnd % (256 - ii);
+      jj = perm[ii];
+      perm[ii] = perm[poly];
+      perm[poly] = jj;
+      rnd >>= 8;
+    }
+    for (ii = 0; ii < 256; ii++)
+      crc32c_fold[ii] = perm[(unsigned char) ToLower((char) ii)];
+    crc32c_seed = ircrandom();
+    crc32c_enabled = 1;
+  }
+#endif
+
+  clientSize.mask = channelSize.mask = watchSize.mask = HASH_MINSIZE - 1;
+  clientTable = MyCalloc(HASH_MINSIZE, sizeof(*clientTable));
+  channelTable = MyCalloc(HASH_MINSIZE, sizeof(*channelTable));
+  watchTable = MyCalloc(HASH_MINSIZE, sizeof(*watchTable));
 }
 
 /** Output type of hash function. */
 typedef unsigned int HASHREGS;
 
-/** Calculate hash value for a string.
+/** Calculate hash value for a string using the CRC-32 table.
  * @param[in] n String to hash.
  * @return Hash value for string.
  */
-static HASHREGS strhash(const char *n)
+static HASHREGS strhash_table(const char *n)
 {
   HASHREGS hash = crc32hash[ToLower(*n++) & 255];
   while (*n)
     hash = (hash >> 8) ^ crc32hash[(hash ^ ToLower(*n++)) & 255];
-  return hash % HASHSIZE;
+  return hash;
+}
+
+#ifdef HASH_CRC32C
+/** Fold eight bytes through #crc32c_fold.
+ * @param[in] v Eight bytes, the first in the low-order position.
+ * @return Folded bytes in the same order.
+ */
+#define CRC32C_FOLD8(v) \
+  ((unsigned long long) crc32c_fold[(v) & 255] | \
+   (unsigned long long) crc32c_fold[((v) >> 8) & 255] << 8 | \
+   (unsigned long long) crc32c_fold[((v) >> 16) & 255] << 16 | \
+   (unsigned long long) crc32c_fold[((v) >> 24) & 255] << 24 | \
+   (unsigned long long) crc32c_fold[((v) >> 32) & 255] << 32 | \
+   (unsigned long long) crc32c_fold[((v) >> 40) & 255] << 40 | \
+   (unsigned long long) crc32c_fold[((v) >> 48) & 255] << 48 | \
+   (unsigned long long) crc32c_fold[(v) >> 56] << 56)
+
+/** Calculate hash value for a string using the CRC32C instruction.
+ * The string is loaded eight bytes at a time, which may read past its
+ * terminating NUL but never into the next page; the bytes are folded
+ * through #crc32c_fold and fed to the CRC in one instruction.
+ * @param[in] n String to hash.
+ * @return Hash value for string.
+ */
+__attribute__((target("sse4.2")))
+static HASHREGS strhash_crc32c(const char *n)
+{
+  const unsigned long long ones = 0x0101010101010101ULL;
+  unsigned long long crc = crc32c_seed;
+  unsigned long long word;
+  unsigned long long zero;
+  unsigned int ii;
+
+  for (;; n += 8) {
+    if (((unsigned long) n & 4095) > 4096 - 8) {
+      /* Too close to the end of a page; gather bytes one at a time. */
+      for (word = 0, ii = 0; ii < 8 && n[ii]; ii++)
+        word |= (unsigned long long) (unsigned char) n[ii] << (ii * 8);
+      if (ii < 8)
+        break;
+    } else {
+      memcpy(&word, n, sizeof(word));
+      if ((zero = (word - ones) & ~word & (ones << 7))) {
+        ii = __builtin_ctzll(zero) >> 3;
+        break;
+      }
+    }
+    crc = _mm_crc32_u64(crc, CRC32C_FOLD8(word));
+  }
+
+  /* Hash the ii bytes left before the NUL, padded with zeroes, and
+   * their count so that the padding cannot collide with real bytes. */
+  word = CRC32C_FOLD8(word) & ((1ULL << (ii * 8)) - 1);
+  crc = _mm_crc32_u64(crc, word);
+  return (HASHREGS) _mm_crc32_u8((unsigned int) crc, ii);
+}
+#endif
+
+/** Calculate hash value for a string.
+ * @param[in] n String to hash.
+ * @return Hash value for string.
+ */
+static HASHREGS strhash(const char *n)
+{
+#ifdef HASH_CRC32C
+  if (crc32c_enabled)
+    return strhash_crc32c(n);
+#endif
+  return strhash_table(n);
+}
+
+/** Check whether a hash table should change size.
+ * @param[in] hs Size of the table.
+ * @return New number of buckets, or zero to keep the current size.
+ */
+static unsigned int hash_newsize(const struct HashSize *hs)
+{
+  unsigned int size = hs->mask + 1;
+
+  if (hs->count > size && size < (UINT_MAX >> 1) + 1)
+    return size << 1;
+  if (hs->count < size >> 3 && size > HASH_MINSIZE)
+    return size >> 1;
+  return 0;
+}
+
+/** Begin resizing a hash table.
+ * @param[in,out] hs Size of the table.
+ * @param[in] size New number of buckets.
+ */
+static void hash_resize(struct HashSize *hs, unsigned int size)
+{
+  hs->oldmask = hs->mask;
+  hs->mask = size - 1;
+  hs->moved = 0;
+  hs->resizes++;
+}
+
+/** Get the bucket that holds (or should hold) a client name.
+ * @param[in] hashv Hash value of the name.
+ * @return Pointer to the head of the bucket.
+ */
+static struct Client **client_bucket(HASHREGS hashv)
+{
+  if (clientOld && (hashv & clientSize.oldmask) >= clientSize.moved)
+    return &clientOld[hashv & clientSize.oldmask];
+  return &clientTable[hashv & clientSize.mask];
+}
+
+/** Move a few buckets of the client table into its new bucket array,
+ * or start a resize if the table needs one.
+ */
+static void client_rehash(void)
+{
+  struct Client *cptr;
+  struct Client **bucket;
+  unsigned int size;
+  int ii;
+
+  if (clientOld) {
+    for (ii = 0; ii < HASH_REHASH_STEP && clientSize.moved <= clientSize.oldmask;
+         ii++, clientSize.moved++) {
+      while ((cptr = clientOld[clientSize.moved])) {
+        clientOld[clientSize.moved] = cli_hnext(cptr);
+        bucket = &clientTable[strhash(cli_name(cptr)) & clientSize.mask];
+        cli_hnext(cptr) = *bucket;
+        *bucket = cptr;
+      }
+    }
+    if (clientSize.moved > clientSize.oldmask)
+      MyFree(clientOld);
+  } else if ((size = hash_newsize(&clientSize))) {
+    clientOld = clientTable;
+    clientTable = MyCalloc(size, sizeof(*clientTable));
+    hash_resize(&clientSize, size);
+  }
+}
+
+/** Get the bucket that holds (or should hold) a channel name.
+ * @param[in] hashv Hash value of the name.
+ * @return Pointer to the head of the bucket.
+ */
+static struct Channel **channel_bucket(HASHREGS hashv)
+{
+  if (channelOld && (hashv & channelSize.oldmask) >= channelSize.moved)
+    return &channelOld[hashv & channelSize.oldmask];
+  return &channelTable[hashv & channelSize.mask];
+}
+
+/** Move a few buckets of the channel table into its new bucket array,
+ * or start a resize if the table needs one.
+ */
+static void channel_rehash(void)
+{
+  struct Channel *chptr;
+  struct Channel **bucket;
+  unsigned int size;
+  int ii;
+
+  if (channelOld) {
+    for (ii = 0; ii < HASH_REHASH_STEP && channelSize.moved <= channelSize.oldmask;
+         ii++, channelSize.moved++) {
+      while ((chptr = channelOld[channelSize.moved])) {
+        channelOld[channelSize.moved] = chptr->hnext;
+        bucket = &channelTable[strhash(chptr->chname) & channelSize.mask];
+        chptr->hnext = *bucket;
+        *bucket = chptr;
+      }
+    }
+    if (channelSize.moved > channelSize.oldmask)
+      MyFree(channelOld);
+  } else if ((size = hash_newsize(&channelSize))) {
+    channelOld = channelTable;
+    channelTable = MyCalloc(size, sizeof(*channelTable));
+    hash_resize(&channelSize, size);
+  }
+}
+
+/** Get the bucket that holds (or should hold) a watched nick.
+ * @param[in] hashv Hash value of the nick.
+ * @return Pointer to the head of the bucket.
+ */
+static struct Watch **watch_bucket(HASHREGS hashv)
+{
+  if (watchOld && (hashv & watchSize.oldmask) >= watchSize.moved)
+    return &watchOld[hashv & watchSize.oldmask];
+  return &watchTable[hashv & watchSize.mask];
+}
+
+/** Move a few buckets of the watch table into its new bucket array,
+ * or start a resize if the table needs one.
+ */
+static void watch_rehash(void)
+{
+  struct Watch *wptr;
+  struct Watch **bucket;
+  unsigned int size;
+  int ii;
+
+  if (watchOld) {
+    for (ii = 0; ii < HASH_REHASH_STEP && watchSize.moved <= watchSize.oldmask;
+         ii++, watchSize.moved++) {
+      while ((wptr = watchOld[watchSize.moved])) {
+        watchOld[watchSize.moved] = wt_next(wptr);
+        bucket = &watchTable[strhash(wt_nick(wptr)) & watchSize.mask];
+        wt_next(wptr) = *bucket;
+        *bucket = wptr;
+      }
+    }
+    if (watchSize.moved > watchSize.oldmask)
+      MyFree(watchOld);
+  } else if ((size = hash_newsize(&watchSize))) {
+    watchOld = watchTable;
+    watchTable = MyCalloc(size, sizeof(*watchTable));
+    hash_resize(&watchSize, size);
+  }
 }
 
 /************************** Externally visible functions ********************/
@@ -121,10 +416,13 @@ static HASHREGS strhash(const char *n)
  */
 int hAddClient(struct Client *cptr)
 {
-  HASHREGS hashv = strhash(cli_name(cptr));
+  struct Client **bucket;
 
-  cli_hnext(cptr) = clientTable[hashv];
-  clientTable[hashv] = cptr;
+  client_rehash();
+  bucket = client_bucket(strhash(cli_name(cptr)));
+  cli_hnext(cptr) = *bucket;
+  *bucket = cptr;
+  clientSize.count++;
 
   return 0;
 }
@@ -135,10 +433,13 @@ int hAddClient(struct Client *cptr)
  */
 int hAddChannel(struct Channel *chptr)
 {
-  HASHREGS hashv = strhash(chptr->chname);
+  struct Channel **bucket;
 
-  chptr->hnext = channelTable[hashv];
-  channelTable[hashv] = chptr;
+  channel_rehash();
+  bucket = channel_bucket(strhash(chptr->chname));
+  chptr->hnext = *bucket;
+  *bucket = chptr;
+  channelSize.count++;
 
   return 0;
 }
@@ -149,12 +450,14 @@ int hAddChannel(struct Channel *chptr)
  */
 int hRemClient(struct Client *cptr)
 {
-  HASHREGS hashv = strhash(cli_name(cptr));
-  struct Client *tmp = clientTable[hashv];
+  struct Client **bucket = client_bucket(strhash(cli_name(cptr)));
+  struct Client *tmp = *bucket;
 
   if (tmp == cptr) {
-    clientTable[hashv] = cli_hnext(cptr);
+    *bucket = cli_hnext(cptr);
     cli_hnext(cptr) = cptr;
+    clientSize.count--;
+    client_rehash();
     return 0;
   }
 
@@ -162,6 +465,8 @@ int hRemClient(struct Client *cptr)
     if (cli_hnext(tmp) == cptr) {
       cli_hnext(tmp) = cli_hnext(cli_hnext(tmp));
       cli_hnext(cptr) = cptr;
+      clientSize.count--;
+      client_rehash();
       return 0;
     }
     tmp = cli_hnext(tmp);
@@ -176,13 +481,15 @@ int hRemClient(struct Client *cptr)
  */
 int hChangeClient(struct Client *cptr, const char *newname)
 {
-  HASHREGS newhash = strhash(newname);
+  struct Client **bucket;
 
   assert(0 != cptr);
   hRemClient(cptr);
 
-  cli_hnext(cptr) = clientTable[newhash];
-  clientTable[newhash] = cptr;
+  bucket = client_bucket(strhash(newname));
+  cli_hnext(cptr) = *bucket;
+  *bucket = cptr;
+  clientSize.count++;
   return 0;
 }
 
@@ -192,12 +499,14 @@ int hChangeClient(struct Client *cptr, const char *newname)
  */
 int hRemChannel(struct Channel *chptr)
 {
-  HASHREGS hashv = strhash(chptr->chname);
-  struct Channel *tmp = channelTable[hashv];
+  struct Channel **bucket = channel_bucket(strhash(chptr->chname));
+  struct Channel *tmp = *bucket;
 
   if (tmp == chptr) {
-    channelTable[hashv] = chptr->hnext;
+    *bucket = chptr->hnext;
     chptr->hnext = chptr;
+    channelSize.count--;
+    channel_rehash();
     return 0;
   }
 
@@ -205,6 +514,8 @@ int hRemChannel(struct Channel *chptr)
     if (tmp->hnext == chptr) {
       tmp->hnext = tmp->hnext->hnext;
       chptr->hnext = chptr;
+      channelSize.count--;
+      channel_rehash();
       return 0;
     }
     tmp = tmp->hnext;
@@ -221,8 +532,8 @@ int hRemChannel(struct Channel *chptr)
  */
 struct Client* hSeekClient(const char *name, int TMask)
 {
-  HASHREGS hashv      = strhash(name);
-  struct Client *cptr = clientTable[hashv];
+  struct Client **bucket = client_bucket(strhash(name));
+  struct Client *cptr = *bucket;
 
   if (cptr) {
     if (0 == (cli_status(cptr) & TMask) || 0 != ircd_strcmp(name, cli_name(cptr))) {
@@ -230,8 +541,8 @@ struct Client* hSeekClient(const char *name, int TMask)
       while (prev = cptr, cptr = cli_hnext(cptr)) {
         if ((cli_status(cptr) & TMask) && (0 == ircd_strcmp(name, cli_name(cptr)))) {
           cli_hnext(prev) = cli_hnext(cptr);
-          cli_hnext(cptr) = clientTable[hashv];
-          clientTable[hashv] = cptr;
+          cli_hnext(cptr) = *bucket;
+          *bucket = cptr;
           break;
         }
       }
@@ -247,8 +558,8 @@ struct Client* hSeekClient(const char *name, int TMask)
  */
 struct Channel* hSeekChannel(const char *name)
 {
-  HASHREGS hashv = strhash(name);
-  struct Channel *chptr = channelTable[hashv];
+  struct Channel **bucket = channel_bucket(strhash(name));
+  struct Channel *chptr = *bucket;
 
   if (chptr) {
     if (0 != ircd_strcmp(name, chptr->chname)) {
@@ -256,8 +567,8 @@ struct Channel* hSeekChannel(const char *name)
       while (prev = chptr, chptr = chptr->hnext) {
         if (0 == ircd_strcmp(name, chptr->chname)) {
           prev->hnext = chptr->hnext;
-          chptr->hnext = channelTable[hashv];
-          channelTable[hashv] = chptr;
+          chptr->hnext = *bucket;
+          *bucket = chptr;
           break;
         }
       }
@@ -272,6 +583,30 @@ struct Channel* hSeekChannel(const char *name)
    coders are able to SIGCORE the server and look into what goes
    on themselves :-) */
 
+/** Send the statistics for one hash table to a client.
+ * @param[in] sptr Client that asked for the statistics.
+ * @param[in] name Name of the table.
+ * @param[in] hs Size of the table.
+ * @param[in] old Non-zero if the table is being resized.
+ * @param[in] buckets Number of non-empty buckets.
+ * @param[in] max_chain Length of the longest bucket.
+ */
+static void hash_report(struct Client *sptr, const char *name,
+                        const struct HashSize *hs, int old,
+                        unsigned int buckets, unsigned int max_chain)
+{
+  unsigned int load = (unsigned int)
+    ((unsigned long long) hs->count * 100 / (hs->mask + 1));
+
+  sendcmdto_one(&me, CMD_NOTICE, sptr, "%C :%s: entries: %u buckets: %u/%u "
+		"load: %u.%02u max chain: %u resizes: %u", sptr, name,
+		hs->count, buckets, hs->mask + 1, load / 100, load % 100,
+		max_chain, hs->resizes);
+  if (old)
+    sendcmdto_one(&me, CMD_NOTICE, sptr, "%C :%s: rehashing from %u "
+		  "buckets, %u moved", sptr, name, hs->oldmask + 1, hs->moved);
+}
+
 /** Report hash table statistics to a client.
  * @param[in] cptr Client that sent us this message.
  * @param[in] sptr Client that originated the message.
@@ -281,51 +616,92 @@ struct Channel* hSeekChannel(const char *name)
  */
 int m_hash(struct Client *cptr, struct Client *sptr, int parc, char *parv[])
 {
-  int max_chain = 0;
-  int buckets   = 0;
-  int count     = 0;
+  unsigned int max_chain;
+  unsigned int buckets;
+  unsigned int len;
+  unsigned int i;
   struct Client*  cl;
   struct Channel* ch;
-  int i;
-  
+  struct Watch*   wt;
+
   sendcmdto_one(&me, CMD_NOTICE, sptr, "%C :Hash Table Statistics", sptr);
 
-  for (i = 0; i < HASHSIZE; ++i) {
-    if ((cl = clientTable[i])) {
-      int len = 0;
+  /* Buckets in the old array of a resizing table hold entries too. */
+  buckets = max_chain = 0;
+  for (i = 0; i <= clientSize.mask + clientSize.oldmask + 1; ++i) {
+    if (i <= clientSize.mask)
+      cl = clientTable[i];
+    else if (clientOld && i - clientSize.mask - 1 >= clientSize.moved)
+      cl = clientOld[i - clientSize.mask - 1];
+    else
+      continue;
+    for (len = 0; cl; cl = cli_hnext(cl))
+      ++len;
+    if (len)
       ++buckets;
-      for ( ; cl; cl = cli_hnext(cl))
-        ++len; 
-      if (len > max_chain)
-        max_chain = len;
-      count += len;
-    }
-  } 
-
-  sendcmdto_one(&me, CMD_NOTICE, sptr, "%C :Client: entries: %d buckets: %d "
-		"max chain: %d", sptr, count, buckets, max_chain);
-
-  buckets = 0;
-  count   = 0;
-  max_chain = 0;
-
-  for (i = 0; i < HASHSIZE; ++i) {
-    if ((ch = channelTable[i])) {
-      int len = 0;
+    if (len > max_chain)
+      max_chain = len;
+  }
+  hash_report(sptr, "Client", &clientSize, clientOld != 0, buckets,
+              max_chain);
+
+  buckets = max_chain = 0;
+  for (i = 0; i <= channelSize.mask + channelSize.oldmask + 1; ++i) {
+    if (i <= channelSize.mask)
+      ch = channelTable[i];
+    else if (channelOld && i - channelSize.mask - 1 >= channelSize.moved)
+      ch = channelOld[i - channelSize.mask - 1];
+    else
+      continue;
+    for (len = 0; ch; ch = ch->hnext)
+      ++len;
+    if (len)
       ++buckets;
-      for ( ; ch; ch = ch->hnext)
-        ++len; 
-      if (len > max_chain)
-        max_chain = len;
-      count += len;
-    }
-  } 
-
-  sendcmdto_one(&me, CMD_NOTICE, sptr, "%C :Channel: entries: %d buckets: %d "
-		"max chain: %d", sptr, count, buckets, max_chain);
+    if (len > max_chain)
+      max_chain = len;
+  }
+  hash_report(sptr, "Channel", &channelSize, channelOld != 0, buckets,
+              max_chain);
+
+  buckets = max_chain = 0;
+  for (i = 0; i <= watchSize.mask + watchSize.oldmask + 1; ++i) {
+    if (i <= watchSize.mask)
+      wt = watchTable[i];
+    else if (watchOld && i - watchSize.mask - 1 >= watchSize.moved)
+      wt = watchOld[i - watchSize.mask - 1];
+    else
+      continue;
+    for (len = 0; wt; wt = wt_next(wt))
+      ++len;
+    if (len)
+      ++buckets;
+    if (len > max_chain)
+      max_chain = len;
+  }
+  hash_report(sptr, "Watch", &watchSize, watchOld != 0, buckets,
+              max_chain);
   return 0;
 }
 
+/** Count memory used by the client, channel and watch hash tables.
+ * @param[out] mem Receives the size of all bucket arrays.
+ * @return Number of buckets in all three tables.
+ */
+unsigned int hash_memory_count(size_t *mem)
+{
+  unsigned int buckets;
+
+  buckets = clientSize.mask + channelSize.mask + watchSize.mask + 3;
+  if (clientOld)
+    buckets += clientSize.oldmask + 1;
+  if (channelOld)
+    buckets += channelSize.oldmask + 1;
+  if (watchOld)
+    buckets += watchSize.oldmask + 1;
+  *mem = buckets * sizeof(void *);
+  return buckets;
+}
+
 /* Nick jupe utilities, these are in a static hash table with entry/bucket
    ratio of one, collision shift up and roll in a circular fashion, the 
    lowest 12 bits of the hash value are used, deletion is not supported,
@@ -430,63 +806,114 @@ stats_nickjupes(struct Client* to, const struct StatDesc* sd, char* param)
       send_reply(to, RPL_STATSJLINE, jupeTable[i]);
 }
 
-/** Send more channels to a client in mid-LIST.
+/** Send the channels in one hash bucket to a client in mid-LIST.
  * @param[in] cptr Client to send the list to.
+ * @param[in] args Listing parameters.
+ * @param[in] chptr First channel in the bucket.
  */
-void list_next_channels(struct Client *cptr)
+static void list_bucket(struct Client *cptr, struct ListingArgs *args,
+                        struct Channel *chptr)
 {
   char modebuf[MODEBUFLEN];
   char parabuf[MODEBUFLEN];
   char modestuff[MODEBUFLEN + TOPICLEN + 5];
-  struct ListingArgs *args;
-  struct Channel *chptr;
 
-  /* Walk consecutive buckets until we hit the end. */
-  for (args = cli_listing(cptr); args->bucket < HASHSIZE; args->bucket++)
+  for (; chptr; chptr = chptr->hnext)
   {
-    /* Send all the matching channels in the bucket. */
-    for (chptr = channelTable[args->bucket]; chptr; chptr = chptr->hnext)
+    if (chptr->users > args->min_users
+        && chptr->users < args->max_users
+        && chptr->creationtime > args->min_time
+        && chptr->creationtime < args->max_time
+        && chptr->last_message >= args->min_active
+        && chptr->last_message < args->max_active
+        && (!args->wildcard[0] || (args->flags & LISTARG_NEGATEWILDCARD) ||
+            (!match(args->wildcard, chptr->chname)))
+        && (!(args->flags & LISTARG_NEGATEWILDCARD) ||
+            match(args->wildcard, chptr->chname))
+        && (!(args->flags & LISTARG_TOPICLIMITS)
+            || (chptr->topic[0]
+                && chptr->topic_time > args->min_topic_time
+                && chptr->topic_time < args->max_topic_time))
+        && ((args->flags & LISTARG_SHOWSECRET)
+            || (ShowChannel(cptr, chptr) || IsInvited(cptr, chptr))))
     {
-      if (chptr->users > args->min_users
-          && chptr->users < args->max_users
-          && chptr->creationtime > args->min_time
-          && chptr->creationtime < args->max_time
-          && chptr->last_message >= args->min_active
-          && chptr->last_message < args->max_active
-          && (!args->wildcard[0] || (args->flags & LISTARG_NEGATEWILDCARD) ||
-              (!match(args->wildcard, chptr->chname)))
-          && (!(args->flags & LISTARG_NEGATEWILDCARD) ||
-              match(args->wildcard, chptr->chname))
-          && (!(args->flags & LISTARG_TOPICLIMITS)
-              || (chptr->topic[0]
-                  && chptr->topic_time > args->min_topic_time
-                  && chptr->topic_time < args->max_topic_time))
-          && ((args->flags & LISTARG_SHOWSECRET)
-              || (ShowChannel(cptr, chptr) || IsInvited(cptr, chptr))))
-      {
-        modebuf[0] = parabuf[0] = modestuff[0] = 0;
-        channel_modes(cptr, modebuf, parabuf, sizeof(modebuf), chptr);
-        if (modebuf[1] != '\0') {
-          strcat(modestuff, "[");
-          strcat(modestuff, modebuf);
-          if (parabuf[0]) {
-            strcat(modestuff, " ");
-            strcat(modestuff, parabuf);
-          }
-          strcat(modestuff, "] ");
+      modebuf[0] = parabuf[0] = modestuff[0] = 0;
+      channel_modes(cptr, modebuf, parabuf, sizeof(modebuf), chptr);
+      if (modebuf[1] != '\0') {
+        strcat(modestuff, "[");
+        strcat(modestuff, modebuf);
+        if (parabuf[0]) {
+          strcat(modestuff, " ");
+          strcat(modestuff, parabuf);
         }
-        strcat(modestuff, chptr->topic);
-        send_reply(cptr, RPL_LIST, chptr->chname, chptr->users, modestuff);
+        strcat(modestuff, "] ");
+      }
+      strcat(modestuff, chptr->topic);
+      send_reply(cptr, RPL_LIST, chptr->chname, chptr->users, modestuff);
+    }
+  }
+}
+
+/** Reverse the bits of a listing cursor.
+ * @param[in] v Value to reverse.
+ * @return \a v with its bits in reverse order.
+ */
+static unsigned int list_reverse(unsigned int v)
+{
+  unsigned int r = 0;
+  int ii;
+
+  for (ii = 0; ii < (int) (sizeof(v) * CHAR_BIT); ii++, v >>= 1)
+    r = (r << 1) | (v & 1);
+  return r;
+}
+
+/** Send more channels to a client in mid-LIST.
+ * The cursor in ListingArgs::bucket counts through bucket numbers
+ * with their bits reversed.  Since the buckets of a table twice the
+ * size split each bucket into two that follow each other in that
+ * order, every channel present for the whole listing is sent even if
+ * the channel table is resized in between calls.  (A channel can be
+ * sent twice if the table shrinks.)
+ * @param[in] cptr Client to send the list to.
+ */
+void list_next_channels(struct Client *cptr)
+{
+  struct ListingArgs *args = cli_listing(cptr);
+  unsigned int small;
+  unsigned int large;
+  unsigned int v;
+
+  do {
+    if (!channelOld) {
+      small = channelSize.mask;
+      list_bucket(cptr, args, channelTable[args->bucket & small]);
+    } else {
+      /* Send the bucket in the smaller array, then every bucket it
+       * splits into in the larger one. */
+      small = IRCD_MIN(channelSize.mask, channelSize.oldmask);
+      large = IRCD_MAX(channelSize.mask, channelSize.oldmask);
+      v = args->bucket & small;
+      if (small == channelSize.mask)
+        list_bucket(cptr, args, channelTable[v]);
+      else if (v >= channelSize.moved)
+        list_bucket(cptr, args, channelOld[v]);
+      for (; v <= large; v += small + 1) {
+        if (large == channelSize.mask)
+          list_bucket(cptr, args, channelTable[v]);
+        else if (v >= channelSize.moved)
+          list_bucket(cptr, args, channelOld[v]);
       }
     }
+    /* Step to the next bucket in bit-reversed order. */
+    args->bucket = list_reverse(list_reverse(args->bucket | ~small) + 1);
     /* If, at the end of the bucket, client sendq is more than half
      * full, stop. */
-    if (MsgQLength(&cli_sendQ(cptr)) > cli_max_sendq(cptr) / 2)
-      break;
-  }
+  } while (args->bucket &&
+           MsgQLength(&cli_sendQ(cptr)) <= cli_max_sendq(cptr) / 2);
 
   /* If we did all buckets, clean the client and send RPL_LISTEND. */
-  if (args->bucket >= HASHSIZE)
+  if (!args->bucket)
   {
     MyFree(cli_listing(cptr));
     cli_listing(cptr) = NULL;
@@ -500,10 +927,13 @@ void list_next_channels(struct Client *cptr)
  */
 int hAddWatch(struct Watch *wptr)
 {
-  register HASHREGS hashv = strhash(wt_nick(wptr));
+  struct Watch **bucket;
 
-  wt_next(wptr) = watchTable[hashv];
-  watchTable[hashv] = wptr;
+  watch_rehash();
+  bucket = watch_bucket(strhash(wt_nick(wptr)));
+  wt_next(wptr) = *bucket;
+  *bucket = wptr;
+  watchSize.count++;
 
   return 0;
 
@@ -515,12 +945,14 @@ int hAddWatch(struct Watch *wptr)
  */
 int hRemWatch(struct Watch *wptr)
 {
-  HASHREGS hashv = strhash(wt_nick(wptr));
-  struct Watch *tmp = watchTable[hashv];
+  struct Watch **bucket = watch_bucket(strhash(wt_nick(wptr)));
+  struct Watch *tmp = *bucket;
 
   if (tmp == wptr) {
-    watchTable[hashv] = wt_next(wptr);
+    *bucket = wt_next(wptr);
     wt_next(wptr) = wptr;
+    watchSize.count--;
+    watch_rehash();
     return 0;
   }
 
@@ -528,6 +960,8 @@ int hRemWatch(struct Watch *wptr)
     if (wt_next(tmp) == wptr) {
       wt_next(tmp) = wt_next(wt_next(tmp));
       wt_next(wptr) = wptr;
+      watchSize.count--;
+      watch_rehash();
       return 0;
     }
     tmp = wt_next(tmp);
@@ -542,8 +976,8 @@ int hRemWatch(struct Watch *wptr)
  */
 struct Watch *hSeekWatch(const char *nick)
 {
-  HASHREGS hashv = strhash(nick);
-  struct Watch *wptr = watchTable[hashv];
+  struct Watch **bucket = watch_bucket(strhash(nick));
+  struct Watch *wptr = *bucket;
 
   if (wptr) {
     if (0 != ircd_strcmp(nick, wt_nick(wptr))) {
@@ -551,8 +985,8 @@ struct Watch *hSeekWatch(const char *nick)
       while (prev = wptr, wptr = wt_next(wptr)) {
         if (0 == ircd_strcmp(nick, wt_nick(wptr))) {
           wt_next(prev) = wt_next(wptr);
-          wt_next(wptr) = watchTable[hashv];
-          watchTable[hashv] = wptr;
+          wt_next(wptr) = *bucket;
+          *bucket = wptr;
           break;
         }
       }
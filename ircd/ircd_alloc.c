@@ -58,6 +58,13 @@ set_nomem_handler(OutOfMemoryHandler handler)
   noMemHandler = handler;
 }
 
+/** Report an allocation failure to the out-of-memory handler. */
+void
+alloc_nomem(void)
+{
+  (*noMemHandler)();
+}
+
 #ifndef MDEBUG
 /** Allocate memory.
  * @param[in] size Number of bytes to allocate.
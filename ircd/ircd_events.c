@@ -54,6 +54,14 @@ extern struct Engine engine_devpoll;
 #define ENGINE_DEVPOLL
 #endif /* USE_DEVPOLL */
 
+#ifdef USE_IOURING
+extern struct Engine engine_iouring;
+#define ENGINE_IOURING &engine_iouring,
+#else
+/** Address of io_uring engine (if used). */
+#define ENGINE_IOURING
+#endif /* USE_IOURING */
+
 #ifdef USE_EPOLL
 extern struct Engine engine_epoll;
 #define ENGINE_EPOLL &engine_epoll,
@@ -75,12 +83,34 @@ extern struct Engine engine_select;
 /** list of engines to try */
 static const struct Engine *evEngines[] = {
   ENGINE_KQUEUE
+  ENGINE_IOURING
   ENGINE_EPOLL
   ENGINE_DEVPOLL
   ENGINE_FALLBACK
   0
 };
 
+/** Number of bits of expiration time resolved by the innermost wheel. */
+#define TW_L0_BITS	8
+/** Number of bits of expiration time resolved by each outer wheel. */
+#define TW_LN_BITS	6
+/** Number of outer wheels. */
+#define TW_LN_COUNT	3
+/** Number of slots in the innermost wheel. */
+#define TW_L0_SIZE	(1 << TW_L0_BITS)
+/** Number of slots in each outer wheel. */
+#define TW_LN_SIZE	(1 << TW_LN_BITS)
+/** Mask to get the slot number in the innermost wheel. */
+#define TW_L0_MASK	(TW_L0_SIZE - 1)
+/** Mask to get the slot number in an outer wheel (after shifting). */
+#define TW_LN_MASK	(TW_LN_SIZE - 1)
+/** Shift to get the slot number in outer wheel \a lvl. */
+#define TW_LN_SHIFT(lvl) (TW_L0_BITS + (lvl) * TW_LN_BITS)
+/** Farthest expiration (relative to the wheel's time) that fits the wheels. */
+#define TW_MAX_DELTA	(((time_t) 1 << TW_LN_SHIFT(TW_LN_COUNT)) - 1)
+/** Largest clock jump handled by ticking the wheel instead of rebuilding it. */
+#define TW_MAX_STEP	((time_t) 1 << TW_LN_SHIFT(1))
+
 /** Signal routines pipe data.
  * This is used if an engine does not implement signal handling itself
  * (when Engine::eng_signal is NULL).
@@ -96,6 +126,12 @@ static struct {
   struct Event*	       events_free;	/**< struct Event free list */
   unsigned int	       events_alloc;	/**< count of allocated struct Events */
   const struct Engine* engine;		/**< core engine being used */
+  time_t	       tw_time;		/**< next second the timer wheel runs */
+  struct GenHeader*    tw_l0[TW_L0_SIZE]; /**< timers due within TW_L0_SIZE seconds */
+  struct GenHeader*    tw_ln[TW_LN_COUNT][TW_LN_SIZE]; /**< outer timer wheels */
+  struct Socket*       dirty;		/**< sockets with deferred interest changes */
+  unsigned long	       ev_changed;	/**< count of interest mask changes */
+  unsigned long	       ev_applied;	/**< count of changes passed to engine */
 #ifdef IRCD_THREADED
   struct GenHeader*    genq_head;	/**< head of generator event queue */
   struct GenHeader*    genq_tail;	/**< tail of generator event queue */
@@ -103,7 +139,7 @@ static struct {
 #endif
 } evInfo = {
   { 0, 0, 0 },
-  0, 0, 0
+  0, 0, 0, 0, { 0 }, { { 0 } }, 0, 0, 0
 #ifdef IRCD_THREADED
   , 0, 0, 0
 #endif
@@ -240,14 +276,134 @@ event_add(struct Event* event)
 }
 #endif /* IRCD_THREADED */
 
+/** Link a timer into the wheel slot for its expiration time.
+ * Timers are kept in a hierarchical timing wheel: the innermost wheel
+ * has one slot per second for the next TW_L0_SIZE seconds, and each
+ * outer wheel covers TW_LN_SIZE times the span of the one inside it.
+ * Outer wheel slots are cascaded inward as the inner wheel wraps.
+ * Timers that are already due go on Generators::g_timer.
+ * @param[in] timer Timer to link; t_expire must already be set.
+ */
+static void
+timer_link(struct Timer* timer)
+{
+  struct GenHeader** ptr_p;
+  time_t expire = timer->t_expire;
+  time_t delta;
+  int lvl;
+
+  if (expire < evInfo.tw_time) /* already due */
+    ptr_p = &evInfo.gens.g_timer;
+  else if ((delta = expire - evInfo.tw_time) < TW_L0_SIZE)
+    ptr_p = &evInfo.tw_l0[expire & TW_L0_MASK];
+  else {
+    for (lvl = 0; lvl < TW_LN_COUNT - 1; lvl++)
+      if (delta < ((time_t) 1 << TW_LN_SHIFT(lvl + 1)))
+	break;
+    if (delta > TW_MAX_DELTA) /* park in the farthest slot; re-sorted later */
+      expire = evInfo.tw_time + TW_MAX_DELTA;
+    ptr_p = &evInfo.tw_ln[lvl][(expire >> TW_LN_SHIFT(lvl)) & TW_LN_MASK];
+  }
+
+  /* link it at the head of the slot */
+  timer->t_header.gh_next = *ptr_p;
+  timer->t_header.gh_prev_p = ptr_p;
+  if (*ptr_p)
+    (*ptr_p)->gh_prev_p = &timer->t_header.gh_next;
+  *ptr_p = &timer->t_header;
+}
+
+/** Re-link every timer in a wheel slot.
+ * @param[in,out] slot_p Slot to empty.
+ */
+static void
+timer_relink(struct GenHeader** slot_p)
+{
+  struct GenHeader* gen;
+  struct GenHeader* next;
+
+  for (gen = *slot_p, *slot_p = 0; gen; gen = next) {
+    next = gen->gh_next;
+    timer_link((struct Timer*) gen);
+  }
+}
+
+/** Advance the timer wheel by one second.
+ * Timers expiring in the second being passed are moved to the due list.
+ */
+static void
+timer_tick(void)
+{
+  unsigned int idx = evInfo.tw_time & TW_L0_MASK;
+  unsigned int slot;
+  int lvl;
+
+  if (!idx) /* inner wheel wrapped; cascade outer wheels inward */
+    for (lvl = 0; lvl < TW_LN_COUNT; lvl++) {
+      slot = (evInfo.tw_time >> TW_LN_SHIFT(lvl)) & TW_LN_MASK;
+      timer_relink(&evInfo.tw_ln[lvl][slot]);
+      if (slot)
+	break;
+    }
+
+  evInfo.tw_time++;
+  timer_relink(&evInfo.tw_l0[idx]); /* everything here is now due */
+}
+
+/** Rebuild the timer wheel around CurrentTime.
+ * Used when the clock jumps backwards or too far forwards to tick
+ * through; timers that are due end up on the due list unordered.
+ */
+static void
+timer_rebase(void)
+{
+  struct GenHeader* list = 0;
+  struct GenHeader* gen;
+  struct GenHeader* next;
+  int i, lvl;
+
+  Debug((DEBUG_LIST, "Rebasing timer wheel from %Tu to %Tu", evInfo.tw_time,
+	 CurrentTime));
+
+  /* gather up every timer... */
+  for (gen = evInfo.gens.g_timer; gen; gen = next) {
+    next = gen->gh_next;
+    gen->gh_next = list;
+    list = gen;
+  }
+  evInfo.gens.g_timer = 0;
+  for (i = 0; i < TW_L0_SIZE; i++) {
+    for (gen = evInfo.tw_l0[i]; gen; gen = next) {
+      next = gen->gh_next;
+      gen->gh_next = list;
+      list = gen;
+    }
+    evInfo.tw_l0[i] = 0;
+  }
+  for (lvl = 0; lvl < TW_LN_COUNT; lvl++)
+    for (i = 0; i < TW_LN_SIZE; i++) {
+      for (gen = evInfo.tw_ln[lvl][i]; gen; gen = next) {
+	next = gen->gh_next;
+	gen->gh_next = list;
+	list = gen;
+      }
+      evInfo.tw_ln[lvl][i] = 0;
+    }
+
+  /* ...and put them back relative to the new time */
+  evInfo.tw_time = CurrentTime;
+  for (gen = list; gen; gen = next) {
+    next = gen->gh_next;
+    timer_link((struct Timer*) gen);
+  }
+}
+
 /** Place a timer in the correct spot on the queue.
  * @param[in] timer Timer to enqueue.
  */
 static void
 timer_enqueue(struct Timer* timer)
 {
-  struct GenHeader** ptr_p;
-
   assert(0 != timer);
   assert(0 == timer->t_header.gh_prev_p); /* not already on queue */
   assert(timer->t_header.gh_flags & GEN_ACTIVE); /* timer is active */
@@ -263,18 +419,7 @@ timer_enqueue(struct Timer* timer)
     break;
   }
 
-  /* Find a slot to insert timer */
-  for (ptr_p = &evInfo.gens.g_timer; ;
-       ptr_p = &(*ptr_p)->gh_next)
-    if (!*ptr_p || timer->t_expire < ((struct Timer*)*ptr_p)->t_expire)
-      break;
-
-  /* link it in the right place */
-  timer->t_header.gh_next = *ptr_p;
-  timer->t_header.gh_prev_p = ptr_p;
-  if (*ptr_p)
-    (*ptr_p)->gh_prev_p = &timer->t_header.gh_next;
-  *ptr_p = &timer->t_header;
+  timer_link(timer);
 }
 
 /** &Signal handler for writing signal notification to pipe.
@@ -356,6 +501,7 @@ event_init(int max_sockets)
   assert(0 != evEngines[i]);
 
   evInfo.engine = evEngines[i]; /* save engine */
+  evInfo.tw_time = CurrentTime; /* start the timer wheel */
 
   if (!evInfo.engine->eng_signal) { /* engine can't do signals */
     if (pipe(p)) {
@@ -415,32 +561,6 @@ event_generate(enum EventType type, void* arg, int data)
   event_add(ptr); /* add event to queue */
 }
 
-#if 0
-/* Try to verify the timer list */
-void
-timer_verify(void)
-{
-  struct Timer* ptr;
-  struct Timer** ptr_p = &evInfo.gens.g_timer;
-  time_t lasttime = 0;
-
-  for (ptr = evInfo.gens.g_timer; ptr;
-       ptr = (struct Timer*) ptr->t_header.gh_next) {
-    /* verify timer is supposed to be in the list */
-    assert(ptr->t_header.gh_prev_p);
-    /* verify timer is correctly ordered */
-    assert((struct Timer**) ptr->t_header.gh_prev_p == ptr_p);
-    /* verify timer is active */
-    assert(ptr->t_header.gh_flags & GEN_ACTIVE);
-    /* verify timer ordering is correct */
-    assert(lasttime <= ptr->t_expire);
-
-    lasttime = ptr->t_expire; /* store time for ordering check */
-    ptr_p = (struct Timer**) &ptr->t_header.gh_next; /* store prev pointer */
-  }
-}
-#endif
-
 /** Initialize a timer structure.
  * @param[in,out] timer Timer to initialize.
  * @return The pointer \a timer.
@@ -542,33 +662,64 @@ timer_chg(struct Timer* timer, enum TimerType type, time_t value)
   timer_enqueue(timer); /* re-queue the timer */
 }
 
+/** Find when the next timer expires.
+ * The answer may be early (never late) when the nearest timer still
+ * sits in an outer wheel; waking up then just cascades it inward.
+ * @param[in] gen Generators list.
+ * @return Time at which timer_run() next has work to do.
+ */
+time_t
+timer_next(struct Generators* gen)
+{
+  int i;
+
+  if (gen->g_timer) /* something is already due */
+    return ((struct Timer*) gen->g_timer)->t_expire;
+
+  for (i = 0; i < TW_L0_SIZE; i++)
+    if (evInfo.tw_l0[(evInfo.tw_time + i) & TW_L0_MASK])
+      return evInfo.tw_time + i;
+
+  /* nothing in the inner wheel; wake up for the next cascade */
+  return (evInfo.tw_time + TW_L0_MASK) & ~(time_t) TW_L0_MASK;
+}
+
 /** Execute all expired timers. */
 void
 timer_run(void)
 {
   struct Timer* ptr;
 
-  /* go through queue... */
-  while ((ptr = (struct Timer*)evInfo.gens.g_timer)) {
-    if (CurrentTime < ptr->t_expire)
-      break; /* processed all pending timers */
-
-    gen_dequeue(ptr); /* must dequeue timer here */
-    ptr->t_header.gh_flags |= (GEN_MARKED |
-			       (ptr->t_type == TT_PERIODIC ? GEN_READD : 0));
-
-    event_generate(ET_EXPIRE, ptr, 0); /* generate expire event */
+  /* clock went backwards or leapt ahead; rebuild rather than tick */
+  if (CurrentTime + 1 < evInfo.tw_time ||
+      CurrentTime - evInfo.tw_time > TW_MAX_STEP)
+    timer_rebase();
+
+  for (;;) {
+    /* go through due list... */
+    while ((ptr = (struct Timer*)evInfo.gens.g_timer)) {
+      gen_dequeue(ptr); /* must dequeue timer here */
+      ptr->t_header.gh_flags |= (GEN_MARKED |
+				 (ptr->t_type == TT_PERIODIC ? GEN_READD : 0));
+
+      event_generate(ET_EXPIRE, ptr, 0); /* generate expire event */
+
+      ptr->t_header.gh_flags &= ~GEN_MARKED;
+
+      if (!(ptr->t_header.gh_flags & GEN_READD)) {
+	Debug((DEBUG_LIST, "Destroying timer %p", ptr));
+	event_generate(ET_DESTROY, ptr, 0);
+      } else {
+	Debug((DEBUG_LIST, "Re-enqueuing timer %p", ptr));
+	timer_enqueue(ptr); /* re-queue timer */
+	ptr->t_header.gh_flags &= ~GEN_READD;
+      }
+    }
 
-    ptr->t_header.gh_flags &= ~GEN_MARKED;
+    if (evInfo.tw_time > CurrentTime)
+      break; /* processed all pending timers */
 
-    if (!(ptr->t_header.gh_flags & GEN_READD)) {
-      Debug((DEBUG_LIST, "Destroying timer %p", ptr));
-      event_generate(ET_DESTROY, ptr, 0);
-    } else {
-      Debug((DEBUG_LIST, "Re-enqueuing timer %p", ptr));
-      timer_enqueue(ptr); /* re-queue timer */
-      ptr->t_header.gh_flags &= ~GEN_READD;
-    }
+    timer_tick(); /* move the next second's timers onto the due list */
   }
 }
 
@@ -604,6 +755,20 @@ signal_add(struct Signal* sigin, EventCallBack call, void* data, int sig)
   }
 }
 
+/** Remove a socket from the list of sockets with deferred changes.
+ * @param[in] sock Socket to take off the list.
+ */
+static void
+socket_clean(struct Socket* sock)
+{
+  if (!sock->s_dirty_prev_p)
+    return;
+  if ((*sock->s_dirty_prev_p = sock->s_dirty_next))
+    sock->s_dirty_next->s_dirty_prev_p = sock->s_dirty_prev_p;
+  sock->s_dirty_next = 0;
+  sock->s_dirty_prev_p = 0;
+}
+
 /** Adds a socket to the event system.
  * @param[in] sock Socket event generator to use.
  * @param[in] call Callback function to use.
@@ -630,7 +795,10 @@ socket_add(struct Socket* sock, EventCallBack call, void* data,
 
   sock->s_state = state;
   sock->s_events = events & SOCK_EVENT_MASK;
+  sock->s_eng_events = sock->s_events;
   sock->s_fd = fd;
+  sock->s_dirty_next = 0;
+  sock->s_dirty_prev_p = 0;
 
   return (*evInfo.engine->eng_add)(sock); /* tell engine about it */
 }
@@ -649,6 +817,8 @@ socket_del(struct Socket* sock)
   /* tell engine socket is going away */
   (*evInfo.engine->eng_closing)(sock);
 
+  socket_clean(sock);
+
   sock->s_header.gh_flags |= GEN_DESTROY;
 
   if (!sock->s_header.gh_ref) { /* not in use; destroy right now */
@@ -687,6 +857,7 @@ socket_state(struct Socket* sock, enum SocketState state)
   (*evInfo.engine->eng_state)(sock, state);
 
   sock->s_state = state; /* set new state */
+  sock->s_eng_events = sock->s_events; /* engine saw pending changes too */
 }
 
 /** Sets the events a socket's interested in.
@@ -723,10 +894,49 @@ socket_events(struct Socket* sock, unsigned int events)
   if (sock->s_events == new_events)
     return; /* no changes have been made */
 
+  evInfo.ev_changed++;
+
+  if (evInfo.engine->eng_flags & ENGINE_DEFER_EVENTS) {
+    /* remember the change; socket_flush() hands the net result over */
+    sock->s_events = new_events;
+    if (!sock->s_dirty_prev_p) {
+      if ((sock->s_dirty_next = evInfo.dirty))
+	evInfo.dirty->s_dirty_prev_p = &sock->s_dirty_next;
+      sock->s_dirty_prev_p = &evInfo.dirty;
+      evInfo.dirty = sock;
+    }
+    return;
+  }
+
   /* tell engine about event mask change */
   (*evInfo.engine->eng_events)(sock, new_events);
+  evInfo.ev_applied++;
 
   sock->s_events = new_events; /* set new events */
+  sock->s_eng_events = new_events;
+}
+
+/** Pass deferred interest mask changes to the engine.
+ * Engines with ENGINE_DEFER_EVENTS call this before waiting for
+ * events.  A socket whose mask changed back to what the engine already
+ * has costs nothing, no matter how often it changed in between.
+ */
+void
+socket_flush(void)
+{
+  struct Socket* sock;
+
+  while ((sock = evInfo.dirty)) {
+    socket_clean(sock);
+
+    if (sock->s_header.gh_flags & (GEN_DESTROY | GEN_ERROR) ||
+	sock->s_events == sock->s_eng_events)
+      continue;
+
+    sock->s_eng_events = sock->s_events;
+    evInfo.ev_applied++;
+    (*evInfo.engine->eng_events)(sock, sock->s_events);
+  }
 }
 
 /** Returns the current engine's name for informational purposes.
@@ -741,6 +951,17 @@ engine_name(void)
   return evInfo.engine->eng_name;
 }
 
+/** Report how many interest mask changes reached the engine.
+ * @param[out] changed Number of changes made through socket_events().
+ * @param[out] applied Number of changes passed to the engine.
+ */
+void
+engine_event_stats(unsigned long* changed, unsigned long* applied)
+{
+  *changed = evInfo.ev_changed;
+  *applied = evInfo.ev_applied;
+}
+
 #ifdef DEBUGMODE
 /* These routines pretty-print names for states and types for debug printing */
 
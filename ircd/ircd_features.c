@@ -26,6 +26,7 @@
 #include "channel.h"	/* list_set_default */
 #include "class.h"
 #include "client.h"
+#include "cloak.h"
 #include "hash.h"
 #include "ircd.h"
 #include "ircd_alloc.h"
@@ -38,6 +39,7 @@
 #include "numeric.h"
 #include "numnicks.h"
 #include "random.h"	/* random_seed_set */
+#include "res.h"	/* trim_resolver_cache */
 #include "s_bsd.h"
 #include "s_debug.h"
 #include "s_misc.h"
@@ -99,6 +101,13 @@ feature_notify_serverinfo(void)
   ircd_strncpy(cli_info(&his), feature_str(FEAT_HIS_SERVERINFO), REALLEN);
 }
 
+/** Handle an update to a feature that shapes hidden hosts. */
+static void
+feature_notify_hiddenhost(void)
+{
+  ban_identity_flush();
+}
+
 /** Look up a struct LogType given the type string.
  * @param[in] from &Client requesting type, or NULL.
  * @param[in] type Name of log type to find.
@@ -458,6 +467,8 @@ static struct FeatureDesc {
   /* Misc. features */
   F_N(LOG, FEAT_MYOPER, feature_log_set, feature_log_reset, feature_log_get,
       0, log_feature_unmark, log_feature_mark, log_feature_report),
+  F_B(LOG_ASYNC, 0, 0, log_feature_async),
+  F_I(LOG_ASYNC_BUFFER, 0, 1048576, log_feature_async),
   F_S(DOMAINNAME, 0, "Nefarious.IRC", 0),
   F_B(RELIABLE_CLOCK, 0, 0, 0),
   F_I(BUFFERPOOL, 0, 27000000, 0),
@@ -476,7 +487,7 @@ static struct FeatureDesc {
   F_S(DEFAULT_LIST_PARAM, FEAT_NULL, 0, list_set_default),
   F_I(NICKNAMEHISTORYLENGTH, 0, 800, whowas_realloc),
   F_B(HOST_HIDING, 0, 1, 0),
-  F_S(HIDDEN_HOST, FEAT_CASE, "Users.Nefarious", 0),
+  F_S(HIDDEN_HOST, FEAT_CASE, "Users.Nefarious", feature_notify_hiddenhost),
   F_S(HIDDEN_IP, 0, "127.0.0.1", 0),
   F_B(CONNEXIT_NOTICES, 0, 0, 0),
 
@@ -516,6 +527,10 @@ static struct FeatureDesc {
   F_I(POLLS_PER_LOOP, 0, 200, 0),
   F_I(IRCD_RES_RETRIES, 0, 2, 0),
   F_I(IRCD_RES_TIMEOUT, 0, 4, 0),
+  F_I(IRCD_RES_CACHE_SIZE, 0, 1048576, trim_resolver_cache),
+  F_I(IRCD_RES_MIN_TTL, 0, 60, 0),
+  F_I(IRCD_RES_MAX_TTL, 0, 86400, 0),
+  F_I(IRCD_RES_NEGATIVE_TTL, 0, 60, 0),
   F_I(AUTH_TIMEOUT, 0, 9, 0),
 
   /* features that affect all operators */
@@ -625,13 +640,14 @@ static struct FeatureDesc {
   F_S(QPATH, FEAT_CASE | FEAT_MYOPER, "ircd.quotes", 0),
   F_S(EPATH, FEAT_CASE | FEAT_MYOPER, "ircd.rules", 0),
   F_S(TPATH, FEAT_CASE | FEAT_MYOPER, "ircd.tune", 0),
-  F_I(HOST_HIDING_STYLE, 0, 1, 0),
-  F_S(HOST_HIDING_PREFIX, 0, "AfterNET", 0),
-  F_S(HOST_HIDING_KEY1, 0, "aoAr1HnR6gl3sJ7hVz4Zb7x4YwpW", 0),
-  F_S(HOST_HIDING_KEY2, 0, "sdfjkLJKHlkjdkfjsdklfjlkjKLJ", 0),
-  F_S(HOST_HIDING_KEY3, 0, "KJklJSDFLkjLKDFJSLKjlKJFlkjS", 0),
-  F_B(OPERHOST_HIDING, 0, 1, 0),
-  F_S(HIDDEN_OPERHOST, FEAT_CASE, "Staff.Nefarious", 0),
+  F_I(HOST_HIDING_STYLE, 0, 1, feature_notify_hiddenhost),
+  F_S(HOST_HIDING_PREFIX, 0, "AfterNET", cloak_flush_cache),
+  F_S(HOST_HIDING_KEY1, 0, "aoAr1HnR6gl3sJ7hVz4Zb7x4YwpW", cloak_flush_cache),
+  F_S(HOST_HIDING_KEY2, 0, "sdfjkLJKHlkjdkfjsdklfjlkjKLJ", cloak_flush_cache),
+  F_S(HOST_HIDING_KEY3, 0, "KJklJSDFLkjLKDFJSLKjlKJFlkjS", cloak_flush_cache),
+  F_I(HOST_HIDING_CACHE, 0, 4096, cloak_flush_cache),
+  F_B(OPERHOST_HIDING, 0, 1, feature_notify_hiddenhost),
+  F_S(HIDDEN_OPERHOST, FEAT_CASE, "Staff.Nefarious", feature_notify_hiddenhost),
   F_B(TOPIC_BURST, 0, 1, 0),
   F_B(REMOTE_OPER, 0, 1, 0),
   F_B(REMOTE_MOTD, 0, 0, 0),
@@ -697,6 +713,7 @@ static struct FeatureDesc {
   F_S(DIEPASS, FEAT_NULL | FEAT_CASE | FEAT_NODISP | FEAT_READ, 0, 0),
   F_B(DNSBL_CHECKS, 0, 0, 0),
   F_S(DNSBL_EXEMPT_CLASS, 0, "DNSBL_Exempt", 0),
+  F_I(DNSBL_CACHE_TIME, 0, 300, 0),
   F_B(ANNOUNCE_INVITES, 0, 0, 0),
   F_B(OPERFLAGS, 0, 1, 0),
   F_S(WHOIS_OPER, 0, "is an IRC Operator", 0),
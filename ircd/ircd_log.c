@@ -29,6 +29,7 @@
 #include "ircd_log.h"
 #include "client.h"
 #include "ircd_alloc.h"
+#include "ircd_features.h"
 #include "ircd_reply.h"
 #include "ircd_snprintf.h"
 #include "ircd_string.h"
@@ -41,6 +42,10 @@
 /* #include <assert.h> -- Now using assert in ircd_log.h */
 #include <errno.h>
 #include <fcntl.h>
+#ifdef USE_ASYNC_LOG
+#include <pthread.h>
+#include <signal.h>
+#endif
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -188,6 +193,382 @@ static struct logInfo_s {
   struct LogFile *dbfile;   /**< debug file */
 } logInfo = { 0, 0, LOG_USER, "ircd", 0 };
 
+/** Timestamp put in front of each line in a log file.  It is only
+ * rebuilt when the second changes, which spares a localtime() call
+ * for every line written during a burst.
+ */
+static struct {
+  time_t       when;    /**< Time the stamp was built for. */
+  unsigned int len;     /**< Length of the stamp. */
+  /* 1234567890123456789012 3 */
+  /* [2000-11-28 16:11:20] \0 */
+  char         buf[23]; /**< Text of the stamp. */
+} logStamp;
+
+/** Bring #logStamp up to date. */
+static void
+log_stamp(void)
+{
+  time_t curtime = TStime();
+  struct tm *tstamp;
+
+  if (logStamp.len && logStamp.when == curtime)
+    return;
+
+  tstamp = localtime(&curtime);
+  logStamp.len =
+    ircd_snprintf(0, logStamp.buf, sizeof(logStamp.buf),
+                  "[%d-%d-%d %d:%02d:%02d] ", tstamp->tm_year + 1900,
+                  tstamp->tm_mon + 1, tstamp->tm_mday, tstamp->tm_hour,
+                  tstamp->tm_min, tstamp->tm_sec);
+  logStamp.when = curtime;
+}
+
+#ifdef USE_ASYNC_LOG
+
+/** Header of a line queued in the log ring.  The line follows,
+ * timestamp and newline included.
+ */
+struct LogRecord {
+  unsigned int   lr_size;   /**< Bytes taken in the ring, header included. */
+  int            lr_fd;     /**< File to write to, or -1. */
+  int            lr_syslog; /**< Syslog priority, or -1. */
+  unsigned short lr_stamp;  /**< Length of the timestamp. */
+  unsigned short lr_len;    /**< Length of the line. */
+};
+
+/** Records start on multiples of this, so even the padding record
+ * that fills the end of the ring has room for its header. */
+#define LOG_RECORD_ALIGN   sizeof(struct LogRecord)
+/** Bytes a record with a line of \a len bytes takes in the ring. */
+#define LOG_RECORD_SIZE(len) ((sizeof(struct LogRecord) + (len) + \
+                               LOG_RECORD_ALIGN - 1) & ~(LOG_RECORD_ALIGN - 1))
+/** Smallest ring, enough for many of the longest lines. */
+#define LOG_RING_MIN       65536
+/** Most lines handed to one writev(). */
+#define LOG_WRITE_LINES    128
+/** How long the writer waits for more lines after writing some. */
+#define LOG_LINGER_NSEC    100000000
+
+#define LOG_WRITER_BUSY    0 /**< Writer is writing lines out. */
+#define LOG_WRITER_LINGER  1 /**< Writer is waiting briefly for more lines. */
+#define LOG_WRITER_IDLE    2 /**< Writer sleeps until woken. */
+
+/** Ring of log lines waiting for the writer thread.
+ * The server is the only producer and the writer the only consumer:
+ * the server alone moves #head and the writer alone moves #tail, so
+ * neither needs the lock.  The lock and conditions are only used to
+ * put the writer to sleep and wake it up again.
+ */
+static struct {
+  char            *buf;     /**< Ring memory. */
+  unsigned long    size;    /**< Size of the ring, a power of two. */
+  unsigned long    head;    /**< Bytes ever queued. */
+  unsigned long    tail;    /**< Bytes ever written out. */
+  int              state;   /**< LOG_WRITER_BUSY, _LINGER or _IDLE. */
+  int              running; /**< Non-zero while the writer thread runs. */
+  int              stop;    /**< Tells the writer to finish up and exit. */
+  pthread_t        thread;  /**< The writer thread. */
+  pthread_mutex_t  lock;    /**< Protects sleeping and waking. */
+  pthread_cond_t   wake;    /**< Signalled to wake the writer. */
+  pthread_cond_t   drained; /**< Broadcast when the ring is empty. */
+  unsigned long    queued;  /**< Lines ever queued. */
+  unsigned long    dropped; /**< Lines dropped because the ring was full. */
+  unsigned long    waits;   /**< Lines that waited for room in the ring. */
+  unsigned long    writes;  /**< writev() calls made by the writer. */
+} logRing = {
+  0, 0, 0, 0, LOG_WRITER_BUSY, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER,
+  PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0, 0, 0
+};
+
+/** Write out the lines between \a tail and \a head.
+ * Consecutive lines for the same file go out in one writev().  This
+ * runs in the writer thread, so it must not log anything itself.
+ * @param[in] tail Ring position of the first line.
+ * @param[in] head Ring position after the last line.
+ */
+static void
+log_writer_flush(unsigned long tail, unsigned long head)
+{
+  struct iovec vector[LOG_WRITE_LINES];
+  struct LogRecord *rec;
+  int count = 0, fd = -1;
+
+  for (; tail != head; tail += rec->lr_size) {
+    rec = (struct LogRecord *) (logRing.buf + (tail & (logRing.size - 1)));
+
+    if (rec->lr_syslog >= 0)
+      syslog(rec->lr_syslog, "%.*s", rec->lr_len - rec->lr_stamp - 1,
+             (char *) (rec + 1) + rec->lr_stamp);
+
+    if (rec->lr_fd < 0)
+      continue;
+
+    if (count && (rec->lr_fd != fd || count == LOG_WRITE_LINES)) {
+      writev(fd, vector, count);
+      __atomic_add_fetch(&logRing.writes, 1, __ATOMIC_RELAXED);
+      count = 0;
+    }
+
+    fd = rec->lr_fd;
+    vector[count].iov_base = (char *) (rec + 1);
+    vector[count++].iov_len = rec->lr_len;
+  }
+
+  if (count) {
+    writev(fd, vector, count);
+    __atomic_add_fetch(&logRing.writes, 1, __ATOMIC_RELAXED);
+  }
+}
+
+/** Body of the writer thread.
+ * After writing a batch the writer lingers for a moment so that a
+ * trickle of lines goes out in a few large writes; only once the ring
+ * has stayed empty does it sleep until the server wakes it.
+ * @param[in] arg Unused.
+ * @return NULL.
+ */
+static void *
+log_writer(void *arg)
+{
+  struct timespec until;
+  unsigned long head, tail;
+
+  pthread_mutex_lock(&logRing.lock);
+  for (;;) {
+    tail = logRing.tail;
+    head = __atomic_load_n(&logRing.head, __ATOMIC_SEQ_CST);
+
+    if (head != tail) {
+      __atomic_store_n(&logRing.state, LOG_WRITER_BUSY, __ATOMIC_SEQ_CST);
+      pthread_mutex_unlock(&logRing.lock);
+      log_writer_flush(tail, head);
+      __atomic_store_n(&logRing.tail, head, __ATOMIC_RELEASE);
+      pthread_mutex_lock(&logRing.lock);
+      continue;
+    }
+
+    if (logRing.stop)
+      break;
+
+    pthread_cond_broadcast(&logRing.drained);
+
+    if (logRing.state == LOG_WRITER_BUSY) {
+      __atomic_store_n(&logRing.state, LOG_WRITER_LINGER, __ATOMIC_SEQ_CST);
+      if (__atomic_load_n(&logRing.head, __ATOMIC_SEQ_CST) != tail)
+        continue;
+      clock_gettime(CLOCK_REALTIME, &until);
+      until.tv_nsec += LOG_LINGER_NSEC;
+      if (until.tv_nsec >= 1000000000) {
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000;
+      }
+      pthread_cond_timedwait(&logRing.wake, &logRing.lock, &until);
+    } else {
+      __atomic_store_n(&logRing.state, LOG_WRITER_IDLE, __ATOMIC_SEQ_CST);
+      if (__atomic_load_n(&logRing.head, __ATOMIC_SEQ_CST) != tail)
+        continue;
+      pthread_cond_wait(&logRing.wake, &logRing.lock);
+    }
+  }
+  pthread_mutex_unlock(&logRing.lock);
+
+  return 0;
+}
+
+/** Wake the writer if it is asleep and has reason to get up.
+ * @param[in] force If non-zero, wake a lingering writer too.
+ */
+static void
+log_wake(int force)
+{
+  int state = __atomic_load_n(&logRing.state, __ATOMIC_SEQ_CST);
+
+  if (state == LOG_WRITER_BUSY || (state == LOG_WRITER_LINGER && !force))
+    return;
+
+  pthread_mutex_lock(&logRing.lock);
+  pthread_cond_signal(&logRing.wake);
+  pthread_mutex_unlock(&logRing.lock);
+}
+
+/** Queue a log line for the writer thread.
+ * If the ring is full, the line either waits for room or is dropped.
+ * @param[in] fd File to write the line to, or -1.
+ * @param[in] prio Syslog priority for the line, or -1.
+ * @param[in] text Line to log, without timestamp or newline.
+ * @param[in] len Length of \a text.
+ * @param[in] block If non-zero, wait for room rather than dropping.
+ */
+static void
+log_queue(int fd, int prio, const char *text, unsigned int len, int block)
+{
+  struct LogRecord *rec;
+  unsigned long head = logRing.head, tail, room, offset;
+  unsigned int size = LOG_RECORD_SIZE(logStamp.len + len + 1);
+  char *line;
+
+  for (;;) {
+    tail = __atomic_load_n(&logRing.tail, __ATOMIC_ACQUIRE);
+    offset = head & (logRing.size - 1);
+    room = logRing.size - (head - tail);
+    if (room >= size + (logRing.size - offset < size ? logRing.size - offset : 0))
+      break;
+
+    if (!block) {
+      logRing.dropped++;
+      log_wake(1);
+      return;
+    }
+
+    logRing.waits++;
+    log_wake(1);
+    usleep(1000);
+  }
+
+  if (logRing.size - offset < size) { /* pad out the end of the ring */
+    rec = (struct LogRecord *) (logRing.buf + offset);
+    rec->lr_size = logRing.size - offset;
+    rec->lr_fd = -1;
+    rec->lr_syslog = -1;
+    head += rec->lr_size;
+    offset = 0;
+  }
+
+  rec = (struct LogRecord *) (logRing.buf + offset);
+  rec->lr_size = size;
+  rec->lr_fd = fd;
+  rec->lr_syslog = prio;
+  rec->lr_stamp = logStamp.len;
+  rec->lr_len = logStamp.len + len + 1;
+
+  line = (char *) (rec + 1);
+  memcpy(line, logStamp.buf, logStamp.len);
+  memcpy(line + logStamp.len, text, len);
+  line[logStamp.len + len] = '\n';
+
+  logRing.queued++;
+  __atomic_store_n(&logRing.head, head + size, __ATOMIC_SEQ_CST);
+
+  /* a half-full ring is worth interrupting the writer's pause for */
+  log_wake(head + size - tail > logRing.size / 2);
+}
+
+/** Start the writer thread with an empty ring. */
+static void
+log_async_start(void)
+{
+  static int registered = 0;
+  unsigned long size = LOG_RING_MIN;
+  sigset_t all, old;
+  int err;
+
+  while (size < (unsigned long) feature_int(FEAT_LOG_ASYNC_BUFFER))
+    size <<= 1;
+
+  logRing.buf = (char *) MyMalloc(size);
+  logRing.size = size;
+  logRing.head = logRing.tail = 0;
+  logRing.state = LOG_WRITER_BUSY;
+  logRing.stop = 0;
+
+  /* signals are for the main thread; the writer inherits this mask */
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  err = pthread_create(&logRing.thread, 0, log_writer, 0);
+  pthread_sigmask(SIG_SETMASK, &old, 0);
+
+  if (err) {
+    MyFree(logRing.buf);
+    log_write(LS_SYSTEM, L_ERROR, 0, "Unable to start log writer thread: %s",
+              strerror(err));
+    return;
+  }
+
+  logRing.running = 1;
+
+  if (!registered) { /* lines still queued at exit() get written */
+    atexit(log_flush);
+    registered = 1;
+  }
+}
+
+/** Write out everything queued and stop the writer thread. */
+static void
+log_async_stop(void)
+{
+  pthread_mutex_lock(&logRing.lock);
+  logRing.stop = 1;
+  pthread_cond_signal(&logRing.wake);
+  pthread_mutex_unlock(&logRing.lock);
+
+  pthread_join(logRing.thread, 0);
+  logRing.running = 0;
+  MyFree(logRing.buf);
+}
+
+#endif /* USE_ASYNC_LOG */
+
+/** Wait until every queued log line has been written out.
+ * This must be done before closing any file the lines may go to.
+ */
+void
+log_flush(void)
+{
+#ifdef USE_ASYNC_LOG
+  if (!logRing.running)
+    return;
+
+  pthread_mutex_lock(&logRing.lock);
+  while (__atomic_load_n(&logRing.tail, __ATOMIC_ACQUIRE) != logRing.head) {
+    pthread_cond_signal(&logRing.wake);
+    pthread_cond_wait(&logRing.drained, &logRing.lock);
+  }
+  pthread_mutex_unlock(&logRing.lock);
+#endif /* USE_ASYNC_LOG */
+}
+
+/** Feature change callback for LOG_ASYNC and LOG_ASYNC_BUFFER.
+ * Starts or stops the writer thread, or restarts it with a ring of
+ * the new size.
+ */
+void
+log_feature_async(void)
+{
+#ifdef USE_ASYNC_LOG
+  unsigned long size = LOG_RING_MIN;
+
+  while (size < (unsigned long) feature_int(FEAT_LOG_ASYNC_BUFFER))
+    size <<= 1;
+
+  if (logRing.running &&
+      (!feature_bool(FEAT_LOG_ASYNC) || size != logRing.size))
+    log_async_stop();
+
+  if (!logRing.running && feature_bool(FEAT_LOG_ASYNC))
+    log_async_start();
+#endif /* USE_ASYNC_LOG */
+}
+
+/** Report the state of the log ring to \a cptr.
+ * @param[in] cptr Client requesting information.
+ */
+void
+log_count_memory(struct Client *cptr)
+{
+#ifdef USE_ASYNC_LOG
+  if (!logRing.running)
+    return;
+
+  send_reply(cptr, SND_EXPLICIT | RPL_STATSDEBUG,
+             ":Log ring %lu used %lu queued %lu dropped %lu waited %lu "
+             "writes %lu", logRing.size,
+             logRing.head - __atomic_load_n(&logRing.tail, __ATOMIC_ACQUIRE),
+             logRing.queued, logRing.dropped, logRing.waits,
+             __atomic_load_n(&logRing.writes, __ATOMIC_RELAXED));
+#endif /* USE_ASYNC_LOG */
+}
+
 /** Helper routine to open a log file if needed.
  * If the log file is already open, do nothing.
  * @param[in,out] lf Log file to open.
@@ -218,6 +599,7 @@ log_debug_reopen(void)
 
   /* Ok, it's a real file; close it if necessary and use log_open to open it */
   if (logInfo.dbfile->fd >= 0) {
+    log_flush();
     close(logInfo.dbfile->fd);
     logInfo.dbfile->fd = -1; /* mark that it's closed for log_open */
   }
@@ -322,6 +704,8 @@ log_close(void)
 {
   struct LogFile *ptr;
 
+  log_flush(); /* write out anything still queued */
+
   closelog(); /* close syslog */
 
   for (ptr = logInfo.filelist; ptr; ptr = ptr->next) {
@@ -370,13 +754,8 @@ log_vwrite(enum LogSys subsys, enum LogLevel severity, unsigned int flags,
   struct VarData vd;
   struct LogDesc *desc;
   struct LevelData *ldata;
-  struct tm *tstamp;
   struct iovec vector[3];
-  time_t curtime;
   char buf[LOG_BUFSIZE];
-  /* 1234567890123456789012 3 */
-  /* [2000-11-28 16:11:20] \0 */
-  char timebuf[23];
 
   /* check basic assumptions */
   assert(-1 < (int)subsys);
@@ -424,20 +803,34 @@ log_vwrite(enum LogSys subsys, enum LogLevel severity, unsigned int flags,
   vector[1].iov_len =
     ircd_snprintf(0, buf, sizeof(buf), "%s [%s]: %v", desc->name,
 		  ldata->string, &vd);
+  if (vector[1].iov_len >= sizeof(buf)) /* truncated; length is untruncated */
+    vector[1].iov_len = sizeof(buf) - 1;
 
-  /* if we have something to write to... */
-  if (flags & LOG_DOFILELOG) {
-    curtime = TStime();
-    tstamp = localtime(&curtime); /* build the timestamp */
+  if (flags & LOG_DOFILELOG)
+    log_stamp(); /* bring the timestamp up to date */
 
-    vector[0].iov_len =
-      ircd_snprintf(0, timebuf, sizeof(timebuf), "[%d-%d-%d %d:%02d:%02d] ",
-		    tstamp->tm_year + 1900, tstamp->tm_mon + 1,
-		    tstamp->tm_mday, tstamp->tm_hour, tstamp->tm_min,
-		    tstamp->tm_sec);
+#ifdef USE_ASYNC_LOG
+  /* hand file and syslog output to the writer thread; critical
+   * messages (including failed assertions) are written at once, after
+   * everything queued before them
+   */
+  if (logRing.running && (flags & (LOG_DOFILELOG | LOG_DOSYSLOG))) {
+    if (severity == L_CRIT || log_inassert)
+      log_flush();
+    else {
+      log_queue((flags & LOG_DOFILELOG) ? desc->file->fd : -1,
+                (flags & LOG_DOSYSLOG) ? ldata->syslog | desc->facility : -1,
+                buf, vector[1].iov_len, severity <= L_WARNING);
+      flags &= ~(LOG_DOFILELOG | LOG_DOSYSLOG);
+    }
+  }
+#endif /* USE_ASYNC_LOG */
 
-    /* set up the remaining parts of the writev vector... */
-    vector[0].iov_base = timebuf;
+  /* if we have something to write to... */
+  if (flags & LOG_DOFILELOG) {
+    /* set up the writev vector... */
+    vector[0].iov_base = logStamp.buf;
+    vector[0].iov_len = logStamp.len;
     vector[1].iov_base = buf;
 
     vector[2].iov_base = (void*) "\n"; /* terminate lines with a \n */
@@ -531,8 +924,10 @@ log_file_destroy(struct LogFile *lf)
     *lf->prev_p = lf->next;
 
     lf->prev_p = 0; /* we won't use it for the free list */
-    if (lf->fd >= 0)
+    if (lf->fd >= 0) {
+      log_flush();
       close(lf->fd);
+    }
     lf->fd = -1;
     MyFree(lf->file); /* free the file name */
 
@@ -897,6 +1292,7 @@ log_set_default(const char *facility)
     return 1;
 
   if (logInfo.facility != oldfac) {
+    log_flush();
     closelog(); /* reopen syslog with new facility setting */
     openlog(logInfo.procname, LOG_PID | LOG_NDELAY, logInfo.facility);
   }
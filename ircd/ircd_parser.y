@@ -1682,9 +1682,12 @@ sfilterblock: SFILTER {
 
       fline->length = length;
       fline->active = 1;
+      filter_rule_init(&fline->rule, fline, fline->filter, regex,
+                       PCRE_CASELESS|PCRE_EXTENDED, action, rtype);
 
       fline->next = GlobalFList;
       GlobalFList = fline;
+      filterset_changed(&FlineRules);
 
       regex = NULL;
       rtype = NULL;
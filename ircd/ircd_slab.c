@@ -0,0 +1,232 @@
+/*
+ * IRC - Internet Relay Chat, ircd/ircd_slab.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+/** @file
+ * @brief Slab allocator for small fixed-size structures.
+ * @version $Id$
+ *
+ * Channel memberships and list links are allocated and freed at a high
+ * rate and used to come from malloc() through private free lists,
+ * which never gave anything back and left the nodes of one channel or
+ * user spread over the whole heap.  Each SlabType instead takes
+ * SLAB_SIZE bytes at a time from mmap() and hands out objects from the
+ * fullest slabs it has, so that slabs emptied by a burst of departures
+ * (a netsplit, say) can be unmapped.
+ */
+#include "config.h"
+
+#include "ircd_slab.h"
+#include "ircd_alloc.h"
+#include "ircd_log.h"
+#include "ircd_reply.h"
+#include "numeric.h"
+#include "s_debug.h"
+#include "send.h"
+
+/* #include <assert.h> -- Now using assert in ircd_log.h */
+#include <stdint.h>
+#include <sys/mman.h>
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/** Size and alignment of a slab. */
+#define SLAB_SIZE       16384
+/** Alignment of objects within a slab. */
+#define SLAB_ALIGN      8
+/** Round \a x up to a multiple of #SLAB_ALIGN. */
+#define SLAB_ROUND(x)   (((x) + SLAB_ALIGN - 1) & ~(size_t) (SLAB_ALIGN - 1))
+/** Find the slab holding object \a obj. */
+#define SLAB_OF(obj)    ((struct Slab *) ((uintptr_t) (obj) & \
+                                          ~(uintptr_t) (SLAB_SIZE - 1)))
+/** Offset of the first object in a slab. */
+#define SLAB_FIRST      SLAB_ROUND(sizeof(struct Slab))
+
+/** Header at the start of each slab. */
+struct Slab {
+  struct Slab      *sl_next;    /**< Next slab on the same list. */
+  struct Slab     **sl_prev_p;  /**< What points to this slab. */
+  struct SlabType  *sl_type;    /**< Type of the objects in this slab. */
+  void             *sl_free;    /**< Freed objects, linked by first word. */
+  char             *sl_fresh;   /**< Next object never handed out. */
+  unsigned int      sl_inuse;   /**< Objects allocated from this slab. */
+};
+
+/** Every SlabType that has allocated anything. */
+struct SlabType *SlabTypeList;
+
+/** Put a slab at the head of a list.
+ * @param[in] list List to add to.
+ * @param[in] slab Slab to add.
+ */
+static void slab_link(struct Slab **list, struct Slab *slab)
+{
+  if ((slab->sl_next = *list))
+    slab->sl_next->sl_prev_p = &slab->sl_next;
+  slab->sl_prev_p = list;
+  *list = slab;
+}
+
+/** Take a slab off whichever list it is on.
+ * @param[in] slab Slab to remove.
+ */
+static void slab_unlink(struct Slab *slab)
+{
+  if ((*slab->sl_prev_p = slab->sl_next))
+    slab->sl_next->sl_prev_p = slab->sl_prev_p;
+}
+
+/** Map a new slab for \a type.
+ * mmap() only promises page alignment, so map twice the size and trim
+ * the excess from both ends.
+ * @param[in] type Type the slab will hold.
+ * @return New empty slab.
+ */
+static struct Slab *slab_map(struct SlabType *type)
+{
+  struct Slab *slab;
+  char *base, *start;
+  size_t head;
+
+  base = mmap(0, SLAB_SIZE * 2, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED) {
+    alloc_nomem();
+    return 0;
+  }
+  start = (char *) (((uintptr_t) base + SLAB_SIZE - 1) &
+                    ~(uintptr_t) (SLAB_SIZE - 1));
+  head = start - base;
+  if (head)
+    munmap(base, head);
+  munmap(start + SLAB_SIZE, SLAB_SIZE - head);
+
+  slab = (struct Slab *) start;
+  slab->sl_type = type;
+  slab->sl_free = 0;
+  slab->sl_fresh = start + SLAB_FIRST;
+  slab->sl_inuse = 0;
+  type->st_slabs++;
+  return slab;
+}
+
+/** Fill in the derived fields of a type on its first use.
+ * @param[in] type Type being set up.
+ */
+static void slab_type_init(struct SlabType *type)
+{
+  type->st_size = SLAB_ROUND(type->st_size < sizeof(void *) ?
+                             sizeof(void *) : type->st_size);
+  type->st_perslab = (SLAB_SIZE - SLAB_FIRST) / type->st_size;
+  assert(type->st_perslab > 0);
+  type->st_next = SlabTypeList;
+  SlabTypeList = type;
+}
+
+/** Allocate an object.
+ * The contents of the object are undefined.
+ * @param[in] type Type of object to allocate.
+ * @return Newly allocated object.
+ */
+void *slab_alloc(struct SlabType *type)
+{
+  struct Slab *slab = type->st_partial;
+  void *obj;
+
+  if (!slab) {
+    if (!type->st_perslab)
+      slab_type_init(type);
+    if ((slab = type->st_spare))
+      type->st_spare = 0;
+    else
+      slab = slab_map(type);
+    slab_link(&type->st_partial, slab);
+  }
+
+  if ((obj = slab->sl_free))
+    slab->sl_free = *(void **) obj;
+  else {
+    obj = slab->sl_fresh;
+    slab->sl_fresh += type->st_size;
+  }
+
+  if (++slab->sl_inuse == type->st_perslab) {
+    slab_unlink(slab);
+    slab_link(&type->st_full, slab);
+  }
+  type->st_inuse++;
+  type->st_allocs++;
+  return obj;
+}
+
+/** Free an object.
+ * A slab that was full goes to the head of the partial list, so that
+ * the next allocations fill it up again rather than touching slabs
+ * that are emptying out.  A slab that becomes empty is unmapped unless
+ * there is no spare yet.
+ * @param[in] type Type the object was allocated as.
+ * @param[in] obj Object to free.
+ */
+void slab_free(struct SlabType *type, void *obj)
+{
+  struct Slab *slab = SLAB_OF(obj);
+
+  assert(0 != obj);
+  assert(slab->sl_type == type);
+  assert(slab->sl_inuse > 0);
+
+  *(void **) obj = slab->sl_free;
+  slab->sl_free = obj;
+  type->st_inuse--;
+
+  if (slab->sl_inuse-- == type->st_perslab) {
+    slab_unlink(slab);
+    if (slab->sl_inuse)
+      slab_link(&type->st_partial, slab);
+  } else if (!slab->sl_inuse)
+    slab_unlink(slab);
+
+  if (!slab->sl_inuse) {
+    if (!type->st_spare)
+      type->st_spare = slab;
+    else {
+      munmap(slab, SLAB_SIZE);
+      type->st_slabs--;
+      type->st_released++;
+    }
+  }
+}
+
+/** Report slab usage for each type to \a cptr.
+ * @param[in] cptr Client requesting information.
+ */
+void slab_count_memory(struct Client *cptr)
+{
+  struct SlabType *type;
+  size_t slots;
+
+  for (type = SlabTypeList; type; type = type->st_next) {
+    slots = (size_t) type->st_slabs * type->st_perslab;
+    send_reply(cptr, SND_EXPLICIT | RPL_STATSDEBUG,
+               ":Slab %s: used %zu(%zu) free %zu slabs %u(%zu) "
+               "allocs %zu released %zu", type->st_name, type->st_inuse,
+               type->st_inuse * type->st_size, slots - type->st_inuse,
+               type->st_slabs, (size_t) type->st_slabs * SLAB_SIZE,
+               type->st_allocs, type->st_released);
+  }
+}
@@ -31,6 +31,7 @@
 #include "ircd_features.h"
 #include "ircd_log.h"
 #include "ircd_reply.h"
+#include "ircd_slab.h"
 #include "ircd_string.h"
 #include "ircd_struct.h"
 #include "listener.h"
@@ -64,8 +65,11 @@ static struct Client* clientFreeList;
 /** Linked list of currently unused Connection structures. */
 static struct Connection* connectionFreeList;
 
-/** Linked list of currently unused SLink structures. */
-static struct SLink* slinkFreeList;
+/** Slab pool for SLink structures. */
+static struct SlabType slinkSlab = SLAB_TYPE_INIT("SLink", struct SLink);
+
+/** Slab pool for DLink structures. */
+static struct SlabType dlinkSlab = SLAB_TYPE_INIT("DLink", struct DLink);
 
 /** Initialize the list manipulation support system.
  * Pre-allocate MAXCONNECTIONS Client and Connection structures.
@@ -168,8 +172,6 @@ static void dealloc_connection(struct Connection* con)
 
   if (con_dns_reply(con))
     --(con_dns_reply(con)->ref_count);
-  if (con_dnsbl_reply(con))
-    --(con_dnsbl_reply(con)->ref_count);
   if (-1 < con_fd(con))
     close(con_fd(con));
   MsgQClear(&(con_sendQ(con)));
@@ -427,20 +429,12 @@ void verify_client_list(void)
 }
 #endif /* DEBUGMODE */
 
-/** Allocate a new SLink element.
- * Pulls from #slinkFreeList if it contains anything, else it
- * allocates a new one from the heap.
+/** Allocate a new SLink element from #slinkSlab.
  * @return Newly allocated list element.
  */
 struct SLink* make_link(void)
 {
-  struct SLink* lp = slinkFreeList;
-  if (lp)
-    slinkFreeList = lp->next;
-  else {
-    lp = (struct SLink*) MyMalloc(sizeof(struct SLink));
-    links.alloc++;
-  }
+  struct SLink* lp = (struct SLink*) slab_alloc(&slinkSlab);
   assert(0 != lp);
   links.inuse++;
   memset(lp, 0, sizeof(*lp));
@@ -453,8 +447,7 @@ struct SLink* make_link(void)
 void free_link(struct SLink* lp)
 {
   if (lp) {
-    lp->next = slinkFreeList;
-    slinkFreeList = lp;
+    slab_free(&slinkSlab, lp);
     links.inuse--;
   }
 }
@@ -469,7 +462,7 @@ void free_link(struct SLink* lp)
  */
 struct DLink *add_dlink(struct DLink **lpp, struct Client *cp)
 {
-  struct DLink* lp = (struct DLink*) MyMalloc(sizeof(struct DLink));
+  struct DLink* lp = (struct DLink*) slab_alloc(&dlinkSlab);
   assert(0 != lp);
   lp->value.cptr = cp;
   lp->prev = 0;
@@ -494,7 +487,7 @@ void remove_dlink(struct DLink **lpp, struct DLink *lp)
   }
   else if ((*lpp = lp->next))
     lp->next->prev = NULL;
-  MyFree(lp);
+  slab_free(&dlinkSlab, lp);
 }
 
 /** Report memory usage of a list to \a cptr.
@@ -537,6 +530,7 @@ void send_listinfo(struct Client *cptr, char *name)
   servs.mem = servs.inuse * sizeof(struct Server);
   send_liststats(cptr, &servs, "Servers", &total);
 
+  links.alloc = (size_t) slinkSlab.st_slabs * slinkSlab.st_perslab;
   links.mem = links.inuse * sizeof(struct SLink);
   send_liststats(cptr, &links, "Links", &total);
 
@@ -198,6 +198,7 @@ int ms_account(struct Client* cptr, struct Client* sptr, int parc,
 	  hidden = HasHiddenHost(acptr);
 	  ClearAccount(acptr);
 	  ircd_strncpy(cli_user(acptr)->account, "", ACCOUNTLEN);
+	  ban_identity_clear(acptr);
 	  --UserStats.authed;
 	  if (hidden && (feature_int(FEAT_HOST_HIDING_STYLE) == 1))
 	    unhide_hostmask(acptr);
@@ -217,6 +218,7 @@ int ms_account(struct Client* cptr, struct Client* sptr, int parc,
 				      parv[3], ACCOUNTLEN, cli_name(acptr));
 
 	  ircd_strncpy(cli_user(acptr)->account, parv[3], ACCOUNTLEN);
+	  ban_identity_clear(acptr);
 	  hidden = HasHiddenHost(acptr);
 	  if (hidden && (feature_int(FEAT_HOST_HIDING_STYLE) == 1))
 	    hide_hostmask(acptr);
@@ -258,6 +260,7 @@ int ms_account(struct Client* cptr, struct Client* sptr, int parc,
 	  hidden = HasHiddenHost(acptr);
 	  SetAccount(acptr);
 	  ircd_strncpy(cli_user(acptr)->account, parv[3], ACCOUNTLEN);
+	  ban_identity_clear(acptr);
 	  ++UserStats.authed;
 	  /* Fake hosts have precedence over account-based hidden hosts,
 	     so, if the user was already hidden, don't do it again */
@@ -364,6 +367,7 @@ int ms_account(struct Client* cptr, struct Client* sptr, int parc,
 	  if (type == 'A') {
 	    SetAccount(acptr);
 	    ircd_strncpy(cli_user(acptr)->account, cli_loc(acptr)->account, ACCOUNTLEN);
+	    ban_identity_clear(acptr);
 	    if (feature_int(FEAT_HOST_HIDING_STYLE) == 1) {
 	      SetHiddenHost(acptr);
 	      hide_hostmask(acptr);
@@ -423,6 +427,7 @@ int ms_account(struct Client* cptr, struct Client* sptr, int parc,
     hidden = HasHiddenHost(acptr);
     SetAccount(acptr);
     ircd_strncpy(cli_user(acptr)->account, parv[2], ACCOUNTLEN);
+    ban_identity_clear(acptr);
     ++UserStats.authed;
     /* Fake hosts have precedence over account-based hidden hosts,
        so, if the user was already hidden, don't do it again */
@@ -204,6 +204,7 @@ do_clearmode(struct Client *cptr, struct Client *sptr, struct Channel *chptr,
     }
 
     chptr->banlist = 0;
+    mode_ban_invalidate(chptr);
   }
 
   /*
@@ -222,6 +223,7 @@ do_clearmode(struct Client *cptr, struct Client *sptr, struct Channel *chptr,
     }
 
     chptr->exceptlist = 0;
+    mode_except_invalidate(chptr);
   }
 
   /* Deal with users on the channel */
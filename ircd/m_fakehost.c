@@ -129,6 +129,7 @@ int ms_fakehost(struct Client* cptr, struct Client* sptr, int parc, char* parv[]
   /* Assign and propagate the fakehost */
   SetFakeHost(target);
   ircd_strncpy(cli_user(target)->fakehost, parv[2], HOSTLEN);
+  ban_identity_clear(target);
   hide_hostmask(target);
 
   sendcmdto_serv_butone(sptr, CMD_FAKEHOST, cptr, "%C %s", target,
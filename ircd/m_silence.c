@@ -130,7 +130,7 @@ int m_silence(struct Client* cptr, struct Client* sptr, int parc, char* parv[])
     if (cli_user(acptr) && ((acptr == sptr) || IsChannelService(acptr))) {
       for (lp = cli_user(acptr)->silence; lp; lp = lp->next) {
         send_reply(sptr, RPL_SILELIST, cli_name(acptr),
-                   (lp->flags & SILENCE_EXEMPT) ? "~" : "", lp->value.cp);
+                   (lp->flags & SILENCE_EXEMPT) ? "~" : "", lp->value.silence.mask);
       }
     }
     send_reply(sptr, RPL_ENDOFSILELIST, cli_name(acptr));
@@ -116,6 +116,8 @@
 #endif
 
 struct SpamFilter* GlobalSpamFilterList  = 0;
+/** Compiled form of #GlobalSpamFilterList, for find_fline(). */
+struct FilterSet SpamFilterRules;
 
 /** Deactivate a Spam Filter.
  * @param[in] regex Raw regex string thats checked against the list.
@@ -182,6 +184,8 @@ spamfilter_free(struct SpamFilter *spamfilter)
   if (spamfilter->sf_next)
     spamfilter->sf_next->sf_prev_p = spamfilter->sf_prev_p;
 
+  filter_rule_clear(&spamfilter->sf_rule);
+  filterset_changed(&SpamFilterRules);
   pcre_free(spamfilter->sf_filter);
   MyFree(spamfilter->sf_rawfilter);
   MyFree(spamfilter->sf_rflags);
@@ -260,6 +264,7 @@ spamfilter_add(struct Client* sptr, char *regex, char *rflags, char *wflags, cha
   if ((spamfilter = spamfilter_find(regex, rflags, wflags))) {
     if (!SpamFilterIsActive(spamfilter)) {
       spamfilter->sf_flags |= SPAMFILTER_ACTIVE;
+      filter_rule_reset_cost(&spamfilter->sf_rule);
       msg = "activating";
       activate = 1;
     }
@@ -293,6 +298,8 @@ spamfilter_add(struct Client* sptr, char *regex, char *rflags, char *wflags, cha
     DupString(spamfilter->sf_rflags, rflags);
     DupString(spamfilter->sf_wflags, wflags);
     DupString(spamfilter->sf_reason, reason);
+    filter_rule_init(&spamfilter->sf_rule, spamfilter, spamfilter->sf_filter,
+                     regex, PCRE_CASELESS|PCRE_EXTENDED, rflags, wflags);
 
     spamfilter->sf_flags |= SPAMFILTER_ACTIVE;
 
@@ -305,6 +312,7 @@ spamfilter_add(struct Client* sptr, char *regex, char *rflags, char *wflags, cha
     if (GlobalSpamFilterList)
       GlobalSpamFilterList->sf_prev_p = &spamfilter->sf_next;
     GlobalSpamFilterList = spamfilter;
+    filterset_changed(&SpamFilterRules);
     msg = "adding";
   }
 
@@ -343,6 +351,7 @@ spamfilter_server_add(struct Client* sptr, char *regex, char *rflags, char *wfla
   if ((spamfilter = spamfilter_find(regex, rflags, wflags))) {
     if (!SpamFilterIsActive(spamfilter) && add) {
       spamfilter->sf_flags |= SPAMFILTER_ACTIVE;
+      filter_rule_reset_cost(&spamfilter->sf_rule);
       msg = "activating";
       a = 1;
     } else if (SpamFilterIsActive(spamfilter) && !add) {
@@ -382,6 +391,8 @@ spamfilter_server_add(struct Client* sptr, char *regex, char *rflags, char *wfla
     DupString(spamfilter->sf_rflags, rflags);
     DupString(spamfilter->sf_wflags, wflags);
     DupString(spamfilter->sf_reason, reason);
+    filter_rule_init(&spamfilter->sf_rule, spamfilter, spamfilter->sf_filter,
+                     regex, PCRE_CASELESS|PCRE_EXTENDED, rflags, wflags);
 
     if (add) {
       msg = "adding";
@@ -400,6 +411,7 @@ spamfilter_server_add(struct Client* sptr, char *regex, char *rflags, char *wfla
     if (GlobalSpamFilterList)
       GlobalSpamFilterList->sf_prev_p = &spamfilter->sf_next;
     GlobalSpamFilterList = spamfilter;
+    filterset_changed(&SpamFilterRules);
   }
 
   if (spamfilter) {
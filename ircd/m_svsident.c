@@ -97,6 +97,8 @@ int ms_svsident(struct Client* cptr, struct Client* sptr, int parc, char* parv[]
 
   ircd_strncpy(cli_user(acptr)->username, newident, USERLEN);
   ircd_strncpy(cli_username(acptr), newident, USERLEN);
+  if (MyConnect(acptr))
+    forget_eline(acptr);
 
   sendcmdto_serv_butone(sptr, CMD_SVSIDENT, cptr, "%s%s %s", acptr->cli_user->server->cli_yxx,
         acptr->cli_yxx, newident);
@@ -261,6 +261,7 @@ int m_webirc(struct Client *cptr, struct Client *sptr, int parc, char *parv[])
 
   ircd_strncpy(cli_sock_ip(cptr), ircd_ntoa((const char*) &(cli_ip(cptr))), SOCKIPLEN);
   ircd_strncpy(cli_sockhost(cptr), hostname, HOSTLEN);
+  forget_eline(cptr);
 
   if (cli_user(sptr)) {
     if (!HasHiddenHost(sptr) && (feature_int(FEAT_HOST_HIDING_STYLE) == 1))
@@ -279,6 +280,7 @@ int m_webirc(struct Client *cptr, struct Client *sptr, int parc, char *parv[])
   if (w_flag & WFLAG_SIDENT) {
     if (!EmptyString(wline->ident)) {
       ircd_strncpy(cli_username(cptr), wline->ident, USERLEN);
+      forget_eline(cptr);
       SetGotId(cptr);
     }
   }
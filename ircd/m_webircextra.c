@@ -102,6 +102,7 @@ int m_webircextra(struct Client *cptr, struct Client *sptr, int parc, char *parv
       ClrFlag(cptr, FLAG_GOTID);
     else {
       ircd_strncpy(cli_username(cptr), data, USERLEN);
+      forget_eline(cptr);
       SetGotId(cptr);
     }
   }
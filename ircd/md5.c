@@ -288,6 +288,7 @@ void MD5_Final(unsigned char *result, MD5_CTX *ctx)
 #include <sys/types.h>
 #include "md5.h"
 #endif
+#include <string.h>
 
 /** Generates an MD5 checksum.
  * @param[out] mdout Buffer to store result in, the result will be 16 bytes in binary
@@ -304,4 +305,216 @@ MD5_CTX hash;
 	MD5_Final(mdout, &hash);
 }
 
+/*
+ * Four independent messages hashed side by side, one in each lane of a
+ * 128-bit vector, for callers that need several unrelated digests at
+ * once.  GCC and clang turn the vector arithmetic below into SSE2 or
+ * NEON instructions; MD5 has no rotate or carry between lanes, so each
+ * lane computes exactly what DoMD5() would.
+ */
+#if defined(__GNUC__)
+
+/** Longest message hashed in the vector lanes; longer ones use DoMD5(). */
+#define MD5X4_MAXLEN	247
+/** Padded size of a #MD5X4_MAXLEN message. */
+#define MD5X4_BUFLEN	256
+
+typedef unsigned int md5x4_vec __attribute__((vector_size(16)));
+
+#define MD5X4_F(x, y, z)	((z) ^ ((x) & ((y) ^ (z))))
+#define MD5X4_G(x, y, z)	((y) ^ ((z) & ((x) ^ (y))))
+#define MD5X4_H(x, y, z)	((x) ^ (y) ^ (z))
+#define MD5X4_I(x, y, z)	((y) ^ ((x) | ~(z)))
+
+/*
+ * MD5X4_LOAD reads a little-endian word.  Where the host is little
+ * endian that is a plain (possibly unaligned) load.
+ */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+static inline unsigned int md5x4_load(const unsigned char *p)
+{
+	unsigned int w;
+
+	memcpy(&w, p, sizeof(w));
+	return w;
+}
+#define MD5X4_LOAD(p)	md5x4_load(p)
+#else
+#define MD5X4_LOAD(p) \
+	((unsigned int) (p)[0] | ((unsigned int) (p)[1] << 8) | \
+	 ((unsigned int) (p)[2] << 16) | ((unsigned int) (p)[3] << 24))
+#endif
+
+#define MD5X4_STEP(f, a, b, c, d, x, t, s) \
+	(a) += f((b), (c), (d)) + (x) + (md5x4_vec) { t, t, t, t }; \
+	(a) = ((a) << (s)) | ((a) >> (32 - (s))); \
+	(a) += (b);
+
+/** Generates four MD5 checksums at once.
+ * @param[out] mdout Four buffers of 16 bytes for the results.
+ * @param[in] src    Four messages to hash.
+ * @param[in] n      Length of each message.
+ */
+void DoMD5x4(unsigned char *mdout[4], unsigned char *src[4],
+             unsigned long n[4])
+{
+	unsigned char buf[4][MD5X4_BUFLEN], *ptr;
+	unsigned int blocks[4], nblocks = 0;
+	md5x4_vec a, b, c, d, saved_a, saved_b, saved_c, saved_d, x[16];
+	md5x4_vec active;
+	unsigned int i, j, k, lane;
+
+	for (lane = 0; lane < 4; lane++) {
+		if (n[lane] > MD5X4_MAXLEN) {
+			DoMD5(mdout[lane], src[lane], n[lane]);
+			blocks[lane] = 0;
+		} else
+			blocks[lane] = (n[lane] + 8) / 64 + 1;
+		if (blocks[lane] > nblocks)
+			nblocks = blocks[lane];
+	}
+
+	/* pad each message as MD5_Final() would, and zero-fill the rest */
+	for (lane = 0; lane < 4; lane++) {
+		if (!blocks[lane]) {
+			memset(buf[lane], 0, nblocks * 64);
+			continue;
+		}
+		memcpy(buf[lane], src[lane], n[lane]);
+		memset(buf[lane] + n[lane], 0, nblocks * 64 - n[lane]);
+		buf[lane][n[lane]] = 0x80;
+		ptr = buf[lane] + blocks[lane] * 64 - 8;
+		for (i = 0; i < 8; i++)
+			ptr[i] = (unsigned char) ((n[lane] << 3) >> (i * 8));
+	}
+
+	a = (md5x4_vec) { 0x67452301, 0x67452301, 0x67452301, 0x67452301 };
+	b = (md5x4_vec) { 0xefcdab89, 0xefcdab89, 0xefcdab89, 0xefcdab89 };
+	c = (md5x4_vec) { 0x98badcfe, 0x98badcfe, 0x98badcfe, 0x98badcfe };
+	d = (md5x4_vec) { 0x10325476, 0x10325476, 0x10325476, 0x10325476 };
+
+	for (k = 0; k < nblocks; k++) {
+		for (j = 0; j < 16; j++)
+			x[j] = (md5x4_vec) {
+				MD5X4_LOAD(buf[0] + k * 64 + j * 4),
+				MD5X4_LOAD(buf[1] + k * 64 + j * 4),
+				MD5X4_LOAD(buf[2] + k * 64 + j * 4),
+				MD5X4_LOAD(buf[3] + k * 64 + j * 4) };
+
+		saved_a = a;
+		saved_b = b;
+		saved_c = c;
+		saved_d = d;
+
+/* Round 1 */
+		MD5X4_STEP(MD5X4_F, a, b, c, d, x[0], 0xd76aa478, 7)
+		MD5X4_STEP(MD5X4_F, d, a, b, c, x[1], 0xe8c7b756, 12)
+		MD5X4_STEP(MD5X4_F, c, d, a, b, x[2], 0x242070db, 17)
+		MD5X4_STEP(MD5X4_F, b, c, d, a, x[3], 0xc1bdceee, 22)
+		MD5X4_STEP(MD5X4_F, a, b, c, d, x[4], 0xf57c0faf, 7)
+		MD5X4_STEP(MD5X4_F, d, a, b, c, x[5], 0x4787c62a, 12)
+		MD5X4_STEP(MD5X4_F, c, d, a, b, x[6], 0xa8304613, 17)
+		MD5X4_STEP(MD5X4_F, b, c, d, a, x[7], 0xfd469501, 22)
+		MD5X4_STEP(MD5X4_F, a, b, c, d, x[8], 0x698098d8, 7)
+		MD5X4_STEP(MD5X4_F, d, a, b, c, x[9], 0x8b44f7af, 12)
+		MD5X4_STEP(MD5X4_F, c, d, a, b, x[10], 0xffff5bb1, 17)
+		MD5X4_STEP(MD5X4_F, b, c, d, a, x[11], 0x895cd7be, 22)
+		MD5X4_STEP(MD5X4_F, a, b, c, d, x[12], 0x6b901122, 7)
+		MD5X4_STEP(MD5X4_F, d, a, b, c, x[13], 0xfd987193, 12)
+		MD5X4_STEP(MD5X4_F, c, d, a, b, x[14], 0xa679438e, 17)
+		MD5X4_STEP(MD5X4_F, b, c, d, a, x[15], 0x49b40821, 22)
+
+/* Round 2 */
+		MD5X4_STEP(MD5X4_G, a, b, c, d, x[1], 0xf61e2562, 5)
+		MD5X4_STEP(MD5X4_G, d, a, b, c, x[6], 0xc040b340, 9)
+		MD5X4_STEP(MD5X4_G, c, d, a, b, x[11], 0x265e5a51, 14)
+		MD5X4_STEP(MD5X4_G, b, c, d, a, x[0], 0xe9b6c7aa, 20)
+		MD5X4_STEP(MD5X4_G, a, b, c, d, x[5], 0xd62f105d, 5)
+		MD5X4_STEP(MD5X4_G, d, a, b, c, x[10], 0x02441453, 9)
+		MD5X4_STEP(MD5X4_G, c, d, a, b, x[15], 0xd8a1e681, 14)
+		MD5X4_STEP(MD5X4_G, b, c, d, a, x[4], 0xe7d3fbc8, 20)
+		MD5X4_STEP(MD5X4_G, a, b, c, d, x[9], 0x21e1cde6, 5)
+		MD5X4_STEP(MD5X4_G, d, a, b, c, x[14], 0xc33707d6, 9)
+		MD5X4_STEP(MD5X4_G, c, d, a, b, x[3], 0xf4d50d87, 14)
+		MD5X4_STEP(MD5X4_G, b, c, d, a, x[8], 0x455a14ed, 20)
+		MD5X4_STEP(MD5X4_G, a, b, c, d, x[13], 0xa9e3e905, 5)
+		MD5X4_STEP(MD5X4_G, d, a, b, c, x[2], 0xfcefa3f8, 9)
+		MD5X4_STEP(MD5X4_G, c, d, a, b, x[7], 0x676f02d9, 14)
+		MD5X4_STEP(MD5X4_G, b, c, d, a, x[12], 0x8d2a4c8a, 20)
+
+/* Round 3 */
+		MD5X4_STEP(MD5X4_H, a, b, c, d, x[5], 0xfffa3942, 4)
+		MD5X4_STEP(MD5X4_H, d, a, b, c, x[8], 0x8771f681, 11)
+		MD5X4_STEP(MD5X4_H, c, d, a, b, x[11], 0x6d9d6122, 16)
+		MD5X4_STEP(MD5X4_H, b, c, d, a, x[14], 0xfde5380c, 23)
+		MD5X4_STEP(MD5X4_H, a, b, c, d, x[1], 0xa4beea44, 4)
+		MD5X4_STEP(MD5X4_H, d, a, b, c, x[4], 0x4bdecfa9, 11)
+		MD5X4_STEP(MD5X4_H, c, d, a, b, x[7], 0xf6bb4b60, 16)
+		MD5X4_STEP(MD5X4_H, b, c, d, a, x[10], 0xbebfbc70, 23)
+		MD5X4_STEP(MD5X4_H, a, b, c, d, x[13], 0x289b7ec6, 4)
+		MD5X4_STEP(MD5X4_H, d, a, b, c, x[0], 0xeaa127fa, 11)
+		MD5X4_STEP(MD5X4_H, c, d, a, b, x[3], 0xd4ef3085, 16)
+		MD5X4_STEP(MD5X4_H, b, c, d, a, x[6], 0x04881d05, 23)
+		MD5X4_STEP(MD5X4_H, a, b, c, d, x[9], 0xd9d4d039, 4)
+		MD5X4_STEP(MD5X4_H, d, a, b, c, x[12], 0xe6db99e5, 11)
+		MD5X4_STEP(MD5X4_H, c, d, a, b, x[15], 0x1fa27cf8, 16)
+		MD5X4_STEP(MD5X4_H, b, c, d, a, x[2], 0xc4ac5665, 23)
+
+/* Round 4 */
+		MD5X4_STEP(MD5X4_I, a, b, c, d, x[0], 0xf4292244, 6)
+		MD5X4_STEP(MD5X4_I, d, a, b, c, x[7], 0x432aff97, 10)
+		MD5X4_STEP(MD5X4_I, c, d, a, b, x[14], 0xab9423a7, 15)
+		MD5X4_STEP(MD5X4_I, b, c, d, a, x[5], 0xfc93a039, 21)
+		MD5X4_STEP(MD5X4_I, a, b, c, d, x[12], 0x655b59c3, 6)
+		MD5X4_STEP(MD5X4_I, d, a, b, c, x[3], 0x8f0ccc92, 10)
+		MD5X4_STEP(MD5X4_I, c, d, a, b, x[10], 0xffeff47d, 15)
+		MD5X4_STEP(MD5X4_I, b, c, d, a, x[1], 0x85845dd1, 21)
+		MD5X4_STEP(MD5X4_I, a, b, c, d, x[8], 0x6fa87e4f, 6)
+		MD5X4_STEP(MD5X4_I, d, a, b, c, x[15], 0xfe2ce6e0, 10)
+		MD5X4_STEP(MD5X4_I, c, d, a, b, x[6], 0xa3014314, 15)
+		MD5X4_STEP(MD5X4_I, b, c, d, a, x[13], 0x4e0811a1, 21)
+		MD5X4_STEP(MD5X4_I, a, b, c, d, x[4], 0xf7537e82, 6)
+		MD5X4_STEP(MD5X4_I, d, a, b, c, x[11], 0xbd3af235, 10)
+		MD5X4_STEP(MD5X4_I, c, d, a, b, x[2], 0x2ad7d2bb, 15)
+		MD5X4_STEP(MD5X4_I, b, c, d, a, x[9], 0xeb86d391, 21)
+
+		/* lanes whose message has ended keep their digest */
+		active = (md5x4_vec) { k < blocks[0], k < blocks[1],
+				       k < blocks[2], k < blocks[3] };
+		active = -active;
+		a = saved_a + (a & active);
+		b = saved_b + (b & active);
+		c = saved_c + (c & active);
+		d = saved_d + (d & active);
+	}
+
+	for (lane = 0; lane < 4; lane++) {
+		if (!blocks[lane])
+			continue;
+		ptr = mdout[lane];
+		for (i = 0; i < 4; i++) {
+			ptr[i] = a[lane] >> (i * 8);
+			ptr[i + 4] = b[lane] >> (i * 8);
+			ptr[i + 8] = c[lane] >> (i * 8);
+			ptr[i + 12] = d[lane] >> (i * 8);
+		}
+	}
+}
+
+#else /* !__GNUC__ */
+
+/** Generates four MD5 checksums, one after the other.
+ * @param[out] mdout Four buffers of 16 bytes for the results.
+ * @param[in] src    Four messages to hash.
+ * @param[in] n      Length of each message.
+ */
+void DoMD5x4(unsigned char *mdout[4], unsigned char *src[4],
+             unsigned long n[4])
+{
+	int lane;
+
+	for (lane = 0; lane < 4; lane++)
+		DoMD5(mdout[lane], src[lane], n[lane]);
+}
 
+#endif /* __GNUC__ */
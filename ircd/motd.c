@@ -36,9 +36,11 @@
 #include "ircd_features.h"
 #include "ircd_log.h"
 #include "ircd_reply.h"
+#include "ircd_snprintf.h"
 #include "ircd_string.h"
 #include "match.h"
 #include "msg.h"
+#include "msgq.h"
 #include "numeric.h"
 #include "numnicks.h"
 #include "s_conf.h"
@@ -50,6 +52,7 @@
 
 /* #include <assert.h> -- Now using assert in ircd_log.h */
 #include <errno.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
@@ -178,6 +181,9 @@ motd_cache(struct Motd *motdin)
 
   cache->modtime = *localtime((time_t *) &sb.st_mtime); /* store modtime */
 
+  cache->text = 0;
+  cache->textlen = 0;
+
   cache->count = 0;
   while (cache->count < cache->maxcount && fbgets(line, sizeof(line), file)) {
     /* copy over line, stopping when we overflow or hit line end */
@@ -231,6 +237,7 @@ motd_decache(struct Motd *motdin)
     *cache->prev_p = cache->next;
 
     MyFree(cache->path); /* free path info... */
+    MyFree(cache->text);
 
     MyFree(cache); /* very simple for a reason... */
   }
@@ -293,6 +300,102 @@ motd_lookup(struct Client *cptr)
   return MotdList.local; /* Ok, return the default motd */
 }
 
+/** Add one reply to a MOTD template.
+ * The reply is laid out as a local user would get it from
+ * send_reply(), except that a NUL byte stands in for the user's nick.
+ * @param[in] pos Where to write the reply.
+ * @param[in] reply Numeric of the reply.
+ * @param[in] format Format string for the text after the nick.
+ * @return Position just past the reply.
+ */
+static char *
+motd_template_add(char *pos, int reply, const char *format, ...)
+{
+  const struct Numeric *num = get_error_numeric(reply);
+  va_list vl;
+
+  pos += ircd_snprintf(0, pos, BUFSIZE, ":%s %s ", cli_name(&me), num->str);
+  *pos++ = '\0'; /* nick goes here */
+  *pos++ = ' ';
+  va_start(vl, format);
+  pos += ircd_vsnprintf(0, pos, BUFSIZE, format ? format : num->format, vl);
+  va_end(vl);
+  *pos++ = '\r';
+  *pos++ = '\n';
+  return pos;
+}
+
+/** Render the replies that make up a MOTD for local users.
+ * Nothing in them depends on the user but the nick, so this is done
+ * once per MotdCache, and sending the MOTD to a user only needs the
+ * nick copied in.
+ * @param[in] cache MOTD body to render.
+ */
+static void
+motd_template(struct MotdCache *cache)
+{
+  char *text, *pos;
+  int i;
+
+  /* every reply is much shorter than BUFSIZE, whatever the server name */
+  pos = text = (char *)MyMalloc((cache->count + 3) * BUFSIZE);
+
+  pos = motd_template_add(pos, RPL_MOTDSTART, 0, cli_name(&me));
+  pos = motd_template_add(pos, RPL_MOTD, ":- %d-%d-%d %d:%02d",
+                          cache->modtime.tm_year + 1900,
+                          cache->modtime.tm_mon + 1, cache->modtime.tm_mday,
+                          cache->modtime.tm_hour, cache->modtime.tm_min);
+  for (i = 0; i < cache->count; i++)
+    pos = motd_template_add(pos, RPL_MOTD, 0, cache->motd[i]);
+  pos = motd_template_add(pos, RPL_ENDOFMOTD, 0);
+
+  cache->textlen = pos - text;
+  cache->text = (char *)MyRealloc(text, cache->textlen);
+}
+
+/** Send the pre-rendered MOTD to a local user.
+ * The replies are queued a few kilobytes at a time rather than one
+ * MsgBuf per line.
+ * @param[in] cptr Client to send MOTD to.
+ * @param[in] cache MOTD body to send to client.
+ */
+static void
+motd_splice(struct Client *cptr, struct MotdCache *cache)
+{
+  char buf[MSGQ_BULKSIZE];
+  const char *nick = cli_name(cptr);
+  const char *line, *mark, *next, *end;
+  unsigned int len = 0, nicklen = strlen(nick);
+  struct MsgBuf *mb;
+
+  if (!cache->text)
+    motd_template(cache);
+
+  for (line = cache->text, end = line + cache->textlen; line < end;
+       line = next) {
+    mark = line + strlen(line); /* the nick goes in place of the NUL */
+    next = (const char *)memchr(mark + 1, '\n', end - mark - 1) + 1;
+
+    if (len + (next - line) - 1 + nicklen > sizeof(buf)) {
+      mb = msgq_bulk(buf, len);
+      send_buffer(cptr, mb, 0);
+      msgq_clean(mb);
+      len = 0;
+    }
+
+    memcpy(buf + len, line, mark - line);
+    len += mark - line;
+    memcpy(buf + len, nick, nicklen);
+    len += nicklen;
+    memcpy(buf + len, mark + 1, next - mark - 1);
+    len += next - mark - 1;
+  }
+
+  mb = msgq_bulk(buf, len);
+  send_buffer(cptr, mb, 0);
+  msgq_clean(mb);
+}
+
 /** Send the content of a MotdCache to a user.
  * If \a cache is NULL, simply send ERR_NOMOTD to the client.
  * @param[in] cptr Client to send MOTD to.
@@ -308,6 +411,11 @@ motd_forward(struct Client *cptr, struct MotdCache *cache)
   if (!cache) /* no motd to send */
     return send_reply(cptr, ERR_NOMOTD);
 
+  if (MyConnect(cptr)) { /* send the pre-rendered replies */
+    motd_splice(cptr, cache);
+    return 0;
+  }
+
   /* send the motd */
   send_reply(cptr, RPL_MOTDSTART, cli_name(&me));
   send_reply(cptr, SND_EXPLICIT | RPL_MOTD, ":- %d-%d-%d %d:%02d",
@@ -505,7 +613,8 @@ motd_memory_count(struct Client *cptr)
   for (cache = MotdList.cachelist; cache; cache = cache->next)
   {
     mtc++;
-    mtcm += sizeof(struct MotdCache) + (MOTD_LINESIZE * (cache->count - 1));
+    mtcm += sizeof(struct MotdCache) + (MOTD_LINESIZE * (cache->count - 1)) +
+            cache->textlen;
   }
 
   if (MotdList.freelist)
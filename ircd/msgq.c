@@ -42,7 +42,7 @@
 #include <sys/uio.h>	/* struct iovec */
 
 #define MB_BASE_SHIFT	5 /**< Log2 of smallest message body to allocate. */
-#define MB_MAX_SHIFT	9 /**< Log2 of largest message body to allocate. */
+#define MB_MAX_SHIFT	12 /**< Log2 of largest message body to allocate. */
 
 /** Buffer for a single message. */
 struct MsgBuf {
@@ -263,7 +263,7 @@ msgq_alloc(struct MsgBuf *in_mb, int length)
     if ((length - 1) >> power == 0)
       break;
   assert((1 << power) >= length);
-  assert((1 << power) <= 512);
+  assert((1 << power) <= MSGQ_BULKSIZE);
   length = 1 << power; /* reset the length */
 
   /* If the message needs a buffer of exactly the existing size, just use it */
@@ -318,20 +318,17 @@ msgq_clear_freembs(void)
     }
 }
 
-/** Format a message buffer for a client from a format string.
- * @param[in] dest %Client that receives the data (may be NULL).
- * @param[in] format Format string for message.
- * @param[in] vl Argument list for \a format.
- * @return Allocated MsgBuf.
+/** Allocate a message buffer, freeing up memory if the pool is full.
+ * If all else fails, the server panics.
+ * @param[in] length Number of bytes of space to reserve.
+ * @return Pointer to a message buffer, linked into the in-use list.
  */
-struct MsgBuf *
-msgq_vmake(struct Client *dest, const char *format, va_list vl)
+static struct MsgBuf *
+msgq_get(int length)
 {
   struct MsgBuf *mb;
 
-  assert(0 != format);
-
-  if (!(mb = msgq_alloc(0, BUFSIZE))) {
+  if (!(mb = msgq_alloc(0, length))) {
     if (feature_bool(FEAT_HAS_FERGUSON_FLUSHER)) {
       /*
        * from "Married With Children" episode were Al bought a REAL toilet
@@ -351,28 +348,49 @@ msgq_vmake(struct Client *dest, const char *format, va_list vl)
        * bailing this may help servers running out of memory
        */
       flush_connections(0);
-      mb = msgq_alloc(0, BUFSIZE);
+      mb = msgq_alloc(0, length);
     }
     if (!mb) { /* OK, try clearing the buffer free list */
       msgq_clear_freembs();
-      mb = msgq_alloc(0, BUFSIZE);
+      mb = msgq_alloc(0, length);
     }
     if (!mb) { /* OK, try killing a client */
       kill_highest_sendq(0); /* Don't kill any server connections */
       msgq_clear_freembs();  /* Release whatever was just freelisted */
-      mb = msgq_alloc(0, BUFSIZE);
+      mb = msgq_alloc(0, length);
     }
     if (!mb) { /* hmmm... */
       kill_highest_sendq(1); /* Try killing a server connection now */
       msgq_clear_freembs();  /* Clear freelist again */
-      mb = msgq_alloc(0, BUFSIZE);
+      mb = msgq_alloc(0, length);
     }
     if (!mb) /* AIEEEE! */
       server_panic("Unable to allocate buffers!");
   }
 
-  mb->next = MQData.msglist; /* initialize the msgbuf */
+  mb->next = MQData.msglist; /* link it into the list */
   mb->prev_p = &MQData.msglist;
+  if (MQData.msglist)
+    MQData.msglist->prev_p = &mb->next;
+  MQData.msglist = mb;
+
+  return mb;
+}
+
+/** Format a message buffer for a client from a format string.
+ * @param[in] dest %Client that receives the data (may be NULL).
+ * @param[in] format Format string for message.
+ * @param[in] vl Argument list for \a format.
+ * @return Allocated MsgBuf.
+ */
+struct MsgBuf *
+msgq_vmake(struct Client *dest, const char *format, va_list vl)
+{
+  struct MsgBuf *mb;
+
+  assert(0 != format);
+
+  mb = msgq_get(BUFSIZE);
 
   /* fill the buffer */
   mb->length = ircd_vsnprintf(dest, mb->msg, bufsize(mb) - 1, format, vl);
@@ -386,10 +404,6 @@ msgq_vmake(struct Client *dest, const char *format, va_list vl)
 
   assert(mb->length <= bufsize(mb));
 
-  if (MQData.msglist) /* link it into the list */
-    MQData.msglist->prev_p = &mb->next;
-  MQData.msglist = mb;
-
   return mb;
 }
 
@@ -411,6 +425,32 @@ msgq_make(struct Client *dest, const char *format, ...)
   return mb;
 }
 
+/** Make a message buffer from text that is already formatted.
+ * The text is one or more complete lines, each ending in CR LF, so
+ * that a long run of replies can be queued as a single Msg.  It is
+ * copied into a close-fitting buffer which msgq_append() must not be
+ * used on.
+ * @param[in] text Lines to send.
+ * @param[in] length Length of \a text, at most #MSGQ_BULKSIZE.
+ * @return Allocated MsgBuf.
+ */
+struct MsgBuf *
+msgq_bulk(const char *text, unsigned int length)
+{
+  struct MsgBuf *mb;
+
+  assert(0 != text);
+  assert(2 <= length && length <= MSGQ_BULKSIZE);
+  assert(text[length - 1] == '\n');
+
+  mb = msgq_get(length);
+  memcpy(mb->msg, text, length);
+  mb->length = length;
+  mb->real = mb; /* already fits; keeps it out of the line histogram */
+
+  return mb;
+}
+
 /** Append text to an existing message buffer.
  * @param[in] dest %Client for whom to format the message.
  * @param[in] mb Message buffer to append to.
@@ -221,6 +221,37 @@ IOResult os_recv_nonb(int fd, char* buf, unsigned int length,
   return IO_FAILURE;
 }
 
+/*
+ * os_recvv_nonb - non blocking readv of a connection
+ * returns:
+ *  1  if data was read or socket is blocked (recoverable error)
+ *    count_out > 0 if data was read
+ *
+ *  0  if socket closed from other end
+ *  -1 if an unrecoverable error occurred
+ */
+IOResult os_recvv_nonb(int fd, struct iovec* iov, int count,
+                       unsigned int* count_out)
+{
+  int res;
+  assert(0 != iov);
+  assert(0 != count_out);
+  *count_out = 0;
+  errno = 0;
+
+  if (0 < (res = readv(fd, iov, count))) {
+    *count_out = (unsigned) res;
+    return IO_SUCCESS;
+  }
+  else if (res < 0) {
+    if (EWOULDBLOCK == errno || EAGAIN == errno)
+      return IO_BLOCKED;
+    else
+      return IO_FAILURE;
+  }
+  return IO_FAILURE;
+}
+
 IOResult os_recvfrom_nonb(int fd, char* buf, unsigned int length, 
                           unsigned int* length_out, struct sockaddr_in* sin_out)
 {
@@ -32,8 +32,10 @@
 #include "s_bsd.h"
 #include "s_misc.h"
 #include "send.h"
+#include "sys.h"
 
 /* #include <assert.h> -- Now using assert in ircd_log.h */
+#include <string.h>
 
 /** Add a certain number of bytes to a client's received statistics.
  * @param[in,out] cptr Client to update.
@@ -63,15 +65,40 @@ static void update_messages_received(struct Client* cptr)
   ++(cli_receiveM(cptr));
 }
 
+/** Parse one line received from a directly connected server.
+ * @param[in] cptr Peer server that sent us data.
+ * @param[in] line NUL-terminated line.
+ * @param[in] endp Terminating NUL of \a line.
+ * @return 1 on success or CPTR_KILLED if the client is squit.
+ */
+static int server_doline(struct Client* cptr, char* line, char* endp)
+{
+  update_messages_received(cptr);
+
+  if (parse_server(cptr, line, endp) == CPTR_KILLED)
+    return CPTR_KILLED;
+  /*
+   *  Socket is dead so exit
+   */
+  if (IsDead(cptr))
+    return exit_client(cptr, cptr, &me, cli_info(cptr));
+  return 1;
+}
+
 /** Handle received data from a directly connected server.
+ * Complete lines are parsed where they lie in \a buffer; only a line
+ * cut off by the end of the buffer is copied into the client's buffer
+ * to be finished by the next read.
  * @param[in] cptr Peer server that sent us data.
  * @param[in] buffer Input buffer.
  * @param[in] length Number of bytes in input buffer.
  * @return 1 on success or CPTR_KILLED if the client is squit.
  */
-int server_dopacket(struct Client* cptr, const char* buffer, int length)
+int server_dopacket(struct Client* cptr, char* buffer, int length)
 {
-  const char* src;
+  char*       src;
+  char*       end;
+  char*       eol;
   char*       endp;
   char*       client_buffer;
 
@@ -80,38 +107,53 @@ int server_dopacket(struct Client* cptr, const char* buffer, int length)
   update_bytes_received(cptr, length);
 
   client_buffer = cli_buffer(cptr);
-  endp = client_buffer + cli_count(cptr);
   src = buffer;
+  end = buffer + length;
+
+  /*
+   * Yuck.  Stuck.  To make sure we stay backward compatible,
+   * we must assume that either CR or LF terminates the message
+   * and not CR-LF.  By allowing CR or LF (alone) into the body
+   * of messages, backward compatibility is lost and major
+   * problems will arise. - Avalon
+   */
+  if (cli_count(cptr)) {
+    /* Finish the line left over from the previous read */
+    endp = client_buffer + cli_count(cptr);
+    for (; src < end && !IsEol(*src); ++src)
+      if (endp < client_buffer + BUFSIZE - 1)
+        *endp++ = *src;         /* Leave room for the null */
+    if (src == end) {
+      cli_count(cptr) = endp - client_buffer;
+      return 1;
+    }
+    *endp = '\0';
+    cli_count(cptr) = 0;
+    ++src;
+    if (server_doline(cptr, client_buffer, endp) == CPTR_KILLED)
+      return CPTR_KILLED;
+  }
 
-  while (length-- > 0) {
-    *endp = *src++;
-    /*
-     * Yuck.  Stuck.  To make sure we stay backward compatible,
-     * we must assume that either CR or LF terminates the message
-     * and not CR-LF.  By allowing CR or LF (alone) into the body
-     * of messages, backward compatibility is lost and major
-     * problems will arise. - Avalon
-     */
-    if (IsEol(*endp)) {
-      if (endp == client_buffer)
-        continue;               /* Skip extra LF/CR's */
-      *endp = '\0';
-
-      update_messages_received(cptr);
-
-      if (parse_server(cptr, cli_buffer(cptr), endp) == CPTR_KILLED)
-        return CPTR_KILLED;
-      /*
-       *  Socket is dead so exit
-       */
-      if (IsDead(cptr))
-        return exit_client(cptr, cptr, &me, cli_info(cptr));
-      endp = client_buffer;
+  while (src < end) {
+    if (IsEol(*src)) {
+      ++src;                    /* Skip extra LF/CR's */
+      continue;
     }
-    else if (endp < client_buffer + BUFSIZE)
-      ++endp;                   /* There is always room for the null */
+    for (eol = src; eol < end && !IsEol(*eol); ++eol)
+      ;
+    if (eol == end) {
+      /* Save the partial line, truncated like the ones parsed in place */
+      length = IRCD_MIN(eol - src, BUFSIZE - 1);
+      memcpy(client_buffer, src, length);
+      cli_count(cptr) = length;
+      break;
+    }
+    endp = IRCD_MIN(eol, src + BUFSIZE - 1);
+    *endp = '\0';
+    if (server_doline(cptr, src, endp) == CPTR_KILLED)
+      return CPTR_KILLED;
+    src = eol + 1;
   }
-  cli_count(cptr) = endp - cli_buffer(cptr);
   return 1;
 }
 
@@ -121,9 +163,9 @@ int server_dopacket(struct Client* cptr, const char* buffer, int length)
  * @param[in] length Number of bytes in input buffer.
  * @return 1 on success or CPTR_KILLED if the client is squit.
  */
-int connect_dopacket(struct Client *cptr, const char *buffer, int length)
+int connect_dopacket(struct Client *cptr, char *buffer, int length)
 {
-  const char* src;
+  char*       src;
   char*       endp;
   char*       client_buffer;
 
@@ -174,19 +216,21 @@ int connect_dopacket(struct Client *cptr, const char *buffer, int length)
   return 1;
 }
 
-/** Handle received data from a local client.
+/** Handle a line received from a local client.
  * @param[in] cptr Local client that sent us data.
- * @param[in] length Total number of bytes in client's input buffer.
+ * @param[in] buffer NUL-terminated line, in the client's input buffer
+ *   or its receive queue.
+ * @param[in] length Number of bytes in \a buffer.
  * @return 1 on success or CPTR_KILLED if the client is squit.
  */
-int client_dopacket(struct Client *cptr, unsigned int length)
+int client_dopacket(struct Client *cptr, char *buffer, unsigned int length)
 {
   assert(0 != cptr);
 
   update_bytes_received(cptr, length);
   update_messages_received(cptr);
 
-  if (CPTR_KILLED == parse_client(cptr, cli_buffer(cptr), cli_buffer(cptr) + length))
+  if (CPTR_KILLED == parse_client(cptr, buffer, buffer + length))
     return CPTR_KILLED;
   else if (IsDead(cptr))
     return exit_client(cptr, cptr, &me, cli_info(cptr));
@@ -106,13 +106,9 @@
 #define NAMES_OFFSET   (ADDRS_OFFSET + ADDRS_DLEN)
 #define MAXGETHOSTLEN  (NAMES_OFFSET + MAXPACKET)
 
-#define AR_TTL          600   /* TTL in seconds for dns cache entries */
+#define AR_TTL          600   /* seconds between idle resolver timer runs */
 
-/*
- * the following values should be prime
- */
-#define ARES_CACSIZE    307
-#define MAXCACHED       281
+#define RES_HASHSIZE    64    /* initial buckets in each cache hash table */
 
 /*
  * RFC 1104/1105 wasn't very helpful about what these fields
@@ -196,6 +192,7 @@ struct ResRequest {
   char               retries;       /* retry counter */
   char               sends;         /* number of sends (>1 means resent) */
   char               resend;        /* send flag. 0 == dont resend */
+  char               failed;        /* answered from a cached failure */
   time_t             sentat;
   time_t             timeout;
   struct in_addr     addr;
@@ -204,21 +201,41 @@ struct ResRequest {
   struct Hostent     he;
 };
 
+/*
+ * Each cache entry is reachable from one hash table key per name
+ * (h_name and every alias) and, unless it is a DNSBL answer, one per
+ * address.  The keys point into the entry's Hostent buffer, so they
+ * are rebuilt whenever that buffer is.
+ */
+struct CacheKey {
+  struct CacheKey*   next;          /* next key in the same bucket */
+  struct CacheEntry* entry;         /* entry the key belongs to */
+  const char*        key;           /* name, or address in network order */
+  unsigned int       hashv;         /* full hash value of key */
+};
+
+struct CacheHash {
+  struct CacheKey**  buckets;
+  unsigned int       mask;          /* number of buckets - 1 */
+  unsigned int       count;         /* keys in the table */
+};
+
 struct CacheEntry {
-  struct CacheEntry* hname_next;
-  struct CacheEntry* hnum_next;
-  struct CacheEntry* list_next;
+  struct CacheEntry* lru_prev;      /* more recently used entry */
+  struct CacheEntry* lru_next;      /* less recently used entry */
+  struct CacheKey*   keys;          /* name keys, then address keys */
+  int                name_keys;
+  int                addr_keys;
   time_t             expireat;
   time_t             ttl;
+  size_t             size;          /* bytes charged against the cache */
+  char               negative;      /* rcode of a cached failure, or 0 */
+  char               is_rbl;        /* DNSBL answer, addresses not keyed */
+  struct in_addr     addr;          /* address of a failed PTR lookup */
   struct Hostent     he;
   struct DNSReply    reply;
 };
 
-struct CacheTable {
-  struct CacheEntry* num_list;
-  struct CacheEntry* name_list;
-};
-
 
 int ResolverFileDescriptor    = -1;   /* GLOBAL - used in s_bsd.c */
 
@@ -239,8 +256,12 @@ static time_t nextCacheExpire = 1;
 static int                spare_fd = -1;
 
 static int                cachedCount = 0;
-static struct CacheTable  hashtable[ARES_CACSIZE];
-static struct CacheEntry* cacheTop;
+static size_t             cacheMemory = 0;   /* bytes held by the cache */
+static struct CacheHash   nameHash;          /* keys for names and aliases */
+static struct CacheHash   addrHash;          /* keys for addresses */
+static struct CacheEntry* cacheTop;          /* most recently used entry */
+static struct CacheEntry* cacheBottom;       /* least recently used entry */
+static int                failPending = 0;   /* requests answered by failures */
 static struct ResRequest* requestListHead;   /* head of resolver request list */
 static struct ResRequest* requestListTail;   /* tail of resolver request list */
 
@@ -263,18 +284,22 @@ static void     query_name(const char* name,
                            struct ResRequest* request);
 static void     resend_query(struct ResRequest* request);
 static struct CacheEntry*  make_cache(struct ResRequest* request);
+static void     make_negative(struct ResRequest* request, int rcode);
 static struct CacheEntry*  find_cache_name(const char* name);
-static struct CacheEntry*  find_cache_number(struct ResRequest* request, 
-                                             const char* addr);
+static struct CacheEntry*  find_cache_number(const char* addr);
 static struct ResRequest*   find_id(int);
 
 static struct cacheinfo {
   int  ca_adds;
   int  ca_dels;
+  int  ca_evicts;
   int  ca_expires;
   int  ca_lookups;
+  int  ca_misses;
   int  ca_na_hits;
   int  ca_nu_hits;
+  int  ca_neg_adds;
+  int  ca_neg_hits;
   int  ca_updates;
 } cainfo;
 
@@ -288,6 +313,7 @@ static  struct  resinfo {
   int  re_sent;
   int  re_timeouts;
   int  re_shortttl;
+  int  re_longttl;
   int  re_unkrep;
 } reinfo;
 
@@ -413,7 +439,6 @@ int init_resolver(void)
   srand48(CurrentTime);
 #endif
   memset(&cainfo,   0, sizeof(cainfo));
-  memset(hashtable, 0, sizeof(hashtable));
   memset(&reinfo,   0, sizeof(reinfo));
 
   requestListHead = requestListTail = 0;
@@ -491,11 +516,29 @@ static void rem_request(struct ResRequest* request)
     prev    = *current;
     current = &(*current)->next;
   }
+  if (request->failed)
+    --failPending;
   MyFree(request->he.buf);
   MyFree(request->name);
   MyFree(request);
 }
 
+/*
+ * fail_request - answer a query from a cached failure.  The callers
+ * of gethost_byname() and gethost_byaddr() expect the callback to come
+ * later when they get NULL back, so queue a request that is never sent
+ * and have the timer deliver the failure on its next run.
+ */
+static void fail_request(const struct DNSQuery* query)
+{
+  struct ResRequest* request = make_request(query);
+
+  request->failed = 1;
+  request->resend = 0;
+  ++failPending;
+  timer_chg(&resExpireDNS, TT_ABSOLUTE, CurrentTime);
+}
+
 /*
  * make_request - Create a DNS request record for the server.
  */
@@ -541,6 +584,11 @@ static time_t timeout_query_list(time_t now)
   Debug((DEBUG_DNS, "Resolver: timeout_query_list at %s", myctime(now)));
   for (request = requestListHead; request; request = next_request) {
     next_request = request->next;
+    if (request->failed) {
+      (*request->query.callback)(request->query.vptr, 0);
+      rem_request(request);
+      continue;
+    }
     timeout = request->sentat + request->timeout;
     if (timeout < now) {
       if (--request->retries <= 0) {
@@ -559,13 +607,21 @@ static time_t timeout_query_list(time_t now)
       next_time = timeout;
     }
   }
+  /*
+   * a callback may have queued another cached failure behind the
+   * last request we looked at; come straight back for it
+   */
+  if (failPending)
+    return now;
   return (next_time > now) ? next_time : (now + AR_TTL);
 }
 
 /*
  * expire_cache - removes entries from the cache which are older 
- * than their expiry times. returns the time at which the server 
- * should next poll the cache.
+ * than their expiry times, or were dropped and are no longer in use.
+ * Lookups already pass over expired entries, so this only gives back
+ * memory and need not run more often than IRCD_RES_MIN_TTL.  returns
+ * the time at which the server should next poll the cache.
  */
 static time_t expire_cache(time_t now)
 {
@@ -575,15 +631,19 @@ static time_t expire_cache(time_t now)
 
   Debug((DEBUG_DNS, "Resolver: expire_cache at %s", myctime(now)));
   for (cp = cacheTop; cp; cp = cp_next) {
-    cp_next = cp->list_next;
-    if (cp->expireat < now) {
+    cp_next = cp->lru_next;
+    if (0 < cp->reply.ref_count)
+      continue; /* renewed by the next answer, or freed once let go */
+    if (cp->expireat < now || !cp->keys) {
       ++cainfo.ca_expires;
       rem_cache(cp);
     }
     else if (!expire || expire > cp->expireat)
       expire = cp->expireat;
   }
-  return (expire > now) ? expire : (now + AR_TTL);
+  if (!expire)
+    return now + AR_TTL;
+  return IRCD_MAX(expire, now + IRCD_MAX(feature_int(FEAT_IRCD_RES_MIN_TTL), 1));
 }
 
 /*
@@ -676,8 +736,12 @@ struct DNSReply* gethost_byname(const char* name,
 
   Debug((DEBUG_DNS, "Resolver: gethost_byname %s", name));
   ++reinfo.re_na_look;
-  if ((cp = find_cache_name(name)))
-    return &(cp->reply);
+  if ((cp = find_cache_name(name))) {
+    if (!cp->negative)
+      return &(cp->reply);
+    fail_request(query);
+    return NULL;
+  }
 
   do_query_name(query, name, NULL);
   nextDNSCheck = 1;
@@ -697,8 +761,12 @@ struct DNSReply* gethost_byaddr(const char* addr,
   Debug((DEBUG_DNS, "Resolver: gethost_byaddr %s", ircd_ntoa(addr)));
 
   ++reinfo.re_nu_look;
-  if ((cp = find_cache_number(NULL, addr)))
-    return &(cp->reply);
+  if ((cp = find_cache_number(addr))) {
+    if (!cp->negative)
+      return &(cp->reply);
+    fail_request(query);
+    return NULL;
+  }
 
   do_query_number(query, (const struct in_addr*) addr, NULL);
   nextDNSCheck = 1;
@@ -854,6 +922,7 @@ static int proc_answer(struct ResRequest* request, HEADER* header,
   int    addr_count  = 0;      /* number of addresses in hostent */
   int    alias_count = 0;      /* number of aliases in hostent */
   int    t_ptr_seen = 0;       /* Seen a T_PTR in proc_answer? */
+  time_t ttl;                  /* answer time to live */
   struct hostent* hp;          /* hostent getting filled */
 
   assert(0 != request);
@@ -958,7 +1027,12 @@ static int proc_answer(struct ResRequest* request, HEADER* header,
     query_class = _getshort(current);
     current += CLASS_SIZE;
 
-    request->ttl = _getlong(current);
+    /*
+     * the whole answer is only good for as long as its shortest record
+     */
+    ttl = _getlong(current);
+    if (answer_count == 0 || ttl < request->ttl)
+      request->ttl = ttl;
     current += TTL_SIZE;
 
     rd_length = _getshort(current);
@@ -1118,7 +1192,7 @@ int resolver_read(void)
 
   if ((header->rcode != NOERROR) || (header->ancount == 0)) {
     ++reinfo.re_errors;
-    if (SERVFAIL == header->rcode)
+    if (SERVFAIL == header->rcode && --request->retries > 0)
       resend_query(request);
     else {
       /*
@@ -1152,6 +1226,15 @@ int resolver_read(void)
           break;
       }
 #endif /* DEBUGMODE */
+      /*
+       * Remember names that do not exist (or have no address) and
+       * servers that have given up on them, so that the next client
+       * from the same place is not kept waiting for the same answer.
+       */
+      if (NXDOMAIN == header->rcode || SERVFAIL == header->rcode)
+        make_negative(request, header->rcode);
+      else if (NOERROR == header->rcode)
+        make_negative(request, NXDOMAIN);
       (*request->query.callback)(request->query.vptr, 0);
       rem_request(request);
     } 
@@ -1431,81 +1514,330 @@ static void update_hostent(struct Hostent* hp, char** addr, char** alias)
 /*
  * hash_number - IP address hash function
  */
-static int hash_number(const unsigned char* ip)
+static unsigned int hash_number(const unsigned char* ip)
 {
-  /* could use loop but slower */
   unsigned int hashv;
-  const u_char* p = (const u_char*) ip;
 
-  assert(0 != p);
+  assert(0 != ip);
 
-  hashv = *p++;
-  hashv += hashv + *p++;
-  hashv += hashv + *p++;
-  hashv += hashv + *p;
-  hashv %= ARES_CACSIZE;
+  memcpy(&hashv, ip, sizeof(hashv));
+  /* spread addresses from a single network over the whole table */
+  hashv ^= hashv >> 16;
+  hashv *= 0x45d9f3b;
+  hashv ^= hashv >> 16;
   return hashv;
 }
 
 /*
  * hash_name - hostname hash function
  */
-static int hash_name(const char* name)
+static unsigned int hash_name(const char* name)
 {
   unsigned int hashv = 0;
   const u_char* p = (const u_char*) name;
 
   assert(0 != p);
 
-  for (; *p && *p != '.'; ++p)
-    hashv += *p;
-  hashv %= ARES_CACSIZE;
+  for (; *p; ++p)
+    hashv = hashv * 31 + ToLower(*p);
   return hashv;
 }
 
 /*
- * add_to_cache - Add a new cache item to the queue and hash table.
+ * hash_grow - double the number of buckets in a cache hash table,
+ * or give it its first ones.
  */
-static struct CacheEntry* add_to_cache(struct CacheEntry* ocp)
+static void hash_grow(struct CacheHash* table)
+{
+  struct CacheKey** buckets;
+  struct CacheKey*  ck;
+  struct CacheKey*  ck_next;
+  unsigned int      size;
+  unsigned int      i;
+
+  size = table->buckets ? (table->mask + 1) * 2 : RES_HASHSIZE;
+  buckets = (struct CacheKey**) MyCalloc(size, sizeof(struct CacheKey*));
+  if (table->buckets) {
+    for (i = 0; i <= table->mask; ++i) {
+      for (ck = table->buckets[i]; ck; ck = ck_next) {
+        ck_next = ck->next;
+        ck->next = buckets[ck->hashv & (size - 1)];
+        buckets[ck->hashv & (size - 1)] = ck;
+      }
+    }
+    MyFree(table->buckets);
+  }
+  table->buckets = buckets;
+  table->mask = size - 1;
+}
+
+/*
+ * hash_add - add a key to a cache hash table, growing the table to
+ * keep about one key per bucket.
+ */
+static void hash_add(struct CacheHash* table, struct CacheKey* ck)
 {
-  int  hashv;
+  if (!table->buckets || table->count > table->mask)
+    hash_grow(table);
+  ck->next = table->buckets[ck->hashv & table->mask];
+  table->buckets[ck->hashv & table->mask] = ck;
+  ++table->count;
+}
 
-  assert(0 != ocp);
+/*
+ * hash_del - remove a key from a cache hash table.
+ */
+static void hash_del(struct CacheHash* table, struct CacheKey* ck)
+{
+  struct CacheKey** ckp;
 
-  ocp->list_next = cacheTop;
-  cacheTop = ocp;
+  for (ckp = &table->buckets[ck->hashv & table->mask]; *ckp;
+       ckp = &(*ckp)->next) {
+    if (*ckp == ck) {
+      *ckp = ck->next;
+      --table->count;
+      break;
+    }
+  }
+}
 
-  hashv = hash_name(ocp->he.h.h_name);
+/*
+ * index_cache - make a cache entry reachable by each of its names
+ * and addresses.  A cached failure is keyed by the name or the
+ * address that failed.
+ */
+static void index_cache(struct CacheEntry* cp)
+{
+  struct hostent*  hp = &cp->he.h;
+  struct CacheKey* ck;
+  int              i;
 
-  ocp->hname_next = hashtable[hashv].name_list;
-  hashtable[hashv].name_list = ocp;
+  assert(0 == cp->keys);
+
+  if (cp->negative) {
+    cp->name_keys = hp->h_name ? 1 : 0;
+    cp->addr_keys = hp->h_name ? 0 : 1;
+  }
+  else {
+    for (cp->name_keys = 1; hp->h_aliases[cp->name_keys - 1]; )
+      ++cp->name_keys;
+    cp->addr_keys = 0;
+    if (!cp->is_rbl) { /* DNSBL answers are not addresses of anything */
+      while (hp->h_addr_list[cp->addr_keys])
+        ++cp->addr_keys;
+    }
+  }
+  ck = cp->keys = (struct CacheKey*) MyMalloc((cp->name_keys + cp->addr_keys) *
+                                              sizeof(struct CacheKey));
+  for (i = 0; i < cp->name_keys; ++i, ++ck) {
+    ck->entry = cp;
+    ck->key   = i ? hp->h_aliases[i - 1] : hp->h_name;
+    ck->hashv = hash_name(ck->key);
+    hash_add(&nameHash, ck);
+  }
+  for (i = 0; i < cp->addr_keys; ++i, ++ck) {
+    ck->entry = cp;
+    ck->key   = cp->negative ? (const char*) &cp->addr : hp->h_addr_list[i];
+    ck->hashv = hash_number((const unsigned char*) ck->key);
+    hash_add(&addrHash, ck);
+  }
+}
 
-  hashv = hash_number((const unsigned char*) ocp->he.h.h_addr);
+/*
+ * unindex_cache - remove all the keys of a cache entry.
+ */
+static void unindex_cache(struct CacheEntry* cp)
+{
+  int i;
 
-  ocp->hnum_next = hashtable[hashv].num_list;
-  hashtable[hashv].num_list = ocp;
+  for (i = 0; i < cp->name_keys; ++i)
+    hash_del(&nameHash, &cp->keys[i]);
+  for (; i < cp->name_keys + cp->addr_keys; ++i)
+    hash_del(&addrHash, &cp->keys[i]);
+  MyFree(cp->keys);
+  cp->keys = 0;
+  cp->name_keys = cp->addr_keys = 0;
+}
 
+/*
+ * size_cache - recount the memory charged for a cache entry.
+ */
+static void size_cache(struct CacheEntry* cp)
+{
+  cacheMemory -= cp->size;
+  cp->size = sizeof(struct CacheEntry) +
+    (cp->name_keys + cp->addr_keys) * sizeof(struct CacheKey);
+  if (!cp->negative)
+    cp->size += calc_hostent_buffer_size(&cp->he.h);
+  else if (cp->he.h.h_name)
+    cp->size += strlen(cp->he.h.h_name) + 1;
+  cacheMemory += cp->size;
+}
+
+/*
+ * lru_unlink - take a cache entry off the LRU list.
+ */
+static void lru_unlink(struct CacheEntry* cp)
+{
+  if (cp->lru_prev)
+    cp->lru_prev->lru_next = cp->lru_next;
+  else
+    cacheTop = cp->lru_next;
+  if (cp->lru_next)
+    cp->lru_next->lru_prev = cp->lru_prev;
+  else
+    cacheBottom = cp->lru_prev;
+}
+
+/*
+ * lru_link - put a cache entry at the most recently used end of the
+ * LRU list.
+ */
+static void lru_link(struct CacheEntry* cp)
+{
+  cp->lru_prev = 0;
+  if ((cp->lru_next = cacheTop))
+    cacheTop->lru_prev = cp;
+  else
+    cacheBottom = cp;
+  cacheTop = cp;
+}
+
+/*
+ * lru_touch - mark a cache entry as just used.
+ */
+static void lru_touch(struct CacheEntry* cp)
+{
+  if (cp != cacheTop) {
+    lru_unlink(cp);
+    lru_link(cp);
+  }
+}
+
+#define CACHE_LIVE      0     /* unexpired entries of either kind */
+#define CACHE_ANSWER    1     /* answers, expired or not */
+#define CACHE_FAILURE   2     /* cached failures, expired or not */
+
+/*
+ * cache_lookup - find the cache entry a name or an address leads to.
+ * which is one of CACHE_LIVE, CACHE_ANSWER or CACHE_FAILURE.
+ */
+static struct CacheEntry* cache_lookup(struct CacheHash* table,
+                                       const char* key, int is_name,
+                                       int which)
+{
+  struct CacheKey*   ck;
+  struct CacheEntry* cp;
+  unsigned int       hashv;
+
+  assert(0 != key);
+  if (!table->buckets)
+    return NULL;
+
+  hashv = is_name ? hash_name(key) : hash_number((const unsigned char*) key);
+  for (ck = table->buckets[hashv & table->mask]; ck; ck = ck->next) {
+    if (ck->hashv != hashv)
+      continue;
+    if (is_name ? ircd_strcmp(ck->key, key) :
+        memcmp(ck->key, key, sizeof(struct in_addr)))
+      continue;
+    cp = ck->entry;
+    if (CACHE_LIVE == which ? cp->expireat >= CurrentTime :
+        (CACHE_FAILURE == which) == (0 != cp->negative))
+      return cp;
+  }
+  return NULL;
+}
+
+/*
+ * rem_cache - delete a cache entry from the cache structures 
+ * and lists and return all memory used for the cache back to the memory pool.
+ * The entry must not be referenced.
+ */
+static void rem_cache(struct CacheEntry* ocp)
+{
+  assert(0 != ocp);
+  assert(0 == ocp->reply.ref_count);
+
+  lru_unlink(ocp);
+  unindex_cache(ocp);
+  cacheMemory -= ocp->size;
   /*
-   * LRU deletion of excessive cache entries.
+   * free memory used to hold the various host names and the array
+   * of alias pointers.
    */
-  if (++cachedCount > MAXCACHED) {
-    struct CacheEntry* cp;
-    struct CacheEntry* cp_next;
-    for (cp = ocp->list_next; cp; cp = cp_next) {
-      cp_next = cp->list_next;
-      rem_cache(cp);
-    }
+  MyFree(ocp->he.buf);
+  MyFree(ocp);
+  --cachedCount;
+  ++cainfo.ca_dels;
+}
+
+/*
+ * drop_cache - make a cache entry unreachable.  An entry still held
+ * by a client or connection cannot be freed yet; it loses its keys
+ * and is freed by expire_cache() or trim_resolver_cache() once it is
+ * let go.
+ */
+static void drop_cache(struct CacheEntry* cp)
+{
+  if (0 == cp->reply.ref_count)
+    rem_cache(cp);
+  else if (cp->keys) {
+    unindex_cache(cp);
+    size_cache(cp);
+  }
+}
+
+/*
+ * evict_cache - evict the least recently used entries until the cache
+ * fits in IRCD_RES_CACHE_SIZE bytes, sparing keep.  Referenced entries
+ * cannot be freed and are passed over.
+ */
+static void evict_cache(const struct CacheEntry* keep)
+{
+  struct CacheEntry* cp;
+  struct CacheEntry* cp_prev;
+  size_t             limit = IRCD_MAX(feature_int(FEAT_IRCD_RES_CACHE_SIZE), 0);
+
+  for (cp = cacheBottom; cp && cacheMemory > limit; cp = cp_prev) {
+    cp_prev = cp->lru_prev;
+    if (cp == keep || 0 < cp->reply.ref_count)
+      continue;
+    ++cainfo.ca_evicts;
+    rem_cache(cp);
   }
+}
+
+/*
+ * trim_resolver_cache - bring the cache back within its memory limit
+ * after IRCD_RES_CACHE_SIZE changes.
+ */
+void trim_resolver_cache(void)
+{
+  evict_cache(NULL);
+}
+
+/*
+ * add_to_cache - Add a new cache item to the LRU list and hash tables.
+ */
+static struct CacheEntry* add_to_cache(struct CacheEntry* ocp)
+{
+  assert(0 != ocp);
+
+  index_cache(ocp);
+  lru_link(ocp);
+  size_cache(ocp);
+  ++cachedCount;
   ++cainfo.ca_adds;
+  evict_cache(ocp);
   return ocp;
 }
 
 /*
- * update_list - does not alter the cache structure passed. It is assumed that
- * it already contains the correct expire time, if it is a new entry. Old
- * entries have the expirey time updated.
-*/
-static void update_list(struct ResRequest* request, struct CacheEntry* cachep, int is_rbl)
+ * update_list - add any names and addresses in a new answer that are
+ * missing from a cached entry.
+ */
+static void update_list(struct ResRequest* request, struct CacheEntry* cachep)
 {
   struct CacheEntry*  cp = cachep;
   char*    s;
@@ -1516,10 +1848,6 @@ static void update_list(struct ResRequest* request, struct CacheEntry* cachep, i
   char*    addrs[RES_MAXADDRS + 1];
   char*    aliases[RES_MAXALIASES + 1];
 
-  /*
-   * search for the new cache item in the cache list by hostname.
-   * If found, move the entry to the top of the list and return.
-   */
   ++cainfo.ca_updates;
 
   if (!request)
@@ -1544,21 +1872,24 @@ static void update_list(struct ResRequest* request, struct CacheEntry* cachep, i
    * Do the same again for IP#'s.
    */
   *addrs = 0;
-  if (!is_rbl) { /* But not for RBL ips */
-    ap = addrs;
-    for (i = 0; (s = request->he.h.h_addr_list[i]); i++) {
-      for (j = 0; (t = cp->he.h.h_addr_list[j]); j++) {
-	if (!memcmp(t, s, sizeof(struct in_addr)))
-	  break;
-      }
-      if (!t) {
-	*ap++ = s;
-	*ap = 0;
-      }
+  ap = addrs;
+  for (i = 0; (s = request->he.h.h_addr_list[i]); i++) {
+    for (j = 0; (t = cp->he.h.h_addr_list[j]); j++) {
+      if (!memcmp(t, s, sizeof(struct in_addr)))
+        break;
+    }
+    if (!t) {
+      *ap++ = s;
+      *ap = 0;
     }
   }
-  if (*addrs || *aliases)
+  if (*addrs || *aliases) {
+    /* the keys point into the buffer update_hostent() replaces */
+    unindex_cache(cp);
     update_hostent(&cp->he, addrs, aliases);
+    index_cache(cp);
+    size_cache(cp);
+  }
 }
 
 /*
@@ -1567,91 +1898,53 @@ static void update_list(struct ResRequest* request, struct CacheEntry* cachep, i
 static struct CacheEntry* find_cache_name(const char* name)
 {
   struct CacheEntry* cp;
-  char*   s;
-  int     hashv;
-  int     i;
 
   assert(0 != name);
-  hashv = hash_name(name);
-
-  cp = hashtable[hashv].name_list;
-
-  for (; cp; cp = cp->hname_next) {
-    for (i = 0, s = cp->he.h.h_name; s; s = cp->he.h.h_aliases[i++]) {
-      if (0 == ircd_strcmp(s, name)) {
-        ++cainfo.ca_na_hits;
-        return cp;
-      }
-    }
-  }
-
-  for (cp = cacheTop; cp; cp = cp->list_next) {
-    /*
-     * if no aliases or the hash value matches, we've already
-     * done this entry and all possiblilities concerning it.
-     */
-    if (!cp->he.h.h_name || hashv == hash_name(cp->he.h.h_name))
-      continue;
-    for (i = 0, s = cp->he.h.h_aliases[i]; s; s = cp->he.h.h_aliases[++i]) {
-      if (0 == ircd_strcmp(name, s)) {
-        ++cainfo.ca_na_hits;
-        return cp;
-      }
-    }
+  ++cainfo.ca_lookups;
+  if ((cp = cache_lookup(&nameHash, name, 1, CACHE_LIVE))) {
+    if (cp->negative)
+      ++cainfo.ca_neg_hits;
+    else
+      ++cainfo.ca_na_hits;
+    lru_touch(cp);
+    return cp;
   }
+  ++cainfo.ca_misses;
   return NULL;
 }
 
 /*
- * find_cache_number - find a cache entry by ip# and update its expire time
+ * find_cache_number - find an ip# in nameserver cache
  */
-static struct CacheEntry* find_cache_number(struct ResRequest* request,
-                                            const char* addr)
+static struct CacheEntry* find_cache_number(const char* addr)
 {
   struct CacheEntry* cp;
-  int     hashv;
-  int     i;
 
   assert(0 != addr);
-  if(request && request->query.callback == auth_dnsbl_callback)
-    return NULL;
-
-  hashv = hash_number((const unsigned char*) addr);
-  cp = hashtable[hashv].num_list;
-
-  for (; cp; cp = cp->hnum_next) {
-    for (i = 0; cp->he.h.h_addr_list[i]; ++i) {
-      if (!memcmp(cp->he.h.h_addr_list[i], addr, sizeof(struct in_addr))) {
-        ++cainfo.ca_nu_hits;
-        return cp;
-      }
-    }
-  }
-  for (cp = cacheTop; cp; cp = cp->list_next) {
-    /*
-     * single address entry...would have been done by hashed
-     * search above...
-     * if the first IP# has the same hashnumber as the IP# we
-     * are looking for, its been done already.
-     */
-    if (!cp->he.h.h_addr_list[1] || 
-        hashv == hash_number((const unsigned char*) cp->he.h.h_addr_list[0]))
-      continue;
-    for (i = 1; cp->he.h.h_addr_list[i]; ++i) {
-      if (!memcmp(cp->he.h.h_addr_list[i], addr, sizeof(struct in_addr))) {
-        ++cainfo.ca_nu_hits;
-        return cp;
-      }
-    }
+  ++cainfo.ca_lookups;
+  if ((cp = cache_lookup(&addrHash, addr, 0, CACHE_LIVE))) {
+    if (cp->negative)
+      ++cainfo.ca_neg_hits;
+    else
+      ++cainfo.ca_nu_hits;
+    lru_touch(cp);
+    return cp;
   }
+  ++cainfo.ca_misses;
   return NULL;
 }
 
-
+/*
+ * make_cache - cache the answer to a request, or renew the entry
+ * already holding it.  The answer is kept for as long as its records
+ * say, within IRCD_RES_MIN_TTL and IRCD_RES_MAX_TTL.
+ */
 static struct CacheEntry* make_cache(struct ResRequest* request)
 {
   struct CacheEntry* cp;
   int     i;
+  char*   s;
+  time_t  ttl;
   struct hostent* hp;
   assert(0 != request);
 
@@ -1663,14 +1956,44 @@ static struct CacheEntry* make_cache(struct ResRequest* request)
 /*    assert(0 != hp->h_addr_list[0]); */
   if (!hp->h_name || !hp->h_addr_list[0])
     return NULL;
+
+  ttl = request->ttl;
+  if (ttl > feature_int(FEAT_IRCD_RES_MAX_TTL)) {
+    ++reinfo.re_longttl;
+    ttl = feature_int(FEAT_IRCD_RES_MAX_TTL);
+  }
+  if (ttl < feature_int(FEAT_IRCD_RES_MIN_TTL)) {
+    ++reinfo.re_shortttl;
+    ttl = feature_int(FEAT_IRCD_RES_MIN_TTL);
+  }
+  /*
+   * the names resolve now, so forget that they failed
+   */
+  for (i = 0, s = hp->h_name; s; s = hp->h_aliases[i++]) {
+    while ((cp = cache_lookup(&nameHash, s, 1, CACHE_FAILURE)))
+      rem_cache(cp);
+  }
   /*
    * Make cache entry.  First check to see if the cache already exists
-   * and if so, return a pointer to it.
+   * and if so, renew it and return a pointer to it.  DNSBL answers
+   * are only known by name and replace what was there; merging the
+   * addresses of one listing with the last would misreport it.
    */
-  for (i = 0; hp->h_addr_list[i]; ++i) {
-    if ((cp = find_cache_number(request, hp->h_addr_list[i]))) {
-      update_list(request, cp, request->query.callback==auth_dnsbl_callback);
-      return cp;
+  if (request->query.callback == auth_dnsbl_callback) {
+    if ((cp = cache_lookup(&nameHash, hp->h_name, 1, CACHE_ANSWER)))
+      drop_cache(cp);
+  }
+  else {
+    for (i = 0; hp->h_addr_list[i]; ++i) {
+      if ((cp = cache_lookup(&addrHash, hp->h_addr_list[i], 0,
+                             CACHE_ANSWER))) {
+        update_list(request, cp);
+        cp->ttl = ttl;
+        cp->expireat = CurrentTime + ttl;
+        lru_touch(cp);
+        evict_cache(cp);
+        return cp;
+      }
     }
   }
   /*
@@ -1682,89 +2005,65 @@ static struct CacheEntry* make_cache(struct ResRequest* request)
   memset(cp, 0, sizeof(struct CacheEntry));
   dup_hostent(&cp->he, hp);
   cp->reply.hp = &cp->he.h;
-  /*
-   * hmmm... we could time out the cache after 10 minutes regardless
-   * would that be reasonable since we don't save the reply?
-   */ 
-  if (request->ttl < AR_TTL) {
-    ++reinfo.re_shortttl;
-    cp->ttl = AR_TTL;
-  }
-  else
-    cp->ttl = request->ttl;
+  cp->is_rbl = (request->query.callback == auth_dnsbl_callback);
+  cp->ttl = ttl;
   cp->expireat = CurrentTime + cp->ttl;
   return add_to_cache(cp);
 }
 
 /*
- * rem_cache - delete a cache entry from the cache structures 
- * and lists and return all memory used for the cache back to the memory pool.
+ * make_negative - remember that a request failed, for
+ * IRCD_RES_NEGATIVE_TTL seconds.
  */
-static void rem_cache(struct CacheEntry* ocp)
+static void make_negative(struct ResRequest* request, int rcode)
 {
-  struct CacheEntry** cp;
-  int                 hashv;
-  struct hostent*     hp;
-  assert(0 != ocp);
-
+  struct CacheEntry* cp;
+  int                ttl = feature_int(FEAT_IRCD_RES_NEGATIVE_TTL);
 
-  if (0 < ocp->reply.ref_count) {
-    if (ocp->expireat < CurrentTime) {
-      ocp->expireat = CurrentTime + AR_TTL;
-      Debug((DEBUG_DNS, "Resolver: referenced cache entry not removed for: %s",
-            ocp->he.h.h_name));
-    }
+  assert(0 != request);
+  if (ttl <= 0 || (T_PTR != request->type && !request->name))
     return;
-  }
-  /*
-   * remove cache entry from linked list
-   */
-  for (cp = &cacheTop; *cp; cp = &((*cp)->list_next)) {
-    if (*cp == ocp) {
-      *cp = ocp->list_next;
-      break;
-    }
-  }
-  hp = &ocp->he.h;
-  /*
-   * remove cache entry from hashed name list
-   */
-  assert(0 != hp->h_name);
-  hashv = hash_name(hp->h_name);
 
-  for (cp = &hashtable[hashv].name_list; *cp; cp = &((*cp)->hname_next)) {
-    if (*cp == ocp) {
-      *cp = ocp->hname_next;
-      break;
-    }
+  /* two clients may have asked at once; keep one failure */
+  if (T_PTR == request->type) {
+    while ((cp = cache_lookup(&addrHash, (const char*) &request->addr, 0,
+                              CACHE_FAILURE)))
+      rem_cache(cp);
+  }
+  else {
+    while ((cp = cache_lookup(&nameHash, request->name, 1, CACHE_FAILURE)))
+      rem_cache(cp);
   }
-  /*
-   * remove cache entry from hashed number list
-   */
-  hashv = hash_number((const unsigned char*) hp->h_addr);
-  assert(-1 < hashv);
 
-  for (cp = &hashtable[hashv].num_list; *cp; cp = &((*cp)->hnum_next)) {
-    if (*cp == ocp) {
-      *cp = ocp->hnum_next;
-      break;
-    }
+  cp = (struct CacheEntry*) MyMalloc(sizeof(struct CacheEntry));
+  memset(cp, 0, sizeof(struct CacheEntry));
+  cp->negative = rcode;
+  if (T_PTR == request->type)
+    cp->addr = request->addr;
+  else {
+    cp->he.buf = (char*) MyMalloc(strlen(request->name) + 1);
+    strcpy(cp->he.buf, request->name);
+    cp->he.h.h_name = cp->he.buf;
   }
-  /*
-   * free memory used to hold the various host names and the array
-   * of alias pointers.
-   */
-  MyFree(ocp->he.buf);
-  MyFree(ocp);
-  --cachedCount;
-  ++cainfo.ca_dels;
+  cp->ttl = ttl;
+  cp->expireat = CurrentTime + ttl;
+  ++cainfo.ca_neg_adds;
+  add_to_cache(cp);
 }
 
+/*
+ * flush_resolver_cache - forget everything in the cache.  Entries
+ * still in use are freed once they are let go.
+ */
 void flush_resolver_cache(void)
 {
-  /*
-   * stubbed - iterate cache and remove everything that isn't referenced
-   */
+  struct CacheEntry* cp;
+  struct CacheEntry* cp_next;
+
+  for (cp = cacheTop; cp; cp = cp_next) {
+    cp_next = cp->lru_next;
+    drop_cache(cp);
+  }
 }
 
 /*
@@ -1785,8 +2084,15 @@ int m_dns(struct Client *cptr, struct Client *sptr, int parc, char *parv[])
   }
 
   if (parv[1] && *parv[1] == 'l') {
-    for(cp = cacheTop; cp; cp = cp->list_next) {
+    for(cp = cacheTop; cp; cp = cp->lru_next) {
       hp = &cp->he.h;
+      if (cp->negative) {
+        sendcmdto_one(&me, CMD_NOTICE, sptr, "%C :Expire %d ttl %d %s %s",
+                      sptr, cp->expireat - CurrentTime, cp->ttl,
+                      hp->h_name ? hp->h_name : ircd_ntoa((char*) &cp->addr),
+                      cp->negative == SERVFAIL ? "(SERVFAIL)" : "(NXDOMAIN)");
+        continue;
+      }
       sendcmdto_one(&me, CMD_NOTICE, sptr, "%C :Expire %d ttl %d host %s(%s)",
 		    sptr, cp->expireat - CurrentTime, cp->ttl,
 		    hp->h_name, ircd_ntoa(hp->h_addr));
@@ -1800,22 +2106,26 @@ int m_dns(struct Client *cptr, struct Client *sptr, int parc, char *parv[])
     return 0;
   }
   sendcmdto_one(&me, CMD_NOTICE, sptr,"%C :""\x02""Cache\x02: "
-		  	"Adds %d Dels %d Expires %d Lookups %d "
-			"Hits(addr/name) %d/%d "
+		  	"Adds %d Dels %d Expires %d Evictions %d Lookups %d "
+			"Hits(addr/name) %d/%d Misses %d "
 			"Updates %d", sptr,
 		cainfo.ca_adds, cainfo.ca_dels, cainfo.ca_expires,
-		cainfo.ca_lookups, cainfo.ca_na_hits, cainfo.ca_nu_hits, 
-		cainfo.ca_updates);
+		cainfo.ca_evicts, cainfo.ca_lookups, cainfo.ca_nu_hits,
+		cainfo.ca_na_hits, cainfo.ca_misses, cainfo.ca_updates);
+  sendcmdto_one(&me, CMD_NOTICE, sptr,"%C :""\x02""Cache\x02: "
+		  "Failures %d Failure Hits %d Entries %d Memory %zu/%d",
+		sptr, cainfo.ca_neg_adds, cainfo.ca_neg_hits, cachedCount,
+		cacheMemory, feature_int(FEAT_IRCD_RES_CACHE_SIZE));
   
   sendcmdto_one(&me, CMD_NOTICE, sptr,"%C :\x02Resolver\x02: "
 		  "Errors %d Lookups %d/%d Replies %d Requests %d",
 		sptr, reinfo.re_errors, reinfo.re_na_look,
 		reinfo.re_nu_look, reinfo.re_replies, reinfo.re_requests);
   sendcmdto_one(&me, CMD_NOTICE, sptr,"%C :\x02Resolver\x02: "
-		  "Unknown Reply %d Short TTL(<10m) %d Resent %d Resends %d "
-		  "Timeouts: %d", sptr,
-		reinfo.re_unkrep, reinfo.re_shortttl, reinfo.re_sent,
-		reinfo.re_resends, reinfo.re_timeouts);
+		  "Unknown Reply %d Short TTL %d Long TTL %d Resent %d "
+		  "Resends %d Timeouts: %d", sptr,
+		reinfo.re_unkrep, reinfo.re_shortttl, reinfo.re_longttl,
+		reinfo.re_sent, reinfo.re_resends, reinfo.re_timeouts);
   sendcmdto_one(&me, CMD_NOTICE, sptr, "%C :ResolverFileDescriptor = %d", 
 		  sptr, ResolverFileDescriptor);
 #endif
@@ -1831,11 +2141,14 @@ size_t cres_mem(struct Client* sptr)
   int    cache_count   = 0;
   int    request_count = 0;
 
-  for (entry = cacheTop; entry; entry = entry->list_next) {
-    cache_mem += sizeof(struct CacheEntry);
-    cache_mem += calc_hostent_buffer_size(&entry->he.h); 
+  for (entry = cacheTop; entry; entry = entry->lru_next) {
+    cache_mem += entry->size;
     ++cache_count;
   }
+  cache_mem += (nameHash.buckets ? nameHash.mask + 1 : 0) *
+    sizeof(struct CacheKey*);
+  cache_mem += (addrHash.buckets ? addrHash.mask + 1 : 0) *
+    sizeof(struct CacheKey*);
   for (request = requestListHead; request; request = request->next) {
     request_mem += sizeof(struct ResRequest);
     if (request->name)
@@ -1852,7 +2165,7 @@ size_t cres_mem(struct Client* sptr)
     assert(cachedCount == cache_count);
   }
   send_reply(sptr, SND_EXPLICIT | RPL_STATSDEBUG,
-	     ":Resolver: cache %d(%d) requests %d(%d)", cache_count,
+	     ":Resolver: cache %d(%zu) requests %d(%zu)", cache_count,
 	     cache_mem, request_count, request_mem);
   return cache_mem + request_mem;
 }
@@ -41,6 +41,7 @@
 #include "ircd_features.h"
 #include "ircd_log.h"
 #include "ircd_osdep.h"
+#include "ircd_reply.h"
 #include "ircd_snprintf.h"
 #include "ircd_string.h"
 #include "ircd_struct.h"
@@ -128,90 +129,351 @@ static void unlink_auth_request(struct AuthRequest* request,
 void free_auth_request(struct AuthRequest* auth);
 
 
-/** Process a DNSBL DNS reply against DNSBLBlocks.
- * @param[in] vptr Callback data containing the AuthRequest.
- * @param[in] reply Struct containing the DNS reply.
+/** One listing of a client address on a DNS ban list. */
+struct DNSBLAnswer {
+  struct DNSBLAnswer*  next;      /**< Next listing of the same address. */
+  char                 reply[16]; /**< Address the list answered with. */
+  char                 host[1];   /**< Name that was looked up. */
+};
+
+/** Combined answer of every DNS ban list for one client address.
+ * While the lists are being asked, further connections from the
+ * address wait on the verdict instead of sending their own queries;
+ * once every list has answered, the verdict is kept for
+ * DNSBL_CACHE_TIME seconds and applied to new connections at once.
+ * Only the raw answers are kept, so that find_blline() always judges
+ * them against the DNSBL blocks currently configured.
  */
-void auth_dnsbl_callback(void* vptr, struct DNSReply* reply)
+struct DNSBLVerdict {
+  struct DNSBLVerdict* dv_next;     /**< Next verdict in hash bucket. */
+  struct in_addr       dv_addr;     /**< Client address. */
+  time_t               dv_expire;   /**< When a complete verdict lapses. */
+  unsigned int         dv_pending;  /**< Lists yet to answer. */
+  int                  dv_hashed;   /**< Non-zero while in #dnsblHash. */
+  struct DNSBLAnswer*  dv_answers;  /**< Listings found so far. */
+  struct AuthRequest*  dv_waiters;  /**< Requests waiting for the lists. */
+};
+
+/** Number of hash buckets to start with. */
+#define DNSBL_HASHSIZE 64
+
+/** Verdicts hashed by client address. */
+static struct DNSBLVerdict** dnsblHash;
+/** One less than the number of buckets in #dnsblHash. */
+static unsigned int dnsblHashMask;
+/** Number of verdicts in #dnsblHash. */
+static unsigned int dnsblCount;
+/** Timer that drops lapsed verdicts. */
+static struct Timer dnsblExpireTimer;
+
+/** Statistics for the verdict cache. */
+static struct {
+  unsigned int hits;       /**< Connections given a complete verdict. */
+  unsigned int joins;      /**< Connections that waited on lookups in flight. */
+  unsigned int lookups;    /**< Verdicts that had to ask the lists. */
+} dnsblStats;
+
+/** Hash a client address into #dnsblHash.
+ * @param[in] addr Address to hash.
+ * @return Bucket index.
+ */
+static unsigned int dnsbl_hash(struct in_addr addr)
 {
-  struct AuthRequest* auth = (struct AuthRequest*) vptr;
+  unsigned int hashv = ntohl(addr.s_addr);
 
-  assert(0 != auth);
-  /*
-   * need to do this here so auth_kill_client doesn't
-   * try have the resolver delete the query it's about
-   * to delete anyways. --Bleep
-   */
+  hashv ^= hashv >> 16;
+  hashv *= 0x45d9f3b;
+  hashv ^= hashv >> 16;
+  return hashv & dnsblHashMask;
+}
 
-  --cli_dnsblcount(auth->client);
+/** Double the number of buckets in #dnsblHash. */
+static void dnsbl_grow(void)
+{
+  struct DNSBLVerdict** old = dnsblHash;
+  struct DNSBLVerdict* dv;
+  unsigned int size = dnsblHashMask + 1;
+  unsigned int ii, bucket;
+
+  dnsblHash = (struct DNSBLVerdict**) MyCalloc(size * 2, sizeof(*dnsblHash));
+  dnsblHashMask = size * 2 - 1;
+  for (ii = 0; ii < size; ++ii) {
+    while ((dv = old[ii])) {
+      old[ii] = dv->dv_next;
+      bucket = dnsbl_hash(dv->dv_addr);
+      dv->dv_next = dnsblHash[bucket];
+      dnsblHash[bucket] = dv;
+    }
+  }
+  MyFree(old);
+}
 
-  if (reply) {
-    const struct hostent* hp = reply->hp;
-    int i;
+/** Find the verdict for a client address.
+ * @param[in] addr Address to look up.
+ * @return Verdict, complete or not, or NULL if there is none.
+ */
+static struct DNSBLVerdict* dnsbl_find(struct in_addr addr)
+{
+  struct DNSBLVerdict* dv;
 
-    assert(0 != hp);
+  if (!dnsblHash)
+    return 0;
+  for (dv = dnsblHash[dnsbl_hash(addr)]; dv; dv = dv->dv_next)
+    if (dv->dv_addr.s_addr == addr.s_addr)
+      break;
+  return dv;
+}
 
-    for (i = 0; hp->h_addr_list[i]; ++i) {
-      if (find_blline(auth->client, ircd_ntoa((char*) hp->h_addr_list[i]), hp->h_name))
-        Debug((DEBUG_DEBUG, "DNSBL Matched"));
+/** Take a verdict out of #dnsblHash.
+ * @param[in] dv Verdict to unhash.
+ */
+static void dnsbl_unhash(struct DNSBLVerdict* dv)
+{
+  struct DNSBLVerdict** dvp;
+
+  assert(dv->dv_hashed);
+  for (dvp = &dnsblHash[dnsbl_hash(dv->dv_addr)]; *dvp != dv;
+       dvp = &(*dvp)->dv_next)
+    assert(0 != *dvp);
+  *dvp = dv->dv_next;
+  dv->dv_next = 0;
+  dv->dv_hashed = 0;
+  --dnsblCount;
+}
+
+/** Free a verdict and its answers.
+ * @param[in] dv Verdict that is no longer hashed or waited on.
+ */
+static void dnsbl_free(struct DNSBLVerdict* dv)
+{
+  struct DNSBLAnswer* answer;
+
+  assert(!dv->dv_hashed);
+  assert(0 == dv->dv_pending);
+  assert(0 == dv->dv_waiters);
+  while ((answer = dv->dv_answers)) {
+    dv->dv_answers = answer->next;
+    MyFree(answer);
+  }
+  MyFree(dv);
+}
+
+/** Drop lapsed verdicts.
+ * @param[in] ev Timer event (ignored).
+ */
+static void dnsbl_expire_callback(struct Event* ev)
+{
+  struct DNSBLVerdict** dvp;
+  struct DNSBLVerdict* dv;
+  unsigned int ii;
+
+  if (ev_type(ev) != ET_EXPIRE || !dnsblHash)
+    return;
+  for (ii = 0; ii <= dnsblHashMask; ++ii) {
+    for (dvp = &dnsblHash[ii]; (dv = *dvp); ) {
+      if (!dv->dv_pending && dv->dv_expire <= CurrentTime) {
+        dnsbl_unhash(dv);
+        dnsbl_free(dv);
+      } else
+        dvp = &dv->dv_next;
     }
   }
+}
 
-  /*
-   * If we're using DNSBL and we've processed the last reply,
-   * mark stuff as done and clean-up.
-   */
-  if (feature_bool(FEAT_DNSBL_CHECKS) && (cli_dnsblcount(auth->client) == 0)) {
-    if (!IsDoingAuth(auth) && !IsDNSPending(auth)) {
-      ClearDNSBLPending(auth);
-      if (IsUserPort(auth->client)) {
-        if (IsDNSBL(auth->client))
-          sendheader(auth->client, REPORT_F_DNSBL);
-        else
-          sendheader(auth->client, REPORT_P_DNSBL);
-      }
+/** Create a verdict for a client address and hash it.
+ * @param[in] addr Client address.
+ * @return New verdict with no answers.
+ */
+static struct DNSBLVerdict* dnsbl_make(struct in_addr addr)
+{
+  struct DNSBLVerdict* dv;
+  unsigned int bucket;
+
+  if (!dnsblHash) {
+    dnsblHash = (struct DNSBLVerdict**) MyCalloc(DNSBL_HASHSIZE,
+                                                 sizeof(*dnsblHash));
+    dnsblHashMask = DNSBL_HASHSIZE - 1;
+    timer_add(timer_init(&dnsblExpireTimer), dnsbl_expire_callback, 0,
+              TT_PERIODIC, 60);
+  } else if (dnsblCount > dnsblHashMask)
+    dnsbl_grow();
+
+  dv = (struct DNSBLVerdict*) MyCalloc(1, sizeof(*dv));
+  dv->dv_addr = addr;
+  bucket = dnsbl_hash(addr);
+  dv->dv_next = dnsblHash[bucket];
+  dnsblHash[bucket] = dv;
+  dv->dv_hashed = 1;
+  ++dnsblCount;
+  return dv;
+}
 
-      Debug((DEBUG_DEBUG, "Freeing auth after dnsbl %s@%s [%s]",
-	     cli_username(auth->client), cli_sockhost(auth->client),
-	     cli_sock_ip(auth->client)));
-      log_write(LS_DNSBL, L_INFO, 0, "DNSBL Checks Complete %p", auth->client);
+/** Drop every verdict, as the DNSBL blocks are being reloaded.
+ * Verdicts still waiting on lookups are only unhashed; they are freed
+ * when their last answer arrives.
+ */
+void dnsbl_flush_verdicts(void)
+{
+  struct DNSBLVerdict* dv;
+  unsigned int ii;
 
-      release_auth_client(auth->client);
-      unlink_auth_request(auth, &AuthIncompleteList);
-      free_auth_request(auth);
-    } else {
-      if (IsUserPort(auth->client)) {
-        if (IsDNSBL(auth->client))
-          sendheader(auth->client, REPORT_F_DNSBL);
-        else
-          sendheader(auth->client, REPORT_P_DNSBL);
-      }
-      ClearDNSBLPending(auth);
-      log_write(LS_DNSBL, L_INFO, 0, "DNSBL Checks Complete %p", auth->client);
+  if (!dnsblHash)
+    return;
+  for (ii = 0; ii <= dnsblHashMask; ++ii) {
+    while ((dv = dnsblHash[ii])) {
+      dnsbl_unhash(dv);
+      if (!dv->dv_pending)
+        dnsbl_free(dv);
     }
   }
-  return;
+}
+
+/** Record the answer of one DNS ban list in a verdict.
+ * @param[in] dv Verdict to add to.
+ * @param[in] hp Addresses the list answered with.
+ * @param[in] host Name that was looked up.
+ */
+static void dnsbl_record(struct DNSBLVerdict* dv, const struct hostent* hp,
+                         const char* host)
+{
+  struct DNSBLAnswer* answer;
+  int i;
+
+  for (i = 0; hp->h_addr_list[i]; ++i) {
+    answer = (struct DNSBLAnswer*) MyMalloc(sizeof(*answer) + strlen(host));
+    ircd_strncpy(answer->reply, ircd_ntoa((char*) hp->h_addr_list[i]),
+                 sizeof(answer->reply) - 1);
+    strcpy(answer->host, host);
+    answer->next = dv->dv_answers;
+    dv->dv_answers = answer;
+  }
+}
+
+/** Apply a complete verdict to a client.
+ * @param[in] dv Verdict to apply.
+ * @param[in] client Client being checked.
+ */
+static void dnsbl_apply(struct DNSBLVerdict* dv, struct Client* client)
+{
+  struct DNSBLAnswer* answer;
+
+  for (answer = dv->dv_answers; answer; answer = answer->next) {
+    if (find_blline(client, answer->reply, answer->host))
+      Debug((DEBUG_DEBUG, "DNSBL Matched"));
+  }
+}
+
+/** Stop an auth request waiting on a verdict.
+ * @param[in] auth Request that is going away.
+ */
+static void dnsbl_unwait(struct AuthRequest* auth)
+{
+  struct AuthRequest** authp;
+
+  for (authp = &auth->dnsbl->dv_waiters; *authp != auth;
+       authp = &(*authp)->dnsbl_next)
+    assert(0 != *authp);
+  *authp = auth->dnsbl_next;
+  auth->dnsbl_next = 0;
+  auth->dnsbl = 0;
+}
+
+/** Finish the DNSBL checks of an auth request that waited on a verdict.
+ * @param[in] auth Request whose verdict is complete.
+ */
+static void dnsbl_done(struct AuthRequest* auth)
+{
+  dnsbl_apply(auth->dnsbl, auth->client);
+  auth->dnsbl = 0;
+  auth->dnsbl_next = 0;
+
+  /* checks were turned off meanwhile; whoever clears the rest releases */
+  if (!feature_bool(FEAT_DNSBL_CHECKS)) {
+    ClearDNSBLPending(auth);
+    return;
+  }
+
+  if (!IsDoingAuth(auth) && !IsDNSPending(auth)) {
+    ClearDNSBLPending(auth);
+    if (IsUserPort(auth->client)) {
+      if (IsDNSBL(auth->client))
+        sendheader(auth->client, REPORT_F_DNSBL);
+      else
+        sendheader(auth->client, REPORT_P_DNSBL);
+    }
+
+    Debug((DEBUG_DEBUG, "Freeing auth after dnsbl %s@%s [%s]",
+	   cli_username(auth->client), cli_sockhost(auth->client),
+	   cli_sock_ip(auth->client)));
+    log_write(LS_DNSBL, L_INFO, 0, "DNSBL Checks Complete %p", auth->client);
+
+    release_auth_client(auth->client);
+    unlink_auth_request(auth, &AuthIncompleteList);
+    free_auth_request(auth);
+  } else {
+    if (IsUserPort(auth->client)) {
+      if (IsDNSBL(auth->client))
+        sendheader(auth->client, REPORT_F_DNSBL);
+      else
+        sendheader(auth->client, REPORT_P_DNSBL);
+    }
+    ClearDNSBLPending(auth);
+    log_write(LS_DNSBL, L_INFO, 0, "DNSBL Checks Complete %p", auth->client);
+  }
+}
+
+/** Process a DNSBL DNS reply against DNSBLBlocks.
+ * @param[in] vptr Callback data containing the DNSBLVerdict.
+ * @param[in] reply Struct containing the DNS reply.
+ */
+void auth_dnsbl_callback(void* vptr, struct DNSReply* reply)
+{
+  struct DNSBLVerdict* dv = (struct DNSBLVerdict*) vptr;
+  struct AuthRequest* auth;
+
+  assert(0 != dv);
+  assert(0 < dv->dv_pending);
+
+  if (reply) {
+    assert(0 != reply->hp);
+    dnsbl_record(dv, reply->hp, reply->hp->h_name);
+  }
+
+  if (--dv->dv_pending)
+    return;
+
+  /*
+   * Every list has answered: settle the verdict, then let everyone
+   * who was waiting for it go on.
+   */
+  dv->dv_expire = CurrentTime + feature_int(FEAT_DNSBL_CACHE_TIME);
+  while ((auth = dv->dv_waiters)) {
+    dv->dv_waiters = auth->dnsbl_next;
+    dnsbl_done(auth);
+  }
+  if (!dv->dv_hashed)
+    dnsbl_free(dv);
 }
 
 /** Begin the DNSBL checks if there are any DNSBLBlocks setup.
+ * A client whose address has a complete verdict gets it at once; one
+ * whose address is still being checked waits for those lookups.
  * @param[in] auth struct containing the AuthRequest.
  * @param[in] client struct containing the client who is connecting.
  */
 static int start_dnsblcheck(struct AuthRequest* auth, struct Client* client)
 {
+  struct DNSBLVerdict* dv;
+  struct DNSReply* reply;
   u_long ip;
   u_char *ipo = (u_char *) &ip;
   char hname[HOSTLEN + 1] = "";
   struct blline *blline;
   struct DNSQuery query;
-  int i;
 
   if (!feature_bool(FEAT_DNSBL_CHECKS))
     return 0;
 
-  query.vptr     = auth;
-  query.callback = auth_dnsbl_callback;
-
   ip = cli_ip(auth->client).s_addr;
 
   if (IsUserPort(auth->client))
@@ -221,43 +483,91 @@ static int start_dnsblcheck(struct AuthRequest* auth, struct Client* client)
             cli_sockhost(auth->client), GlobalBLCount);
   Debug((DEBUG_DEBUG, "DNSBL t: %u", GlobalBLCount));
 
-  cli_dnsblcount(auth->client) = GlobalBLCount;
-  SetDNSBLPending(auth);
-
-  for (blline = GlobalBLList; blline; blline = blline->next) {
-    ircd_snprintf(0, hname, HOSTLEN + 1, "%d.%d.%d.%d.%s", ipo[3],
-                  ipo[2], ipo[1], ipo[0], blline->server);
-
-    cli_dnsbl_reply(client) = gethost_byname(hname, &query);
-
-    if (cli_dnsbl_reply(client)) {
-      log_write(LS_DNSBL, L_INFO, 0, "DNSBL entry for %p was cached (%s %s)", auth->client,
-                cli_dnsbl_reply(client)->hp->h_name, hname);
-      Debug((DEBUG_DEBUG, "DNSBL entry for %p was cached (%s %s)", auth->client,  
-            cli_dnsbl_reply(client)->hp->h_name, hname));
-      ++(cli_dnsbl_reply(client))->ref_count;
-      --cli_dnsblcount(auth->client);
-      for (i = 0; cli_dnsbl_reply(client)->hp->h_addr_list[i]; ++i) {
-        if (find_blline(auth->client, ircd_ntoa((char*)cli_dnsbl_reply(client)->hp->h_addr_list[i]), hname))
-          Debug((DEBUG_DEBUG, "DNSBL Matched"));
+  if ((dv = dnsbl_find(cli_ip(client))) && !dv->dv_pending &&
+      dv->dv_expire <= CurrentTime) {
+    dnsbl_unhash(dv);
+    dnsbl_free(dv);
+    dv = 0;
+  }
+
+  if (dv) {
+    if (dv->dv_pending)
+      ++dnsblStats.joins;
+    else
+      ++dnsblStats.hits;
+    log_write(LS_DNSBL, L_INFO, 0, "DNSBL verdict for %p was %s", auth->client,
+              dv->dv_pending ? "in progress" : "cached");
+  } else {
+    ++dnsblStats.lookups;
+    dv = dnsbl_make(cli_ip(client));
+    query.vptr     = dv;
+    query.callback = auth_dnsbl_callback;
+
+    for (blline = GlobalBLList; blline; blline = blline->next) {
+      ircd_snprintf(0, hname, HOSTLEN + 1, "%d.%d.%d.%d.%s", ipo[3],
+                    ipo[2], ipo[1], ipo[0], blline->server);
+
+      ++dv->dv_pending;
+      if ((reply = gethost_byname(hname, &query))) {
+        log_write(LS_DNSBL, L_INFO, 0, "DNSBL entry for %p was cached (%s %s)", auth->client,
+                  reply->hp->h_name, hname);
+        Debug((DEBUG_DEBUG, "DNSBL entry for %p was cached (%s %s)", auth->client,
+              reply->hp->h_name, hname));
+        --dv->dv_pending;
+        dnsbl_record(dv, reply->hp, hname);
       }
     }
+    if (!dv->dv_pending)
+      dv->dv_expire = CurrentTime + feature_int(FEAT_DNSBL_CACHE_TIME);
   }
 
-  if (cli_dnsblcount(auth->client) == 0) {
-    if (IsUserPort(auth->client)) {
-      if (IsDNSBL(auth->client))
-        sendheader(auth->client, REPORT_F_DNSBL);
-      else
-        sendheader(auth->client, REPORT_P_DNSBL);
-    }
-    ClearDNSBLPending(auth);
-    log_write(LS_DNSBL, L_INFO, 0, "DNSBL Checks Complete (none left to check) %s", auth->client);
+  if (dv->dv_pending) {
+    SetDNSBLPending(auth);
+    auth->dnsbl = dv;
+    auth->dnsbl_next = dv->dv_waiters;
+    dv->dv_waiters = auth;
+    return 0;
   }
 
+  dnsbl_apply(dv, client);
+  if (IsUserPort(auth->client)) {
+    if (IsDNSBL(auth->client))
+      sendheader(auth->client, REPORT_F_DNSBL);
+    else
+      sendheader(auth->client, REPORT_P_DNSBL);
+  }
+  log_write(LS_DNSBL, L_INFO, 0, "DNSBL Checks Complete (none left to check) %p", auth->client);
+
   return 0;
 }
 
+/** Report memory and hits of the DNSBL verdict cache to \a sptr.
+ * @param[in] sptr Client requesting information.
+ */
+void dnsbl_count_memory(struct Client* sptr)
+{
+  struct DNSBLVerdict* dv;
+  struct DNSBLAnswer* answer;
+  unsigned int ii, pending = 0, answers = 0;
+  size_t mem = 0;
+
+  for (ii = 0; dnsblHash && ii <= dnsblHashMask; ++ii) {
+    for (dv = dnsblHash[ii]; dv; dv = dv->dv_next) {
+      mem += sizeof(*dv);
+      pending += !!dv->dv_pending;
+      for (answer = dv->dv_answers; answer; answer = answer->next) {
+        mem += sizeof(*answer) + strlen(answer->host);
+        ++answers;
+      }
+    }
+  }
+  send_reply(sptr, SND_EXPLICIT | RPL_STATSDEBUG,
+             ":DNSBL verdicts %u(%zu) pending %u listings %u buckets %u "
+             "hits %u joins %u lookups %u", dnsblCount, mem, pending, answers,
+             dnsblHash ? dnsblHashMask + 1 : 0, dnsblStats.hits,
+             dnsblStats.joins, dnsblStats.lookups);
+}
+
 /** Timeout a given auth request.
  * @param[in] ev A timer event whose associated data is the expired
  *   struct AuthRequest.
@@ -359,9 +669,6 @@ void destroy_auth_request(struct AuthRequest* auth, int send_reports)
       sendheader(auth->client, REPORT_FAIL_DNS);
   }
 
-  if (IsDNSBLPending(auth) && feature_bool(FEAT_DNSBL_CHECKS))
-    delete_resolver_queries(auth);
-
   if (send_reports) {
     log_write(LS_RESOLVER, L_INFO, 0, "DNS/AUTH timeout %s",
 	      get_client_name(auth->client, HIDE_IP));
@@ -400,6 +707,8 @@ void free_auth_request(struct AuthRequest* auth)
     Debug((DEBUG_LIST, "Deleting auth socket for %p", auth->client));
     socket_del(&auth->socket);
   }
+  if (auth->dnsbl)
+    dnsbl_unwait(auth);
   Debug((DEBUG_LIST, "Deleting auth timeout timer for %p", auth->client));
   timer_del(&auth->timeout);
 }
@@ -460,7 +769,7 @@ static void auth_kill_client(struct AuthRequest* auth)
 
   unlink_auth_request(auth, (IsDoingAuth(auth)) ? &AuthPollList : &AuthIncompleteList);
 
-  if (IsDNSPending(auth) || (IsDNSBLPending(auth) && feature_bool(FEAT_DNSBL_CHECKS)))
+  if (IsDNSPending(auth))
     delete_resolver_queries(auth);
   if (feature_bool(FEAT_IPCHECK) && !find_eline(auth->client, EFLAG_IPCHECK))
     IPcheck_disconnect(auth->client);
@@ -537,6 +846,7 @@ static void auth_dns_callback(void* vptr, struct DNSReply* reply)
       ++reply->ref_count;
       cli_dns_reply(auth->client) = reply;
       ircd_strncpy(cli_sockhost(auth->client), hp->h_name, HOSTLEN);
+      forget_eline(auth->client);
       if (IsUserPort(auth->client))
         sendheader(auth->client, REPORT_FIN_DNS);
     }
@@ -769,9 +1079,10 @@ void start_auth(struct Client* client)
   Debug((DEBUG_INFO, "Beginning auth request on client %p", client));
 
   if (!feature_bool(FEAT_NODNS)) {
-    if (LOOPBACK == inet_netof(cli_ip(client)))
+    if (LOOPBACK == inet_netof(cli_ip(client))) {
       strcpy(cli_sockhost(client), cli_name(&me));
-    else {
+      forget_eline(client);
+    } else {
       struct DNSQuery query;
 
       query.vptr     = auth;
@@ -787,6 +1098,7 @@ void start_auth(struct Client* client)
 	++(cli_dns_reply(client))->ref_count;
 	ircd_strncpy(cli_sockhost(client), cli_dns_reply(client)->hp->h_name,
 		     HOSTLEN);
+	forget_eline(client);
 	if (IsUserPort(auth->client))
 	  sendheader(client, REPORT_FIN_DNSC);
 	Debug((DEBUG_LIST, "DNS entry for %p was cached", auth->client));
@@ -882,6 +1194,7 @@ void read_auth_reply(struct AuthRequest* auth)
   
   if (!EmptyString(username)) {
     ircd_strncpy(cli_username(auth->client), username, USERLEN);
+    forget_eline(auth->client);
     /*
      * Not needed, struct is zeroed by memset
      * auth->client->username[USERLEN] = '\0';
@@ -70,6 +70,7 @@
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <sys/utsname.h>
 #include <unistd.h>
 
@@ -435,19 +436,6 @@ void release_dns_reply(struct Client* cptr)
 }
 
 
-void release_dnsbl_reply(struct Client* cptr)
-{
-  assert(0 != cptr);
-  assert(MyConnect(cptr));
-
-  if (cli_dnsbl_reply(cptr)) {
-    assert(0 < cli_dnsbl_reply(cptr)->ref_count);
-    --(cli_dnsbl_reply(cptr))->ref_count;
-    cli_dnsbl_reply(cptr) = 0;
-  }
-}
-
-
 /*
  * completed_connection
  *
@@ -819,17 +807,41 @@ void update_write(struct Client* cptr)
 static int
 read_packet(struct Client *cptr, int socket_ready)
 {
+  struct iovec iov[2];
+  IOResult io;
   unsigned int dolen = 0;
   unsigned int length = 0;
+  int direct = 0;
+  int count;
+  char *line;
 
   if (socket_ready &&
       !(IsUser(cptr) && !IsOper(cptr) && !IsBot(cptr) &&
 	DBufLength(&(cli_recvQ(cptr))) > feature_int(FEAT_CLIENT_FLOOD))) {
+    /*
+     * Plain client connections read straight into the free space at
+     * the end of the receive queue.  Servers are parsed out of readbuf
+     * directly, and SSL_read() needs a single buffer big enough for a
+     * whole record.
+     */
+    direct = !IsServer(cptr) && !IsHandshake(cptr) && !IsConnecting(cptr);
+#ifdef USE_SSL
+    if (cli_socket(cptr).ssl)
+      direct = 0;
+#endif /* USE_SSL */
+    if (direct) {
+      if (0 == (count = dbuf_reserve(&(cli_recvQ(cptr)), iov, BUFSIZE)))
+        return exit_client(cptr, cptr, &me, "dbuf_put fail");
+      io = os_recvv_nonb(cli_fd(cptr), iov, count, &length);
+      dbuf_commit(&(cli_recvQ(cptr)), length);
+    }
+    else
 #ifdef USE_SSL
-    switch (client_recv(cptr, readbuf, sizeof(readbuf), &length)) {
+      io = client_recv(cptr, readbuf, sizeof(readbuf), &length);
 #else
-    switch (os_recv_nonb(cli_fd(cptr), readbuf, sizeof(readbuf), &length)) {
+      io = os_recv_nonb(cli_fd(cptr), readbuf, sizeof(readbuf), &length);
 #endif /* USE_SSL */
+    switch (io) {
     case IO_SUCCESS:
       if (length) {
         if (!IsServer(cptr))
@@ -864,7 +876,8 @@ read_packet(struct Client *cptr, int socket_ready)
      * it on the end of the receive queue and do it when its
      * turn comes around.
      */
-    if (length > 0 && dbuf_put(&(cli_recvQ(cptr)), readbuf, length) == 0)
+    if (length > 0 && !direct &&
+        dbuf_put(&(cli_recvQ(cptr)), readbuf, length) == 0)
       return exit_client(cptr, cptr, &me, "dbuf_put fail");
 
     if (IsUser(cptr)) {
@@ -877,7 +890,29 @@ read_packet(struct Client *cptr, int socket_ready)
            (IsTrusted(cptr) || IsOper(cptr) || IsBot(cptr) ||
 	    cli_since(cptr) - CurrentTime < 10))
     {
-      dolen = dbuf_getmsg(&(cli_recvQ(cptr)), cli_buffer(cptr), BUFSIZE);
+      /*
+       * A line that lies within one buffer of the receive queue is
+       * parsed where it is; only lines that straddle two buffers are
+       * copied out into cli_buffer.
+       */
+      if ((line = dbuf_getline(&(cli_recvQ(cptr)), BUFSIZE, &dolen)))
+      {
+        SetFlag(cptr, FLAG_PARSING);
+        if (client_dopacket(cptr, line, dolen) == CPTR_KILLED)
+          return CPTR_KILLED;
+        ClrFlag(cptr, FLAG_PARSING);
+        /* dead_link() leaves the queue to us while the line is in use */
+        if (IsDead(cptr))
+          DBufClear(&(cli_recvQ(cptr)));
+        else
+          dbuf_delete(&(cli_recvQ(cptr)), dolen + 1);
+      }
+      else if ((dolen = dbuf_getmsg(&(cli_recvQ(cptr)), cli_buffer(cptr),
+                                    BUFSIZE)))
+      {
+        if (client_dopacket(cptr, cli_buffer(cptr), dolen) == CPTR_KILLED)
+          return CPTR_KILLED;
+      }
       /*
        * Devious looking...whats it do ? well..if a client
        * sends a *long* message without any CR or LF, then
@@ -886,15 +921,10 @@ read_packet(struct Client *cptr, int socket_ready)
        * deletes the rest of the buffer contents.
        * -avalon
        */
-      if (dolen == 0)
-      {
-        if (DBufLength(&(cli_recvQ(cptr))) < 510)
-          SetFlag(cptr, FLAG_NONL);
-        else
-          DBufClear(&(cli_recvQ(cptr)));
-      }
-      else if (client_dopacket(cptr, dolen) == CPTR_KILLED)
-        return CPTR_KILLED;
+      else if (DBufLength(&(cli_recvQ(cptr))) < 510)
+        SetFlag(cptr, FLAG_NONL);
+      else
+        DBufClear(&(cli_recvQ(cptr)));
       /*
        * If it has become registered as a Server
        * then skip the per-message parsing below.
@@ -50,6 +50,7 @@
 #include "opercmds.h"
 #include "parse.h"
 #include "res.h"
+#include "s_auth.h"
 #include "s_bsd.h"
 #include "s_debug.h"
 #include "s_misc.h"
@@ -93,23 +94,33 @@
 #endif
 
 struct ConfItem* GlobalConfList;
+/** Index of the Client blocks in #GlobalConfList, used by attach_iline(). */
+static struct BanIndex client_index;
+/** Number of Client blocks in #client_index filed by host mask. */
+static unsigned int client_index_hosts;
 int              GlobalConfCount = 0;
 char*            GlobalForwards[256];
 
 unsigned int     GlobalBLCount;
 
 struct eline*    GlobalEList;
+/** Bumped whenever the E:Lines change, to invalidate cached exemptions. */
+unsigned int     eline_generation = 1;
 struct svcline*  GlobalServicesList;
 struct sline*    GlobalSList;
 struct csline*   GlobalConnStopList;
 struct wline*    GlobalWList;
 struct fline*    GlobalFList;
+/** Compiled form of #GlobalFList, for find_fline(). */
+struct FilterSet FlineRules;
 struct blline*   GlobalBLList;
 struct qline*    GlobalQuarantineList;
 struct SpamFilter* GlobalSpamFilterList;
 
 struct LocalConf   localConf;
 struct DenyConf*   denyConfList;
+/** Index of #denyConfList, used by find_kill() and find_prompt(). */
+static struct BanIndex deny_index;
 struct CRuleConf*  cruleConfList;
 
 /* static struct ServerConf* serverConfList; */
@@ -447,6 +458,7 @@ void free_conf(struct ConfItem *aconf)
          aconf->port));
   if (aconf->dns_pending)
     delete_resolver_queries(aconf);
+  banindex_del(&client_index, &aconf->index);
   MyFree(aconf->username);
   MyFree(aconf->host);
   if (aconf->passwd)
@@ -640,59 +652,96 @@ void det_confs_butmask(struct Client* cptr, int mask)
   }
 }
 
+/** What iline_check() matches Client blocks against. */
+struct IlineCheck {
+  struct Client*  cptr; /**< Client being checked. */
+  struct hostent* hp;   /**< Its DNS reply, or NULL if it has none. */
+};
+
+/*
+ * iline_check
+ * input:
+ *  Client block
+ *  client details
+ * returns:
+ *  non-zero if the Client block applies to the client
+ */
+static int iline_check(void *ban, void *arg)
+{
+  struct ConfItem*    aconf = (struct ConfItem *) ban;
+  struct IlineCheck*  ic = (struct IlineCheck *) arg;
+  struct Client*      cptr = ic->cptr;
+  const char*         hname;
+  int                 i;
+  static char         fullname[HOSTLEN + 1];
+
+  if (aconf->status != CONF_CLIENT)
+    return 0;
+  if (aconf->port && aconf->port != cli_listener(cptr)->port)
+    return 0;
+  if (aconf->username && match(aconf->username, cli_username(cptr)))
+    return 0;
+
+  if (ic->hp && aconf->host) {
+    for (i = 0, hname = ic->hp->h_name; hname; hname = ic->hp->h_aliases[i++]) {
+      ircd_strncpy(fullname, hname, HOSTLEN);
+      fullname[HOSTLEN] = '\0';
+
+      Debug((DEBUG_DNS, "a_il: %s->%s", cli_sockhost(cptr), fullname));
+
+      if (match(aconf->host, fullname))
+        return 0;
+    }
+  }
+
+  return (cli_ip(cptr).s_addr & NETMASK(aconf->bits)) == aconf->ipnum.s_addr;
+}
+
 /*
  * Find the first (best) I line to attach.
  */
 enum AuthorizationCheckResult attach_iline(struct Client*  cptr)
 {
-  struct ConfItem* aconf;
-  const char*      hname;
-  int              i, m = 0;
-  static char      fullname[HOSTLEN + 1];
-  struct hostent*  hp = 0;
+  struct ConfItem*      aconf;
+  struct BanIndexEntry* entry;
+  struct IlineCheck     ic;
 
   assert(0 != cptr);
 
-  if (cli_dns_reply(cptr))
-    hp = cli_dns_reply(cptr)->hp;
-
-  for (aconf = GlobalConfList; aconf; aconf = aconf->next) {
-    if (aconf->status != CONF_CLIENT)
-      continue;
-    if (aconf->port && aconf->port != cli_listener(cptr)->port)
-      continue;
-    if (aconf->username && match(aconf->username, cli_username(cptr)))
-      continue;
-
-    if (hp && aconf->host) {
-      for (i = 0, hname = hp->h_name; hname; hname = hp->h_aliases[i++]) {
-        m = 0;
-        ircd_strncpy(fullname, hname, HOSTLEN);
-        fullname[HOSTLEN] = '\0';
+  ic.cptr = cptr;
+  ic.hp = cli_dns_reply(cptr) ? cli_dns_reply(cptr)->hp : 0;
 
-        Debug((DEBUG_DNS, "a_il: %s->%s", cli_sockhost(cptr), fullname));
+  /* A block's host mask has to match every name the client resolved
+   * to, so looking up the canonical name finds all candidates.
+   */
+  aconf = (struct ConfItem *) banindex_find(&client_index, cli_ip(cptr),
+                                            ic.hp ? ic.hp->h_name : 0,
+                                            iline_check, &ic);
 
-        if (match(aconf->host, fullname)) {
-           m = 1;
-           break;
-        }
+  /* Without a DNS reply host masks are not checked at all; a block
+   * filed by host that comes earlier in the list may still apply.
+   */
+  if (!ic.hp && client_index_hosts) {
+    for (entry = client_index.bi_first; entry; entry = entry->bie_after) {
+      if (aconf && entry->bie_order >= aconf->index.bie_order)
+        break;
+      if (entry->bie_where == BI_HOST && iline_check(entry->bie_ban, &ic)) {
+        aconf = (struct ConfItem *) entry->bie_ban;
+        break;
       }
-      if (m == 1)
-        continue;
     }
- 
-    if ((aconf->bits >= 0) && ((cli_ip(cptr).s_addr & NETMASK(aconf->bits)) != aconf->ipnum.s_addr))
-        continue;
+  }
 
-    if (feature_bool(FEAT_IPCHECK) && !find_eline(cptr, EFLAG_IPCHECK)) {
-      if (IPcheck_nr(cptr) > aconf->maximum)
-        return ACR_TOO_MANY_FROM_IP;
-    }
-    if (aconf->username)
-      SetFlag(cptr, FLAG_DOID);
-    return attach_conf(cptr, aconf);
+  if (!aconf)
+    return ACR_NO_AUTHORIZATION;
+
+  if (feature_bool(FEAT_IPCHECK) && !find_eline(cptr, EFLAG_IPCHECK)) {
+    if (IPcheck_nr(cptr) > aconf->maximum)
+      return ACR_TOO_MANY_FROM_IP;
   }
-  return ACR_NO_AUTHORIZATION;
+  if (aconf->username)
+    SetFlag(cptr, FLAG_DOID);
+  return attach_conf(cptr, aconf);
 }
 
 static int is_attached(struct ConfItem *aconf, struct Client *cptr)
@@ -1026,6 +1075,7 @@ void clear_fline_list(void)
   struct fline *fline;
   while ((fline = GlobalFList)) {
     GlobalFList = fline->next;
+    filter_rule_clear(&fline->rule);
     pcre_free(fline->filter);
     fline->length = 0;
     fline->active = 0;
@@ -1036,6 +1086,7 @@ void clear_fline_list(void)
     MyFree(fline->reason);
   }
   GlobalFList = 0;
+  filterset_changed(&FlineRules);
 }
 
 void clear_eline_list(void)
@@ -1047,6 +1098,7 @@ void clear_eline_list(void)
     MyFree(eline->flags);
   }
   GlobalEList = 0;
+  eline_generation++;
 }
 
 void clear_dnsbl_list(void)
@@ -1063,6 +1115,7 @@ void clear_dnsbl_list(void)
     MyFree(blline);
   }
   GlobalBLList = 0;
+  dnsbl_flush_verdicts();
 }
 
 extern int find_dnsbl(struct Client* sptr, const char* dnsbl)
@@ -1299,6 +1352,63 @@ extern void yyparse(void);
 extern int init_lexer(void);
 extern void deinit_lexer(void);
 
+/** File every Kill block in #deny_index, in list order. */
+static void conf_index_deny_list(void)
+{
+  struct DenyConf* p;
+  struct DenyConf* prev = 0;
+
+  for (p = denyConfList; p; p = p->next)
+    banindex_del(&deny_index, &p->index);
+
+  for (p = denyConfList; p; prev = p, p = p->next) {
+    if ((p->flags & (DENY_FLAGS_IP | DENY_FLAGS_REALNAME | DENY_FLAGS_VERSION))
+        == DENY_FLAGS_IP) {
+      struct in_addr addr;
+
+      addr.s_addr = p->address;
+      banindex_add(&deny_index, &p->index, p, prev ? &prev->index : 0,
+                   &addr, p->bits, 0);
+    } else if ((p->flags & DENY_FLAGS_IP) || EmptyString(p->hostmask))
+      /* an IP mask that may be matched by name, or no mask at all */
+      banindex_add(&deny_index, &p->index, p, prev ? &prev->index : 0,
+                   0, 0, 0);
+    else
+      banindex_add(&deny_index, &p->index, p, prev ? &prev->index : 0,
+                   0, 0, p->hostmask);
+  }
+}
+
+/** File every Client block in #client_index, in list order.
+ * Blocks for a specific network go in the radix tree; those for any
+ * address are filed by host mask if they have one.
+ */
+static void conf_index_client_list(void)
+{
+  struct ConfItem* aconf;
+  struct ConfItem* prev = 0;
+
+  for (aconf = GlobalConfList; aconf; aconf = aconf->next)
+    banindex_del(&client_index, &aconf->index);
+  client_index_hosts = 0;
+
+  for (aconf = GlobalConfList; aconf; aconf = aconf->next) {
+    if (aconf->status != CONF_CLIENT)
+      continue;
+    if (aconf->bits > 0)
+      banindex_add(&client_index, &aconf->index, aconf,
+                   prev ? &prev->index : 0, &aconf->ipnum, aconf->bits, 0);
+    else if (aconf->ipnum.s_addr != 0)
+      continue; /* no ip given: the block can never match */
+    else
+      banindex_add(&client_index, &aconf->index, aconf,
+                   prev ? &prev->index : 0, 0, 0, aconf->host);
+    if (aconf->index.bie_where == BI_HOST)
+      client_index_hosts++;
+    prev = aconf;
+  }
+}
+
 /** Read configuration file.
  * @return Zero on failure, non-zero on success. */
 int read_configuration_file(void)
@@ -1311,6 +1421,8 @@ int read_configuration_file(void)
   deinit_lexer();
   feature_mark(); /* reset unmarked features */
   conf_already_read = 1;
+  conf_index_deny_list();
+  conf_index_client_list();
 
   /* Set our local FLAG_HUB if necessary. */
   if (feature_bool(FEAT_HUB))
@@ -1512,6 +1624,7 @@ void conf_erase_deny_list(void)
   struct DenyConf* p = denyConfList;
   for ( ; p; p = next) {
     next = p->next;
+    banindex_del(&deny_index, &p->index);
     MyFree(p->hostmask);
     MyFree(p->usermask);
     MyFree(p->message);
@@ -1595,6 +1708,7 @@ int rehash(struct Client *cptr, int sig)
   mark_listeners_closing();
 
   read_configuration_file();
+  eline_generation++; /* in case E:Lines were checked while reading */
 
   log_reopen(); /* reopen log files */
 
@@ -1712,6 +1826,32 @@ char* get_type(unsigned int flag)
     return "(unknown)";
 }
 
+/*
+ * update_filter_rules
+ *
+ * Rebuild the compiled F:Line and spam filter rule sets if either list
+ * has changed since they were last built.
+ */
+static void update_filter_rules(void)
+{
+  struct fline *fline;
+  struct SpamFilter *spamfilter;
+
+  if (FlineRules.fs_dirty) {
+    filterset_reset(&FlineRules);
+    for (fline = GlobalFList; fline; fline = fline->next)
+      filterset_add(&FlineRules, &fline->rule);
+    filterset_build(&FlineRules);
+  }
+  if (SpamFilterRules.fs_dirty) {
+    filterset_reset(&SpamFilterRules);
+    for (spamfilter = GlobalSpamFilterList; spamfilter;
+         spamfilter = spamfilter->sf_next)
+      filterset_add(&SpamFilterRules, &spamfilter->sf_rule);
+    filterset_build(&SpamFilterRules);
+  }
+}
+
 /*
  * find_fline
  * input:
@@ -1723,10 +1863,10 @@ int find_fline(struct Client *cptr, struct Client *sptr, char *string, unsigned
   struct fline *fline;
   struct Channel *chptr;
   struct Membership *member,*nmember;
-  struct rusage rnow, rprev;
   struct SpamFilter *spamfilter;
-  struct SpamFilter *sspamfilter;
-  long ms_past;
+  struct FilterRule **rules;
+  enum FilterCost cost;
+  unsigned int count, ii;
   int rf_flag = 0, wf_flag = 0, regmatch = 0;
   int ret = 0, fbrk = 0, ovector[186];
   char temp1[BUFSIZE], temp2[BUFSIZE], temphost[HOSTLEN +3], reason[BUFSIZE];
@@ -1734,13 +1874,25 @@ int find_fline(struct Client *cptr, struct Client *sptr, char *string, unsigned
   char* zline[6];
   char* shun[6];
 
-  for (fline = GlobalFList; fline; fline = fline->next) {
-    regmatch = 0;
-    rf_flag = reactfflagstr(fline->rflags);
-    wf_flag = watchfflagstr(fline->wflags);
+  update_filter_rules();
+  if (!FlineRules.fs_count && !SpamFilterRules.fs_count)
+    return 0;
 
-    if (IsAnOper(sptr))
-      break;
+  if (IsAnOper(sptr))
+    return 0;
+
+  if (find_eline(sptr, EFLAG_SFILTER)) {
+    Debug((DEBUG_DEBUG, "Exempt from spam filter, breaking"));
+    return 0;
+  }
+
+  /* Only the rules watching this kind of text are visited. */
+  rules = filterset_begin(&FlineRules, string, flags, &count);
+  for (ii = 0; ii < count; ii++) {
+    fline = (struct fline *) rules[ii]->fr_owner;
+    regmatch = 0;
+    rf_flag = rules[ii]->fr_rflags;
+    wf_flag = rules[ii]->fr_wflags;
 
     if (fline->active == 0) {
       Debug((DEBUG_DEBUG, "filter has been disabled"));
@@ -1752,11 +1904,6 @@ int find_fline(struct Client *cptr, struct Client *sptr, char *string, unsigned
       break;
     }
 
-    if (find_eline(sptr, EFLAG_SFILTER)) {
-      Debug((DEBUG_DEBUG, "Exempt from spam filter, breaking"));
-      break;
-    }
-
     if (target && *target) {
       if (IsChannelPrefix(*target) && (rf_flag & RFFLAG_OPS)) {
         chptr = FindChannel(target);
@@ -1789,26 +1936,20 @@ int find_fline(struct Client *cptr, struct Client *sptr, char *string, unsigned
       fbrk = 0;
     }
 
-    if (wf_flag & flags) {
-      memset(&rnow, 0, sizeof(rnow));
-      memset(&rprev, 0, sizeof(rnow));
-
-      getrusage(RUSAGE_SELF, &rprev);
-      regmatch = pcre_exec(fline->filter, NULL, string, strlen(string), 0, 0, ovector, 186);
-      getrusage(RUSAGE_SELF, &rnow);
-
+    if ((wf_flag & flags) && filterset_candidate(&FlineRules, rules[ii])) {
+      regmatch = filterset_exec(&FlineRules, rules[ii], ovector, 186);
 
-      ms_past = ((rnow.ru_utime.tv_sec - rprev.ru_utime.tv_sec) * 1000) +
-                ((rnow.ru_utime.tv_usec - rprev.ru_utime.tv_usec) / 1000);
-
-      if ((feature_int(FEAT_FILTER_FATAL_TIME) > 0) && (ms_past > feature_int(FEAT_FILTER_FATAL_TIME))) {
-        sendto_allops(&me, SNO_OLDSNO, "Warning: Very slow spam filter detected (%s) - (took %ld msec to execute). Filter has been disabled",
-                      fline->rawfilter, ms_past);
+      cost = filter_rule_cost(rules[ii]);
+      if (cost == FILTER_COST_FATAL) {
+        sendto_allops(&me, SNO_OLDSNO, "Warning: Very slow spam filter detected (%s) - (averaging %lu usec over %lu runs). Filter has been disabled",
+                      fline->rawfilter, (unsigned long) (rules[ii]->fr_time / rules[ii]->fr_samples / 1000),
+                      rules[ii]->fr_samples);
         fline->active = 0;
         break;
-      } else if ((feature_int(FEAT_FILTER_WARN_TIME) > 0) && (ms_past > feature_int(FEAT_FILTER_WARN_TIME))) {
-        sendto_allops(&me, SNO_OLDSNO, "Warning: Slow spam filter detected (%s) - (took %ld msec to execute).",
-                      fline->rawfilter, ms_past);
+      } else if (cost == FILTER_COST_WARN) {
+        sendto_allops(&me, SNO_OLDSNO, "Warning: Slow spam filter detected (%s) - (averaging %lu usec over %lu runs).",
+                      fline->rawfilter, (unsigned long) (rules[ii]->fr_time / rules[ii]->fr_samples / 1000),
+                      rules[ii]->fr_samples);
       }
 
       if (regmatch > 0) {
@@ -1916,20 +2057,18 @@ int find_fline(struct Client *cptr, struct Client *sptr, char *string, unsigned
     }
   }
 
-  for (spamfilter = GlobalSpamFilterList; spamfilter; spamfilter = sspamfilter) {
-    sspamfilter = spamfilter->sf_next;
+  rules = filterset_begin(&SpamFilterRules, string, flags, &count);
+  for (ii = 0; ii < count; ii++) {
+    spamfilter = (struct SpamFilter *) rules[ii]->fr_owner;
 
     if (spamfilter->sf_expire <= CurrentTime) {
-      spamfilter_free(spamfilter);
+      spamfilter_free(spamfilter); /* the set is rebuilt on the next call */
       continue;
     }
 
     regmatch = 0;
-    rf_flag = reactfflagstr(spamfilter->sf_rflags);
-    wf_flag = watchfflagstr(spamfilter->sf_wflags);
-
-    if (IsAnOper(sptr))
-      break;
+    rf_flag = rules[ii]->fr_rflags;
+    wf_flag = rules[ii]->fr_wflags;
 
     if (!SpamFilterIsActive(spamfilter)) {
       Debug((DEBUG_DEBUG, "filter has been disabled"));
@@ -1941,11 +2080,6 @@ int find_fline(struct Client *cptr, struct Client *sptr, char *string, unsigned
       break;
     }
 
-    if (find_eline(sptr, EFLAG_SFILTER)) {
-      Debug((DEBUG_DEBUG, "Exempt from spam filter, breaking"));
-      break;
-    }
-
     if (target && *target) {
       if (IsChannelPrefix(*target) && (rf_flag & RFFLAG_OPS)) {
         chptr = FindChannel(target);
@@ -1978,21 +2112,14 @@ int find_fline(struct Client *cptr, struct Client *sptr, char *string, unsigned
       fbrk = 0;
     }
 
-    if (wf_flag & flags) {
-      memset(&rnow, 0, sizeof(rnow));
-      memset(&rprev, 0, sizeof(rnow));
+    if ((wf_flag & flags) && filterset_candidate(&SpamFilterRules, rules[ii])) {
+      regmatch = filterset_exec(&SpamFilterRules, rules[ii], ovector, 186);
 
-      getrusage(RUSAGE_SELF, &rprev);
-      regmatch = pcre_exec(spamfilter->sf_filter, NULL, string, strlen(string), 0, 0, ovector, 186);
-      getrusage(RUSAGE_SELF, &rnow);
-
-
-      ms_past = ((rnow.ru_utime.tv_sec - rprev.ru_utime.tv_sec) * 1000) +
-                ((rnow.ru_utime.tv_usec - rprev.ru_utime.tv_usec) / 1000);
-
-      if ((feature_int(FEAT_FILTER_FATAL_TIME) > 0) && (ms_past > feature_int(FEAT_FILTER_FATAL_TIME))) {
-        sendto_allops(&me, SNO_OLDSNO, "Warning: Very slow spam filter detected (%s) - (took %ld msec to execute). Filter has been disabled",
-                      spamfilter->sf_rawfilter, ms_past);
+      cost = filter_rule_cost(rules[ii]);
+      if (cost == FILTER_COST_FATAL) {
+        sendto_allops(&me, SNO_OLDSNO, "Warning: Very slow spam filter detected (%s) - (averaging %lu usec over %lu runs). Filter has been disabled",
+                      spamfilter->sf_rawfilter, (unsigned long) (rules[ii]->fr_time / rules[ii]->fr_samples / 1000),
+                      rules[ii]->fr_samples);
         spamfilter->sf_flags &= ~SPAMFILTER_ACTIVE;
         sendcmdto_serv_butone(&me, CMD_SPAMFILTER, cptr, "* - %s %s %Tu %s :%s",
                               spamfilter->sf_wflags, spamfilter->sf_rflags,
@@ -2000,9 +2127,10 @@ int find_fline(struct Client *cptr, struct Client *sptr, char *string, unsigned
                               spamfilter->sf_reason, spamfilter->sf_rawfilter);
 
         break;
-      } else if ((feature_int(FEAT_FILTER_WARN_TIME) > 0) && (ms_past > feature_int(FEAT_FILTER_WARN_TIME))) {
-        sendto_allops(&me, SNO_OLDSNO, "Warning: Slow spam filter detected (%s) - (took %ld msec to execute).",
-                      spamfilter->sf_rawfilter, ms_past);
+      } else if (cost == FILTER_COST_WARN) {
+        sendto_allops(&me, SNO_OLDSNO, "Warning: Slow spam filter detected (%s) - (averaging %lu usec over %lu runs).",
+                      spamfilter->sf_rawfilter, (unsigned long) (rules[ii]->fr_time / rules[ii]->fr_samples / 1000),
+                      rules[ii]->fr_samples);
       }
 
       if (regmatch > 0) {
@@ -2114,53 +2242,41 @@ int find_fline(struct Client *cptr, struct Client *sptr, char *string, unsigned
 }
 
 /*
- * find_eline
+ * eline_flags_for
  * input:
  *  client pointer
- *  combination of EFLAG_*'s
+ *  user name to match E:Lines against
+ *  whether to match user@host as well as user@ip
  * returns:
- *  0: Client does not have an E:Line.
- * -1: Client has an E:Line with 1 or more of the supplied flags.
-*/
-int find_eline(struct Client *cptr, unsigned int flags)
+ *  the EFLAG_*'s of every E:Line matching user@ip or user@host
+ */
+static unsigned int eline_flags_for(struct Client *cptr, const char *user,
+                                    int by_host)
 {
   char i_host[SOCKIPLEN + USERLEN + 2];
   char s_host[HOSTLEN + USERLEN + 2];
-  int found = 0;
+  unsigned int found = 0;
   unsigned int e_flag = 0;
   struct eline *eline;
+  in_addr_t cli_addr = cli_ip(cptr).s_addr;
 
-  if (flags & EFLAG_IPCHECK) {
-    if (IsIPCheckExempted(cptr))
-      return -1;
-
-    if (IsNotIPCheckExempted(cptr))
-      return 0;
-
-    ircd_snprintf(0, i_host, USERLEN+SOCKIPLEN+2, "nobody@%s", ircd_ntoa((const char*) &(cli_ip(cptr))));
-  } else {
-    ircd_snprintf(0, i_host, USERLEN+SOCKIPLEN+2, "%s@%s", cli_username(cptr), ircd_ntoa((const char*) &(cli_ip(cptr))));
-    ircd_snprintf(0, s_host, USERLEN+HOSTLEN+2, "%s@%s", cli_username(cptr), cli_sockhost(cptr));
-  }
+  ircd_snprintf(0, i_host, USERLEN+SOCKIPLEN+2, "%s@%s", user, ircd_ntoa((const char*) &(cli_ip(cptr))));
+  if (by_host)
+    ircd_snprintf(0, s_host, USERLEN+HOSTLEN+2, "%s@%s", user, cli_sockhost(cptr));
 
   for (eline = GlobalEList; eline; eline = eline->next) {
     char* ip_start;
     char* cidr_start;
-    in_addr_t cli_addr = 0;
 
     e_flag = eflagstr(eline->flags);
+    if (!e_flag || !(e_flag & ~found))
+      continue; /* cannot tell us anything new */
 
-    if (s_host) {
-      if ((match(eline->mask, s_host) == 0) || (match(eline->mask, i_host) == 0)) {
-        if (e_flag & flags) {
-          found = 1;
-        }
-      }
+    if ((by_host && match(eline->mask, s_host) == 0) || (match(eline->mask, i_host) == 0)) {
+      found |= e_flag;
+      continue;
     }
 
-    if ((ip_start = strrchr(i_host, '@')))
-      cli_addr = inet_addr(ip_start + 1);
-
     if ((ip_start = strrchr(eline->mask, '@')) && (cidr_start = strchr(ip_start + 1, '/'))) {
       int bits = atoi(cidr_start + 1);
       char* p = strchr(i_host, '@');
@@ -2173,23 +2289,55 @@ int find_eline(struct Client *cptr, unsigned int flags)
             *cidr_start = 0;
             ban_addr = inet_addr(ip_start + 1);
             *cidr_start = '/';
-            if ((NETMASK(bits) & cli_addr) == ban_addr) {
-              *p = *ip_start = '@';
-              if (e_flag & flags) {
-                found = 1;
-              }
-            }
+            if ((NETMASK(bits) & cli_addr) == ban_addr)
+              found |= e_flag;
           }
         }
         *p = *ip_start = '@';
       }
     }
-
   }
 
-  if (found)
+  return found;
+}
+
+/*
+ * find_eline
+ * input:
+ *  client pointer
+ *  combination of EFLAG_*'s
+ * returns:
+ *  0: Client does not have an E:Line.
+ * -1: Client has an E:Line with 1 or more of the supplied flags.
+ *
+ * The full set of exemptions of a local client is worked out once and
+ * kept on its connection until its user name, IP or host changes (see
+ * forget_eline()) or the E:Lines are reloaded.
+ */
+int find_eline(struct Client *cptr, unsigned int flags)
+{
+  unsigned int e_flags;
+
+  if (flags & EFLAG_IPCHECK) {
+    if (IsIPCheckExempted(cptr))
       return -1;
 
+    if (IsNotIPCheckExempted(cptr))
+      return 0;
+
+    e_flags = eline_flags_for(cptr, "nobody", 0);
+  } else if (MyConnect(cptr)) {
+    if (cli_elinegen(cptr) != eline_generation) {
+      cli_eflags(cptr) = eline_flags_for(cptr, cli_username(cptr), 1);
+      cli_elinegen(cptr) = eline_generation;
+    }
+    e_flags = cli_eflags(cptr);
+  } else
+    e_flags = eline_flags_for(cptr, cli_username(cptr), 1);
+
+  if (e_flags & flags)
+    return -1;
+
   if (flags & EFLAG_IPCHECK)
     SetNotIPCheckExempted(cptr);
 
@@ -2260,6 +2408,86 @@ int find_eline_from_ip(struct in_addr addr, unsigned int flags)
   return 0;
 }
 
+/** What deny_check() matches Kill blocks against. */
+struct DenyCheck {
+  struct Client* cptr;     /**< Client being checked. */
+  const char*    host;     /**< Its hostname. */
+  const char*    name;     /**< Its user name. */
+  const char*    realname; /**< Its real name. */
+  const char*    version;  /**< Its CTCP version reply. */
+  int            prompt;   /**< Whether to look at prompting Kill blocks
+                                rather than the others. */
+};
+
+/*
+ * deny_check
+ * input:
+ *  Kill block
+ *  client details
+ * returns:
+ *  non-zero if the Kill block applies to the client
+ */
+static int deny_check(void *ban, void *arg)
+{
+  struct DenyConf*  deny = (struct DenyConf *) ban;
+  struct DenyCheck* dc = (struct DenyCheck *) arg;
+
+  if (!(deny->flags & DENY_FLAGS_PROMPT) != !dc->prompt)
+    return 0;
+
+  if (0 != match(deny->usermask, dc->name))
+    return 0;
+
+  if (EmptyString(deny->hostmask))
+    return 1;
+
+  if (deny->flags & DENY_FLAGS_VERSION && feature_bool(FEAT_CTCP_VERSIONING) && feature_bool(FEAT_CTCP_VERSIONING_KILL)) /* K: by version - added by Vadtec 02/25/2006 */
+    return 0 == match(deny->hostmask, dc->version);
+  else if (deny->flags & DENY_FLAGS_REALNAME) /* K: by real name */
+    return 0 == match(deny->hostmask, dc->realname);
+  else if (deny->flags & DENY_FLAGS_IP) { /* k: by IP */
+    Debug((DEBUG_DEBUG, "ip: %08x network: %08x/%i mask: %08x",
+           cli_ip(dc->cptr).s_addr, deny->address, deny->bits, NETMASK(deny->bits)));
+    return (cli_ip(dc->cptr).s_addr & NETMASK(deny->bits)) == deny->address;
+  }
+  return 0 == match(deny->hostmask, dc->host);
+}
+
+/*
+ * find_deny
+ * input:
+ *  client pointer
+ *  whether to look for a prompting Kill block
+ * returns:
+ *  the first Kill block in the list that applies to the client, or 0
+ */
+static struct DenyConf *find_deny(struct Client *cptr, int prompt)
+{
+  struct DenyCheck dc;
+  const char*      names[3];
+
+  dc.cptr = cptr;
+  dc.host = cli_sockhost(cptr);
+  dc.name = cli_user(cptr)->username;
+  dc.realname = cli_info(cptr);
+  dc.version = cli_version(cptr); /* added by Vadtec 02/26/2008 */
+  dc.prompt = prompt;
+
+  assert(strlen(dc.host) <= HOSTLEN);
+  assert((dc.name ? strlen(dc.name) : 0) <= HOSTLEN);
+  assert((dc.realname ? strlen(dc.realname) : 0) <= REALLEN);
+  assert((dc.version ? strlen(dc.version) : 0) <= VERSIONLEN); /* added by Vadtec 02/26/2008 */
+
+  /* Host, real name and version masks share the index's suffix trie;
+   * deny_check() sorts out which string each mask is matched against.
+   */
+  names[0] = dc.host;
+  names[1] = dc.realname;
+  names[2] = dc.version;
+  return (struct DenyConf *) banindex_find_names(&deny_index, cli_ip(cptr),
+                                                 names, 3, deny_check, &dc);
+}
+
 /*
  * find_kill
  * input:
@@ -2273,10 +2501,6 @@ int find_eline_from_ip(struct in_addr addr, unsigned int flags)
  */
 int find_kill(struct Client *cptr)
 {
-  const char*      host;
-  const char*      name;
-  const char*      realname;
-  const char*      version; /* added by Vadtec 02/26/2008 */
   struct DenyConf* deny;
   struct Gline*    agline = NULL;
 
@@ -2285,45 +2509,7 @@ int find_kill(struct Client *cptr)
   if (!cli_user(cptr))
     return 0;
 
-  host = cli_sockhost(cptr);
-  name = cli_user(cptr)->username;
-  realname = cli_info(cptr);
-  version = cli_version(cptr); /* added by Vadtec 02/26/2008 */
-
-  assert(strlen(host) <= HOSTLEN);
-  assert((name ? strlen(name) : 0) <= HOSTLEN);
-  assert((realname ? strlen(realname) : 0) <= REALLEN);
-  assert((version ? strlen(version) : 0) <= VERSIONLEN); /* added by Vadtec 02/26/2008 */
-
-  /* 2000-07-14: Rewrote this loop for massive speed increases.
-   *             -- Isomer
-   */
-  for (deny = denyConfList; deny; deny = deny->next) {
-    if (deny->flags & DENY_FLAGS_PROMPT) /* handled by find_prompt */
-      continue;
-
-    if (0 != match(deny->usermask, name))
-      continue;
-
-    if (EmptyString(deny->hostmask))
-      break;
-
-    if (deny->flags & DENY_FLAGS_VERSION && feature_bool(FEAT_CTCP_VERSIONING) && feature_bool(FEAT_CTCP_VERSIONING_KILL)) { /* K: by version - added by Vadtec 02/25/2006 */
-      if (0 == match(deny->hostmask, version))
-	break;
-    }
-    else if (deny->flags & DENY_FLAGS_REALNAME) { /* K: by real name */
-      if (0 == match(deny->hostmask, realname))
-	break;
-    } else if (deny->flags & DENY_FLAGS_IP) { /* k: by IP */
-      Debug((DEBUG_DEBUG, "ip: %08x network: %08x/%i mask: %08x",
-             cli_ip(cptr).s_addr, deny->address, deny->bits, NETMASK(deny->bits)));
-      if ((cli_ip(cptr).s_addr & NETMASK(deny->bits)) == deny->address)
-        break;
-    }
-    else if (0 == match(deny->hostmask, host))
-      break;
-  }
+  deny = find_deny(cptr, 0);
   if (deny && !find_eline(cptr, EFLAG_KLINE)) {
     if (EmptyString(deny->message))
       send_reply(cptr, SND_EXPLICIT | ERR_YOUREBANNEDCREEP,
@@ -2360,10 +2546,6 @@ int find_kill(struct Client *cptr)
  */
 struct DenyConf *find_prompt(struct Client *cptr)
 {
-  const char*      host;
-  const char*      name;
-  const char*      realname;
-  const char*      version; /* added by Vadtec 02/26/2008 */
   struct DenyConf* deny;
 
   assert(0 != cptr);
@@ -2371,45 +2553,7 @@ struct DenyConf *find_prompt(struct Client *cptr)
   if (!cli_user(cptr))
     return 0;
 
-  host = cli_sockhost(cptr);
-  name = cli_user(cptr)->username;
-  realname = cli_info(cptr);
-  version = cli_version(cptr); /* added by Vadtec 02/26/2008 */
-
-  assert(strlen(host) <= HOSTLEN);
-  assert((name ? strlen(name) : 0) <= HOSTLEN);
-  assert((realname ? strlen(realname) : 0) <= REALLEN);
-  assert((version ? strlen(version) : 0) <= VERSIONLEN); /* added by Vadtec 02/26/2008 */
-
-  /* 2000-07-14: Rewrote this loop for massive speed increases.
-   *             -- Isomer
-   */
-  for (deny = denyConfList; deny; deny = deny->next) {
-    if (deny->flags & DENY_FLAGS_PROMPT) {
-
-      if (0 != match(deny->usermask, name))
-        continue;
-
-      if (EmptyString(deny->hostmask))
-        break;
-
-      if (deny->flags & DENY_FLAGS_VERSION && feature_bool(FEAT_CTCP_VERSIONING) && feature_bool(FEAT_CTCP_VERSIONING_KILL)) { /* K: by version - added by Vadtec 02/25/2006 */
-        if (0 == match(deny->hostmask, version))
-	break;
-      }
-      else if (deny->flags & DENY_FLAGS_REALNAME) { /* K: by real name */
-        if (0 == match(deny->hostmask, realname))
-	  break;
-      } else if (deny->flags & DENY_FLAGS_IP) { /* k: by IP */
-        Debug((DEBUG_DEBUG, "ip: %08x network: %08x/%i mask: %08x",
-               cli_ip(cptr).s_addr, deny->address, deny->bits, NETMASK(deny->bits)));
-        if ((cli_ip(cptr).s_addr & NETMASK(deny->bits)) == deny->address)
-          break;
-      }
-      else if (0 == match(deny->hostmask, host))
-        break;
-    }
-  }
+  deny = find_deny(cptr, 1);
 
   if (deny && !find_eline(cptr, EFLAG_KLINE))
     return deny;
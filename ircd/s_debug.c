@@ -26,6 +26,7 @@
 #include "channel.h"
 #include "class.h"
 #include "client.h"
+#include "cloak.h"
 #include "gline.h"
 #include "hash.h"
 #include "ircd_alloc.h"
@@ -33,6 +34,7 @@
 #include "ircd_log.h"
 #include "ircd_osdep.h"
 #include "ircd_reply.h"
+#include "ircd_slab.h"
 #include "ircd.h"
 #include "jupe.h"
 #include "list.h"
@@ -42,6 +44,7 @@
 #include "numeric.h"
 #include "numnicks.h"
 #include "res.h"
+#include "s_auth.h"
 #include "s_bsd.h"
 #include "s_conf.h"
 #include "s_stats.h"
@@ -224,6 +227,8 @@ void count_memory(struct Client *cptr, const struct StatDesc *sd,
       sh = 0,                   /* shuns */
       ju = 0;                   /* jupes */
 
+  unsigned int hb = 0;          /* hash buckets */
+
   size_t chm = 0,               /* memory used by channels */
       chbm = 0,                 /* memory used by channel bans */
       chem = 0,                 /* memory used by channel excepts */
@@ -240,6 +245,7 @@ void count_memory(struct Client *cptr, const struct StatDesc *sd,
       zlm = 0,                  /* memory used by zlines */
       shm = 0,                  /* memory used by shuns */
       jum = 0,                  /* memory used by jupes */
+      hbm = 0,                  /* memory used by hash tables */
       com = 0,                  /* memory used by conf lines */
       dbufs_allocated = 0,      /* memory used by dbufs */
       dbufs_used = 0,           /* memory used by dbufs */
@@ -248,6 +254,10 @@ void count_memory(struct Client *cptr, const struct StatDesc *sd,
       listenersm = 0,           /* memory used by listetners */
       rm = 0,                   /* res memory used */
       totcl = 0, totch = 0, totww = 0, tot = 0;
+#ifdef USE_SSL
+  unsigned long sslrec = 0,     /* TLS records written */
+      sslbytes = 0;             /* payload bytes in those records */
+#endif /* USE_SSL */
 
   count_whowas_memory(&wwu, &wwm, &wwa, &wwam);
   wwm += sizeof(struct Whowas) * feature_int(FEAT_NICKNAMEHISTORYLENGTH);
@@ -287,6 +297,8 @@ void count_memory(struct Client *cptr, const struct StatDesc *sd,
     chm += (strlen(chptr->chname) + sizeof(struct Channel));
     for (linkh = chptr->invites; linkh; linkh = linkh->next)
       chi++;
+    chbm += ban_cache_memory(chptr->bancache);
+    chem += ban_cache_memory(chptr->exceptcache);
     for (linkh = chptr->banlist; linkh; linkh = linkh->next)
     {
       chb++;
@@ -314,6 +326,10 @@ void count_memory(struct Client *cptr, const struct StatDesc *sd,
 #ifdef USE_SSL
   send_reply(cptr, SND_EXPLICIT | RPL_STATSDEBUG,
 	     ":Clients %d(%zu) Connections %d(%zu) SSL %d", c, cm, cn, cnm, ssl_count());
+  ssl_record_stats(&sslrec, &sslbytes);
+  send_reply(cptr, SND_EXPLICIT | RPL_STATSDEBUG,
+	     ":SSL records %lu bytes %lu average %lu", sslrec, sslbytes,
+	     sslrec ? sslbytes / sslrec : 0);
 #else
   send_reply(cptr, SND_EXPLICIT | RPL_STATSDEBUG,
 	     ":Clients %d(%zu) Connections %d(%zu)", c, cm, cn, cnm);
@@ -367,9 +383,9 @@ void count_memory(struct Client *cptr, const struct StatDesc *sd,
 
   totww = wwu * sizeof(struct User) + wwam + wwm;
 
+  hb = hash_memory_count(&hbm);
   send_reply(cptr, SND_EXPLICIT | RPL_STATSDEBUG,
-	     ":Hash: client %d(%zu), chan is the same", HASHSIZE,
-	     sizeof(void *) * HASHSIZE);
+	     ":Hash: client, channel and watch buckets %u(%zu)", hb, hbm);
 
   count_listener_memory(&listeners, &listenersm);
   send_reply(cptr, SND_EXPLICIT | RPL_STATSDEBUG,
@@ -393,12 +409,20 @@ void count_memory(struct Client *cptr, const struct StatDesc *sd,
    */
   msgq_count_memory(cptr, &msg_allocated, &msgbuf_allocated);
 
+  slab_count_memory(cptr);
+
+  dnsbl_count_memory(cptr);
+
+  log_count_memory(cptr);
+
+  cloak_count_memory(cptr);
+
   rm = cres_mem(cptr);
 
   tot =
       totww + totch + totcl + com + cl * sizeof(struct ConnectionClass) +
       dbufs_allocated + msg_allocated + msgbuf_allocated + rm;
-  tot += sizeof(void *) * HASHSIZE * 3;
+  tot += hbm;
 
 #if defined(MDEBUG)
   send_reply(cptr, SND_EXPLICIT | RPL_STATSDEBUG, ":Allocations: %zu(%zu)",
@@ -290,7 +290,7 @@ int server_estab(struct Client *cptr, struct ConfItem *aconf)
                       cli_sslclifp(acptr));
 
       for (lp = cli_user(acptr)->silence; lp; lp = lp->next)
-        sendcmdto_one(cli_user(acptr)->server, CMD_SILENCE, cptr, "%C +%s", acptr, lp->value.cp);
+        sendcmdto_one(cli_user(acptr)->server, CMD_SILENCE, cptr, "%C +%s", acptr, lp->value.silence.mask);
 
       privs = client_print_privs(acptr);
       if (strlen(privs) > 1)
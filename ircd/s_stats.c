@@ -29,6 +29,7 @@
 #include "gline.h"
 #include "hash.h"
 #include "ircd.h"
+#include "ircd_alloc.h"
 #include "ircd_chattr.h"
 #include "ircd_events.h"
 #include "ircd_features.h"
@@ -154,7 +155,13 @@ stats_crule_list(struct Client* to, const struct StatDesc *sd,
 static void
 stats_engine(struct Client *to, const struct StatDesc *sd, char *param)
 {
+  unsigned long changed, applied;
+
   send_reply(to, RPL_STATSENGINE, engine_name());
+  engine_event_stats(&changed, &applied);
+  send_reply(to, SND_EXPLICIT | RPL_STATSDEBUG,
+             ":Interest changes %lu, engine updates %lu, avoided %lu",
+             changed, applied, changed - applied);
 }
 
  
@@ -255,6 +262,70 @@ stats_flines(struct Client* to, const struct StatDesc *sd, char* param)
   spamfilter_stats(to, sd, param);
 }
 
+/** A filter rule, as listed by stats_filtercost(). */
+struct FilterCostEntry {
+  struct FilterRule *rule;   /**< The rule and its costs. */
+  const char        *filter; /**< Its regex, as entered. */
+  int                active; /**< Whether it is in use. */
+};
+
+/** Order filter rules by the CPU time they have used, dearest first. */
+static int
+filtercost_cmp(const void *a_, const void *b_)
+{
+  unsigned long long a = filter_rule_total(((const struct FilterCostEntry *) a_)->rule);
+  unsigned long long b = filter_rule_total(((const struct FilterCostEntry *) b_)->rule);
+
+  return (a < b) ? 1 : (a > b) ? -1 : 0;
+}
+
+static void
+stats_filtercost(struct Client* to, const struct StatDesc *sd, char* param)
+{
+  struct FilterCostEntry *entries;
+  struct FilterRule *rule;
+  struct fline *fline;
+  struct SpamFilter *spamfilter;
+  unsigned int count = 0, ii;
+
+  /* send header so the client knows what we are showing */
+  send_reply(to, SND_EXPLICIT | RPL_STATSHEADER,
+            "A Cost(us) Runs Hits Average(us) Max(us) Status :Filter");
+
+  for (fline = GlobalFList; fline; fline = fline->next)
+    count++;
+  for (spamfilter = GlobalSpamFilterList; spamfilter; spamfilter = spamfilter->sf_next)
+    count++;
+  if (!count)
+    return;
+
+  entries = (struct FilterCostEntry *) MyMalloc(count * sizeof(*entries));
+  count = 0;
+  for (fline = GlobalFList; fline; fline = fline->next) {
+    entries[count].rule = &fline->rule;
+    entries[count].filter = fline->rawfilter;
+    entries[count++].active = fline->active;
+  }
+  for (spamfilter = GlobalSpamFilterList; spamfilter; spamfilter = spamfilter->sf_next) {
+    if (spamfilter->sf_expire <= CurrentTime)
+      continue;
+    entries[count].rule = &spamfilter->sf_rule;
+    entries[count].filter = spamfilter->sf_rawfilter;
+    entries[count++].active = SpamFilterIsActive(spamfilter);
+  }
+  qsort(entries, count, sizeof(*entries), filtercost_cmp);
+
+  for (ii = 0; ii < count; ii++) {
+    rule = entries[ii].rule;
+    send_reply(to, SND_EXPLICIT | RPL_STATSDEBUG, "A %llu %lu %lu %lu %lu %s :%s",
+               filter_rule_total(rule) / 1000, rule->fr_calls, rule->fr_hits,
+               rule->fr_samples ? (unsigned long) (rule->fr_time / rule->fr_samples / 1000) : 0,
+               (unsigned long) (rule->fr_max / 1000),
+               entries[ii].active ? "active" : "disabled", entries[ii].filter);
+  }
+  MyFree(entries);
+}
+
 static void
 stats_webirc(struct Client* to, const struct StatDesc *sd, char* param)
 {
@@ -587,6 +658,9 @@ stats_help(struct Client* to, const struct StatDesc *sd, char* param)
  * stats.  Struct StatDesc is defined in s_stats.h.
  */
 struct StatDesc statsinfo[] = {
+  { 'A', "filtercost", (STAT_FLAG_OPERFEAT | STAT_FLAG_CASESENS), FEAT_HIS_STATS_FILTERS,
+    stats_filtercost, 0,
+    "Filter lines by CPU time used." },
   { 'b', "forwards", (STAT_FLAG_OPERFEAT | STAT_FLAG_CASESENS), FEAT_HIS_STATS_FORWARDS,
     stats_configured_forwards, 0,
     "Service forwards." },
@@ -693,8 +693,6 @@ int register_user(struct Client *cptr, struct Client *sptr,
     char chkhosti[NICKLEN+USERLEN+SOCKIPLEN+3];
     char chkhosth[NICKLEN+USERLEN+HOSTLEN+3];
 
-    release_dnsbl_reply(sptr);
-
     ircd_snprintf(0, chkhosti, NICKLEN+USERLEN+SOCKIPLEN+3, "%s!%s@%s", cli_name(sptr), user->username, (char*)ircd_ntoa((const char*) &(cli_ip(sptr))));
     ircd_snprintf(0, chkhosth, NICKLEN+USERLEN+HOSTLEN+3, "%s!%s@%s", cli_name(sptr), user->username, cli_sockhost(sptr));
 
@@ -1330,6 +1328,7 @@ int set_nick_name(struct Client* cptr, struct Client* sptr,
       hRemClient(sptr);
     strcpy(cli_name(sptr), nick);
     hAddClient(sptr);
+    ban_identity_clear(sptr);
 
     /* Notify change nick local/remote user */
     check_status_watch(sptr, RPL_LOGON);
@@ -1574,6 +1573,9 @@ void send_umode_out(struct Client *cptr, struct Client *sptr, struct Flags *old,
   int i;
   struct Client *acptr;
 
+  /* Hidden, set and account hosts all depend on the user's modes */
+  ban_identity_clear(sptr);
+
   send_umode(NULL, sptr, old, prop ? SEND_UMODES : SEND_UMODES_BUT_OPER);
 
   for (i = HighestFd; i >= 0; i--) {
@@ -1646,6 +1648,107 @@ void make_hidden_hostmask(char *buffer, struct Client *cptr)
   }
 }
 
+/*
+ * Create a string of form "foo!bar@fubar" given foo, bar and fubar
+ * as the parameters.  If NULL, they become "*".
+ */
+#define NUH_BUFSIZE     (NICKLEN + USERLEN + HOSTLEN + 3)
+static char *make_nick_user_host(char *namebuf, const char *nick,
+                                 const char *name, const char *host)
+{
+  ircd_snprintf(0, namebuf, NUH_BUFSIZE, "%s!%s@%s", nick, name, host);
+  return namebuf;
+}
+
+/*
+ * Create a string of form "foo!bar@123.456.789.123" given foo, bar and the
+ * IP-number as the parameters.  If NULL, they become "*".
+ */
+#define NUI_BUFSIZE     (NICKLEN + USERLEN + 16 + 3)
+static char *make_nick_user_ip(char *ipbuf, char *nick, char *name,
+                               struct in_addr ip)
+{
+  ircd_snprintf(0, ipbuf, NUI_BUFSIZE, "%s!%s@%s", nick, name,
+                ircd_ntoa((const char*) &ip));
+  return ipbuf;
+}
+
+/** Serial number of current ban identities; see user_ban_identity(). */
+static unsigned int ban_identity_serial = 1;
+
+/** Mark a user's cached ban masks stale.
+ * @param[in] cptr User whose nick, host, account or modes changed.
+ */
+void ban_identity_clear(struct Client *cptr)
+{
+  if (cli_user(cptr))
+    cli_user(cptr)->banid.bid_serial = 0;
+}
+
+/** Mark every user's cached ban masks stale. */
+void ban_identity_flush(void)
+{
+  if (!++ban_identity_serial)
+    ban_identity_serial = 1;
+}
+
+/** Return the masks channel bans and excepts are matched against for
+ * \a cptr, rebuilding them if they are stale.
+ * @param[in] cptr User being checked.
+ * @return The user's ban identity.
+ */
+struct BanIdentity *user_ban_identity(struct Client *cptr)
+{
+  struct User *user = cli_user(cptr);
+  struct BanIdentity *bid = &user->banid;
+  char tmphost[HOSTLEN + 1];
+
+  if (bid->bid_serial == ban_identity_serial)
+    return bid;
+
+  make_nick_user_host(bid->bid_host, cli_name(cptr), user->realusername,
+                      user->host);
+
+  bid->bid_sethost[0] = '\0';
+  if (HasSetHost(cptr))
+    make_nick_user_host(bid->bid_sethost, cli_name(cptr), user->realusername,
+                        user->realhost);
+
+  bid->bid_fakehost[0] = '\0';
+  if (HasFakeHost(cptr))
+    make_nick_user_host(bid->bid_fakehost, cli_name(cptr),
+                        user->realusername, user->fakehost);
+
+  bid->bid_accthost[0] = '\0';
+  if (feature_int(FEAT_HOST_HIDING_STYLE) == 1) {
+    if (IsAccount(cptr)) {
+      if (HasHiddenHost(cptr) && !HasSetHost(cptr))
+        make_nick_user_host(bid->bid_accthost, cli_name(cptr),
+                            user->realusername, user->realhost);
+      else {
+        make_hidden_hostmask(tmphost, cptr);
+        make_nick_user_host(bid->bid_accthost, cli_name(cptr),
+                            user->realusername, tmphost);
+      }
+    }
+  } else {
+    if (IsHiddenHost(cptr) && !HasSetHost(cptr))
+      make_nick_user_host(bid->bid_accthost, cli_name(cptr),
+                          user->realusername, user->realhost);
+    else {
+      ircd_snprintf(0, tmphost, HOSTLEN, "%s", user->virthost);
+      make_nick_user_host(bid->bid_accthost, cli_name(cptr),
+                          user->realusername, tmphost);
+    }
+  }
+
+  make_nick_user_ip(bid->bid_ip, cli_name(cptr), user->realusername,
+                    cli_ip(cptr));
+
+  bid->bid_serial = ban_identity_serial;
+  return bid;
+}
+
 /*
  * hide_hostmask()
  *
@@ -1667,6 +1770,8 @@ int hide_hostmask(struct Client *cptr)
       return 0;
   }
 
+  ban_identity_clear(cptr);
+
   /* Invalidate all bans against the user so we check them again */
   if (feature_bool(FEAT_HIDDEN_HOST_QUIT)) {
     for (chan = (cli_user(cptr))->channel; chan; chan = chan->next_channel)
@@ -1749,6 +1854,8 @@ int unhide_hostmask(struct Client *cptr)
 {
   struct Membership *chan;
 
+  ban_identity_clear(cptr);
+
   /* Invalidate all bans against the user so we check them again */
   if (feature_bool(FEAT_HIDDEN_HOST_QUIT)) {
     for (chan = (cli_user(cptr))->channel; chan; chan = chan->next_channel)
@@ -1944,6 +2051,7 @@ int set_hostmask(struct Client *sptr, struct Client *cptr, char *hostmask, char
     ClearSetHost(cptr);
   else
     SetSetHost(cptr);
+  ban_identity_clear(cptr);
 
   /* Invalidate all bans against the user so we check them again */
   for (chan = (cli_user(cptr))->channel; chan;
@@ -2883,6 +2991,96 @@ void set_snomask(struct Client *cptr, unsigned int newmask, int what)
   cli_snomask(cptr) = newmask;
 }
 
+/** Prepare to match silence masks against a message sender.
+ * The sender's identity strings are only built when a recipient with
+ * a silence list is found, and then only once for the whole message.
+ * @param[out] ss Sender state to initialize.
+ * @param[in] sptr Client sending the message.
+ */
+void silence_sender_init(struct SilenceSender *ss, struct Client *sptr)
+{
+  ss->sptr = sptr;
+  ss->ready = 0;
+}
+
+/** Build the identity strings of a message sender.
+ * @param[in,out] ss Sender state from silence_sender_init().
+ */
+static void silence_sender_build(struct SilenceSender *ss)
+{
+  struct Client *sptr = ss->sptr;
+  struct User *user = cli_user(sptr);
+
+  ircd_snprintf(0, ss->sender, sizeof(ss->sender), "%s!%s@%s", cli_name(sptr),
+		user->username, user->host);
+  ircd_snprintf(0, ss->senderip, sizeof(ss->senderip), "%s!%s@%s", cli_name(sptr),
+		user->username, ircd_ntoa((const char*) &(cli_ip(sptr))));
+  if (((feature_int(FEAT_HOST_HIDING_STYLE) == 1) ? HasHiddenHost(sptr) :
+       IsHiddenHost(sptr)) || HasSetHost(sptr))
+    ircd_snprintf(0, ss->senderh, sizeof(ss->senderh), "%s!%s@%s", cli_name(sptr),
+		  user->username, user->realhost);
+  else
+    ss->senderh[0] = '\0';
+  ss->ready = 1;
+}
+
+/** Check whether one silence entry matches a message sender.
+ * @param[in,out] ss Sender state from silence_sender_init().
+ * @param[in] lp Silence entry.
+ * @return Non-zero if the entry matches the sender.
+ */
+static int silence_matches(struct SilenceSender *ss, struct SLink *lp)
+{
+  struct Client *sptr = ss->sptr;
+
+  if (!ss->ready)
+    silence_sender_build(ss);
+
+  if (lp->flags & SILENCE_IPMASK)
+    return !matchexec(ss->senderip, lp->value.silence.cmask,
+                      lp->value.silence.minlen);
+
+  return !matchexec(ss->sender, lp->value.silence.cmask,
+                    lp->value.silence.minlen) ||
+    ((HasHiddenHost(sptr) || HasSetHost(sptr)) && ss->senderh[0] &&
+     !matchexec(ss->senderh, lp->value.silence.cmask,
+                lp->value.silence.minlen));
+}
+
+/** Look for a silence entry of \a acptr that matches a sender.
+ * @param[in,out] ss Sender state from silence_sender_init().
+ * @param[in] acptr Client whose silence list is searched.
+ * @param[in] exempt SILENCE_EXEMPT to look for exemptions, 0 for silences.
+ * @return Non-zero if a matching entry of that kind exists.
+ */
+static int silence_find(struct SilenceSender *ss, struct Client *acptr,
+                        unsigned int exempt)
+{
+  struct SLink *lp;
+
+  if (!cli_user(acptr) || !(lp = cli_user(acptr)->silence) || !cli_user(ss->sptr))
+    return 0;
+  for (; lp; lp = lp->next)
+    if ((lp->flags & SILENCE_EXEMPT) == exempt && silence_matches(ss, lp))
+      return 1;
+  return 0;
+}
+
+/** Check whether \a acptr silences the sender described by \a ss.
+ * This is is_silenced() && !is_silence_exempted(), but builds the
+ * sender's strings at most once no matter how many recipients are
+ * checked.
+ * @param[in,out] ss Sender state from silence_sender_init().
+ * @param[in] acptr Recipient of the message.
+ * @return Non-zero if the message should not be delivered to \a acptr.
+ */
+int silence_blocks(struct SilenceSender *ss, struct Client *acptr)
+{
+  if (!cli_user(acptr) || !cli_user(acptr)->silence)
+    return 0;
+  return silence_find(ss, acptr, 0) && !silence_find(ss, acptr, SILENCE_EXEMPT);
+}
+
 /*
  * is_silenced : Does the actual check wether sptr is allowed
  *               to send a message to acptr.
@@ -2893,41 +3091,10 @@ void set_snomask(struct Client *cptr, unsigned int newmask, int what)
  */
 int is_silenced(struct Client *sptr, struct Client *acptr)
 {
-  struct SLink *lp;
-  struct User *user;
-  static char sender[HOSTLEN + NICKLEN + USERLEN + 5];
-  static char senderip[16 + NICKLEN + USERLEN + 5];
-  static char senderh[HOSTLEN + ACCOUNTLEN + USERLEN + 6];
+  struct SilenceSender ss;
 
-  if (!cli_user(acptr) || !(lp = cli_user(acptr)->silence) || !(user = cli_user(sptr)))
-    return 0;
-  ircd_snprintf(0, sender, sizeof(sender), "%s!%s@%s", cli_name(sptr),
-		user->username, user->host);
-  ircd_snprintf(0, senderip, sizeof(senderip), "%s!%s@%s", cli_name(sptr),
-		user->username, ircd_ntoa((const char*) &(cli_ip(sptr))));
-  if (((feature_int(FEAT_HOST_HIDING_STYLE) == 1) ? HasHiddenHost(sptr) :
-       IsHiddenHost(sptr)) || HasSetHost(sptr))
-    ircd_snprintf(0, senderh, sizeof(senderh), "%s!%s@%s", cli_name(sptr),
-		  user->username, user->realhost);
-  for (; lp; lp = lp->next)
-  {
-    if (!(lp->flags & SILENCE_EXEMPT)) {
-      if ((!(lp->flags & SILENCE_IPMASK) && (!match(lp->value.cp, sender) ||
-          (HasHiddenHost(sptr) && !match(lp->value.cp, senderh)) ||
-          (HasSetHost(sptr) && !match(lp->value.cp, senderh)))) ||
-          ((lp->flags & SILENCE_IPMASK) && !match(lp->value.cp, senderip)))
-      {
-/*      if (!MyConnect(sptr))
- *      {
- *       sendcmdto_one(acptr, CMD_SILENCE, cli_from(sptr), "%C %s", sptr,
- *                     lp->value.cp);
- *      }
- */
-        return 1;
-      }
-    }
-  }
-  return 0;
+  silence_sender_init(&ss, sptr);
+  return silence_find(&ss, acptr, 0);
 }
 
 /*
@@ -2940,41 +3107,10 @@ int is_silenced(struct Client *sptr, struct Client *acptr)
  */
 int is_silence_exempted(struct Client *sptr, struct Client *acptr)
 {
-  struct SLink *lp;
-  struct User *user;
-  static char sender[HOSTLEN + NICKLEN + USERLEN + 5];
-  static char senderip[16 + NICKLEN + USERLEN + 5];
-  static char senderh[HOSTLEN + ACCOUNTLEN + USERLEN + 6];
+  struct SilenceSender ss;
 
-  if (!cli_user(acptr) || !(lp = cli_user(acptr)->silence) || !(user = cli_user(sptr)))
-    return 0;
-  ircd_snprintf(0, sender, sizeof(sender), "%s!%s@%s", cli_name(sptr),
-		user->username, user->host);
-  ircd_snprintf(0, senderip, sizeof(senderip), "%s!%s@%s", cli_name(sptr),
-		user->username, ircd_ntoa((const char*) &(cli_ip(sptr))));
-  if (((feature_int(FEAT_HOST_HIDING_STYLE) == 1) ? HasHiddenHost(sptr) :
-       IsHiddenHost(sptr)) || HasSetHost(sptr))
-    ircd_snprintf(0, senderh, sizeof(senderh), "%s!%s@%s", cli_name(sptr),
-		  user->username, user->realhost);
-  for (; lp; lp = lp->next)
-  {
-    if (lp->flags & SILENCE_EXEMPT) {
-      if ((!(lp->flags & SILENCE_IPMASK) && (!match(lp->value.cp, sender) ||
-          (HasHiddenHost(sptr) && !match(lp->value.cp, senderh)) ||
-          (HasSetHost(sptr) && !match(lp->value.cp, senderh)))) ||
-          ((lp->flags & SILENCE_IPMASK) && !match(lp->value.cp, senderip)))
-      {
-/*      if (!MyConnect(sptr))
- *      {
- *       sendcmdto_one(acptr, CMD_SILENCE, cli_from(sptr), "%C %s", sptr,
- *                     lp->value.cp);
- *      }
- */
-        return 1;
-      }
-    }
-  }
-  return 0;
+  silence_sender_init(&ss, sptr);
+  return silence_find(&ss, acptr, SILENCE_EXEMPT);
 }
 
 /*
@@ -2990,12 +3126,12 @@ int del_silence(struct Client *sptr, char *mask, int exempt)
   int ret = -1;
 
   for (lp = &(cli_user(sptr))->silence; *lp;) {
-    if (!mmatch(mask, (*lp)->value.cp))
+    if (!mmatch(mask, (*lp)->value.silence.mask))
     {
       if ((((*lp)->flags & SILENCE_EXEMPT) && exempt) || (!((*lp)->flags & SILENCE_EXEMPT) && !exempt)) {
         tmp = *lp;
         *lp = tmp->next;
-        MyFree(tmp->value.cp);
+        MyFree(tmp->value.silence.mask);
         free_link(tmp);
         ret = 0;
       } else
@@ -3015,26 +3151,26 @@ int add_silence(struct Client* sptr, const char* mask, int exempt)
 
   for (lpp = &(cli_user(sptr))->silence, lp = *lpp; lp;)
   {
-    if (0 == ircd_strcmp(mask, lp->value.cp))
+    if (0 == ircd_strcmp(mask, lp->value.silence.mask))
       return -1;
-    if (!mmatch(mask, lp->value.cp))
+    if (!mmatch(mask, lp->value.silence.mask))
     {
       struct SLink *tmp = lp;
       *lpp = lp = lp->next;
-      MyFree(tmp->value.cp);
+      MyFree(tmp->value.silence.mask);
       free_link(tmp);
       continue;
     }
     if (MyUser(sptr))
     {
-      len += strlen(lp->value.cp);
+      len += strlen(lp->value.silence.mask);
       if ((len > (feature_int(FEAT_AVBANLEN) * feature_int(FEAT_MAXSILES))) ||
 	  (++cnt >= feature_int(FEAT_MAXSILES)))
       {
         send_reply(sptr, ERR_SILELISTFULL, mask);
         return -1;
       }
-      else if (!mmatch(lp->value.cp, mask)) {
+      else if (!mmatch(lp->value.silence.mask, mask)) {
         if (exempt && (lp->flags & SILENCE_EXEMPT))
           return -1;
         else if (!exempt && !(lp->flags & SILENCE_EXEMPT))
@@ -3047,9 +3183,12 @@ int add_silence(struct Client* sptr, const char* mask, int exempt)
   lp = make_link();
   memset(lp, 0, sizeof(struct SLink));
   lp->next = cli_user(sptr)->silence;
-  lp->value.cp = (char*) MyMalloc(strlen(mask) + 1);
-  assert(0 != lp->value.cp);
-  strcpy(lp->value.cp, mask);
+  /* the compiled mask is kept in the same block, after the text */
+  lp->value.silence.mask = (char*) MyMalloc(2 * (strlen(mask) + 1));
+  assert(0 != lp->value.silence.mask);
+  strcpy(lp->value.silence.mask, mask);
+  lp->value.silence.cmask = lp->value.silence.mask + strlen(mask) + 1;
+  matchcomp(lp->value.silence.cmask, &lp->value.silence.minlen, NULL, mask);
   if (exempt)
     lp->flags |= SILENCE_EXEMPT;
   if ((ip_start = strrchr(mask, '@')) && check_if_ipmask(ip_start + 1))
@@ -3334,43 +3473,11 @@ send_supported(struct Client *cptr)
   return 0; /* convenience return, if it's ever needed */
 }
 
-/*
- * Create a string of form "foo!bar@fubar" given foo, bar and fubar
- * as the parameters.  If NULL, they become "*".
- */
-#define NUH_BUFSIZE     (NICKLEN + USERLEN + HOSTLEN + 3)
-static char *make_nick_user_host(char *namebuf, const char *nick,
-                                 const char *name, const char *host)
-{
-  ircd_snprintf(0, namebuf, NUH_BUFSIZE, "%s!%s@%s", nick, name, host);
-  return namebuf;
-}
-
-/*
- * Create a string of form "foo!bar@123.456.789.123" given foo, bar and the
- * IP-number as the parameters.  If NULL, they become "*".
- */
-#define NUI_BUFSIZE     (NICKLEN + USERLEN + 16 + 3)
-static char *make_nick_user_ip(char *ipbuf, char *nick, char *name,
-                               struct in_addr ip)
-{
-  ircd_snprintf(0, ipbuf, NUI_BUFSIZE, "%s!%s@%s", nick, name,
-                ircd_ntoa((const char*) &ip));
-  return ipbuf;
-}
-
 int user_matches_host(struct Client *cptr, char *comparemask, int flags) {
 
-  struct SLink* tmp;
-  char          tmphost[HOSTLEN + 1];
-  char          nu_host[NUH_BUFSIZE];
-  char          nu_accthost[NUH_BUFSIZE];
+  struct BanIdentity* bid;
   char          nu_dnsblhost[NUH_BUFSIZE];
-  char          nu_realhost[NUH_BUFSIZE];
-  char          nu_fakehost[NUH_BUFSIZE];
-  char          nu_ip[NUI_BUFSIZE];
   char*         s;
-  char*         sb;
   char*         sa = NULL;
   char*         sh = NULL;
   char*         sf = NULL;
@@ -3381,57 +3488,21 @@ int user_matches_host(struct Client *cptr, char *comparemask, int flags) {
   if (!IsUser(cptr))
     return 0;
 
-  /* eeeek */
-  s = make_nick_user_host(nu_host, cli_name(cptr), (cli_user(cptr))->realusername,
-                         (cli_user(cptr))->realhost);
-
-  sb = make_nick_user_host(nu_host, cli_name(cptr), (cli_user(cptr))->realusername,
-                          (cli_user(cptr))->host);
-
-  if (HasSetHost(cptr))
-    sh = make_nick_user_host(nu_realhost, cli_name(cptr),
-                            cli_user(cptr)->realusername,
-                            cli_user(cptr)->realhost);
-
-  if (HasFakeHost(cptr))
-    sf = make_nick_user_host(nu_fakehost, cli_name(cptr),
-                            cli_user(cptr)->realusername,
-                            cli_user(cptr)->fakehost);
-
-  if (feature_int(FEAT_HOST_HIDING_STYLE) == 1) {
-    if (IsAccount(cptr)) {
-       if (HasHiddenHost(cptr) && !HasSetHost(cptr))
-          sa = make_nick_user_host(nu_accthost, cli_name(cptr),
-                                  cli_user(cptr)->realusername,
-                                  cli_user(cptr)->realhost);
-       else {
-         make_hidden_hostmask(tmphost, cptr);
-          sa = make_nick_user_host(nu_accthost, cli_name(cptr),
-                                   cli_user(cptr)->realusername,
-                                   tmphost);
-       }
-    }
-  } else {
-    if (IsHiddenHost(cptr) && !HasSetHost(cptr))
-      sa = make_nick_user_host(nu_accthost, cli_name(cptr),
-                               cli_user(cptr)->realusername,
-                               cli_user(cptr)->realhost);
-    else {
-      ircd_snprintf(0, tmphost, HOSTLEN, "%s", cli_user(cptr)->virthost);
-      sa = make_nick_user_host(nu_accthost, cli_name(cptr),
-                               cli_user(cptr)->realusername,
-                               tmphost);
-    }
-  }
-
+  bid = user_ban_identity(cptr);
+  s = bid->bid_host;
+  if (*bid->bid_sethost)
+    sh = bid->bid_sethost;
+  if (*bid->bid_fakehost)
+    sf = bid->bid_fakehost;
+  if (*bid->bid_accthost)
+    sa = bid->bid_accthost;
 
   if ((flags & CHFL_BAN_IPMASK)) {
     char* ip_start;
     char* cidr_start;
 
     if (!ip_s) {
-      ip_s = make_nick_user_ip(nu_ip, cli_name(cptr),
-                              (cli_user(cptr))->realusername, cli_ip(cptr));
+      ip_s = bid->bid_ip;
       if ((ip_start = strrchr(ip_s, '@')))
         cli_addr = inet_addr(ip_start + 1);
     }
@@ -3496,8 +3567,6 @@ int user_matches_host(struct Client *cptr, char *comparemask, int flags) {
 
   if (match(comparemask, s) == 0)
     return 1;
-  else if (sb && match(comparemask, sb) == 0)
-    return 1;
   else if (sh && match(comparemask, sh) == 0)
     return 1;
   else if (sf && match(comparemask, sf) == 0)
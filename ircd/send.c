@@ -49,7 +49,10 @@
 
 #define IsGlobalForward(prefix, nick)   (prefix && nick && *nick && GlobalForwards[prefix] && !ircd_strcmp(GlobalForwards[prefix], nick))
 
-static int sentalong_marker;
+/** Terminator for the list of connections marked by sentalong_mark(). */
+static struct Connection sentalong_tail;
+/** Connections marked by the send operation in progress. */
+static struct Connection *sentalong_list = &sentalong_tail;
 struct SLink *opsarray[32];     /* don't use highest bit unless you change
 				   atoi to strtoul in sendto_op_mask() */
 static struct Connection *send_queues = 0;
@@ -78,9 +81,12 @@ static void dead_link(struct Client *to, char *notice)
   SetFlag(to, FLAG_DEADSOCKET);
   /*
    * If because of BUFFERPOOL problem then clean dbuf's now so that
-   * notices don't hurt operators below.
+   * notices don't hurt operators below.  A line being parsed where it
+   * lies in the receive queue is still in use; read_packet() clears
+   * the queue once the command returns.
    */
-  DBufClear(&(cli_recvQ(to)));
+  if (!HasFlag(to, FLAG_PARSING))
+    DBufClear(&(cli_recvQ(to)));
   MsgQClear(&(cli_sendQ(to)));
   client_drop_sendq(cli_connect(to));
 
@@ -361,42 +367,43 @@ void sendcmdto_serv_butone(struct Client *from, const char *cmd,
   msgq_clean(mb);
 }
 
-/*
- * Send a (prefix) command originating from <from> to all channels
- * <from> is locally on.  <from> must be a user. <tok> is ignored in
- * this function.
- *
- * Update: don't send to 'one', if any. --Vampire
- * Update: use 'skip' like sendcmdto_channel_butone. --Entrope
- */
-/* XXX sentalong_marker used XXX
- *
- * There is not an easy way to revoke the need for sentalong_marker
- * from this function.  Thoughts and ideas would be welcome... -Kev
- *
- * One possibility would be to internalize the sentalong array; that
- * could be prohibitively big, though.  We could get around that by
- * making one that's the number of connected servers or something...
- * or perhaps by adding a special flag to the servers we've sent a
- * message to, and then a final loop through the connected servers
- * to delete the flag. -Kev
+/** Mark the connection of \a one as already sent to by the current
+ * operation.  Marked connections are chained through their
+ * con_sentalong fields so that sentalong_clear() only has to visit the
+ * connections that were actually marked.
+ * @param[in] one Client whose connection should be marked (may be NULL).
  */
+static void
+sentalong_mark(struct Client *one)
+{
+  if (one && !cli_sentalong(one))
+  {
+    cli_sentalong(one) = sentalong_list;
+    sentalong_list = cli_connect(one);
+  }
+}
 
+/** Remove the marks left by sentalong_mark(). */
 static void
-bump_sentalong(struct Client *one)
+sentalong_clear(void)
 {
-  if (!++sentalong_marker)
+  struct Connection *con;
+
+  while ((con = sentalong_list) != &sentalong_tail)
   {
-    int ii;
-    for (ii = 0; ii < HighestFd; ++ii)
-      if (LocalClientArray[ii])
-        cli_sentalong(LocalClientArray[ii]) = 0;
-    ++sentalong_marker;
+    sentalong_list = con_sentalong(con);
+    con_sentalong(con) = 0;
   }
-  if (one)
-    cli_sentalong(one) = sentalong_marker;
 }
 
+/*
+ * Send a (prefix) command originating from <from> to all channels
+ * <from> is locally on.  <from> must be a user. <tok> is ignored in
+ * this function.
+ *
+ * Update: don't send to 'one', if any. --Vampire
+ * Update: use 'skip' like sendcmdto_channel_butone. --Entrope
+ */
 void sendcmdto_common_channels_butone(struct Client *from, const char *cmd,
                                      const char *tok, struct Client *one,
                                      const char *pattern, ...)
@@ -419,23 +426,23 @@ void sendcmdto_common_channels_butone(struct Client *from, const char *cmd,
   mb = msgq_make(0, "%:#C %s %v", from, cmd, &vd);
   va_end(vd.vd_args);
 
-  bump_sentalong(from);
+  sentalong_mark(from);
+  sentalong_mark(one);
   /*
-   * loop through from's channels, and the members on their channels
+   * loop through from's channels, and the local members on their channels
    */
   for (chan = cli_user(from)->channel; chan; chan = chan->next_channel) {
     if (IsZombie(chan))
       continue;
-    for (member = chan->channel->members; member;
-	 member = member->next_member)
-      if (MyConnect(member->user)
-          && -1 < cli_fd(cli_from(member->user))
-          && member->user != one
-          && cli_sentalong(member->user) != sentalong_marker) {
-	cli_sentalong(member->user) = sentalong_marker;
+    for (member = chan->channel->locals; member;
+	 member = member->next_local)
+      if (-1 < cli_fd(member->user)
+          && !cli_sentalong(member->user)) {
+	sentalong_mark(member->user);
 	send_buffer(member->user, mb, 0);
       }
   }
+  sentalong_clear();
 
   if (MyConnect(from) && from != one)
     send_buffer(from, mb, 0);
@@ -466,9 +473,8 @@ void sendcmdto_channel_butserv_butone(struct Client *from, const char *cmd,
   va_end(vd.vd_args);
 
   /* send the buffer to each local channel member */
-  for (member = to->members; member; member = member->next_member) {
-    if (!MyConnect(member->user)
-        || member->user == one 
+  for (member = to->locals; member; member = member->next_local) {
+    if (member->user == one 
         || IsZombie(member)
         || (skip & SKIP_DEAF && IsDeaf(member->user))
         || (skip & SKIP_NONOPS && !IsChanOp(member))
@@ -481,11 +487,57 @@ void sendcmdto_channel_butserv_butone(struct Client *from, const char *cmd,
   msgq_clean(mb);
 }
 
+/** Send \a mb to each server link of \a chptr.
+ * When \a skip restricts the message by member status, the downlink
+ * reference counts cannot tell which links have an op, halfop or
+ * voice behind them, so one walk of the member list finds them
+ * instead.  Links already marked by sentalong_mark() are passed over;
+ * the rest are marked as they are sent to.
+ * @param[in] chptr Channel being sent to.
+ * @param[in] skip SKIP_* flags for the message.
+ * @param[in] mb Message to send.
+ */
+static void
+sendcmdto_channel_links(struct Channel *chptr, unsigned int skip,
+                        struct MsgBuf *mb)
+{
+  struct Membership *member;
+  struct SLink *lp;
+  struct Client *link;
+
+  if (!(skip & (SKIP_NONOPS | SKIP_NONHOPS | SKIP_NONVOICES))) {
+    for (lp = chptr->downlinks; lp; lp = lp->next) {
+      link = lp->value.cptr;
+      if ((skip & SKIP_BURST && IsBurstOrBurstAck(link))
+          || cli_fd(link) < 0
+          || cli_sentalong(link))
+        continue;
+      sentalong_mark(link);
+      send_buffer(link, mb, 0);
+    }
+    return;
+  }
+
+  for (member = chptr->members; member; member = member->next_member) {
+    if (MyConnect(member->user)
+        || IsZombie(member)
+        || (skip & SKIP_NONOPS && !IsChanOp(member))
+        || (skip & SKIP_NONHOPS && !IsChanOp(member) && !IsHalfOp(member))
+        || (skip & SKIP_NONVOICES && !IsChanOp(member) && !IsHalfOp(member) && !HasVoice(member)))
+      continue;
+    link = cli_from(member->user);
+    if ((skip & SKIP_BURST && IsBurstOrBurstAck(link))
+        || cli_fd(link) < 0
+        || cli_sentalong(link))
+      continue;
+    sentalong_mark(link);
+    send_buffer(link, mb, 0);
+  }
+}
+
 /*
  * Send a (prefixed) command to all servers with users on the channel
  * specified by <to>; <cmd> and <skip> are ignored by this function.
- *
- * XXX sentalong_marker used XXX
  */
 void sendcmdto_channel_servers_butone(struct Client *from, const char *cmd,
                                       const char *tok, struct Channel *to,
@@ -494,7 +546,6 @@ void sendcmdto_channel_servers_butone(struct Client *from, const char *cmd,
 {
   struct VarData vd;
   struct MsgBuf *serv_mb;
-  struct Membership *member;
 
   /* build the buffer */
   vd.vd_format = pattern;
@@ -503,20 +554,10 @@ void sendcmdto_channel_servers_butone(struct Client *from, const char *cmd,
   va_end(vd.vd_args);
 
   /* send the buffer to each server */
-  bump_sentalong(one);
-  cli_sentalong(from) = sentalong_marker;
-  for (member = to->members; member; member = member->next_member) {
-    if (MyConnect(member->user)
-        || IsZombie(member)
-        || cli_fd(cli_from(member->user)) < 0
-        || cli_sentalong(member->user) == sentalong_marker
-        || (skip & SKIP_NONOPS && !IsChanOp(member))
-        || (skip & SKIP_NONHOPS && !IsChanOp(member) && !IsHalfOp(member))
-        || (skip & SKIP_NONVOICES && !IsChanOp(member) && !IsHalfOp(member) && !HasVoice(member)))
-      continue;
-    cli_sentalong(member->user) = sentalong_marker;
-    send_buffer(member->user, serv_mb, 0);
-  }
+  sentalong_mark(one);
+  sentalong_mark(from);
+  sendcmdto_channel_links(to, skip, serv_mb);
+  sentalong_clear();
   msgq_clean(serv_mb);
 }
 
@@ -525,18 +566,10 @@ void sendcmdto_channel_servers_butone(struct Client *from, const char *cmd,
  * Send a (prefixed) command to all users on this channel, including
  * remote users; users to skip may be specified by setting appropriate
  * flags in the <skip> argument.  <one> will also be skipped.
- */
-/* XXX sentalong_marker used XXX
  *
- * We can drop sentalong_marker from this function by adding a field to
- * channels and to connections; what we do is make a user's connection
- * a "member" of the channel by adding it to the new list, and we use
- * the struct Membership status as a reference count.  Then, to implement
- * this function, we just walk the list of connections.  Unfortunately,
- * this doesn't account for sending only to channel ops, or for not
- * sending to +d users; we could account for that by splitting those
- * counts out, but that would imply adding two more fields (at least) to
- * the struct Membership... -Kev
+ * Local users are taken from the channel's list of local members, and
+ * each server link with users on the channel gets one copy.  Deaf and
+ * silence filtering of remote users is left to the server they are on.
  */
 void sendcmdto_channel_butone(struct Client *from, const char *cmd,
 			      const char *tok, struct Channel *to,
@@ -548,6 +581,7 @@ void sendcmdto_channel_butone(struct Client *from, const char *cmd,
   struct MsgBuf *user_mb;
   struct MsgBuf *serv_mb;
   struct Client *service = NULL;
+  struct SilenceSender ss;
 
   vd.vd_format = pattern;
 
@@ -563,27 +597,24 @@ void sendcmdto_channel_butone(struct Client *from, const char *cmd,
   va_end(vd.vd_args);
 
   /* send buffer along! */
-  bump_sentalong(one);
-  for (member = to->members; member; member = member->next_member) {
+  silence_sender_init(&ss, from);
+  sentalong_mark(one);
+  for (member = to->locals; member; member = member->next_local) {
     /* skip one, zombies, and deaf users... */
     if (IsZombie(member) ||
         (skip & SKIP_DEAF && (IsDeaf(member->user) && !IsGlobalForward(prefix,cli_name(member->user)))) ||
 	(skip & SKIP_NONOPS && !IsChanOp(member)) ||
         (skip & SKIP_NONHOPS && (!IsHalfOp(member)) && !IsChanOp(member)) ||
 	(skip & SKIP_NONVOICES && !HasVoice(member) && !IsChanOp(member) && !IsHalfOp(member)) ||
-	(skip & SKIP_BURST && IsBurstOrBurstAck(cli_from(member->user))) ||
-        (is_silenced(from,member->user) && !is_silence_exempted(from,member->user)) ||
-	cli_fd(cli_from(member->user)) < 0 ||
-        cli_sentalong(member->user) == sentalong_marker)
+        silence_blocks(&ss, member->user) ||
+	cli_fd(member->user) < 0 ||
+        cli_sentalong(member->user))
       continue;
-    cli_sentalong(member->user) = sentalong_marker;
-
-    if (MyConnect(member->user)) /* pick right buffer to send */
-      send_buffer(member->user, user_mb, 0);
-    else
-      send_buffer(member->user, serv_mb, 0);
+    send_buffer(member->user, user_mb, 0);
   }
 
+  sendcmdto_channel_links(to, skip, serv_mb);
+
   /* - this doesnt work, and isnt what i really want
    * it to do anyway. Implimented the above instead.
    * If someone else is interested in offchannel command
@@ -593,10 +624,11 @@ void sendcmdto_channel_butone(struct Client *from, const char *cmd,
   */
   if (GlobalForwards[prefix]
     && (service = FindServer(GlobalForwards[prefix]))
-    && cli_sentalong(service) != sentalong_marker){
-    cli_sentalong(service) = sentalong_marker;
+    && !cli_sentalong(service)){
+    sentalong_mark(service);
     send_buffer(service, serv_mb, 0);
   }
+  sentalong_clear();
 
   msgq_clean(user_mb);
   msgq_clean(serv_mb);
@@ -674,7 +706,7 @@ void sendwallto_group_butone(struct Client *from, int type, struct Client *one,
  * Send a (prefixed) command to all users who match <to>, under control
  * of <who>
  */
-/* XXX sentalong_marker used XXX
+/* XXX sentalong marks used XXX
  *
  * This is also a difficult one to solve.  The basic approach would be
  * to walk the client list of each connected server until we find a
@@ -711,19 +743,20 @@ void sendcmdto_match_butone(struct Client *from, const char *cmd,
   va_end(vd.vd_args);
 
   /* send buffer along */
-  bump_sentalong(one);
+  sentalong_mark(one);
   for (cptr = GlobalClientList; cptr; cptr = cli_next(cptr)) {
     if (!IsRegistered(cptr) || IsServer(cptr) ||
 	!match_it(from, cptr, to, who) || cli_fd(cli_from(cptr)) < 0 ||
-	cli_sentalong(cptr) == sentalong_marker)
+	cli_sentalong(cptr))
       continue; /* skip it */
-    cli_sentalong(cptr) = sentalong_marker;
+    sentalong_mark(cptr);
 
     if (MyConnect(cptr)) /* send right buffer */
       send_buffer(cptr, user_mb, 0);
     else
       send_buffer(cptr, serv_mb, 0);
   }
+  sentalong_clear();
 
   msgq_clean(user_mb);
   msgq_clean(serv_mb);
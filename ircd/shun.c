@@ -69,6 +69,9 @@
 
 struct Shun* GlobalShunList  = 0;
 
+/* index over GlobalShunList for shun_lookup() */
+static struct BanIndex ShunIndex;
+
 static void
 canon_userhost(char *userhost, char **user_p, char **host_p, char *def_user)
 {
@@ -186,6 +189,15 @@ make_shun(char *user, char *host, char *reason, time_t expire, time_t lastmod,
     GlobalShunList = shun;
   }
 
+  if (ShunIsRealName(shun))
+    banindex_add(&ShunIndex, &shun->sh_index, shun,
+                 after ? &after->sh_index : 0, 0, 0, 0);
+  else
+    banindex_add(&ShunIndex, &shun->sh_index, shun,
+                 after ? &after->sh_index : 0,
+                 ShunIsIpMask(shun) ? &shun->ipnum : 0, shun->bits,
+                 shun->sh_host);
+
   return shun;
 }
 
@@ -582,64 +594,76 @@ shun_find(char *userhost, unsigned int flags)
   return shun;
 }
 
-struct Shun *
-shun_lookup(struct Client *cptr, unsigned int flags)
-{
-  struct Shun *shun;
-  struct Shun *sshun;
+/* arguments for shun_check() */
+struct ShunCheck {
+  struct Client *cptr;
+  unsigned int   flags;
+};
 
-  for (shun = GlobalShunList; shun; shun = sshun) {
-    sshun = shun->sh_next;
+/*
+ * shun_check - decide whether a shun found through ShunIndex applies
+ * to the client in arg, freeing it if it has expired
+ */
+static int
+shun_check(void *ban, void *arg)
+{
+  struct Shun *shun = ban;
+  struct Client *cptr = ((struct ShunCheck *) arg)->cptr;
+  unsigned int flags = ((struct ShunCheck *) arg)->flags;
 
-    if (shun->sh_expire <= CurrentTime) {
-      shun_free(shun);
-      continue;
-    }
-    
-    if ((flags & SHUN_GLOBAL && shun->sh_flags & SHUN_LOCAL) ||
-	     (flags & SHUN_LASTMOD && !shun->sh_lastmod))
-      continue;
+  if (shun->sh_expire <= CurrentTime) {
+    shun_free(shun);
+    return 0;
+  }
 
-    if (ShunIsRealName(shun)) {
-      Debug((DEBUG_DEBUG,"realname shun: '%s' '%s'",shun->sh_user,cli_info(cptr)));
+  if ((flags & SHUN_GLOBAL && shun->sh_flags & SHUN_LOCAL) ||
+      (flags & SHUN_LASTMOD && !shun->sh_lastmod))
+    return 0;
 
-      if (match(shun->sh_user+2, cli_info(cptr)) != 0)
-	continue;
+  if (ShunIsRealName(shun)) {
+    Debug((DEBUG_DEBUG,"realname shun: '%s' '%s'",shun->sh_user,cli_info(cptr)));
 
-      if (!ShunIsActive(shun))
-        continue;
+    if (match(shun->sh_user+2, cli_info(cptr)) != 0)
+      return 0;
 
-      return shun;
-    }
-    else {
-      if (match(shun->sh_user,
-          (cli_user(cptr)->realusername ? cli_user(cptr)->realusername : cli_user(cptr)->username)) != 0)
-        continue;
-    	 
-      if (ShunIsIpMask(shun)) {
-        Debug((DEBUG_DEBUG,"IP shun: %08x %08x/%i",(cli_ip(cptr)).s_addr,shun->ipnum.s_addr,shun->bits));
-        if (((cli_ip(cptr)).s_addr & NETMASK(shun->bits)) != shun->ipnum.s_addr)
-          continue;
-      }    
-      else {
-        if (match(shun->sh_host,
-            (cli_user(cptr)->realhost ? cli_user(cptr)->realhost : cli_user(cptr)->host)) != 0) 
-          continue;
-      }
-    }
+    return ShunIsActive(shun);
+  }
 
-    /* Check if shunned user matches an E:Line */
-    if (find_eline(cptr, EFLAG_SHUN)) {
-      continue;;
-    }
+  if (match(shun->sh_user,
+      (cli_user(cptr)->realusername ? cli_user(cptr)->realusername : cli_user(cptr)->username)) != 0)
+    return 0;
 
-    if (ShunIsActive(shun))
-      return shun;
+  if (ShunIsIpMask(shun)) {
+    Debug((DEBUG_DEBUG,"IP shun: %08x %08x/%i",(cli_ip(cptr)).s_addr,shun->ipnum.s_addr,shun->bits));
+    if (((cli_ip(cptr)).s_addr & NETMASK(shun->bits)) != shun->ipnum.s_addr)
+      return 0;
   }
-  /*
-   * No Shuns matched
-   */
-  return 0;
+  else {
+    if (match(shun->sh_host,
+        (cli_user(cptr)->realhost ? cli_user(cptr)->realhost : cli_user(cptr)->host)) != 0)
+      return 0;
+  }
+
+  /* Check if shunned user matches an E:Line */
+  if (find_eline(cptr, EFLAG_SHUN))
+    return 0;
+
+  return ShunIsActive(shun);
+}
+
+struct Shun *
+shun_lookup(struct Client *cptr, unsigned int flags)
+{
+  struct ShunCheck args;
+  char *host = 0;
+
+  if (cli_user(cptr))
+    host = cli_user(cptr)->realhost ? cli_user(cptr)->realhost :
+      cli_user(cptr)->host;
+
+  args.cptr = cptr;
+  args.flags = flags;
+  return banindex_find(&ShunIndex, cli_ip(cptr), host, shun_check, &args);
 }
 
 void
@@ -647,6 +671,8 @@ shun_free(struct Shun *shun)
 {
   assert(0 != shun);
 
+  banindex_del(&ShunIndex, &shun->sh_index);
+
   *shun->sh_prev_p = shun->sh_next; /* squeeze this shun out */
   if (shun->sh_next)
     shun->sh_next->sh_prev_p = shun->sh_prev_p;
@@ -773,6 +799,7 @@ shun_memory_count(size_t *sh_size)
     *sh_size += shun->sh_host ? (strlen(shun->sh_host) + 1) : 0;
     *sh_size += shun->sh_reason ? (strlen(shun->sh_reason) + 1) : 0;
   }
+  *sh_size += banindex_memory_count(&ShunIndex);
   return sh;
 }
 
@@ -210,6 +210,44 @@ IOResult ssl_recv(struct Socket *socketh, char* buf,
   return IO_FAILURE;
 }
     
+/*
+ * TLS output is staged into a single buffer so that queued lines leave as
+ * full-sized records instead of one record per MsgBuf.  The staging buffer
+ * is shared: if SSL_write() wants to be retried, the unsent bytes are still
+ * at the head of the MsgQ (we only report what was actually written), so
+ * the next call regathers the same data, and SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER
+ * lets us hand it over from the same (or any) address.
+ */
+#define SSL_STAGE_SIZE 16384 /* SSL3_RT_MAX_PLAIN_LENGTH */
+
+static char ssl_stage[SSL_STAGE_SIZE];
+static unsigned long ssl_records;      /* successful SSL_write() calls */
+static unsigned long ssl_record_bytes; /* bytes written by them */
+
+/*
+ * ssl_stage_msgq - copy up to SSL_STAGE_SIZE bytes from the head of \a buf
+ * into the staging buffer.  Returns the number of bytes staged.
+ */
+static unsigned int ssl_stage_msgq(struct MsgQ* buf)
+{
+  struct iovec iov[IOV_MAX];
+  unsigned int mapped = 0;
+  unsigned int staged = 0;
+  unsigned int len;
+  int count;
+  int k;
+
+  count = msgq_mapiov(buf, iov, IOV_MAX, &mapped);
+  for (k = 0; k < count && staged < SSL_STAGE_SIZE; k++) {
+    len = iov[k].iov_len;
+    if (len > SSL_STAGE_SIZE - staged)
+      len = SSL_STAGE_SIZE - staged;
+    memcpy(ssl_stage + staged, iov[k].iov_base, len);
+    staged += len;
+  }
+  return staged;
+}
+
 /*
  * ssl_sendv - non blocking writev to a connection
  * returns:
@@ -223,10 +261,6 @@ IOResult ssl_sendv(struct Socket *socketh, struct MsgQ* buf,
                   unsigned int* count_in, unsigned int* count_out)
 {
   int res;
-  int count;
-  int k;
-  struct iovec iov[IOV_MAX];
-  IOResult retval = IO_BLOCKED;
   int ssl_err = 0;
 
   errno = 0;
@@ -236,63 +270,69 @@ IOResult ssl_sendv(struct Socket *socketh, struct MsgQ* buf,
   assert(0 != count_in);
   assert(0 != count_out);
 
-  *count_in = 0;
   *count_out = 0;
 
-  count = msgq_mapiov(buf, iov, IOV_MAX, count_in);
-  for (k = 0; k < count; k++) {
-    res = SSL_write(socketh->ssl, iov[k].iov_base, iov[k].iov_len);
-    ssl_err = SSL_get_error(socketh->ssl, res);
-    Debug((DEBUG_DEBUG, "SSL_write returned %d, error code %d.", res, ssl_err));
-    switch (ssl_err) {
-    case SSL_ERROR_NONE:
-      *count_out += (unsigned) res;
-      retval = IO_SUCCESS;
-      break;
-    case SSL_ERROR_WANT_WRITE:
-    case SSL_ERROR_WANT_READ:
-    case SSL_ERROR_WANT_X509_LOOKUP:
-      Debug((DEBUG_DEBUG, "SSL_write returned want WRITE, READ, or X509; returning retval %d", retval));
-      return retval;
-    case SSL_ERROR_SSL:
-      {   
-          int errorValue;
-          Debug((DEBUG_ERROR, "SSL_write returned SSL_ERROR_SSL, errno %d, retval %d, res %d, ssl error code %d", errno, retval, res, ssl_err));
-          ERR_load_crypto_strings();
-          while((errorValue = ERR_get_error())) {
-            Debug((DEBUG_ERROR, "  Error Queue: %d -- %s", errorValue, ERR_error_string(errorValue, NULL)));
-          }
-          return IO_FAILURE;
-       }
-    case SSL_ERROR_SYSCALL:
-      if(res < 0 && (errno == EWOULDBLOCK ||
-                     errno == EINTR ||
-                     errno == EBUSY ||
-                     errno == EAGAIN)) {
-             Debug((DEBUG_DEBUG, "SSL_write returned ERROR_SYSCALL, errno %d - returning retval %d", errno, retval));
-             return retval;
-      }
-      else {
-             Debug((DEBUG_DEBUG, "SSL_write returned ERROR_SYSCALL - errno %d - returning IO_FAILURE", errno));
-             return IO_FAILURE;
-      }
-      /*
-      if(errno == EAGAIN) * its what unreal ircd does..*
-      {
-          Debug((DEBUG_DEBUG, "SSL_write returned ERROR_SSL - errno %d returning retval %d", errno, retval));
-          return retval;
-      }
-      */
-    case SSL_ERROR_ZERO_RETURN:
-      SSL_shutdown(socketh->ssl);
-      return IO_FAILURE;
-    default:
-      Debug((DEBUG_DEBUG, "SSL_write return fell through - errno %d returning retval %d", errno, retval));
-      return retval; /* unknown error, assume block or success*/
+  /*
+   * count_in only covers what we hand to SSL_write(), so that a complete
+   * record write does not look like a short write to deliver_it(); the
+   * caller keeps calling us while the MsgQ has data.
+   */
+  if (!(*count_in = ssl_stage_msgq(buf)))
+    return IO_BLOCKED;
+
+  res = SSL_write(socketh->ssl, ssl_stage, *count_in);
+  ssl_err = SSL_get_error(socketh->ssl, res);
+  Debug((DEBUG_DEBUG, "SSL_write returned %d, error code %d.", res, ssl_err));
+  switch (ssl_err) {
+  case SSL_ERROR_NONE:
+    *count_out = (unsigned) res;
+    ++ssl_records;
+    ssl_record_bytes += res;
+    return IO_SUCCESS;
+  case SSL_ERROR_WANT_WRITE:
+  case SSL_ERROR_WANT_READ:
+  case SSL_ERROR_WANT_X509_LOOKUP:
+    Debug((DEBUG_DEBUG, "SSL_write returned want WRITE, READ, or X509; retrying later"));
+    return IO_BLOCKED;
+  case SSL_ERROR_SSL:
+    {   
+        int errorValue;
+        Debug((DEBUG_ERROR, "SSL_write returned SSL_ERROR_SSL, errno %d, res %d, ssl error code %d", errno, res, ssl_err));
+        ERR_load_crypto_strings();
+        while((errorValue = ERR_get_error())) {
+          Debug((DEBUG_ERROR, "  Error Queue: %d -- %s", errorValue, ERR_error_string(errorValue, NULL)));
+        }
+        return IO_FAILURE;
+     }
+  case SSL_ERROR_SYSCALL:
+    if(res < 0 && (errno == EWOULDBLOCK ||
+                   errno == EINTR ||
+                   errno == EBUSY ||
+                   errno == EAGAIN)) {
+           Debug((DEBUG_DEBUG, "SSL_write returned ERROR_SYSCALL, errno %d - blocked", errno));
+           return IO_BLOCKED;
+    }
+    else {
+           Debug((DEBUG_DEBUG, "SSL_write returned ERROR_SYSCALL - errno %d - returning IO_FAILURE", errno));
+           return IO_FAILURE;
     }
+  case SSL_ERROR_ZERO_RETURN:
+    SSL_shutdown(socketh->ssl);
+    return IO_FAILURE;
+  default:
+    Debug((DEBUG_DEBUG, "SSL_write return fell through - errno %d, assuming blocked", errno));
+    return IO_BLOCKED; /* unknown error, assume block */
   }
-  Debug((DEBUG_DEBUG, "SSL_write return fell through(2) - errno %d returning retval %d", errno, retval));
-  return retval;
+}
+
+/*
+ * ssl_record_stats - report the number of TLS records written and the
+ * number of payload bytes they carried.
+ */
+void ssl_record_stats(unsigned long *records, unsigned long *bytes)
+{
+  *records = ssl_records;
+  *bytes = ssl_record_bytes;
 }
      
 int ssl_send(struct Client *cptr, const char *buf, unsigned int len)
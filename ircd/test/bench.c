@@ -0,0 +1,97 @@
+/*
+ * bench.c - shared support for the benchmark programs
+ */
+#include "config.h"
+#include "ircd_alloc.h"
+#include "ircd_log.h"
+#include "ircd_reply.h"
+#include "ircd_snprintf.h"
+#include "s_debug.h"
+#include "bench.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define WEAK __attribute__((weak))
+
+/* Minimal environment for the objects under test */
+WEAK int log_inassert;
+
+WEAK void alloc_nomem(void)
+{
+  fprintf(stderr, "out of memory\n");
+  abort();
+}
+
+WEAK void *DoMalloc(size_t len, const char *type, const char *file, int line)
+{
+  void *p = malloc(len);
+  if (!p)
+    alloc_nomem();
+  return p;
+}
+
+WEAK void *DoMallocZero(size_t len, const char *type, const char *file,
+                        int line)
+{
+  void *p = calloc(1, len);
+  if (!p)
+    alloc_nomem();
+  return p;
+}
+
+WEAK void *DoRealloc(void *orig, size_t len, const char *file, int line)
+{
+  void *p = realloc(orig, len);
+  if (!p)
+    alloc_nomem();
+  return p;
+}
+
+WEAK void debug(int level, const char *form, ...)
+{
+}
+
+/** Show critical messages, such as failed assertions; drop the rest. */
+WEAK void log_write(enum LogSys subsys, enum LogLevel severity,
+                    unsigned int flags, const char *fmt, ...)
+{
+  va_list vl;
+
+  if (severity != L_CRIT)
+    return;
+  va_start(vl, fmt);
+  vfprintf(stderr, fmt, vl);
+  va_end(vl);
+  fputc('\n', stderr);
+}
+
+WEAK int send_reply(struct Client *to, int reply, ...)
+{
+  return 0;
+}
+
+WEAK int ircd_snprintf(struct Client *dest, char *buf, size_t buf_len,
+                       const char *format, ...)
+{
+  return 0;
+}
+
+double bench_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void bench_report(const char *what, double start, unsigned long count,
+                  const char *unit)
+{
+  double elapsed = bench_now() - start;
+
+  printf("  %-14s %9.2f ms  %8.1f ns per %s\n", what, elapsed * 1e3,
+         count ? elapsed * 1e9 / count : 0.0, unit);
+}
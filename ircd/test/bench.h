@@ -0,0 +1,26 @@
+/*
+ * bench.h - shared support for the benchmark programs
+ *
+ * bench.c supplies weak stand-ins for the server functions most
+ * objects under test call (allocation, logging, debug output and
+ * numeric replies), so a benchmark only has to stub what is peculiar
+ * to it.  Linking the real object for any of them overrides the
+ * stand-in.
+ */
+#ifndef INCLUDED_bench_h
+#define INCLUDED_bench_h
+
+/** Return the value of integer argument \a n, or \a def if absent. */
+#define BENCH_ARG(argc, argv, n, def) \
+  ((argc) > (n) ? atoi((argv)[n]) : (def))
+
+/** Monotonic time in seconds. */
+extern double bench_now(void);
+
+/** Print \a what with the time since \a start, per \a count items of
+ * \a unit.
+ */
+extern void bench_report(const char *what, double start, unsigned long count,
+                         const char *unit);
+
+#endif /* INCLUDED_bench_h */
@@ -0,0 +1,229 @@
+/*
+ * cloak_bench.c - cost of style 2 IPv4 cloaks
+ *
+ * Cloaks a set of synthetic addresses three ways and checks that they
+ * all agree:
+ *
+ *   original  six DoMD5() calls per address, as hidehost_ipv4() used
+ *             to do
+ *   cold      hidehost_ipv4() on addresses it has not seen, so only the
+ *             BETA and GAMMA caches can help
+ *   again     hidehost_ipv4() on each address twice in a row, which is
+ *             what register_user() does for virthost and virtip
+ *
+ * It does the same for hostnames, against hidehost_normalhost() as it
+ * was, and times DoMD5x4() against four DoMD5() calls on cloak-sized
+ * input.  The addresses come from a limited number of /16 networks, as
+ * users of a real network do; pass 65536 to spread them over every
+ * /16 instead.
+ *
+ * Build with "make bench" in this directory after compiling the server.
+ *
+ * Usage: ./cloak_bench [addresses [networks [cache size]]]
+ */
+#include "config.h"
+#include "client.h"
+#include "cloak.h"
+#include "ircd_chattr.h"
+#include "ircd_features.h"
+#include "ircd_snprintf.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Minimal environment for cloak.o and its helpers */
+static int cache_size;
+
+const char *feature_str(enum Feature feat)
+{
+  switch (feat) {
+  case FEAT_HOST_HIDING_KEY1: return "aoAr1HnR6gl3sJ7hVz4Zb7x4YwpW";
+  case FEAT_HOST_HIDING_KEY2: return "sdfjkLJKHlkjdkfjsdklfjlkjKLJ";
+  case FEAT_HOST_HIDING_KEY3: return "KJklJSDFLkjLKDFJSLKjlKJFlkjS";
+  case FEAT_HOST_HIDING_PREFIX: return "AfterNET";
+  default: return "";
+  }
+}
+
+int feature_int(enum Feature feat)
+{
+  return feat == FEAT_HOST_HIDING_CACHE ? cache_size : 0;
+}
+
+#define KEY1 feature_str(FEAT_HOST_HIDING_KEY1)
+#define KEY2 feature_str(FEAT_HOST_HIDING_KEY2)
+#define KEY3 feature_str(FEAT_HOST_HIDING_KEY3)
+
+static unsigned int downsample(unsigned char *i)
+{
+  return ((unsigned int) (i[0] ^ i[1] ^ i[2] ^ i[3]) << 24) +
+         ((unsigned int) (i[4] ^ i[5] ^ i[6] ^ i[7]) << 16) +
+         ((unsigned int) (i[8] ^ i[9] ^ i[10] ^ i[11]) << 8) +
+         (unsigned int) (i[12] ^ i[13] ^ i[14] ^ i[15]);
+}
+
+/** hidehost_ipv4() as it was before any caching. */
+static char *reference_ipv4(char *host)
+{
+  unsigned int a, b, c, d;
+  static char buf[512], result[128];
+  unsigned char res[512], res2[512];
+  unsigned int alpha, beta, gamma;
+
+  sscanf(host, "%u.%u.%u.%u", &a, &b, &c, &d);
+
+  ircd_snprintf(0, buf, HOSTLEN, "%s:%s:%s", KEY2, host, KEY3);
+  DoMD5(res, (unsigned char *) buf, strlen(buf));
+  strcpy((char *) res + 16, KEY1);
+  DoMD5(res2, res, strlen((char *) res + 16) + 16);
+  alpha = downsample(res2);
+
+  ircd_snprintf(0, buf, HOSTLEN, "%s:%d.%d.%d:%s", KEY3, a, b, c, KEY1);
+  DoMD5(res, (unsigned char *) buf, strlen(buf));
+  strcpy((char *) res + 16, KEY2);
+  DoMD5(res2, res, strlen((char *) res + 16) + 16);
+  beta = downsample(res2);
+
+  ircd_snprintf(0, buf, HOSTLEN, "%s:%d.%d:%s", KEY1, a, b, KEY2);
+  DoMD5(res, (unsigned char *) buf, strlen(buf));
+  strcpy((char *) res + 16, KEY3);
+  DoMD5(res2, res, strlen((char *) res + 16) + 16);
+  gamma = downsample(res2);
+
+  ircd_snprintf(0, result, HOSTLEN, "%X.%X.%X.IP", alpha, beta, gamma);
+  return result;
+}
+
+/** hidehost_normalhost() as it was before any caching. */
+static char *reference_host(char *host)
+{
+  static char buf[512], result[HOSTLEN + 1];
+  unsigned char res[512], res2[512];
+  unsigned int alpha, len;
+  char *p;
+
+  ircd_snprintf(0, buf, 512, "%s:%s:%s", KEY1, host, KEY2);
+  DoMD5(res, (unsigned char *) buf, strlen(buf));
+  strcpy((char *) res + 16, KEY3);
+  DoMD5(res2, res, strlen((char *) res + 16) + 16);
+  alpha = downsample(res2);
+
+  for (p = host; *p; p++)
+    if (*p == '.' && IsAlpha(p[1]))
+      break;
+  if (*p) {
+    p++;
+    ircd_snprintf(0, result, HOSTLEN, "%s-%X.",
+                  feature_str(FEAT_HOST_HIDING_PREFIX), alpha);
+    len = strlen(result) + strlen(p);
+    strcat(result, len <= HOSTLEN ? p : p + (len - HOSTLEN));
+  } else
+    ircd_snprintf(0, result, HOSTLEN, "%s-%X",
+                  feature_str(FEAT_HOST_HIDING_PREFIX), alpha);
+  return result;
+}
+
+int main(int argc, char **argv)
+{
+  int count = BENCH_ARG(argc, argv, 1, 1000000);
+  int networks = BENCH_ARG(argc, argv, 2, 2000);
+  char (*hosts)[16], (*names)[64], (*cloaks)[HOSTLEN + 1];
+  unsigned short *nets;
+  unsigned char in[4][80], out[4][16], *src[4], *dst[4];
+  unsigned long n[4];
+  double start;
+  int ii, jj, bad = 0;
+
+  cache_size = BENCH_ARG(argc, argv, 3, 4096);
+  hosts = malloc(count * sizeof(*hosts));
+  names = malloc(count * sizeof(*names));
+  cloaks = malloc(count * sizeof(*cloaks));
+  nets = malloc(networks * sizeof(*nets));
+  if (!hosts || !names || !cloaks || !nets)
+    abort();
+
+  srandom(1);
+  for (ii = 0; ii < networks; ii++)
+    nets[ii] = networks >= 65536 ? ii : random();
+  for (ii = 0; ii < count; ii++) {
+    unsigned int net = nets[random() % networks];
+    unsigned int a = random() % 256, b = random() % 256;
+
+    sprintf(hosts[ii], "%u.%u.%u.%u", net >> 8, net & 255, a, b);
+    sprintf(names[ii], "host-%u-%u.pool%u.isp%u.example.net", b, a,
+            net & 255, net >> 8);
+  }
+  printf("%d addresses in %d /16 networks, cache of %d cloaks\n", count,
+         networks, cache_size);
+
+  start = bench_now();
+  for (ii = 0; ii < count; ii++)
+    strcpy(cloaks[ii], reference_ipv4(hosts[ii]));
+  bench_report("original", start, count, "address");
+
+  start = bench_now();
+  for (ii = 0; ii < count; ii++)
+    if (strcmp(cloaks[ii], hidehost_ipv4(hosts[ii])))
+      bad++;
+  bench_report("cold", start, count, "address");
+
+  cloak_flush_cache();
+  start = bench_now();
+  for (ii = 0; ii < count; ii++) {
+    if (strcmp(cloaks[ii], hidehost_ipv4(hosts[ii])))
+      bad++;
+    if (strcmp(cloaks[ii], hidehost_ipv4(hosts[ii])))
+      bad++;
+  }
+  bench_report("again", start, count, "address");
+
+  cloak_flush_cache();
+  start = bench_now();
+  for (ii = 0; ii < count; ii++)
+    strcpy(cloaks[ii], reference_host(names[ii]));
+  bench_report("original host", start, count, "hostname");
+
+  start = bench_now();
+  for (ii = 0; ii < count; ii++)
+    if (strcmp(cloaks[ii], hidehost_normalhost(names[ii])))
+      bad++;
+  bench_report("cold host", start, count, "hostname");
+
+  cloak_flush_cache();
+  start = bench_now();
+  for (ii = 0; ii < count; ii++) {
+    if (strcmp(cloaks[ii], hidehost_normalhost(names[ii])))
+      bad++;
+    if (strcmp(cloaks[ii], hidehost_normalhost(names[ii])))
+      bad++;
+  }
+  bench_report("again host", start, count, "hostname");
+
+  /* the first-round input of an ALPHA part, four at a time */
+  for (jj = 0; jj < 4; jj++) {
+    src[jj] = in[jj];
+    dst[jj] = out[jj];
+  }
+  start = bench_now();
+  for (ii = 0; ii < count; ii += 4)
+    for (jj = 0; jj < 4; jj++) {
+      n[jj] = ircd_snprintf(0, (char *) in[jj], sizeof(in[jj]), "%s:%s:%s",
+                            KEY2, hosts[(ii + jj) % count], KEY3);
+      DoMD5(out[jj], in[jj], n[jj]);
+    }
+  bench_report("DoMD5", start, count, "address");
+
+  start = bench_now();
+  for (ii = 0; ii < count; ii += 4) {
+    for (jj = 0; jj < 4; jj++)
+      n[jj] = ircd_snprintf(0, (char *) in[jj], sizeof(in[jj]), "%s:%s:%s",
+                            KEY2, hosts[(ii + jj) % count], KEY3);
+    DoMD5x4(dst, src, n);
+  }
+  bench_report("DoMD5x4", start, count, "address");
+
+  printf("%d mismatched cloaks\n", bad);
+  return bad != 0;
+}
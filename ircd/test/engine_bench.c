@@ -0,0 +1,227 @@
+/*
+ * engine_bench.c - event engine syscall benchmark
+ *
+ * Relays fixed-size messages around a ring of socketpairs through the
+ * socket_add()/socket_events() interface and counts the system calls
+ * the event engine itself makes (epoll_wait/epoll_ctl for the epoll
+ * engine, io_uring_enter for the io_uring engine) per delivered
+ * message.  Each readable event reads a single message; as in the
+ * server, messages are written straight away and write interest is
+ * only requested when the socket buffer is full.
+ *
+ * The io_uring engine is used when the kernel supports it; setting
+ * BENCH_ENGINE=epoll in the environment makes io_uring_setup() fail
+ * so event_init() falls back to the epoll engine.  The benchmark exits
+ * with an error if it ends up with any other engine, such as poll(),
+ * whose system calls it does not count.
+ *
+ * Build with "make bench" in this directory after compiling the server
+ * with both engines enabled.
+ *
+ * Usage: ./engine_bench [pairs [messages]]
+ */
+#include "config.h"
+#include "ircd_events.h"
+#include "ircd_features.h"
+#include "bench.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define MSGLEN 64
+
+/* Minimal environment for ircd_events.o and the engines */
+time_t CurrentTime;
+int running;
+struct Engine engine_kqueue, engine_devpoll, engine_select;
+
+int feature_int(enum Feature feat)
+{
+  return 200; /* FEAT_POLLS_PER_LOOP default */
+}
+
+void exit_schedule(int restart, time_t when, struct Client *who,
+                   const char *message)
+{
+  fprintf(stderr, "engine failure: %s\n", message);
+  exit(2);
+}
+
+/* System call counters */
+static unsigned long n_enter, n_wait, n_ctl;
+
+long __real_syscall(long nr, ...);
+int __real_epoll_wait(int epfd, struct epoll_event *events, int maxevents,
+                      int timeout);
+int __real_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event);
+
+long __wrap_syscall(long nr, ...)
+{
+  long a[6];
+  va_list vl;
+  int i;
+
+  va_start(vl, nr);
+  for (i = 0; i < 6; i++)
+    a[i] = va_arg(vl, long);
+  va_end(vl);
+#ifdef __NR_io_uring_setup
+  if (nr == __NR_io_uring_setup) {
+    const char *want = getenv("BENCH_ENGINE");
+    if (want && !strcmp(want, "epoll")) {
+      errno = ENOSYS;
+      return -1;
+    }
+  }
+#endif
+#ifdef __NR_io_uring_enter
+  if (nr == __NR_io_uring_enter)
+    n_enter++;
+#endif
+  return __real_syscall(nr, a[0], a[1], a[2], a[3], a[4], a[5]);
+}
+
+int __wrap_epoll_wait(int epfd, struct epoll_event *events, int maxevents,
+                      int timeout)
+{
+  n_wait++;
+  return __real_epoll_wait(epfd, events, maxevents, timeout);
+}
+
+int __wrap_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event)
+{
+  n_ctl++;
+  return __real_epoll_ctl(epfd, op, fd, event);
+}
+
+/* The relay ring: what socks[k] reads is written out of socks[k + 2]
+ * and read back by its peer, socks[(k + 2) ^ 1].
+ */
+static struct Socket *socks;
+static unsigned int *pending;    /* bytes queued for writing */
+static unsigned int *partial;    /* bytes of an incomplete message */
+static int nsocks;
+static unsigned long delivered, wanted, blocked;
+static char payload[16 * MSGLEN];
+
+static void flush_queue(int k)
+{
+  struct Socket *sock = &socks[k];
+  unsigned int len;
+  ssize_t res;
+
+  while (pending[k]) {
+    len = pending[k] > sizeof(payload) ? sizeof(payload) : pending[k];
+    if ((res = write(s_fd(sock), payload, len)) <= 0)
+      break;
+    pending[k] -= res;
+  }
+  if (pending[k] && !(s_events(sock) & SOCK_EVENT_WRITABLE)) {
+    blocked++;
+    socket_events(sock, SOCK_ACTION_ADD | SOCK_EVENT_WRITABLE);
+  } else if (!pending[k] && (s_events(sock) & SOCK_EVENT_WRITABLE))
+    socket_events(sock, SOCK_ACTION_DEL | SOCK_EVENT_WRITABLE);
+}
+
+static void relay_callback(struct Event *ev)
+{
+  struct Socket *sock = ev_socket(ev);
+  int k = sock - socks, next = (k + 2) % nsocks;
+  char buf[MSGLEN];
+  ssize_t res;
+
+  switch (ev_type(ev)) {
+  case ET_READ:
+    if ((res = read(s_fd(sock), buf, sizeof(buf))) > 0) {
+      partial[k] += res;
+      delivered += partial[k] / MSGLEN;
+      pending[next] += partial[k] - partial[k] % MSGLEN;
+      partial[k] %= MSGLEN;
+    }
+    if (delivered >= wanted)
+      running = 0;
+    else
+      flush_queue(next);
+    break;
+
+  case ET_WRITE:
+    flush_queue(k);
+    break;
+
+  case ET_DESTROY:
+    break;
+
+  default:
+    fprintf(stderr, "unexpected event %d on socket %d\n", ev_type(ev), k);
+    exit(2);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  int pairs = BENCH_ARG(argc, argv, 1, 500);
+  const char *want = getenv("BENCH_ENGINE");
+  unsigned long sys;
+  double start, elapsed;
+  int fds[2], i, k;
+
+  wanted = argc > 2 ? strtoul(argv[2], 0, 10) : 1000000;
+  nsocks = pairs * 2;
+  socks = calloc(nsocks, sizeof(*socks));
+  pending = calloc(nsocks, sizeof(*pending));
+  partial = calloc(nsocks, sizeof(*partial));
+  memset(payload, 'x', sizeof(payload));
+
+  CurrentTime = time(0);
+  event_init(nsocks + 16);
+  if (!want || strcmp(want, "epoll"))
+    want = "io_uring";
+  if (strncmp(engine_name(), want, strlen(want))) {
+    fprintf(stderr, "wanted the %s engine but got %s\n", want,
+            engine_name());
+    return 2;
+  }
+
+  for (i = 0; i < pairs; i++) {
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+      perror("socketpair");
+      return 2;
+    }
+    for (k = 0; k < 2; k++)
+      if (fcntl(fds[k], F_SETFL, O_NONBLOCK) < 0 ||
+          !socket_add(&socks[i * 2 + k], relay_callback, 0, SS_CONNECTED,
+                      SOCK_EVENT_READABLE, fds[k])) {
+        fprintf(stderr, "socket_add failed\n");
+        return 2;
+      }
+  }
+
+  /* Put a few messages in flight on every link */
+  for (k = 0; k < nsocks; k++) {
+    pending[k] = 4 * MSGLEN;
+    flush_queue(k);
+  }
+
+  n_enter = n_wait = n_ctl = 0;
+  running = 1;
+  start = bench_now();
+  event_loop();
+  elapsed = bench_now() - start;
+
+  sys = n_enter + n_wait + n_ctl;
+  printf("engine %s, %d sockets, %lu messages in %.3f s\n", engine_name(),
+         nsocks, delivered, elapsed);
+  printf("io_uring_enter %lu, epoll_wait %lu, epoll_ctl %lu, "
+         "writes blocked %lu\n", n_enter, n_wait, n_ctl, blocked);
+  printf("engine syscalls per message: %.4f\n",
+         delivered ? (double) sys / delivered : 0.0);
+  return delivered >= wanted ? 0 : 1;
+}
@@ -0,0 +1,210 @@
+/*
+ * kline_bench.c - Kill block lookup benchmark
+ *
+ * Loads 10000 generated Kill blocks of the kinds abuse feeds produce
+ * (IP addresses and CIDR ranges, exact hostnames, "*.domain" masks,
+ * real name masks and a few free-form wildcards) and looks up
+ * generated clients both with the old walk of the whole list and with
+ * the ban index find_kill() now uses, checking that both find the same
+ * block and reporting the time per lookup.
+ *
+ * Build with "make bench" in this directory after compiling the server.
+ *
+ * Usage: ./kline_bench [blocks [clients]]
+ */
+#include "config.h"
+#include "banindex.h"
+#include "ircd_log.h"
+#include "match.h"
+#include "bench.h"
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KB_IP       0x0002 /* as DENY_FLAGS_IP */
+#define KB_REALNAME 0x0004 /* as DENY_FLAGS_REALNAME */
+
+/** Cut-down struct DenyConf. */
+struct Block {
+  struct Block        *next;
+  char                *hostmask;
+  char                *usermask;
+  unsigned int         address;
+  unsigned int         flags;
+  int                  bits;
+  struct BanIndexEntry index;
+};
+
+/** Cut-down client. */
+struct Probe {
+  char           host[128];
+  char           name[16];
+  char           realname[64];
+  struct in_addr ip;
+};
+
+static const char *words[] = {
+  "proxy", "dsl", "cable", "dyn", "pool", "static", "vps", "host",
+  "client", "node", "user", "ppp", "adsl", "fiber", "mobile", "cust"
+};
+static const char *tlds[] = { "com", "net", "org", "de", "ru", "br", "cn" };
+
+static struct Block *blocks;
+static struct BanIndex idx;
+
+#define WORD() words[random() % (sizeof(words) / sizeof(words[0]))]
+#define TLD() tlds[random() % (sizeof(tlds) / sizeof(tlds[0]))]
+
+/** Fill in a random domain of the kind found in the blocks. */
+static void make_domain(char *buf, size_t len)
+{
+  snprintf(buf, len, "%s%ld.%s", WORD(), random() % 2000, TLD());
+}
+
+/** Generate a Kill block, put it at the head of the list as the
+ * parser does. */
+static void make_block(void)
+{
+  struct Block *b = calloc(1, sizeof(*b));
+  char buf[128], dom[64];
+  int kind = random() % 100;
+
+  b->usermask = strdup(random() % 20 ? "*" : "*bot*");
+  if (kind < 40) {
+    /* 10.x.y.z, mostly single addresses, some ranges */
+    b->bits = (random() % 4) ? 32 : 16 + random() % 16;
+    b->address = htonl((10U << 24 | (random() & 0xffffff)) &
+                       (~0U << (32 - b->bits)));
+    snprintf(buf, sizeof(buf), "%s/%d",
+             inet_ntoa(*(struct in_addr *) &b->address), b->bits);
+    b->flags = KB_IP;
+  } else if (kind < 60) {
+    make_domain(dom, sizeof(dom));
+    snprintf(buf, sizeof(buf), "%s-%ld.%s", WORD(), random() % 500, dom);
+  } else if (kind < 85) {
+    make_domain(dom, sizeof(dom));
+    snprintf(buf, sizeof(buf), "*.%s", dom);
+  } else if (kind < 95) {
+    snprintf(buf, sizeof(buf), random() % 2 ? "*%s %s*" : "%s %s",
+             WORD(), WORD());
+    b->flags = KB_REALNAME;
+  } else {
+    snprintf(buf, sizeof(buf), "*%s%ld*.%s", WORD(), random() % 100, TLD());
+  }
+  b->hostmask = strdup(buf);
+  b->next = blocks;
+  blocks = b;
+}
+
+/** The per-block test of find_kill(). */
+static int block_check(void *ban, void *arg)
+{
+  struct Block *b = ban;
+  struct Probe *p = arg;
+
+  if (0 != match(b->usermask, p->name))
+    return 0;
+  if (b->flags & KB_REALNAME)
+    return 0 == match(b->hostmask, p->realname);
+  if (b->flags & KB_IP)
+    return (p->ip.s_addr & htonl(b->bits ? ~0U << (32 - b->bits) : 0)) ==
+      b->address;
+  return 0 == match(b->hostmask, p->host);
+}
+
+/** The old find_kill() loop. */
+static struct Block *walk(struct Probe *p)
+{
+  struct Block *b;
+
+  for (b = blocks; b; b = b->next)
+    if (block_check(b, p))
+      break;
+  return b;
+}
+
+/** The new find_kill() lookup. */
+static struct Block *lookup(struct Probe *p)
+{
+  const char *names[2];
+
+  names[0] = p->host;
+  names[1] = p->realname;
+  return banindex_find_names(&idx, p->ip, names, 2, block_check, p);
+}
+
+/** Generate a client; about half look like the blocked ones. */
+static void make_probe(struct Probe *p)
+{
+  char dom[64];
+
+  if (random() % 2) {
+    make_domain(dom, sizeof(dom));
+    snprintf(p->host, sizeof(p->host), "%s-%ld.%s", WORD(), random() % 500,
+             dom);
+    p->ip.s_addr = htonl(10U << 24 | (random() & 0xffffff));
+  } else {
+    snprintf(p->host, sizeof(p->host), "host%ld.example.%s", random() % 9999,
+             TLD());
+    p->ip.s_addr = htonl(192U << 24 | (random() & 0xffffff));
+  }
+  snprintf(p->name, sizeof(p->name), "%s%ld", random() % 10 ? "user" : "bot",
+           random() % 1000);
+  snprintf(p->realname, sizeof(p->realname), "%s %s", WORD(),
+           random() % 4 ? "Realname" : WORD());
+}
+
+int main(int argc, char **argv)
+{
+  int nblocks = BENCH_ARG(argc, argv, 1, 10000);
+  int nprobes = BENCH_ARG(argc, argv, 2, 20000);
+  struct Probe *probes;
+  struct Block *b, *prev = 0, **found;
+  double start;
+  int ii, hits = 0;
+
+  srandom(1);
+  for (ii = 0; ii < nblocks; ii++)
+    make_block();
+  for (b = blocks; b; prev = b, b = b->next) {
+    if (b->flags & KB_IP) {
+      struct in_addr addr;
+
+      addr.s_addr = b->address;
+      banindex_add(&idx, &b->index, b, prev ? &prev->index : 0, &addr,
+                   b->bits, 0);
+    } else
+      banindex_add(&idx, &b->index, b, prev ? &prev->index : 0, 0, 0,
+                   b->hostmask);
+  }
+
+  probes = calloc(nprobes, sizeof(*probes));
+  found = calloc(nprobes, sizeof(*found));
+  for (ii = 0; ii < nprobes; ii++)
+    make_probe(&probes[ii]);
+
+  printf("%d Kill blocks, %d clients\n", nblocks, nprobes);
+  start = bench_now();
+  for (ii = 0; ii < nprobes; ii++)
+    found[ii] = walk(&probes[ii]);
+  bench_report("list walk", start, nprobes, "client");
+
+  start = bench_now();
+  for (ii = 0; ii < nprobes; ii++) {
+    b = lookup(&probes[ii]);
+    if (b != found[ii]) {
+      printf("mismatch for %s@%s (%s) [%s]: walk %s, index %s\n",
+             probes[ii].name, probes[ii].host, inet_ntoa(probes[ii].ip),
+             probes[ii].realname, found[ii] ? found[ii]->hostmask : "none",
+             b ? b->hostmask : "none");
+      return 1;
+    }
+    hits += !!b;
+  }
+  bench_report("ban index", start, nprobes, "client");
+
+  printf("%d clients denied\n", hits);
+  return 0;
+}
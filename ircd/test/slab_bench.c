@@ -0,0 +1,237 @@
+/*
+ * slab_bench.c - memory held for channel memberships and list links
+ *
+ * Runs a synthetic join/part workload twice, in separate processes:
+ * once allocating as the server used to (Membership and SLink from
+ * malloc() through free lists that are never trimmed, DLink straight
+ * from malloc()), and once from the slab allocator.
+ *
+ * The workload has a steady population of local users who keep
+ * quitting and reconnecting, each joining a few channels and holding a
+ * few links.  A server then bursts in with many more users while a
+ * trickle of local churn goes on, and later splits away again.  After
+ * each phase it reports the bytes in live objects, the bytes held for
+ * them (the malloc() heap or the mapped slabs), and the fragmentation:
+ * the share of held memory not in live objects.
+ * The heap size comes from mallinfo2(), so this needs glibc 2.33 or
+ * later.
+ *
+ * Build with "make bench" in this directory after compiling the server.
+ *
+ * Usage: ./slab_bench [locals [remotes [cycles]]]
+ */
+#include "config.h"
+#include "ircd_log.h"
+#include "ircd_slab.h"
+#include "bench.h"
+
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* Stand-ins with the sizes of the real structures on LP64 */
+struct Membership { void *p[8]; unsigned int status; };
+struct SLink { void *next; void *p[5]; };
+struct DLink { void *next, *prev, *value; };
+
+#define MAX_CHANS 12 /* channels per user */
+#define MAX_LINKS 4  /* invites, silences and watches per user */
+
+/** One user's nodes. */
+struct User {
+  int                nchans;
+  int                nlinks;
+  struct Membership *chans[MAX_CHANS];
+  struct SLink      *links[MAX_LINKS];
+  struct DLink      *dlink;
+};
+
+static int use_slab;
+static struct SlabType membership_slab =
+  SLAB_TYPE_INIT("Membership", struct Membership);
+static struct SlabType slink_slab = SLAB_TYPE_INIT("SLink", struct SLink);
+static struct SlabType dlink_slab = SLAB_TYPE_INIT("DLink", struct DLink);
+static void *membership_free, *slink_free;
+static size_t live, overhead;
+
+/** Allocate from a free list, as make_link() used to. */
+static void *list_alloc(void **list, size_t size)
+{
+  void *p = *list;
+
+  if (p)
+    *list = *(void **) p;
+  else if (!(p = malloc(size)))
+    abort();
+  return p;
+}
+
+static void list_free(void **list, void *p)
+{
+  *(void **) p = *list;
+  *list = p;
+}
+
+static void *alloc_node(struct SlabType *type, void **list, size_t size)
+{
+  void *p;
+
+  if (use_slab)
+    p = slab_alloc(type);
+  else if (list)
+    p = list_alloc(list, size);
+  else if (!(p = malloc(size)))
+    abort();
+  memset(p, 0, size);
+  live += size;
+  return p;
+}
+
+static void free_node(struct SlabType *type, void **list, size_t size,
+                      void *p)
+{
+  if (use_slab)
+    slab_free(type, p);
+  else if (list)
+    list_free(list, p);
+  else
+    free(p);
+  live -= size;
+}
+
+/** Connect a user: join some channels, pick up some links. */
+static void connect_user(struct User *u)
+{
+  int ii;
+
+  u->nchans = 1 + random() % MAX_CHANS;
+  for (ii = 0; ii < u->nchans; ii++)
+    u->chans[ii] = alloc_node(&membership_slab, &membership_free,
+                              sizeof(struct Membership));
+  u->nlinks = random() % (MAX_LINKS + 1);
+  for (ii = 0; ii < u->nlinks; ii++)
+    u->links[ii] = alloc_node(&slink_slab, &slink_free, sizeof(struct SLink));
+  u->dlink = random() % 4 ? 0 : alloc_node(&dlink_slab, 0,
+                                           sizeof(struct DLink));
+}
+
+/** Disconnect a user, freeing everything it held. */
+static void quit_user(struct User *u)
+{
+  int ii;
+
+  for (ii = 0; ii < u->nchans; ii++)
+    free_node(&membership_slab, &membership_free, sizeof(struct Membership),
+              u->chans[ii]);
+  for (ii = 0; ii < u->nlinks; ii++)
+    free_node(&slink_slab, &slink_free, sizeof(struct SLink), u->links[ii]);
+  if (u->dlink)
+    free_node(&dlink_slab, 0, sizeof(struct DLink), u->dlink);
+  u->nchans = u->nlinks = 0;
+  u->dlink = 0;
+}
+
+/** Part a random channel and join another, as users do all day. */
+static void cycle_channel(struct User *u)
+{
+  int ii;
+
+  if (!u->nchans)
+    return;
+  ii = random() % u->nchans;
+  free_node(&membership_slab, &membership_free, sizeof(struct Membership),
+            u->chans[ii]);
+  u->chans[ii] = alloc_node(&membership_slab, &membership_free,
+                            sizeof(struct Membership));
+}
+
+/** One unit of local churn: a reconnect or a few part/join pairs. */
+static void churn(struct User *locals, int nlocals)
+{
+  struct User *u = &locals[random() % nlocals];
+  int ii;
+
+  if (random() % 4 == 0) {
+    quit_user(u);
+    connect_user(u);
+  } else
+    for (ii = 0; ii < 4; ii++)
+      cycle_channel(&locals[random() % nlocals]);
+}
+
+/** Print live and held memory. */
+static void report(const char *phase)
+{
+  size_t held;
+
+  if (use_slab) {
+    struct SlabType *type;
+
+    for (held = 0, type = SlabTypeList; type; type = type->st_next)
+      held += (size_t) type->st_slabs * 16384;
+  } else {
+    /* nodes are far too small to get their own mappings */
+    held = mallinfo2().arena - overhead;
+  }
+  printf("  %-14s live %7.1f MB  held %7.1f MB  fragmentation %5.1f%%\n",
+         phase, live / 1048576.0, held / 1048576.0,
+         held ? 100.0 * (held - live) / held : 0.0);
+}
+
+static void run(int nlocals, int nremotes, int cycles)
+{
+  struct User *locals = calloc(nlocals, sizeof(*locals));
+  struct User *remotes = calloc(nremotes, sizeof(*remotes));
+  int ii;
+
+  overhead = mallinfo2().arena;
+  srandom(1);
+  for (ii = 0; ii < nlocals; ii++)
+    connect_user(&locals[ii]);
+  for (ii = 0; ii < cycles; ii++)
+    churn(locals, nlocals);
+  report("steady state");
+
+  /* netburst, with a trickle of local users coming and going */
+  for (ii = 0; ii < nremotes; ii++) {
+    connect_user(&remotes[ii]);
+    if (ii % 64 == 0)
+      churn(locals, nlocals);
+  }
+  for (ii = 0; ii < cycles; ii++)
+    churn(locals, nlocals);
+  report("after burst");
+
+  /* the remote server splits; locals carry on */
+  for (ii = 0; ii < nremotes; ii++)
+    quit_user(&remotes[ii]);
+  report("after split");
+  for (ii = 0; ii < cycles; ii++)
+    churn(locals, nlocals);
+  report("split + churn");
+}
+
+int main(int argc, char **argv)
+{
+  int nlocals = BENCH_ARG(argc, argv, 1, 20000);
+  int nremotes = BENCH_ARG(argc, argv, 2, 100000);
+  int cycles = BENCH_ARG(argc, argv, 3, 200000);
+
+  printf("%d local users, %d remote users, %d churn steps per phase\n",
+         nlocals, nremotes, cycles);
+  for (use_slab = 0; use_slab < 2; use_slab++) {
+    pid_t pid;
+
+    fflush(stdout);
+    if ((pid = fork()) == 0) {
+      printf("%s\n", use_slab ? "slabs" : "malloc() and free lists");
+      run(nlocals, nremotes, cycles);
+      exit(0);
+    }
+    waitpid(pid, 0, 0);
+  }
+  return 0;
+}
@@ -0,0 +1,227 @@
+/*
+ * split_bench.c - netsplit QUIT delivery benchmark
+ *
+ * Builds a network in which a server with 20000 users, spread over
+ * channels of very different sizes, splits off from a hub with 2000
+ * local clients on the same channels.  It then delivers the QUITs as
+ * exit_one_client() does, with one walk of the local members of every
+ * channel per departing user.
+ *
+ * The QUITs are formatted and queued on each local client's sendQ by
+ * the server's own msgq code, and no client reads any of them.  It
+ * reports the wall time, the member visits, the MsgBufs formatted,
+ * and the longest sendQ the QUITs built up.
+ *
+ * Build with "make bench" in this directory after compiling the server.
+ *
+ * Usage: ./split_bench [users [locals [channels]]]
+ */
+#include "config.h"
+#include "channel.h"
+#include "ircd.h"
+#include "client.h"
+#include "ircd_features.h"
+#include "ircd_log.h"
+#include "ircd_struct.h"
+#include "msgq.h"
+#include "send.h"
+#include "bench.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Minimal environment for msgq.o and ircd_snprintf.o */
+
+int feature_int(enum Feature feat)
+{
+  return feat == FEAT_BUFFERPOOL ? 0x7fffffff : 0;
+}
+
+int feature_bool(enum Feature feat)
+{
+  return 0;
+}
+
+void flush_connections(struct Client *cptr)
+{
+}
+
+void kill_highest_sendq(int servers_too)
+{
+  fprintf(stderr, "out of MsgBuf memory\n");
+  abort();
+}
+
+void server_panic(const char *message)
+{
+  fprintf(stderr, "%s\n", message);
+  abort();
+}
+
+static struct Connection **locals;
+static unsigned long msgbufs, queued;
+static unsigned int sendq_peak;
+
+/** Count the MsgBufs formatted.  The benchmark is linked with
+ * --wrap=msgq_make, so this sees every call.
+ */
+struct MsgBuf *__wrap_msgq_make(struct Client *dest, const char *format, ...)
+{
+  struct MsgBuf *mb;
+  va_list vl;
+
+  va_start(vl, format);
+  mb = msgq_vmake(dest, format, vl);
+  va_end(vl);
+  msgbufs++;
+  return mb;
+}
+
+/** Queue a message for a local client; nobody ever reads them. */
+void send_buffer(struct Client *to, struct MsgBuf *buf, int prio)
+{
+  struct MsgQ *mq = &cli_sendQ(to);
+
+  msgq_add(mq, buf, prio);
+  if (MsgQLength(mq) > sendq_peak)
+    sendq_peak = MsgQLength(mq);
+  queued++;
+}
+
+static struct Connection sentalong_tail;
+static struct Connection *sentalong_list = &sentalong_tail;
+static unsigned long visits;
+
+/** The QUIT loop of sendcmdto_common_channels_butone(). */
+static void send_quit(struct Client *from, const char *comment)
+{
+  struct MsgBuf *mb = msgq_make(0, "%:#C %s :%s", from, "QUIT", comment);
+  struct Membership *chan, *member;
+  struct Connection *con;
+
+  for (chan = cli_user(from)->channel; chan; chan = chan->next_channel) {
+    if (IsZombie(chan))
+      continue;
+    for (member = chan->channel->locals; member; member = member->next_local) {
+      visits++;
+      if (-1 < cli_fd(member->user) && !cli_sentalong(member->user)) {
+        cli_sentalong(member->user) = sentalong_list;
+        sentalong_list = cli_connect(member->user);
+        send_buffer(member->user, mb, 0);
+      }
+    }
+  }
+  while ((con = sentalong_list) != &sentalong_tail) {
+    sentalong_list = con_sentalong(con);
+    con_sentalong(con) = 0;
+  }
+  msgq_clean(mb);
+}
+
+static struct Channel **channels;
+static int nchannels;
+
+/** Pick a channel; low numbers are much more popular. */
+static struct Channel *pick_channel(void)
+{
+  double r = random() / (double) RAND_MAX;
+
+  return channels[(int) (nchannels * r * r * r) % nchannels];
+}
+
+/** Put a user on a channel, as add_user_to_channel() would. */
+static void join(struct Client *cptr, struct Channel *chptr, int local)
+{
+  struct Membership *member;
+
+  for (member = cli_user(cptr)->channel; member; member = member->next_channel)
+    if (member->channel == chptr)
+      return;
+  member = calloc(1, sizeof(*member));
+  member->user = cptr;
+  member->channel = chptr;
+  member->next_member = chptr->members;
+  chptr->members = member;
+  member->next_channel = cli_user(cptr)->channel;
+  cli_user(cptr)->channel = member;
+  if (local) {
+    member->next_local = chptr->locals;
+    chptr->locals = member;
+  }
+  chptr->users++;
+}
+
+/** Make a client with its user structure and connection. */
+static struct Client *make_user(struct Connection *con, const char *fmt, int n)
+{
+  struct Client *cptr = calloc(1, sizeof(*cptr));
+
+  cptr->cli_user = calloc(1, sizeof(struct User));
+  cptr->cli_connect = con;
+  cptr->cli_status = STAT_USER;
+  snprintf(cli_name(cptr), sizeof(cli_name(cptr)), fmt, n);
+  strcpy(cli_user(cptr)->username, "~user");
+  snprintf(cli_user(cptr)->host, sizeof(cli_user(cptr)->host),
+           "host-%d.example.net", n);
+  return cptr;
+}
+int main(int argc, char **argv)
+{
+  int nusers = BENCH_ARG(argc, argv, 1, 20000);
+  int nlocals = BENCH_ARG(argc, argv, 2, 2000);
+  struct Client **users;
+  struct Connection *link;
+  unsigned long bytes = 0;
+  double start;
+  int ii, jj;
+
+  nchannels = BENCH_ARG(argc, argv, 3, 5000);
+  srandom(1);
+
+  channels = calloc(nchannels, sizeof(*channels));
+  for (ii = 0; ii < nchannels; ii++)
+    channels[ii] = calloc(1, sizeof(struct Channel) + 16);
+
+  /* the hub's local clients, one connection each */
+  locals = calloc(nlocals, sizeof(*locals));
+  for (ii = 0; ii < nlocals; ii++) {
+    struct Connection *con = calloc(1, sizeof(*con));
+    struct Client *cptr = make_user(con, "local%d", ii);
+
+    msgq_init(&con->con_sendQ);
+    locals[ii] = con;
+    con->con_client = cptr;
+    con->con_fd = ii;
+    for (jj = 1 + random() % 10; jj > 0; jj--)
+      join(cptr, pick_channel(), 1);
+  }
+
+  /* the users of the server that splits, reached over one link */
+  link = calloc(1, sizeof(*link));
+  link->con_fd = nlocals;
+  users = calloc(nusers, sizeof(*users));
+  for (ii = 0; ii < nusers; ii++) {
+    users[ii] = make_user(link, "user%d", ii);
+    for (jj = 1 + random() % 8; jj > 0; jj--)
+      join(users[ii], pick_channel(), 0);
+  }
+
+  printf("%d users split from %d local clients on %d channels\n",
+         nusers, nlocals, nchannels);
+
+  start = bench_now();
+  for (ii = 0; ii < nusers; ii++)
+    send_quit(users[ii], "*.net *.split");
+  bench_report("per-user walk", start, nusers, "user");
+
+  for (ii = 0; ii < nlocals; ii++) {
+    bytes += MsgQLength(&con_sendQ(locals[ii]));
+    MsgQClear(&con_sendQ(locals[ii]));
+  }
+  printf("  %lu member visits, %lu MsgBufs, %lu QUITs queued (%lu KB)\n",
+         visits, msgbufs, queued, bytes / 1024);
+  printf("  peak sendQ %u bytes\n", sendq_peak);
+  return 0;
+}
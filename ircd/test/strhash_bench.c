@@ -0,0 +1,153 @@
+/*
+ * strhash_bench.c - nick and channel name hash microbenchmark
+ *
+ * Hashes generated nicknames and channel names with both the CRC-32
+ * table hash and the SSE4.2 CRC32C hash from hash.c, reporting the
+ * time per name and the longest chain each produces in a table with
+ * as many buckets as names.  It also checks that names differing only
+ * in case hash alike.
+ *
+ * hash.c is included directly so its static functions can be called.
+ * Build with "make bench" in this directory after compiling the server.
+ */
+#include "../hash.c"
+#include "bench.h"
+
+#include <stdio.h>
+
+#define NNAMES  65536
+#define ROUNDS  50
+
+/* Minimal environment for hash.c */
+struct Client me;
+
+unsigned int ircrandom(void)
+{
+  return random();
+}
+
+int match(const char *mask, const char *name)
+{
+  return 1;
+}
+
+int IsInvited(struct Client *cptr, struct Channel *chptr)
+{
+  return 0;
+}
+
+void channel_modes(struct Client *cptr, char *mbuf, char *pbuf, int buflen,
+                   struct Channel *chptr)
+{
+}
+
+struct Membership *find_channel_member(struct Client *cptr,
+                                       struct Channel *chptr)
+{
+  return 0;
+}
+
+void sendcmdto_one(struct Client *from, const char *cmd, const char *tok,
+                   struct Client *to, const char *pattern, ...)
+{
+}
+
+static char pool[NNAMES * 48];
+static char *names[NNAMES];
+
+/** Fill #names with nicknames or channel names. */
+static void make_names(int channels)
+{
+  static const char first[] = "abcdefghijklmnopqrstuvwxyz"
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZ[]\\`_^{|}";
+  static const char rest[] = "abcdefghijklmnopqrstuvwxyz"
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-[]\\`_^{|}";
+  int ii, jj, len;
+  char *p = pool;
+
+  for (ii = 0; ii < NNAMES; ii++) {
+    names[ii] = p;
+    if (channels) {
+      *p++ = '#';
+      len = 3 + random() % 14;  /* mostly short channel names */
+      if (random() % 8 == 0)
+        len += random() % 30;
+    } else
+      len = 3 + random() % 9;   /* nicks are NICKLEN or shorter */
+    if (random() % 4 == 0) {
+      /* common stems: Guest12345, #help-foo */
+      strcpy(p, channels ? "help-" : "Guest");
+      p += 5;
+      len = 3 + random() % 5;
+      for (jj = 0; jj < len; jj++)
+        *p++ = channels ? rest[random() % 26] : '0' + random() % 10;
+    } else {
+      *p++ = first[random() % (sizeof(first) - 1)];
+      for (jj = 1; jj < len; jj++)
+        *p++ = rest[random() % (sizeof(rest) - 1)];
+    }
+    *p++ = '\0';
+  }
+}
+
+/** Time one hash function and report its longest chain. */
+static void run(const char *what, HASHREGS (*fn)(const char *))
+{
+  static unsigned int chain[NNAMES];
+  unsigned int max_chain = 0, sum = 0;
+  double start, elapsed;
+  int ii, round;
+
+  start = bench_now();
+  for (round = 0; round < ROUNDS; round++)
+    for (ii = 0; ii < NNAMES; ii++)
+      sum += fn(names[ii]);
+  elapsed = bench_now() - start;
+
+  memset(chain, 0, sizeof(chain));
+  for (ii = 0; ii < NNAMES; ii++)
+    if (++chain[fn(names[ii]) & (NNAMES - 1)] > max_chain)
+      max_chain = chain[fn(names[ii]) & (NNAMES - 1)];
+
+  printf("  %-8s %6.1f ns/name, max chain %u (%08x)\n", what,
+         elapsed * 1e9 / ((double) ROUNDS * NNAMES), max_chain, sum);
+}
+
+int main(void)
+{
+  int channels;
+
+  srandom(1);
+  init_hash();
+#ifdef HASH_CRC32C
+  if (!crc32c_enabled) {
+    printf("no SSE4.2 on this processor; only the table hash is used\n");
+  } else {
+    static char page[8192] __attribute__((aligned(4096)));
+    char *edge = page + 4096 - sizeof("NiCk[Away]");
+
+    /* Same name ending right at a page boundary, which is read
+     * byte by byte instead of eight bytes at a time. */
+    strcpy(edge, "NiCk[Away]");
+    if (strhash_crc32c(edge) != strhash_crc32c("nick{away}")) {
+      printf("CRC32C hash is not case-insensitive\n");
+      return 1;
+    }
+  }
+#endif
+  if (strhash_table("NiCk[Away]") != strhash_table("nick{away}")) {
+    printf("table hash is not case-insensitive\n");
+    return 1;
+  }
+
+  for (channels = 0; channels < 2; channels++) {
+    make_names(channels);
+    printf("%d %s:\n", NNAMES, channels ? "channel names" : "nicknames");
+    run("table", strhash_table);
+#ifdef HASH_CRC32C
+    if (crc32c_enabled)
+      run("crc32c", strhash_crc32c);
+#endif
+  }
+  return 0;
+}
@@ -0,0 +1,82 @@
+/*
+ * timer_bench.c - timer queue microbenchmark
+ *
+ * Inserts, re-arms and cancels a large number of timers through the
+ * timer_add()/timer_chg()/timer_del()/timer_run() interface and checks
+ * that every timer fires at the second it was scheduled for.
+ *
+ * Build with "make bench" in this directory after compiling the server.
+ */
+#include "config.h"
+#include "ircd_events.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NTIMERS 100000
+
+/* Minimal environment for ircd_events.o */
+time_t CurrentTime;
+struct Engine engine_kqueue, engine_devpoll, engine_iouring, engine_epoll,
+  engine_poll, engine_select;
+
+static struct Timer timers[NTIMERS];
+static time_t wanted[NTIMERS];
+static unsigned int fired, destroyed, late;
+
+static void bench_callback(struct Event *ev)
+{
+  struct Timer *t = ev_timer(ev);
+
+  if (ev_type(ev) == ET_DESTROY) {
+    destroyed++;
+    return;
+  }
+  fired++;
+  if (wanted[t - timers] != CurrentTime)
+    late++;
+}
+
+int main(void)
+{
+  double start;
+  time_t value;
+  int i;
+
+  printf("%d timers\n", NTIMERS);
+  srand(1);
+  CurrentTime = 1000000;
+  timer_run(); /* start the queue at CurrentTime */
+
+  start = bench_now();
+  for (i = 0; i < NTIMERS; i++) {
+    value = 1 + rand() % 600; /* auth, ping and proc style timeouts */
+    wanted[i] = CurrentTime + value;
+    timer_add(timer_init(&timers[i]), bench_callback, 0, TT_RELATIVE, value);
+  }
+  bench_report("insert", start, NTIMERS, "timer");
+
+  start = bench_now();
+  for (i = 0; i < NTIMERS; i++) {
+    value = 1 + rand() % 86400;
+    wanted[i] = CurrentTime + value;
+    timer_chg(&timers[i], TT_RELATIVE, value);
+  }
+  bench_report("re-arm", start, NTIMERS, "timer");
+
+  start = bench_now();
+  for (i = 0; i < NTIMERS; i += 2)
+    timer_del(&timers[i]);
+  bench_report("cancel", start, NTIMERS / 2, "timer");
+
+  start = bench_now();
+  while (fired < NTIMERS / 2 && CurrentTime < 1000000 + 86400 + 1) {
+    CurrentTime++;
+    timer_run();
+  }
+  bench_report("expire", start, fired, "timer");
+
+  printf("fired %u destroyed %u late %u\n", fired, destroyed, late);
+  return (fired == NTIMERS / 2 && destroyed == NTIMERS && !late) ? 0 : 1;
+}
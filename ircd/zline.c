@@ -69,6 +69,9 @@
 
 struct Zline* GlobalZlineList  = 0;
 
+/* index over GlobalZlineList for zline_lookup() and zline_lookup_oc() */
+static struct BanIndex ZlineIndex;
+
 static struct Zline *
 make_zline(char *userhost, char *reason, time_t expire, time_t lastmod,
 	   unsigned int flags)
@@ -160,6 +163,11 @@ make_zline(char *userhost, char *reason, time_t expire, time_t lastmod,
     GlobalZlineList = zline;
   }
 
+  banindex_add(&ZlineIndex, &zline->zl_index, zline,
+               after ? &after->zl_index : 0,
+               ZlineIsIpMask(zline) ? &zline->ipnum : 0, zline->bits,
+               zline->zl_host);
+
   return zline;
 }
 
@@ -522,80 +530,72 @@ zline_find(char *userhost, unsigned int flags)
   return zline;
 }
 
-struct Zline *
-zline_lookup(struct Client *cptr, unsigned int flags)
+/* arguments for zline_check() */
+struct ZlineCheck {
+  struct Client *cptr;
+  unsigned int   flags;
+  int            hosts;	/* also try host zlines, as zline_lookup_oc() */
+};
+
+/*
+ * zline_check - decide whether a zline found through ZlineIndex
+ * applies to the client in arg, freeing it if it has expired
+ */
+static int
+zline_check(void *ban, void *arg)
 {
-  struct Zline *zline;
-  struct Zline *szline;
+  struct Zline *zline = ban;
+  struct ZlineCheck *args = arg;
+  struct Client *cptr = args->cptr;
 
-  for (zline = GlobalZlineList; zline; zline = szline) {
-    szline = zline->zl_next;
+  if (zline->zl_expire <= CurrentTime) {
+    zline_free(zline);
+    return 0;
+  }
 
-    if (zline->zl_expire <= CurrentTime) {
-      zline_free(zline);
-      continue;
-    }
-    
-    if ((flags & ZLINE_GLOBAL && zline->zl_flags & ZLINE_LOCAL) ||
-	     (flags & ZLINE_LASTMOD && !zline->zl_lastmod))
-      continue;
+  if ((args->flags & ZLINE_GLOBAL && zline->zl_flags & ZLINE_LOCAL) ||
+      (args->flags & ZLINE_LASTMOD && !zline->zl_lastmod))
+    return 0;
 
-    if (ZlineIsIpMask(zline)) {
-      Debug((DEBUG_DEBUG,"IP zline: %08x %08x/%i",(cli_ip(cptr)).s_addr,zline->ipnum.s_addr,zline->bits));
-      if (((cli_ip(cptr)).s_addr & NETMASK(zline->bits)) != zline->ipnum.s_addr)
-        continue;
-    } else
-      continue;
+  if (ZlineIsIpMask(zline)) {
+    Debug((DEBUG_DEBUG,"IP zline: %08x %08x/%i",(cli_ip(cptr)).s_addr,zline->ipnum.s_addr,zline->bits));
+    if (((cli_ip(cptr)).s_addr & NETMASK(zline->bits)) != zline->ipnum.s_addr)
+      return 0;
+  } else if (!args->hosts)
+    return 0;
+  else if (!cli_user(cptr) ||
+           match(zline->zl_host, (cli_user(cptr))->realhost) != 0)
+    return 0;
 
-    if (ZlineIsActive(zline))
-      return zline;
-  }
-  /*
-   * No Zlines matched
-   */
-  return 0;
+  /* Check if Z:Lined user matches an E:Line */
+  if (args->hosts && find_eline(cptr, EFLAG_ZLINE))
+    return 0;
+
+  return ZlineIsActive(zline);
 }
 
 struct Zline *
-zline_lookup_oc(struct Client *cptr, unsigned int flags)
+zline_lookup(struct Client *cptr, unsigned int flags)
 {
-  struct Zline *zline;
-  struct Zline *szline;
-
-  for (zline = GlobalZlineList; zline; zline = szline) {
-    szline = zline->zl_next;
+  struct ZlineCheck args;
 
-    if (zline->zl_expire <= CurrentTime) {
-      zline_free(zline);
-      continue;
-    }
-    
-    if ((flags & ZLINE_GLOBAL && zline->zl_flags & ZLINE_LOCAL) ||
-	     (flags & ZLINE_LASTMOD && !zline->zl_lastmod))
-      continue;
-
-    if (ZlineIsIpMask(zline)) {
-      Debug((DEBUG_DEBUG,"IP zline: %08x %08x/%i",(cli_ip(cptr)).s_addr,zline->ipnum.s_addr,zline->bits));
-      if (((cli_ip(cptr)).s_addr & NETMASK(zline->bits)) != zline->ipnum.s_addr)
-        continue;
-    }    
-    else {
-      if (match(zline->zl_host, (cli_user(cptr))->realhost) != 0) 
-        continue;
-    }
-
-    /* Check if Z:Lined user matches an E:Line */
-    if (find_eline(cptr, EFLAG_ZLINE)) {
-      continue;;
-    }
+  args.cptr = cptr;
+  args.flags = flags;
+  args.hosts = 0;
+  return banindex_find(&ZlineIndex, cli_ip(cptr), 0, zline_check, &args);
+}
 
-    if (ZlineIsActive(zline))
-      return zline;
-  }
-  /*
-   * No Zlines matched
-   */
-  return 0;
+struct Zline *
+zline_lookup_oc(struct Client *cptr, unsigned int flags)
+{
+  struct ZlineCheck args;
+
+  args.cptr = cptr;
+  args.flags = flags;
+  args.hosts = 1;
+  return banindex_find(&ZlineIndex, cli_ip(cptr),
+                       cli_user(cptr) ? cli_user(cptr)->realhost : 0,
+                       zline_check, &args);
 }
 
 void
@@ -603,6 +603,8 @@ zline_free(struct Zline *zline)
 {
   assert(0 != zline);
 
+  banindex_del(&ZlineIndex, &zline->zl_index);
+
   *zline->zl_prev_p = zline->zl_next; /* squeeze this zline out */
   if (zline->zl_next)
     zline->zl_next->zl_prev_p = zline->zl_prev_p;
@@ -722,6 +724,7 @@ zline_memory_count(size_t *zl_size)
     *zl_size += zline->zl_host ? (strlen(zline->zl_host) + 1) : 0;
     *zl_size += zline->zl_reason ? (strlen(zline->zl_reason) + 1) : 0;
   }
+  *zl_size += banindex_memory_count(&ZlineIndex);
   return gl;
 }
 